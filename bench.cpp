@@ -0,0 +1,526 @@
+//
+// bench.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/util.h>
+#include "bench.h"
+#include "resid/sid.h"
+#include "fmopl.h"
+#include "sidengine.h"
+#include "sidpipe.h"
+#include "litesid.h"
+#include "gpio_defs.h"
+#include "crt.h"
+
+using namespace reSID;
+
+// clocking in steps of 2 cycles as in sidengine.h
+#define BENCH_STEP			2
+
+// the results of all runs go here, i.e. nothing can be optimized away
+volatile u32 benchSink;
+
+typedef struct
+{
+	const char	*name;
+	const char	*unit;
+	u32			param;
+	u32			granule;			// units per run are a multiple of this
+	u32			perSample;			// how to derive BENCH_RESULT::psSample
+	void		(*setup)( u32 param );
+	u32			(*run)( u32 param, u32 units );
+} BENCH_CASE;
+
+enum { PER_NONE = 0, PER_CYCLE, PER_SAMPLE };
+
+static u32 lcgState = 0x1541;
+
+static u32 lcg()
+{
+	lcgState = lcgState * 1664525 + 1013904223;
+	return lcgState >> 8;
+}
+
+//
+// reSID: complete chips (one per model, reused by all cases) and its components in isolation
+//
+static SID *sid[ 2 ];
+static Filter *filter;
+static EnvelopeGenerator envelope;
+static WaveformGenerator waveform;
+
+#define SAMPLE_BUFFER	1024
+static short sampleBuffer[ SAMPLE_BUFFER ];
+
+// voices: freq lo/hi, pw lo/hi, control, attack/decay, sustain/release; then fc lo/hi, res/filt, mode/vol
+// (pulse, saw and triangle with long sustains, all voices routed into the lowpass)
+static const u8 sidSetup[ 25 ] = {
+	0x00, 0x12, 0x00, 0x08, 0x41, 0x09, 0xa8,  0x00, 0x09, 0x00, 0x04, 0x21, 0x22, 0xc6,  0x80, 0x04, 0x00, 0x00, 0x11, 0x00, 0xf0,  0x03, 0x40, 0xf7, 0x1f };
+
+static SID *getSID( u32 model )
+{
+	if ( !sid[ model ] )
+	{
+		sid[ model ] = new SID;
+		sid[ model ]->set_chip_model( model ? MOS8580 : MOS6581 );
+	}
+	return sid[ model ];
+}
+
+// param = sampling method | model << 4 (the method is only relevant for runSIDSamples)
+static void setupSID( u32 param )
+{
+	SID *s = getSID( param >> 4 );
+	s->reset();
+	s->set_sampling_parameters( BENCH_C64_CLOCK, (sampling_method)( param & 15 ), BENCH_SAMPLERATE );
+	for ( u32 i = 0; i < 25; i++ )
+		s->write( i, sidSetup[ i ] );
+}
+
+// SID::clock( delta_t, buf, n ) with the chosen sampling method
+static u32 runSIDSamples( u32 param, u32 units )
+{
+	SID *s = sid[ param >> 4 ];
+	cycle_count delta_t = units;
+	u32 sum = 0;
+	while ( delta_t > 0 )
+	{
+		int n = s->clock( delta_t, sampleBuffer, SAMPLE_BUFFER );
+		sum += n + sampleBuffer[ 0 ];
+	}
+	return sum;
+}
+
+// SID::clock( delta_t ) as in sidengine.h, reading the output once per sample
+static u32 runSIDEngine( u32 param, u32 units )
+{
+	SID *s = sid[ param >> 4 ];
+	u32 sum = 0, t = 0;
+	for ( u32 i = 0; i < units; i += BENCH_STEP )
+	{
+		s->clock( BENCH_STEP );
+		t += BENCH_SAMPLERATE * BENCH_STEP;
+		if ( t >= BENCH_C64_CLOCK )
+		{
+			sum += s->output();
+			t -= BENCH_C64_CLOCK;
+		}
+	}
+	return sum;
+}
+
+// the stages of sidpipe.h: SID::clock_raw (the cycle outputs) and SID::decimate (the resampling)
+static short rawBuffer[ SIDPIPE_BLOCK_CYCLES ];
+
+static u32 runSIDRaw( u32 param, u32 units )
+{
+	SID *s = sid[ param >> 4 ];
+	cycle_count delta_t = units;
+	u32 sum = 0;
+	while ( delta_t > 0 )
+	{
+		int n = s->clock_raw( delta_t, rawBuffer, SIDPIPE_BLOCK_CYCLES );
+		sum += rawBuffer[ n - 1 ];
+	}
+	return sum;
+}
+
+static void setupDecimate( u32 param )
+{
+	setupSID( param );
+	cycle_count delta_t = SIDPIPE_BLOCK_CYCLES;
+	sid[ param >> 4 ]->clock_raw( delta_t, rawBuffer, SIDPIPE_BLOCK_CYCLES );
+}
+
+// the same block of cycle outputs over and over (units are a multiple of SIDPIPE_BLOCK_CYCLES)
+static u32 runDecimate( u32 param, u32 units )
+{
+	SID *s = sid[ param >> 4 ];
+	u32 sum = 0;
+	for ( u32 i = 0; i < units; i += SIDPIPE_BLOCK_CYCLES )
+		sum += s->decimate( rawBuffer, SIDPIPE_BLOCK_CYCLES, sampleBuffer ) + sampleBuffer[ 0 ];
+	return sum;
+}
+
+// the chips of the engine behind CSIDChip (sidchip.h): reSID and CLiteSID clocked as in sidengine.h
+static CSIDChip *chip[ ENGINE_CHIP_TYPES ][ 2 ];
+
+// param = ENGINE_CHIP_xxx | model << 4
+static void setupChip( u32 param )
+{
+	CSIDChip *&c = chip[ param & 15 ][ param >> 4 ];
+	if ( !c )
+		c = ( param & 15 ) == ENGINE_CHIP_LITE ? (CSIDChip *)new CLiteSID : (CSIDChip *)new CReSIDChip;
+	c->set_chip_model( ( param >> 4 ) ? MOS8580 : MOS6581 );
+	c->set_sampling_parameters( BENCH_C64_CLOCK, BENCH_SAMPLERATE );
+	c->reset();
+	for ( u32 i = 0; i < 25; i++ )
+		c->write( i, sidSetup[ i ] );
+}
+
+static u32 runChip( u32 param, u32 units )
+{
+	CSIDChip *c = chip[ param & 15 ][ param >> 4 ];
+	u32 sum = 0, t = 0;
+	for ( u32 i = 0; i < units; i += BENCH_STEP )
+	{
+		c->clock( BENCH_STEP );
+		t += BENCH_SAMPLERATE * BENCH_STEP;
+		if ( t >= BENCH_C64_CLOCK )
+		{
+			sum += c->output();
+			t -= BENCH_C64_CLOCK;
+		}
+	}
+	return sum;
+}
+
+// typical outputs of voices (waveform times envelope, ~20 bits) as input to the filter
+#define VOICE_INPUTS	1024
+static int voiceInput[ VOICE_INPUTS ];
+
+static void setupFilter( u32 param )
+{
+	if ( !filter )
+		filter = new Filter;
+
+	for ( u32 i = 0; i < VOICE_INPUTS; i++ )
+		voiceInput[ i ] = ( (int)( ( i * 97 ) & 0xfff ) - 0x800 ) * (int)( lcg() & 255 );
+
+	filter->set_chip_model( param ? MOS8580 : MOS6581 );
+	filter->enable_filter( true );
+	filter->reset();
+	filter->writeFC_LO( sidSetup[ 21 ] );
+	filter->writeFC_HI( sidSetup[ 22 ] );
+	filter->writeRES_FILT( sidSetup[ 23 ] );
+	filter->writeMODE_VOL( sidSetup[ 24 ] );
+}
+
+static u32 runFilter( u32 param, u32 units )
+{
+	u32 sum = 0;
+	for ( u32 i = 0; i < units; i += BENCH_STEP )
+	{
+		u32 j = i / BENCH_STEP;
+		filter->clock( BENCH_STEP, voiceInput[ j & ( VOICE_INPUTS - 1 ) ], voiceInput[ ( j + 341 ) & ( VOICE_INPUTS - 1 ) ], voiceInput[ ( j + 682 ) & ( VOICE_INPUTS - 1 ) ] );
+		sum += filter->output();
+	}
+	return sum;
+}
+
+static void setupEnvelope( u32 param )
+{
+	envelope.reset();
+	envelope.writeATTACK_DECAY( 0x22 );
+	envelope.writeSUSTAIN_RELEASE( 0x84 );
+	envelope.writeCONTROL_REG( 0x01 );
+}
+
+// the gate toggles every 2^15 cycles, i.e. all phases of the ADSR are included
+static u32 runEnvelope( u32 param, u32 units )
+{
+	static u32 cycle = 0;
+	u32 sum = 0;
+	for ( u32 i = 0; i < units; i += BENCH_STEP, cycle += BENCH_STEP )
+	{
+		if ( ( cycle & 32767 ) == 0 )
+			envelope.writeCONTROL_REG( ( cycle >> 15 ) & 1 );
+		envelope.clock( BENCH_STEP );
+		sum += envelope.output();
+	}
+	return sum;
+}
+
+// pulse+saw, i.e. the output goes through the combined waveform tables
+static void setupWaveform( u32 param )
+{
+	waveform.set_chip_model( param ? MOS8580 : MOS6581 );
+	waveform.reset();
+	waveform.writeFREQ_LO( 0x00 );
+	waveform.writeFREQ_HI( 0x12 );
+	waveform.writePW_LO( 0x00 );
+	waveform.writePW_HI( 0x08 );
+	waveform.writeCONTROL_REG( 0x61 );
+}
+
+static u32 runWaveform( u32 param, u32 units )
+{
+	u32 sum = 0;
+	for ( u32 i = 0; i < units; i += BENCH_STEP )
+	{
+		waveform.clock( BENCH_STEP );
+		waveform.set_waveform_output( BENCH_STEP );
+		sum += waveform.output();
+	}
+	return sum;
+}
+
+//
+// OPL2: 9 melodic channels with sustained notes, or 6 channels and the rhythm section (param = 1)
+//
+static FM_OPL *opl;
+
+static void oplWrite( u32 reg, u32 value )
+{
+	ym3812_write( opl, 0, reg );
+	ym3812_write( opl, 1, value );
+}
+
+static void setupOPL( u32 param )
+{
+	static const u8 slot[ 9 ] = { 0, 1, 2, 8, 9, 10, 16, 17, 18 };
+
+	if ( !opl )
+		opl = ym3812_init( ENGINE_OPL_CLOCK, BENCH_SAMPLERATE );
+	ym3812_reset_chip( opl );
+
+	oplWrite( 0x01, 0x20 );
+	for ( u32 ch = 0; ch < 9; ch++ )
+	{
+		for ( u32 op = 0; op < 2; op++ )
+		{
+			u32 s = slot[ ch ] + op * 3;
+			oplWrite( 0x20 + s, 0x21 + op );
+			oplWrite( 0x40 + s, op ? 0x00 : 0x18 );
+			oplWrite( 0x60 + s, 0xf4 );
+			oplWrite( 0x80 + s, 0x57 );
+			oplWrite( 0xe0 + s, ch % 3 );
+		}
+		oplWrite( 0xa0 + ch, 0x98 + ch * 8 );
+		oplWrite( 0xc0 + ch, 0x0e );
+		oplWrite( 0xb0 + ch, 0x31 );
+	}
+	oplWrite( 0xbd, param ? 0x3f : 0x00 );
+}
+
+static u32 runOPL( u32 param, u32 units )
+{
+	u32 sum = 0;
+	for ( u32 i = 0; i < units; i++ )
+	{
+		OPLSAMPLE s;
+		ym3812_update_one( opl, &s, 1 );
+		sum += s;
+	}
+	return sum;
+}
+
+//
+// mixer (sidengine.h), the configurations are the template parameter
+//
+#define MIXER_INPUTS	256
+static SID_ENGINE_SAMPLE mixerInput[ MIXER_INPUTS ];
+
+static void setupMixer( u32 param )
+{
+	for ( u32 i = 0; i < MIXER_INPUTS; i++ )
+	{
+		mixerInput[ i ].sid1 = lcg();
+		mixerInput[ i ].sid2 = lcg();
+		mixerInput[ i ].opl = lcg();
+	}
+}
+
+template <u32 FLAGS>
+static u32 runMixer( u32 param, u32 units )
+{
+	u32 sum = 0;
+	for ( u32 i = 0; i < units; i++ )
+	{
+		SID_ENGINE_SAMPLE *s = &mixerInput[ i & ( MIXER_INPUTS - 1 ) ];
+		engineMix<FLAGS>( s );
+		sum += s->left ^ s->right;
+	}
+	return sum;
+}
+
+//
+// GPIO codecs (gpio_defs.cpp) with random levels
+//
+static u32 gpioInput[ 256 ];
+
+static void setupGPIO( u32 param )
+{
+	for ( u32 i = 0; i < 256; i++ )
+		gpioInput[ i ] = lcg() ^ ( lcg() << 24 );
+}
+
+static u32 runEncodeGPIO( u32 param, u32 units )
+{
+	u32 sum = 0;
+	for ( u32 i = 0; i < units; i++ )
+		sum += encodeGPIO( gpioInput[ i & 255 ] );
+	return sum;
+}
+
+static u32 runDecodeGPIO( u32 param, u32 units )
+{
+	u32 sum = 0;
+	for ( u32 i = 0; i < units; i++ )
+	{
+		u8 a, d;
+		decodeGPIO( gpioInput[ i & 255 ], &a, &d );
+		sum += a + d;
+	}
+	return sum;
+}
+
+//
+// cache-optimized CRT layout (crt.h): 8k banks, ROML and ROMH alternating, 512k of flash (larger than the L1 cache)
+//
+#define CRT_BANKS		32
+static u8 *crtFlash;
+static u8 crtBank[ 8192 ];
+
+static void setupCRT( u32 param )
+{
+	if ( !crtFlash )
+		crtFlash = new u8[ CRT_BANKS * 8192 * 2 ];
+
+	for ( u32 i = 0; i < 8192; i++ )
+		crtBank[ i ] = lcg();
+}
+
+static u32 runScatterCRT( u32 param, u32 units )
+{
+	static u32 b = 0;
+	for ( u32 i = 0; i < units; i += 8192, b++ )
+		scatterCacheOptimized( crtFlash, ( b >> 1 ) % CRT_BANKS, b & 1, crtBank, 8192 );
+	return crtFlash[ b & 8191 ];
+}
+
+static u32 runGatherCRT( u32 param, u32 units )
+{
+	static u32 b = 0;
+	for ( u32 i = 0; i < units; i += 8192, b++ )
+		gatherCacheOptimized( crtFlash, ( b >> 1 ) % CRT_BANKS, b & 1, crtBank, 8192 );
+	return crtBank[ b & 8191 ];
+}
+
+#define SID_PARAM( method, model )	( (method) | ( (model) << 4 ) )
+
+static const BENCH_CASE benchCases[] = {
+	{ "resid.clock.fast.6581",				"cycle",	SID_PARAM( SAMPLE_FAST, 0 ),				1,		PER_CYCLE,	setupSID, runSIDSamples },
+	{ "resid.clock.fast.8580",				"cycle",	SID_PARAM( SAMPLE_FAST, 1 ),				1,		PER_CYCLE,	setupSID, runSIDSamples },
+	{ "resid.clock.interpolate.6581",		"cycle",	SID_PARAM( SAMPLE_INTERPOLATE, 0 ),			1,		PER_CYCLE,	setupSID, runSIDSamples },
+	{ "resid.clock.interpolate.8580",		"cycle",	SID_PARAM( SAMPLE_INTERPOLATE, 1 ),			1,		PER_CYCLE,	setupSID, runSIDSamples },
+	{ "resid.clock.resample.6581",			"cycle",	SID_PARAM( SAMPLE_RESAMPLE, 0 ),			1,		PER_CYCLE,	setupSID, runSIDSamples },
+	{ "resid.clock.resample.8580",			"cycle",	SID_PARAM( SAMPLE_RESAMPLE, 1 ),			1,		PER_CYCLE,	setupSID, runSIDSamples },
+	{ "resid.clock.resample_fastmem.6581",	"cycle",	SID_PARAM( SAMPLE_RESAMPLE_FASTMEM, 0 ),	1,		PER_CYCLE,	setupSID, runSIDSamples },
+	{ "resid.clock.resample_fastmem.8580",	"cycle",	SID_PARAM( SAMPLE_RESAMPLE_FASTMEM, 1 ),	1,		PER_CYCLE,	setupSID, runSIDSamples },
+	{ "resid.clock.engine.6581",			"cycle",	SID_PARAM( SAMPLE_INTERPOLATE, 0 ),			2,		PER_CYCLE,	setupSID, runSIDEngine },
+	{ "resid.clock.engine.8580",			"cycle",	SID_PARAM( SAMPLE_INTERPOLATE, 1 ),			2,		PER_CYCLE,	setupSID, runSIDEngine },
+	{ "resid.pipe.raw.6581",				"cycle",	SID_PARAM( SAMPLE_RESAMPLE, 0 ),			SIDPIPE_BLOCK_CYCLES,	PER_CYCLE,	setupSID, runSIDRaw },
+	{ "resid.pipe.raw.8580",				"cycle",	SID_PARAM( SAMPLE_RESAMPLE, 1 ),			SIDPIPE_BLOCK_CYCLES,	PER_CYCLE,	setupSID, runSIDRaw },
+	{ "resid.pipe.decimate",				"cycle",	SID_PARAM( SAMPLE_RESAMPLE, 0 ),			SIDPIPE_BLOCK_CYCLES,	PER_CYCLE,	setupDecimate, runDecimate },
+	{ "sidchip.resid.6581",					"cycle",	SID_PARAM( ENGINE_CHIP_RESID, 0 ),			2,		PER_CYCLE,	setupChip, runChip },
+	{ "sidchip.resid.8580",					"cycle",	SID_PARAM( ENGINE_CHIP_RESID, 1 ),			2,		PER_CYCLE,	setupChip, runChip },
+	{ "sidchip.lite.6581",					"cycle",	SID_PARAM( ENGINE_CHIP_LITE, 0 ),			2,		PER_CYCLE,	setupChip, runChip },
+	{ "sidchip.lite.8580",					"cycle",	SID_PARAM( ENGINE_CHIP_LITE, 1 ),			2,		PER_CYCLE,	setupChip, runChip },
+	{ "filter.clock.6581",					"cycle",	0,											2,		PER_CYCLE,	setupFilter, runFilter },
+	{ "filter.clock.8580",					"cycle",	1,											2,		PER_CYCLE,	setupFilter, runFilter },
+	{ "envelope.clock",						"cycle",	0,											2,		PER_CYCLE,	setupEnvelope, runEnvelope },
+	{ "waveform.clock.6581",				"cycle",	0,											2,		PER_CYCLE,	setupWaveform, runWaveform },
+	{ "waveform.clock.8580",				"cycle",	1,											2,		PER_CYCLE,	setupWaveform, runWaveform },
+	{ "opl.update",							"sample",	0,											1,		PER_SAMPLE,	setupOPL, runOPL },
+	{ "opl.update.rhythm",					"sample",	1,											1,		PER_SAMPLE,	setupOPL, runOPL },
+	{ "mixer.stereo",						"sample",	0,											1,		PER_SAMPLE,	setupMixer, runMixer<ENGINE_FLAG_SID2> },
+	{ "mixer.opl",							"sample",	0,											1,		PER_SAMPLE,	setupMixer, runMixer<ENGINE_FLAG_SID2 | ENGINE_FLAG_OPL> },
+	{ "mixer.mono",							"sample",	0,											1,		PER_SAMPLE,	setupMixer, runMixer<ENGINE_FLAG_SID2 | ENGINE_FLAG_OPL | ENGINE_FLAG_MONO> },
+	{ "gpio.encode",						"call",		0,											1,		PER_NONE,	setupGPIO, runEncodeGPIO },
+	{ "gpio.decode",						"call",		0,											1,		PER_NONE,	setupGPIO, runDecodeGPIO },
+	{ "crt.scatter",						"byte",		0,											8192,	PER_NONE,	setupCRT, runScatterCRT },
+	{ "crt.gather",							"byte",		0,											8192,	PER_NONE,	setupCRT, runGatherCRT },
+};
+
+#define BENCH_CASES	( sizeof( benchCases ) / sizeof( BENCH_CASE ) )
+
+u32 benchNumCases()
+{
+	return BENCH_CASES;
+}
+
+const char *benchCaseName( u32 c )
+{
+	return c < BENCH_CASES ? benchCases[ c ].name : 0;
+}
+
+// duration of one run in ns
+static u64 measure( const BENCH_CASE *bc, TBenchClock clock, u32 units )
+{
+	u64 t0 = clock();
+	benchSink += bc->run( bc->param, units );
+	return clock() - t0;
+}
+
+static void sort( u32 *v, u32 n )
+{
+	for ( u32 i = 1; i < n; i++ )
+		for ( u32 j = i; j > 0 && v[ j - 1 ] > v[ j ]; j-- )
+		{
+			u32 t = v[ j ]; v[ j ] = v[ j - 1 ]; v[ j - 1 ] = t;
+		}
+}
+
+void benchRun( u32 c, TBenchClock clock, BENCH_RESULT *r )
+{
+	const BENCH_CASE *bc = &benchCases[ c ];
+
+	bc->setup( bc->param );
+
+	// calibration: increase the units until a run is long enough to be measured reliably, then scale to BENCH_RUN_NS
+	u32 units = bc->granule;
+	u64 t;
+	while ( ( t = measure( bc, clock, units ) ) < BENCH_RUN_NS / 8 && units < ( 1u << 28 ) )
+		units *= 4;
+
+	u64 scaled = (u64)units * BENCH_RUN_NS / ( t ? t : 1 );
+	if ( scaled > ( 1u << 30 ) ) scaled = 1u << 30;
+	units = ( (u32)scaled + bc->granule - 1 ) / bc->granule * bc->granule;
+	if ( units == 0 ) units = bc->granule;
+
+	for ( u32 i = 0; i < BENCH_WARMUP; i++ )
+		measure( bc, clock, units );
+
+	u32 ps[ BENCH_RUNS ], dev[ BENCH_RUNS ];
+	for ( u32 i = 0; i < BENCH_RUNS; i++ )
+	{
+		u64 p = measure( bc, clock, units ) * 1000 / units;
+		ps[ i ] = p > 0xffffffff ? 0xffffffff : (u32)p;
+	}
+
+	sort( ps, BENCH_RUNS );
+	u32 median = ps[ BENCH_RUNS / 2 ];
+
+	for ( u32 i = 0; i < BENCH_RUNS; i++ )
+		dev[ i ] = ps[ i ] > median ? ps[ i ] - median : median - ps[ i ];
+	sort( dev, BENCH_RUNS );
+
+	r->name = bc->name;
+	r->unit = bc->unit;
+	r->units = units;
+	r->ps = median;
+	r->psMin = ps[ 0 ];
+	r->madPermille = median ? (u32)( (u64)dev[ BENCH_RUNS / 2 ] * 1000 / median ) : 0;
+
+	if ( bc->perSample == PER_CYCLE )
+		r->psSample = (u32)( (u64)median * BENCH_C64_CLOCK / BENCH_SAMPLERATE ); else
+	if ( bc->perSample == PER_SAMPLE )
+		r->psSample = median; else
+		r->psSample = 0;
+}
@@ -0,0 +1,68 @@
+//
+// bench.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _bench_h
+#define _bench_h
+
+#include <circle/types.h>
+
+//
+// micro-benchmarks of the sound emulation (reSID and its components, OPL2, mixer) and of the codecs used by the
+// FIQ handlers (GPIO data, cache-optimized CRT layout). The same cases run on the RPi (kernel=bench, HDMI and
+// SD:bench.json) and on the host (host/bench), only the clock is provided by the caller.
+//
+// a case is calibrated to runs of about BENCH_RUN_NS, then BENCH_WARMUP runs are discarded and BENCH_RUNS runs
+// are measured: the result is the median time per unit (cycle, sample, call or byte), the minimum, and the median
+// absolute deviation (MAD) relative to the median as a measure of the noise. Times are stored in ps (integers
+// only, the same JSON is written on both platforms).
+//
+#define BENCH_RUN_NS		10000000
+#define BENCH_WARMUP		2
+#define BENCH_RUNS			15
+
+// C64 clock and sample rate for converting ns/cycle into ns/sample
+#define BENCH_C64_CLOCK		985248
+#define BENCH_SAMPLERATE	44100
+
+// a monotonic clock in ns
+typedef u64 (*TBenchClock)( void );
+
+typedef struct
+{
+	const char	*name;
+	const char	*unit;
+	u32			units;				// per run
+	u32			ps;					// median per unit
+	u32			psMin;
+	u32			madPermille;		// MAD relative to the median (in 0.1%)
+	u32			psSample;			// median per output sample (SID cases: per BENCH_C64_CLOCK / BENCH_SAMPLERATE cycles), 0 = n/a
+} BENCH_RESULT;
+
+extern u32 benchNumCases();
+extern const char *benchCaseName( u32 c );
+// sets up (the chips are created when needed first), calibrates and measures case c
+extern void benchRun( u32 c, TBenchClock clock, BENCH_RESULT *r );
+
+// one case of the JSON file as written by both platforms (and parsed by host/bench for comparisons),
+// BENCH_JSON_ARGS provides the arguments for BENCH_JSON_CASE
+#define BENCH_JSON_CASE		"    { \"name\": \"%s\", \"unit\": \"%s\", \"ns\": %u.%03u, \"min\": %u.%03u, \"mad\": %u.%u, \"ns_sample\": %u.%03u }"
+#define BENCH_JSON_ARGS( r )	(r).name, (r).unit, (r).ps / 1000, (r).ps % 1000, (r).psMin / 1000, (r).psMin % 1000, \
+								(r).madPermille / 10, (r).madPermille % 10, (r).psSample / 1000, (r).psSample % 1000
+
+#endif
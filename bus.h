@@ -0,0 +1,131 @@
+//
+// bus.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _bus_h
+#define _bus_h
+
+#include <circle/types.h>
+#include <circle/bcm2835.h>
+#include <circle/memio.h>
+#include "gpio_defs.h"
+#include "lowlevel_arm.h"
+
+//
+// bus backends: everything the FIQ handlers need to access the expansion port (GPIO levels, setting/clearing outputs,
+// direction of D0-D7, cycle counter, and cache hints) as static inline functions of a policy class
+//
+// the handlers are templates instantiated with BUS (the default backend of this build), the macros in 
+// lowlevel_arm.h and gpio_defs.h expand to calls of BUS as well
+//
+
+// GPFSEL2 with D0-D7 configured as inputs, GPIO 28/29 are never reconfigured after gpioInit()
+// (this saves reading GPFSEL2 before every change of the data direction)
+extern u32 gpfsel2Shadow;
+
+#define GPFSEL2_D_OUTPUT	( ( 1 << 0 ) | ( 1 << 3 ) | ( 1 << 6 ) | ( 1 << 9 ) | ( 1 << 12 ) | ( 1 << 15 ) | ( 1 << 18 ) | ( 1 << 21 ) )
+
+#define BUS_INLINE	static __attribute__( ( always_inline ) ) inline
+
+// the real thing: memory mapped GPIOs and ARM performance counters
+struct BusMMIO
+{
+	BUS_INLINE u32  getLevels() { return read32( ARM_GPIO_GPLEV0 ); }
+	BUS_INLINE void setPins( u32 v ) { write32( ARM_GPIO_GPSET0, v ); }
+	BUS_INLINE void clrPins( u32 v ) { write32( ARM_GPIO_GPCLR0, v ); }
+
+	BUS_INLINE void dataInput() { write32( ARM_GPIO_GPFSEL2, gpfsel2Shadow ); }
+	BUS_INLINE void dataOutput() { write32( ARM_GPIO_GPFSEL2, gpfsel2Shadow | GPFSEL2_D_OUTPUT ); }
+
+	BUS_INLINE u32 readCycleCounter() 
+	{ 
+		u32 cc;
+		asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n": "=r"(cc));
+		return cc;
+	}
+
+	// PMU event counter n (0..3, the events are configured with initEventCounters)
+	BUS_INLINE u32 readEventCounter( u32 n )
+	{
+		u32 v;
+		asm volatile ("MCR p15, 0, %0, c9, c12, 5\t\n" :: "r"(n));
+		asm volatile ("ISB\t\n");
+		asm volatile ("MRC p15, 0, %0, c9, c13, 2\t\n": "=r"(v));
+		return v;
+	}
+
+	BUS_INLINE void preload( const void *ptr ) { asm volatile ("pld\t[%0]" :: "r" (ptr)); }
+	BUS_INLINE void preloadW( const void *ptr ) { asm volatile ("pldw\t[%0]" :: "r" (ptr)); }
+	BUS_INLINE void preloadI( const void *ptr ) { asm volatile ("pli\t[%0]" :: "r" (ptr)); }
+
+	BUS_INLINE void waitForInterrupt() { asm volatile ("wfi"); }
+
+	// events are only counted in the simulator
+	BUS_INLINE void countEvent( const char *name ) {}
+};
+
+#ifdef HOST_SIMULATION
+
+// host build (see host/): the expansion port simulator, reading the cycle counter advances simulated time
+extern u32  simRead32( uintptr nAddress );
+extern void simWrite32( uintptr nAddress, u32 nValue );
+extern u32  simReadCycleCounter();
+extern void simCachePreload( const void *ptr );
+extern void simWaitForInterrupt();
+extern void simCountEvent( const char *name );
+
+struct BusSim
+{
+	BUS_INLINE u32  getLevels() { return simRead32( ARM_GPIO_GPLEV0 ); }
+	BUS_INLINE void setPins( u32 v ) { simWrite32( ARM_GPIO_GPSET0, v ); }
+	BUS_INLINE void clrPins( u32 v ) { simWrite32( ARM_GPIO_GPCLR0, v ); }
+
+	BUS_INLINE void dataInput() { simWrite32( ARM_GPIO_GPFSEL2, gpfsel2Shadow ); }
+	BUS_INLINE void dataOutput() { simWrite32( ARM_GPIO_GPFSEL2, gpfsel2Shadow | GPFSEL2_D_OUTPUT ); }
+
+	BUS_INLINE u32 readCycleCounter() { return simReadCycleCounter(); }
+
+	// there are no event counters in the simulator (only the cycles of PMU_SCOPE etc. are meaningful)
+	BUS_INLINE u32 readEventCounter( u32 n ) { return 0; }
+
+	BUS_INLINE void preload( const void *ptr ) { simCachePreload( ptr ); }
+	BUS_INLINE void preloadW( const void *ptr ) { simCachePreload( ptr ); }
+	BUS_INLINE void preloadI( const void *ptr ) { simCachePreload( ptr ); }
+
+	BUS_INLINE void waitForInterrupt() { simWaitForInterrupt(); }
+
+	// bus scripts can require a minimum count of an event ("expect name count")
+	BUS_INLINE void countEvent( const char *name ) { simCountEvent( name ); }
+};
+
+typedef BusSim BUS;
+
+#else
+
+typedef BusMMIO BUS;
+
+#endif
+
+// keeps the D0-D7 masks (see WRITE_D0D7) in the caches, called from the main loops
+__attribute__( ( always_inline ) ) inline void warmDataMask()
+{
+	for ( u32 i = 0; i < 256; i += 64 / sizeof( DATA_MASK ) )
+		CACHE_PRELOAD( &dataMask[ i ] );
+}
+
+#endif
@@ -29,7 +29,12 @@ u16 swapBytesU16( u8 *buf )
 }
 
 // .CRT reading
-void readCRTFile( CLogger *logger, CRT_HEADER *crtHeader, char *DRIVE, char *FILENAME, u8 *ef_low_raw, u8 *ef_high_raw, u32 *bankswitchType, u32 *ROM_LH )
+// the file is parsed while streaming it from SD card one CHIP packet at a time, 
+// the ROM data is directly written to its final position in the cache-optimized flash layout 
+// (flash needs to hold CRT_MAX_BANKS * 2 * 8k bytes, banks not contained in the .CRT remain untouched)
+static u8 chunk[ 8192 ];
+
+void readCRTFile( CLogger *logger, CRT_HEADER *crtHeader, char *DRIVE, char *FILENAME, u8 *flash, u32 *bankswitchType, u32 *ROM_LH, u32 *chipOffsets, u32 *chipLengths )
 {
 	CRT_HEADER header;
 
@@ -39,41 +44,22 @@ void readCRTFile( CLogger *logger, CRT_HEADER *crtHeader, char *DRIVE, char *FIL
 	if ( f_mount( &m_FileSystem, DRIVE, 1 ) != FR_OK )
 		logger->Write( "RaspiFlash", LogPanic, "Cannot mount drive: %s", DRIVE );
 
-	// get filesize
-	FILINFO info;
-	u32 result = f_stat( FILENAME, &info );
-	u32 filesize = (u32)info.fsize;
-
 	// open file
 	FIL file;
-	result = f_open( &file, FILENAME, FA_READ | FA_OPEN_EXISTING );
-	if ( result != FR_OK )
+	if ( f_open( &file, FILENAME, FA_READ | FA_OPEN_EXISTING ) != FR_OK )
 		logger->Write( "RaspiFlash", LogPanic, "Cannot open file: %s", FILENAME );
 
-	if ( filesize > 1025 * 1024 )
-		filesize = 1025 * 1024;
-
-	// read data in one big chunk
-	u32 nBytesRead;
-	u8 rawCRT[ 1025 * 1024 ];
-	result = f_read( &file, rawCRT, filesize, &nBytesRead );
-
-	if ( result != FR_OK )
-		logger->Write( "RaspiFlash", LogError, "Read error" );
-
-	if ( f_close( &file ) != FR_OK )
-		logger->Write( "RaspiFlash", LogPanic, "Cannot close file" );
-
-	// unmount file system
-	if ( f_mount( 0, DRIVE, 0 ) != FR_OK )
-		logger->Write( "RaspiFlash", LogPanic, "Cannot unmount drive: %s", DRIVE );
+	u32 filesize = (u32)f_size( &file );
 
+	if ( chipOffsets )
+		memset( chipOffsets, 0, sizeof( u32 ) * 2 * CRT_MAX_BANKS );
+	if ( chipLengths )
+		memset( chipLengths, 0, sizeof( u32 ) * 2 * CRT_MAX_BANKS );
 
-	// now "parse" the file which we already have in memory
-	u8 *crt = rawCRT;
-	u8 *crtEnd = crt + filesize;
-
-	#define readCRT( dst, bytes ) memcpy( (dst), crt, bytes ); crt += bytes;
+	u32 nBytesRead;
+	#define readCRT( dst, bytes ) \
+		if ( f_read( &file, (dst), (bytes), &nBytesRead ) != FR_OK || nBytesRead != (bytes) ) \
+			logger->Write( "RaspiFlash", LogPanic, "Read error" );
 
 	readCRT( &header.signature, 16 );
 
@@ -103,8 +89,33 @@ void readCRTFile( CLogger *logger, CRT_HEADER *crtHeader, char *DRIVE, char *FIL
 	case 19:
 		*bankswitchType = BS_MAGICDESK;
 		*ROM_LH = bROML;
+		break;
+	case 5:
+		*bankswitchType = BS_OCEAN;
+		*ROM_LH = bROML;
+		break;
+	case 7:
+		*bankswitchType = BS_FUNPLAY;
+		*ROM_LH = bROML;
+		break;
+	case 15:
+		*bankswitchType = BS_SYSTEM3;
+		*ROM_LH = bROML;
+		break;
+	case 17:
+		*bankswitchType = BS_DINAMIC;
+		*ROM_LH = bROML;
+		break;
+	case 4:
+		*bankswitchType = BS_SIMONSBASIC;
+		*ROM_LH = bROML | bROMH;
+		break;
 	case 0:
+		*bankswitchType = BS_NONE;
+		*ROM_LH = 0;
+		break;
 	default:
+		logger->Write( "RaspiFlash", LogWarning, "unsupported cartridge type %d, treating it as a normal cartridge", header.type );
 		*bankswitchType = BS_NONE;
 		*ROM_LH = 0;
 		break;
@@ -119,12 +130,18 @@ void readCRTFile( CLogger *logger, CRT_HEADER *crtHeader, char *DRIVE, char *FIL
 	logger->Write( "RaspiFlash", LogNotice, "name=%s", header.name );
 	#endif
 
-	while ( crt < crtEnd )
+	// the first CHIP packet follows the header (which is usually, but not necessarily, 64 bytes long)
+	u32 pos = header.length < 0x40 ? 0x40 : header.length;
+
+	while ( pos + 16 <= filesize )
 	{
 		CHIP_HEADER chip;
 
 		memset( &chip, 0, sizeof( CHIP_HEADER ) );
 
+		if ( f_lseek( &file, pos ) != FR_OK )
+			logger->Write( "RaspiFlash", LogPanic, "Read error" );
+
 		readCRT( &chip.signature, 4 );
 
 		if ( memcmp( CHIP_HEADER_SIG, chip.signature, 4 ) )
@@ -152,25 +169,123 @@ void readCRTFile( CLogger *logger, CRT_HEADER *crtHeader, char *DRIVE, char *FIL
 		logger->Write( "RaspiFlash", LogNotice, "rom length=%d", chip.rom_length );
 		#endif
 
-		if ( chip.adr == 0x8000 )
+		u32 bank = chip.bank;
+		u32 romLength = chip.rom_length;
+		u32 ofs = pos + 16;
+
+		if ( ofs + romLength > filesize )
+			romLength = filesize - ofs;
+
+		// banks beyond what we can store are skipped (instead of overwriting a lower bank)
+		if ( bank >= CRT_MAX_BANKS )
 		{
-			*ROM_LH |= bROML;
-			memcpy( &ef_low_raw[ chip.bank * 8192 ], crt, 8192 );
-			crt += 8192;
-
-			if ( chip.rom_length > 8192 )
-			{
-				*ROM_LH |= bROMH;
-				memcpy( &ef_high_raw[ chip.bank * 8192 ], crt, 8192 );
-				crt += chip.rom_length - 8192;
-			}
-		} else
+			logger->Write( "RaspiFlash", LogWarning, "CHIP packet for bank %d skipped (max. %d banks)", bank, CRT_MAX_BANKS );
+			romLength = 0;
+		}
+
+		// a 16k packet at $8000 contains ROML and ROMH, everything else goes to one chip only
+		u32 chipIdx = ( chip.adr == 0x8000 ) ? 0 : 1;
+
+		while ( romLength > 0 && chipIdx < 2 )
 		{
-			*ROM_LH |= bROMH;
-			memcpy( &ef_high_raw[ chip.bank * 8192 ], crt, 8192 );
-			crt += 8192;
+			u32 bytes = romLength > 8192 ? 8192 : romLength;
+
+			// ocean carts show the selected bank at ROML and ROMH, hence all banks go to the ROML plane
+			u32 plane = ( *bankswitchType == BS_OCEAN ) ? 0 : chipIdx;
+
+			readCRT( chunk, bytes );
+			scatterCacheOptimized( flash, bank, plane, chunk, bytes );
+
+			*ROM_LH |= chipIdx ? bROMH : bROML;
+
+			if ( chipOffsets )
+				chipOffsets[ plane * CRT_MAX_BANKS + bank ] = ofs;
+			if ( chipLengths )
+				chipLengths[ plane * CRT_MAX_BANKS + bank ] = bytes;
+
+			romLength -= bytes;
+			ofs += bytes;
+			chipIdx ++;
 		}
+
+		// a broken length would let us loop forever
+		if ( chip.total_length < 16 )
+			break;
+
+		pos += chip.total_length;
 	}
 
+	#undef readCRT
+
+	if ( f_close( &file ) != FR_OK )
+		logger->Write( "RaspiFlash", LogPanic, "Cannot close file" );
+
+	// unmount file system
+	if ( f_mount( 0, DRIVE, 0 ) != FR_OK )
+		logger->Write( "RaspiFlash", LogPanic, "Cannot unmount drive: %s", DRIVE );
+
 	memcpy( crtHeader, &header, sizeof( CRT_HEADER ) );
-}
\ No newline at end of file
+}
+
+static void putBytesU32( u8 *buf, u32 v )
+{
+	buf[ 0 ] = v >> 24; buf[ 1 ] = v >> 16; buf[ 2 ] = v >> 8; buf[ 3 ] = v;
+}
+
+static void putBytesU16( u8 *buf, u16 v )
+{
+	buf[ 0 ] = v >> 8; buf[ 1 ] = v;
+}
+
+// appends a CHIP packet (type 2 = flash ROM) with the header only, returns the offset of the data
+static boolean appendCRTChip( FIL *file, u32 chip, u32 bank, u32 *ofs )
+{
+	u32 nBytesWritten;
+	u8 chipHeader[ 16 ];
+	memcpy( &chipHeader[ 0 ], CHIP_HEADER_SIG, 4 );
+	putBytesU32( &chipHeader[ 4 ], 16 + 8192 );
+	putBytesU16( &chipHeader[ 8 ], 2 );
+	putBytesU16( &chipHeader[ 10 ], bank );
+	putBytesU16( &chipHeader[ 12 ], chip ? 0xa000 : 0x8000 );
+	putBytesU16( &chipHeader[ 14 ], 8192 );
+
+	*ofs = f_size( file );
+	if ( f_lseek( file, *ofs ) != FR_OK ||
+		 f_write( file, chipHeader, 16, &nBytesWritten ) != FR_OK || nBytesWritten != 16 )
+		return FALSE;
+
+	*ofs += 16;
+	return TRUE;
+}
+
+boolean writeCRTBank( FIL *file, u32 *chipOffsets, u32 *chipLengths, u32 chip, u32 bank, u8 *data )
+{
+	u32 nBytesWritten;
+	u32 idx = chip * CRT_MAX_BANKS + bank;
+	u32 ofs = chipOffsets[ idx ];
+	u32 length = ofs ? chipLengths[ idx ] : 0;
+
+	// the part of the bank not covered by the existing CHIP packet (if any) must be erased, otherwise the bank
+	// is appended as a complete 8k packet: it follows the old one in the file and replaces it when the .CRT is read
+	u32 i;
+	for ( i = length; i < 8192; i++ )
+		if ( data[ i ] != 0xff ) break;
+
+	if ( i < 8192 )
+	{
+		if ( !appendCRTChip( file, chip, bank, &ofs ) )
+			return FALSE;
+		chipOffsets[ idx ] = ofs;
+		chipLengths[ idx ] = length = 8192;
+	}
+
+	// never write beyond the packet, a shorter one (e.g. 4k) is followed by the next packet's header
+	if ( length == 0 )
+		return TRUE;
+
+	if ( f_lseek( file, ofs ) != FR_OK ||
+		 f_write( file, data, length, &nBytesWritten ) != FR_OK || nBytesWritten != length )
+		return FALSE;
+
+	return TRUE;
+}
@@ -30,9 +30,14 @@
 #include "gpio_defs.h"
 
 // which type of cartridge are we emulating?
-#define BS_NONE			0x00
+#define BS_NONE			0x00	// normal 8k, 16k, ultimax
 #define BS_EASYFLASH	0x01
 #define BS_MAGICDESK	0x02
+#define BS_OCEAN		0x03
+#define BS_FUNPLAY		0x04
+#define BS_SYSTEM3		0x05
+#define BS_DINAMIC		0x06
+#define BS_SIMONSBASIC	0x07
 
 static const char CRT_HEADER_SIG[] = "C64 CARTRIDGE   ";
 static const char CHIP_HEADER_SIG[] = "CHIP";
@@ -58,6 +63,41 @@ typedef struct  {
 	u8  data[ 8192 ];
 } CHIP_HEADER;
 
-void readCRTFile( CLogger *logger, CRT_HEADER *crtHeader, char *DRIVE, char *FILENAME, u8 *ef_low_raw, u8 *ef_high_raw, u32 *bankswitchType, u32 *ROM_LH );
+// file offsets of the ROM data of each bank, [ 0..63 ] = ROML, [ 64..127 ] = ROMH (0 = bank is not contained in the .CRT)
+#define CRT_MAX_BANKS	64
+
+// scatters (up to) 8k of ROM data into the cache-optimized layout of one bank/chip
+// (addresses are stored as ( A0..A7 << 5 ) | A8..A12, ROML and ROMH are interleaved, see kernel_ef.cpp)
+static inline void scatterCacheOptimized( u8 *flash, u32 bank, u32 chip, const u8 *data, u32 bytes )
+{
+	u8 *dst = &flash[ bank * 8192 * 2 + chip ];
+
+	for ( u32 i = 0; i < bytes; i++ )
+	{
+		u32 realAdr = ( ( i & 255 ) << 5 ) | ( ( i >> 8 ) & 31 );
+		dst[ realAdr * 2 ] = data[ i ];
+	}
+}
+
+// the inverse: undoes the cache-optimized layout of one bank/chip (e.g. to write modified flash back to a .CRT)
+static inline void gatherCacheOptimized( const u8 *flash, u32 bank, u32 chip, u8 *data, u32 bytes )
+{
+	const u8 *src = &flash[ bank * 8192 * 2 + chip ];
+
+	for ( u32 i = 0; i < bytes; i++ )
+	{
+		u32 realAdr = ( ( i & 255 ) << 5 ) | ( ( i >> 8 ) & 31 );
+		data[ i ] = src[ realAdr * 2 ];
+	}
+}
+
+// reads a .CRT and stores the ROM data directly in the cache-optimized, interleaved layout used by the FIQ handler:
+// flash[ ( bank * 8192 + ( ( A0..A7 << 5 ) | A8..A12 ) ) * 2 + 0/1 ] for ROML/ROMH
+// chipOffsets/chipLengths (2 * CRT_MAX_BANKS entries each, optional) receive the file offset and length of the data of every bank
+void readCRTFile( CLogger *logger, CRT_HEADER *crtHeader, char *DRIVE, char *FILENAME, u8 *flash, u32 *bankswitchType, u32 *ROM_LH, u32 *chipOffsets = 0, u32 *chipLengths = 0 );
+
+// writes one 8k bank of ROML (chip = 0) or ROMH (chip = 1) back into an opened .CRT: into its CHIP packet (at most the packet's
+// length), missing banks (and banks with data beyond a short packet) are appended as new CHIP packets
+boolean writeCRTBank( FIL *file, u32 *chipOffsets, u32 *chipLengths, u32 chip, u32 bank, u8 *data );
 
 #endif
\ No newline at end of file
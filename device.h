@@ -0,0 +1,327 @@
+//
+// device.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _device_h
+#define _device_h
+
+#include <circle/types.h>
+#include "gpio_defs.h"
+#include "lowlevel_arm.h"
+#include "dispatch.h"
+#include "slotwork.h"
+#include "timings.h"
+
+//
+// declarative devices: a device is a policy class derived from DeviceBase which lists the accesses it serves (with address 
+// ranges), its callbacks, its default bus timings and estimates of the callbacks' worst-case cycles. Device<DEV, BUS> 
+// turns it into a specialized FIQ handler (one dispatch table entry per kind of bus cycle, see dispatch.h).
+//
+// when Device<DEV, BUS> is instantiated, every path through the handler is checked against the deadlines of the C64 bus
+// with the cost model below (for the default timings, a calibrated profile may override them at runtime), and the build 
+// fails if a path cannot meet them.
+//
+// example (an 8k cartridge, see kernel_cart.cpp):
+//
+//	struct DeviceMyCart : DeviceBase
+//	{
+//		enum { ROML_READ = 1, ROML_READ_CYCLES = 4 };
+//		enum { ADDR_SAMPLE_NS = 125, MUX_SAMPLE_NS = 203, READ_RELEASE_NS = 578, WRITE_SAMPLE_NS = 467 };
+//		static u8 ROMLRead( u32 addr ) { return rom[ addr ]; }
+//	};
+//
+//	m_InputPin.ConnectInterrupt( Device<DeviceMyCart, BUS>::FIQHandler, this );
+//
+
+// ARM clock for which the budget is checked (at runtime the timings are derived for the measured clock, see timings.h)
+#ifndef TIMINGS_RPI3B_PLUS
+#define DEVICE_ARM_MHZ	1200
+#else
+#define DEVICE_ARM_MHZ	1400
+#endif
+
+#define DEVICE_NS2CYCLES( ns )	( ( (ns) * DEVICE_ARM_MHZ ) / 1000 )
+
+// a bus timing (ns after PHI2 rising) in cycles after the FIQ started, rounded as in timings.cpp
+#define DEVICE_TIMING( ns )		( ( ( (ns) - BUS_FIQ_LATENCY_NS ) * DEVICE_ARM_MHZ + 500 ) / 1000 )
+
+// cost model (same values as the defaults of the host simulator, see host/bussim.cpp): 
+// FIQ latency after PHI2 rising, duration of a GPLEV0 read and when during the read the levels are sampled, 
+// duration of a (posted) GPSET0/GPCLR0 write and until the pins change
+#define DEVICE_FIQ_LATENCY_NS	BUS_FIQ_LATENCY_NS
+#define DEVICE_GPIO_READ_NS		40
+#define DEVICE_GPIO_SAMPLE_NS	20
+#define DEVICE_GPIO_WRITE_NS	8
+#define DEVICE_GPIO_LATENCY_NS	40
+
+// ARM cycles for computing the dispatch index and calling the handler, and for the two loads of WRITE_D0D7
+#define DEVICE_DISPATCH_CYCLES	16
+#define DEVICE_DATA_CYCLES		4
+
+// cost of a callback that has not been estimated (an enabled access without estimate always fails the check)
+#define DEVICE_CYCLES_UNKNOWN	100000
+
+typedef void TDeviceCycleHandler( u32 g2, u32 g3, unsigned long armCycleCounter );
+
+struct DeviceBase
+{
+	// served accesses
+	enum { IO1_READ = 0, IO1_WRITE = 0, IO2_READ = 0, IO2_WRITE = 0, CS_READ = 0, CS_WRITE = 0, ROML_READ = 0, ROMH_READ = 0 };
+
+	// address ranges (A0-A7) within IO1, IO2 and CS, accesses outside are ignored
+	enum { IO1_FIRST = 0, IO1_LAST = 255, IO2_FIRST = 0, IO2_LAST = 255, CS_FIRST = 0, CS_LAST = 255 };
+
+	// worst-case ARM cycles of the callbacks and prefetchAddress (with hot caches, the callbacks should prefetch what they need next)
+	enum {
+		IO1_READ_CYCLES = DEVICE_CYCLES_UNKNOWN, IO1_WRITE_CYCLES = DEVICE_CYCLES_UNKNOWN, 
+		IO2_READ_CYCLES = DEVICE_CYCLES_UNKNOWN, IO2_WRITE_CYCLES = DEVICE_CYCLES_UNKNOWN,
+		CS_READ_CYCLES = DEVICE_CYCLES_UNKNOWN, CS_WRITE_CYCLES = DEVICE_CYCLES_UNKNOWN, 
+		ROML_READ_CYCLES = DEVICE_CYCLES_UNKNOWN, ROMH_READ_CYCLES = DEVICE_CYCLES_UNKNOWN,
+		PREFETCH_CYCLES = 0
+	};
+
+	// deadlines of the C64 bus in ns after PHI2 rising: data of read cycles has to be stable until DATA_VALID_NS (= PHI2 falling - setup time)
+	// and held until DATA_HOLD_NS, the bus has to be released before RELEASE_NS, data of write cycles is valid from WRITE_VALID_NS 
+	// until DATA_HOLD_NS, and everything must be done before the next cycle starts (CYCLE_NS)
+	enum { DATA_VALID_NS = 390, DATA_HOLD_NS = 520, RELEASE_NS = 890, WRITE_VALID_NS = 200, CYCLE_NS = 1015 };
+
+	// default bus timings in ns after PHI2 rising (see timings.h), must be provided by the device
+	// enum { ADDR_SAMPLE_NS = ..., MUX_SAMPLE_NS = ..., READ_RELEASE_NS = ..., WRITE_SAMPLE_NS = ... };
+
+	// called at the beginning of the FIQ handler, and when A0-A7 are known (e.g. to preload caches)
+	static void prefetch() {}
+	static void prefetchAddress( u32 A ) {}
+
+	// called in every cycle with RESET low
+	static void onReset() {}
+
+	// work done while waiting for READ_RELEASE and WRITE_SAMPLE (see slotwork.h)
+	typedef SlotWorkNone SlotWork;
+
+	// A = A0-A7 for IO1, IO2 and CS, ROM addresses are in the cache-friendly order ( A0-A7 << 5 ) | A8-A12
+	static u8   IO1Read( u32 A ) { return 0; }
+	static void IO1Write( u32 A, u8 D ) {}
+	static u8   IO2Read( u32 A ) { return 0; }
+	static void IO2Write( u32 A, u8 D ) {}
+	static u8   CSRead( u32 A ) { return 0; }
+	static void CSWrite( u32 A, u8 D ) {}
+	static u8   ROMLRead( u32 addr ) { return 0; }
+	static u8   ROMHRead( u32 addr ) { return 0; }
+};
+
+constexpr u32 deviceMax( u32 a, u32 b ) { return a > b ? a : b; }
+
+template <class DEV, class BUS>
+struct Device
+{
+	// ROML/ROMH are multiplexed with A0-A2, then all lines are read after switching the multiplexers
+	enum { USE_MUX = DEV::ROML_READ || DEV::ROMH_READ };
+
+	enum { DECODE = ( ( DEV::IO1_READ || DEV::IO1_WRITE ) ? CTRL_IO1 : 0 ) | ( ( DEV::IO2_READ || DEV::IO2_WRITE ) ? CTRL_IO2 : 0 ) |
+					( ( DEV::CS_READ || DEV::CS_WRITE ) ? CTRL_CS : 0 ) | ( DEV::ROML_READ ? CTRL_ROML : 0 ) | ( DEV::ROMH_READ ? CTRL_ROMH : 0 ) };
+
+	static constexpr u32 cycleType( u32 ctrl )
+	{
+		u32 t = classifyCycle( ctrl, DECODE );
+
+		if ( ( t == CYCLE_IO1_READ && !DEV::IO1_READ ) || ( t == CYCLE_IO1_WRITE && !DEV::IO1_WRITE ) ||
+			 ( t == CYCLE_IO2_READ && !DEV::IO2_READ ) || ( t == CYCLE_IO2_WRITE && !DEV::IO2_WRITE ) ||
+			 ( t == CYCLE_CS_READ && !DEV::CS_READ ) || ( t == CYCLE_CS_WRITE && !DEV::CS_WRITE ) || 
+			 ( t == CYCLE_ROM_READ && !DEV::ROML_READ && !DEV::ROMH_READ ) || t == CYCLE_ROM_WRITE )
+			return CYCLE_IDLE;
+
+		return t;
+	}
+
+	static void setDefaultTimings() 
+	{ 
+		setBusTimings( DEV::ADDR_SAMPLE_NS, DEV::MUX_SAMPLE_NS, DEV::READ_RELEASE_NS, DEV::WRITE_SAMPLE_NS ); 
+	}
+
+	typedef typename DEV::SlotWork SlotWork;
+
+	static void FIQHandler( void *pParam );
+
+	template <u32 T> static void BusCycle( u32 g2, u32 g3, unsigned long armCycleCounter );
+
+	//
+	// cycle budget check, all times in ARM cycles after the FIQ started
+	//
+	enum {
+		LATENCY = DEVICE_NS2CYCLES( DEVICE_FIQ_LATENCY_NS ),
+		GPIO_READ = DEVICE_NS2CYCLES( DEVICE_GPIO_READ_NS ),
+		GPIO_SAMPLE = DEVICE_NS2CYCLES( DEVICE_GPIO_SAMPLE_NS ),
+		GPIO_WRITE = DEVICE_NS2CYCLES( DEVICE_GPIO_WRITE_NS ),
+		GPIO_LATENCY = DEVICE_NS2CYCLES( DEVICE_GPIO_LATENCY_NS ),
+
+		ADDR_SAMPLE = DEVICE_TIMING( DEV::ADDR_SAMPLE_NS ),
+		MUX_SAMPLE = DEVICE_TIMING( DEV::MUX_SAMPLE_NS ),
+		READ_RELEASE = DEVICE_TIMING( DEV::READ_RELEASE_NS ),
+		WRITE_SAMPLE = DEVICE_TIMING( DEV::WRITE_SAMPLE_NS ),
+
+		// the control lines are known after this
+		SAMPLED = ( USE_MUX ? (u32)MUX_SAMPLE : (u32)ADDR_SAMPLE ) + GPIO_READ + DEV::PREFETCH_CYCLES + DEVICE_DISPATCH_CYCLES,
+
+		READ_CYCLES = deviceMax( deviceMax( DEV::IO1_READ ? DEV::IO1_READ_CYCLES : 0, DEV::IO2_READ ? DEV::IO2_READ_CYCLES : 0 ),
+					  deviceMax( DEV::CS_READ ? DEV::CS_READ_CYCLES : 0, 
+					  deviceMax( DEV::ROML_READ ? DEV::ROML_READ_CYCLES : 0, DEV::ROMH_READ ? DEV::ROMH_READ_CYCLES : 0 ) ) ),
+		WRITE_CYCLES = deviceMax( deviceMax( DEV::IO1_WRITE ? DEV::IO1_WRITE_CYCLES : 0, DEV::IO2_WRITE ? DEV::IO2_WRITE_CYCLES : 0 ),
+					   DEV::CS_WRITE ? DEV::CS_WRITE_CYCLES : 0 ),
+
+		HAS_READ = DEV::IO1_READ || DEV::IO2_READ || DEV::CS_READ || DEV::ROML_READ || DEV::ROMH_READ,
+		HAS_WRITE = DEV::IO1_WRITE || DEV::IO2_WRITE || DEV::CS_WRITE,
+
+		// read: data is on the bus after the callback, WRITE_D0D7 and the latency of the GPIOs
+		DATA_STABLE = SAMPLED + READ_CYCLES + DEVICE_DATA_CYCLES + 2 * GPIO_WRITE + GPIO_LATENCY,
+		RELEASED = deviceMax( READ_RELEASE, DATA_STABLE ) + GPIO_WRITE + GPIO_LATENCY,
+
+		// write: D0-D7 are sampled during the GPLEV0 read, then the callback runs
+		WRITE_SAMPLED = deviceMax( WRITE_SAMPLE, SAMPLED + 2 * GPIO_WRITE ) + GPIO_SAMPLE,
+		WRITE_DONE = WRITE_SAMPLED + GPIO_READ - GPIO_SAMPLE + 2 * GPIO_WRITE + WRITE_CYCLES,
+	};
+
+	static_assert( !HAS_READ || LATENCY + DATA_STABLE <= DEVICE_NS2CYCLES( DEV::DATA_VALID_NS ), 
+		"read cycles: data cannot be put onto the bus before the deadline (MUX_SAMPLE/ADDR_SAMPLE or the callbacks are too slow)" );
+	static_assert( !HAS_READ || LATENCY + READ_RELEASE >= DEVICE_NS2CYCLES( DEV::DATA_HOLD_NS ), 
+		"read cycles: READ_RELEASE releases the bus before the data hold time" );
+	static_assert( !HAS_READ || LATENCY + RELEASED <= DEVICE_NS2CYCLES( DEV::RELEASE_NS ), 
+		"read cycles: the bus cannot be released in time" );
+	static_assert( !HAS_WRITE || LATENCY + WRITE_SAMPLED >= DEVICE_NS2CYCLES( DEV::WRITE_VALID_NS ), 
+		"write cycles: WRITE_SAMPLE samples D0-D7 before the data is valid" );
+	static_assert( !HAS_WRITE || LATENCY + WRITE_SAMPLED <= DEVICE_NS2CYCLES( DEV::DATA_HOLD_NS ), 
+		"write cycles: D0-D7 cannot be sampled before the end of the data hold time" );
+	static_assert( !HAS_WRITE || LATENCY + WRITE_DONE <= DEVICE_NS2CYCLES( DEV::CYCLE_NS ), 
+		"write cycles: the handler cannot finish before the next cycle (the callbacks are too slow)" );
+	static_assert( !HAS_READ || LATENCY + RELEASED <= DEVICE_NS2CYCLES( DEV::CYCLE_NS ), 
+		"read cycles: the handler cannot finish before the next cycle" );
+};
+
+template <class DEV, class BUS>
+void Device<DEV, BUS>::FIQHandler( void *pParam )
+{
+	register u32 g2, g3;
+
+	#define DEVICE_CYCLE( n ) BusCycle<cycleType( n )>
+	static TDeviceCycleHandler * const dispatch[ CTRL_SIZE ] AA = { DISPATCH_TABLE( DEVICE_CYCLE ) };
+	#undef DEVICE_CYCLE
+
+	BEGIN_CYCLE_COUNTER
+
+	// the nasty trick of kernel_cart: switch the multiplexers to A8..12 right away, A0..A7 are read before they switch
+	if ( USE_MUX ) 
+		BUS::setPins( 1 << DIR_CTRL_257 ); 
+
+	DEV::prefetch();
+	SlotWork::prepare();
+	CACHE_PRELOAD( &dispatch[ 0 ] );
+	CACHE_PRELOAD( &dispatch[ 16 ] );
+	CACHE_PRELOAD( &dispatch[ 32 ] );
+	CACHE_PRELOAD( &dispatch[ 48 ] );
+
+	// without multiplexing wait for the PLA delay, otherwise IO1, IO2, ... are read together with A8..12
+	if ( !USE_MUX )
+		WAIT_UP_TO_CYCLE( busTimings.addrSample );
+
+	g2 = BUS::getLevels();
+
+	if ( !( g2 & bRESET ) ) DEV::onReset();
+
+	// block wrong executions
+	if ( !( g2 & bPHI ) ) 
+	{
+		if ( USE_MUX )
+			BUS::clrPins( 1 << DIR_CTRL_257 ); 
+		return;
+	}
+
+	DEV::prefetchAddress( ( g2 >> A0 ) & 255 );
+
+	if ( USE_MUX )
+	{
+		WAIT_UP_TO_CYCLE( busTimings.muxSample );
+		g3 = BUS::getLevels();
+	} else
+		g3 = g2;
+
+	dispatch[ CTRL_INDEX( g3 ) ]( g2, g3, armCycleCounter );
+}
+
+template <class DEV, class BUS> template <u32 T>
+void Device<DEV, BUS>::BusCycle( u32 g2, u32 g3, unsigned long armCycleCounter )
+{
+	const u32 mux = USE_MUX ? ( 1 << DIR_CTRL_257 ) : 0;
+	u32 A = ( g2 >> A0 ) & 255;
+
+	// nothing to do, or outside the address range of the device
+	if ( T == CYCLE_IDLE ||
+		 ( ( T == CYCLE_IO1_READ || T == CYCLE_IO1_WRITE ) && ( A < DEV::IO1_FIRST || A > DEV::IO1_LAST ) ) ||
+		 ( ( T == CYCLE_IO2_READ || T == CYCLE_IO2_WRITE ) && ( A < DEV::IO2_FIRST || A > DEV::IO2_LAST ) ) ||
+		 ( ( T == CYCLE_CS_READ || T == CYCLE_CS_WRITE ) && ( A < DEV::CS_FIRST || A > DEV::CS_LAST ) ) )
+	{
+		if ( USE_MUX )
+			BUS::clrPins( mux ); 
+		return;
+	}
+
+	if ( T == CYCLE_IO1_READ || T == CYCLE_IO2_READ || T == CYCLE_CS_READ || T == CYCLE_ROM_READ )
+	{
+		// read-from-periphery / write-to-bus cycle
+		u8 D;
+		if ( T == CYCLE_IO1_READ ) D = DEV::IO1Read( A ); else
+		if ( T == CYCLE_IO2_READ ) D = DEV::IO2Read( A ); else
+		if ( T == CYCLE_CS_READ ) D = DEV::CSRead( A ); else
+		{
+			u32 addr = ( A << 5 ) | ( ( g3 >> A8 ) & 31 );
+			if ( DEV::ROMH_READ && ( !DEV::ROML_READ || !( g3 & bROMH ) ) )
+				D = DEV::ROMHRead( addr ); else
+				D = DEV::ROMLRead( addr );
+		}
+
+		// put it onto the bus, enable the 74LVC245 (and switch the multiplexers back to A0..A7)
+		WRITE_D0D7( D, ( 1 << GPIO_OE ) | mux );
+
+		WAIT_UP_TO_CYCLE_WORK( busTimings.readRelease, SlotWork );
+
+		// disable 74LVC245
+		BUS::setPins( 1 << GPIO_OE );
+	} else
+	{
+		// read-from-bus (= write to periphery) cycle
+		SET_BANK2_INPUT 
+
+		// enable 74LVC245
+		BUS::clrPins( ( 1 << GPIO_OE ) | mux );
+
+		WAIT_UP_TO_CYCLE_WORK( busTimings.writeSample, SlotWork );
+
+		u32 g1 = BUS::getLevels();
+
+		// disable 74LVC245
+		BUS::setPins( 1 << GPIO_OE ); 
+
+		SET_BANK2_OUTPUT 
+
+		u8 D = ( g1 >> D0 ) & 255;
+
+		if ( T == CYCLE_IO1_WRITE ) DEV::IO1Write( A, D ); else
+		if ( T == CYCLE_IO2_WRITE ) DEV::IO2Write( A, D ); else
+			DEV::CSWrite( A, D );
+	}
+}
+
+#endif
@@ -0,0 +1,96 @@
+//
+// dispatch.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _dispatch_h
+#define _dispatch_h
+
+#include <circle/types.h>
+#include "gpio_defs.h"
+
+//
+// bus cycle dispatch: the control lines sampled in a FIQ handler are packed into a 6 bit index, and a table with 64 entries
+// maps it to the handler for this kind of bus cycle (i.e. the control lines are tested exactly once)
+//
+// the handlers are template instantiations, one per cycle type and kernel configuration (e.g. cartridge mapper),
+// and the tables are built at compile time by classifying every index (see DISPATCH_TABLE and classifyCycle)
+//
+// latency: the host simulator reports when the data of each read is valid ("data valid ROML/ROMH/IO1/IO2", ns after PHI2
+// rising). It models the deadlines and GPIO accesses of the handlers, but not the instructions between them, and it does not
+// run kernel=sid. With the scripts of 50b62ee, before (50b62ee) and after (1a77ae8) the table dispatch:
+//
+//		kernel=cart ROML            300.9 ns    300.9 ns    (cart keeps its single test)
+//		kernel=ef   ROML/ROMH/IO    301.6 ns    303.0 ns
+//		kernel=ram  IO1/IO2         222.1 ns    222.1 ns
+//
+// i.e. the simulator shows no decrease, the data is put onto the bus at the multiplexer deadline in both cases. Whether the
+// dispatch shortens the time from FIQ entry to valid data has to be measured on the RPi (make kernel=... PMU_PROFILING=1),
+// for both commits:
+//
+//		static PMU_SAMPLE pmuEntry;						// global, the handlers are separate functions
+//		pmuSample<BUS>( pmuEntry );						// first statement of the FIQ handler
+//		PMU_END( pmuData )								// in the read handlers, directly after WRITE_D0D7
+//		PMU_ADD( PMU_DATA_VALID, "entry to data", pmuEntry, pmuData )	// after the bus has been released
+//
+// the "cycles" column of the report is the latency (the cost of sampling the counters is the same for both builds)
+//
+
+// bits of the dispatch index, the signals are stored as sampled, i.e. IO1, IO2, ROML, ROMH, CS are active low
+#define CTRL_IO1	1
+#define CTRL_IO2	2
+#define CTRL_ROML	4
+#define CTRL_ROMH	8
+#define CTRL_CS		16
+#define CTRL_RW		32
+
+#define CTRL_SIZE	64
+
+// caution: ROML/ROMH are only valid after switching the multiplexers, otherwise these are A1/A2 (and ignored by the kernel)
+#define CTRL_INDEX( g ) ( ( ( (g) >> IO1 ) & 3 ) | ( ( (g) >> ( ROML - 2 ) ) & 12 ) | ( ( (g) >> ( CS - 4 ) ) & 16 ) | ( ( (g) >> ( RW - 5 ) ) & 32 ) )
+
+static_assert( IO2 == IO1 + 1 && ROMH == ROML + 1 && ROML >= 2 && CS >= 4 && RW >= 5, "CTRL_INDEX assumes a different GPIO mapping" );
+
+// kinds of bus cycles
+enum {
+	CYCLE_IDLE = 0,
+	CYCLE_ROM_READ, CYCLE_ROM_WRITE,
+	CYCLE_IO1_READ, CYCLE_IO1_WRITE,
+	CYCLE_IO2_READ, CYCLE_IO2_WRITE,
+	CYCLE_CS_READ, CYCLE_CS_WRITE
+};
+
+// classifies a dispatch index, 'decoded' are the CTRL_xxx lines which a kernel actually uses
+// (priorities: ROML/ROMH, CS, IO1, IO2 -- which only matters for invalid combinations anyway)
+constexpr u32 classifyCycle( u32 ctrl, u32 decoded )
+{
+	u32 active = ~ctrl & decoded;
+	u32 read = ctrl & CTRL_RW;
+
+	if ( active & ( CTRL_ROML | CTRL_ROMH ) ) return read ? CYCLE_ROM_READ : CYCLE_ROM_WRITE;
+	if ( active & CTRL_CS )	return read ? CYCLE_CS_READ : CYCLE_CS_WRITE;
+	if ( active & CTRL_IO1 ) return read ? CYCLE_IO1_READ : CYCLE_IO1_WRITE;
+	if ( active & CTRL_IO2 ) return read ? CYCLE_IO2_READ : CYCLE_IO2_WRITE;
+	return CYCLE_IDLE;
+}
+
+// expands to the initializer of a dispatch table, ENTRY( n ) is the handler for index n
+#define DISPATCH_4( ENTRY, n )	ENTRY( (n) ), ENTRY( (n) + 1 ), ENTRY( (n) + 2 ), ENTRY( (n) + 3 )
+#define DISPATCH_16( ENTRY, n )	DISPATCH_4( ENTRY, (n) ), DISPATCH_4( ENTRY, (n) + 4 ), DISPATCH_4( ENTRY, (n) + 8 ), DISPATCH_4( ENTRY, (n) + 12 )
+#define DISPATCH_TABLE( ENTRY )	DISPATCH_16( ENTRY, 0 ), DISPATCH_16( ENTRY, 16 ), DISPATCH_16( ENTRY, 32 ), DISPATCH_16( ENTRY, 48 )
+
+#endif
@@ -0,0 +1,178 @@
+//
+// fiqcheck.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/types.h>
+#include <circle/memio.h>
+#include "lowlevel_arm.h"
+#include "gpio_defs.h"
+#include "timings.h"
+#include "bus.h"
+
+//
+// evidence that the bus backends (bus.h) cost nothing in the FIQ handlers: the FIQ handler of kernel=cart as it was written
+// before the backends existed (direct register accesses and inline assembly) and the same handler written with BUS,
+// "make fiqcheck" compiles this file with the kernel's flags and fails if the disassemblies of both differ
+// (the host simulator has the same check for BusSim, see host/Makefile)
+//
+// not covered: SET_BANK2_INPUT/OUTPUT, which store the GPFSEL2 shadow instead of a read-modify-write of the register
+//
+// note that both handlers here are reconstructions of the kernel=cart handler, not the handlers the kernels ship with:
+// "make fiqcompare" compiles the kernels at two commits and compares their actual FIQ handlers (see Makefile). Neither
+// check has been run with the ARM toolchain yet, i.e. that the ARM code is unchanged is unverified; on x86-64 (host/Makefile)
+// the two handlers here compile to identical code
+//
+
+u8 fiqCheckROM[ 8192 ] AA;
+
+#define FIQCHECK_ROM_LH	bROML
+
+//
+// the FIQ handler with the macros as they were before bus.h
+//
+#ifdef HOST_SIMULATION
+
+#define BASELINE_BEGIN_CYCLE_COUNTER \
+								u32 armCycleCounter = simReadCycleCounter();
+
+#define BASELINE_WAIT_UP_TO_CYCLE( wc ) { \
+								u32 cc2; \
+								do { \
+									cc2 = simReadCycleCounter(); \
+								} while ( (cc2-armCycleCounter) < (wc) ); }
+
+#define BASELINE_CACHE_PRELOAD( ptr ) { simCachePreload( (const void*)(ptr) ); }
+#define BASELINE_CACHE_PRELOADI( ptr ) { simCachePreload( (const void*)(ptr) ); }
+
+#else
+
+#define BASELINE_BEGIN_CYCLE_COUNTER \
+						  		unsigned long armCycleCounter asm ("r9"); \
+								armCycleCounter = 0; \
+								asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n": "=r"(armCycleCounter));  
+
+#define BASELINE_WAIT_UP_TO_CYCLE( wc ) { \
+								unsigned long cc2  asm ("r10"); \
+								do { \
+									asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n": "=r"(cc2)); \
+								} while ( (cc2-armCycleCounter) < (wc) ); }
+
+#define BASELINE_CACHE_PRELOAD( ptr ) { asm volatile ("pld\t[%0]" :: "r" (ptr)); }
+#define BASELINE_CACHE_PRELOADI( ptr ) { asm volatile ("pli\t[%0]" :: "r" (ptr)); }
+
+#endif
+
+void fiqBaseline( void *pParam )
+{
+	register u32 g2;
+	register u32 g3;
+	register u32 D;
+
+	BASELINE_CACHE_PRELOADI( &&cachesetup );
+	BASELINE_CACHE_PRELOADI( &&romaccess );
+
+	BASELINE_BEGIN_CYCLE_COUNTER
+
+	write32( ARM_GPIO_GPSET0, 1 << DIR_CTRL_257 ); 
+
+	g2 = read32( ARM_GPIO_GPLEV0 );
+
+	if ( !( g2 & bPHI ) ) 
+	{
+		write32( ARM_GPIO_GPCLR0, 1 << DIR_CTRL_257 ); 
+		return;
+	}
+
+cachesetup:
+	register u32 addr = g2 & ( 255 << 5 );
+	BASELINE_CACHE_PRELOAD( &fiqCheckROM[ addr ] );
+
+	BASELINE_WAIT_UP_TO_CYCLE( busTimings.muxSample );
+	g3 = read32( ARM_GPIO_GPLEV0 );
+
+romaccess:
+	if ( ( g3 & FIQCHECK_ROM_LH ) || !( g3 & bRW ) )
+	{
+		write32( ARM_GPIO_GPCLR0, 1 << DIR_CTRL_257 ); 
+		return;
+	}
+
+	addr |= ( g3 >> A8 ) & 31;
+
+	D = fiqCheckROM[ addr ] << D0;
+
+	write32( ARM_GPIO_GPSET0, D );
+	write32( ARM_GPIO_GPCLR0, (D_FLAG & ( ~D )) | (1 << GPIO_OE) | (1 << DIR_CTRL_257) );
+
+	BASELINE_WAIT_UP_TO_CYCLE( busTimings.readRelease );
+
+	write32( ARM_GPIO_GPSET0, (1 << GPIO_OE) );
+}
+
+//
+// the same with the bus backend
+//
+template <class BUS>
+void fiqTemplated( void *pParam )
+{
+	register u32 g2;
+	register u32 g3;
+	register u32 D;
+
+	CACHE_PRELOADI( &&cachesetup );
+	CACHE_PRELOADI( &&romaccess );
+
+	BEGIN_CYCLE_COUNTER
+
+	BUS::setPins( 1 << DIR_CTRL_257 ); 
+
+	g2 = BUS::getLevels();
+
+	if ( !( g2 & bPHI ) ) 
+	{
+		BUS::clrPins( 1 << DIR_CTRL_257 ); 
+		return;
+	}
+
+cachesetup:
+	register u32 addr = g2 & ( 255 << 5 );
+	CACHE_PRELOAD( &fiqCheckROM[ addr ] );
+
+	WAIT_UP_TO_CYCLE( busTimings.muxSample );
+	g3 = BUS::getLevels();
+
+romaccess:
+	if ( ( g3 & FIQCHECK_ROM_LH ) || !( g3 & bRW ) )
+	{
+		BUS::clrPins( 1 << DIR_CTRL_257 ); 
+		return;
+	}
+
+	addr |= ( g3 >> A8 ) & 31;
+
+	D = fiqCheckROM[ addr ] << D0;
+
+	BUS::setPins( D );
+	BUS::clrPins( (D_FLAG & ( ~D )) | (1 << GPIO_OE) | (1 << DIR_CTRL_257) );
+
+	WAIT_UP_TO_CYCLE( busTimings.readRelease );
+
+	BUS::setPins( (1 << GPIO_OE) );
+}
+
+template void fiqTemplated<BUS>( void *pParam );
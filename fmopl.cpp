@@ -1698,6 +1698,63 @@ int ym3812_timer_over(FM_OPL *chip, int c)
     return OPLTimerOver(chip, c);
 }
 
+/*
+** Complete state of a chip: a copy of FM_OPL with the connect1 pointers
+** replaced by flags (1 = output, 0 = phase modulation), followed by the flags.
+** The globals (output, phase_modulation, LFO_AM, LFO_PM) are recomputed for
+** every sample and are not part of the state.
+*/
+int ym3812_state_size(void)
+{
+    return sizeof(FM_OPL) + 9 * 2;
+}
+
+void ym3812_save_state(FM_OPL *chip, void *buf)
+{
+    FM_OPL *state = (FM_OPL *)buf;
+    UINT8 *output0 = (UINT8 *)buf + sizeof(FM_OPL);
+    int x, y;
+
+    memcpy(state, chip, sizeof(FM_OPL));
+    for (x = 0; x < 9; x++) {
+        for (y = 0; y < 2; y++) {
+            output0[x * 2 + y] = connect1_is_output0(chip->P_CH[x].SLOT[y].connect1);
+            state->P_CH[x].SLOT[y].connect1 = NULL;
+        }
+    }
+}
+
+void ym3812_load_state(FM_OPL *chip, const void *buf)
+{
+    const UINT8 *output0 = (const UINT8 *)buf + sizeof(FM_OPL);
+    int x, y;
+
+    memcpy(chip, buf, sizeof(FM_OPL));
+    for (x = 0; x < 9; x++) {
+        for (y = 0; y < 2; y++) {
+            set_connect1(chip, x, y, output0[x * 2 + y]);
+        }
+    }
+}
+
+/* changes the sampling rate of a running chip: the rate dependent increments are derived again, the state is kept */
+void ym3812_set_rate(FM_OPL *chip, UINT32 rate)
+{
+    int x, y;
+
+    chip->rate = rate;
+    OPL_initalize(chip);
+
+    for (x = 0; x < 9; x++) {
+        OPL_CH *CH = &chip->P_CH[x];
+
+        CH->fc = chip->fn_tab[CH->block_fnum & 0x03ff] >> (7 - (CH->block_fnum >> 10));
+        for (y = 0; y < 2; y++) {
+            CALC_FCSLOT(CH, &CH->SLOT[y]);
+        }
+    }
+}
+
 /*
 ** Generate samples for one of the YM3812's
 **
@@ -125,6 +125,20 @@ extern unsigned char ym3812_read(FM_OPL *chip, int a);
 extern unsigned char ym3812_peek(FM_OPL *chip, int a);
 extern int ym3812_timer_over(FM_OPL *chip, int c);
 
+/*
+ * Save/restore the complete state of a chip (e.g. for checkpoints of a
+ * rendering), 'buf' holds ym3812_state_size() bytes
+ */
+extern int ym3812_state_size(void);
+extern void ym3812_save_state(FM_OPL *chip, void *buf);
+extern void ym3812_load_state(FM_OPL *chip, const void *buf);
+
+/*
+ * Change the sampling rate of a running chip (e.g. to emulate it at a
+ * lower rate when the CPU cannot keep up), the state is kept
+ */
+extern void ym3812_set_rate(FM_OPL *chip, UINT32 rate);
+
 /*
  * Generate samples for one of the YM3812's
  *
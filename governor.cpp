@@ -0,0 +1,118 @@
+//
+// governor.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/util.h>
+#include "governor.h"
+
+void governorInit( QUALITY_GOVERNOR *g, SID_ENGINE *e )
+{
+	memset( g, 0, sizeof( QUALITY_GOVERNOR ) );
+
+	g->levels[ g->nLevels ++ ] = ENGINE_QUALITY_EXACT;
+	if ( e->exactStep < 4 )
+		g->levels[ g->nLevels ++ ] = ENGINE_QUALITY_STEP4;
+	if ( e->exactStep < 8 )
+		g->levels[ g->nLevels ++ ] = ENGINE_QUALITY_STEP8;
+	if ( e->opl )
+		g->levels[ g->nLevels ++ ] = ENGINE_QUALITY_OPL_HALF;
+
+	g->cur = 0;
+	g->calmNeeded = GOVERNOR_CALM;
+	g->sinceRaise = GOVERNOR_RAISE_FAILED;
+	g->windowStart = e->nCyclesEmulated;
+
+	engineSetQuality( e, ENGINE_QUALITY_EXACT );
+}
+
+static void governorSet( QUALITY_GOVERNOR *g, SID_ENGINE *e, u32 cur, u32 ring, CLogger *logger )
+{
+	logger->Write( "RaspiSID", LogNotice, "quality %s -> %s (load %u.%u%%, %u cycles behind, %u writes queued)",
+		engineQualityName( e->quality ), engineQualityName( g->levels[ cur ] ), g->load / 10, g->load % 10, g->maxLag, ring );
+
+	g->cur = cur;
+	g->changes ++;
+	engineSetQuality( e, g->levels[ cur ] );
+}
+
+boolean governorUpdate( QUALITY_GOVERNOR *g, SID_ENGINE *e, u32 lag, u32 ring, u32 ringSize, u32 armClock, u32 clockFreq, CLogger *logger )
+{
+	if ( lag > g->maxLag ) g->maxLag = lag;
+	if ( ring > g->maxRing ) g->maxRing = ring;
+
+	u64 emulated = e->nCyclesEmulated - g->windowStart;
+	if ( emulated < (u64)clockFreq * GOVERNOR_WINDOW_MS / 1000 )
+		return FALSE;
+
+	// ARM cycles available for the emulated C64 cycles (in real time) vs. cycles spent
+	u64 available = emulated * armClock / clockFreq;
+	g->load = (u32)( g->armCycles * 1000 / available );
+
+	boolean pressure = g->load > GOVERNOR_LOAD_HIGH || 
+					   g->maxLag > clockFreq / 1000 * GOVERNOR_LAG_HIGH_MS ||
+					   g->maxRing > ringSize / GOVERNOR_RING_HIGH;
+	boolean relaxed = g->load < GOVERNOR_LOAD_LOW && g->maxLag < clockFreq / 1000 * GOVERNOR_LAG_HIGH_MS / 4;
+
+	boolean changed = FALSE;
+
+	if ( g->hold )
+	{
+		// wait for the last lowering to take effect (the backlog needs some time to go away)
+		g->hold --;
+	} else
+	if ( pressure )
+	{
+		g->calm = 0;
+		if ( g->cur + 1 < g->nLevels )
+		{
+			// the last raise did not hold: wait twice as long next time
+			if ( g->sinceRaise < GOVERNOR_RAISE_FAILED && g->calmNeeded < GOVERNOR_CALM_MAX )
+				g->calmNeeded *= 2;
+
+			governorSet( g, e, g->cur + 1, ring, logger );
+			g->hold = GOVERNOR_HOLD;
+			changed = TRUE;
+		} else
+		if ( !g->warned )
+		{
+			logger->Write( "RaspiSID", LogWarning, "cannot keep up even at the lowest quality (load %u.%u%%, %u cycles behind)",
+				g->load / 10, g->load % 10, g->maxLag );
+			g->warned = TRUE;
+		}
+	} else
+	if ( relaxed && g->cur > 0 )
+	{
+		if ( ++ g->calm >= g->calmNeeded )
+		{
+			governorSet( g, e, g->cur - 1, ring, logger );
+			g->calm = 0;
+			g->sinceRaise = 0;
+			changed = TRUE;
+		}
+	} else
+		g->calm = 0;
+
+	if ( g->sinceRaise < GOVERNOR_RAISE_FAILED )
+		g->sinceRaise ++;
+
+	g->windowStart = e->nCyclesEmulated;
+	g->armCycles = 0;
+	g->maxLag = g->maxRing = 0;
+
+	return changed;
+}
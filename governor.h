@@ -0,0 +1,76 @@
+//
+// governor.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _governor_h
+#define _governor_h
+
+#include <circle/types.h>
+#include <circle/logger.h>
+#include "sidengine.h"
+
+//
+// adaptive emulation quality for kernel=sid: the main loop accounts the ARM cycles spent in engineRenderSample and 
+// how far the emulation is behind the C64 (C64 cycles not yet emulated, register writes waiting in the ring buffer). 
+// Under pressure the quality is lowered one level at a time (ENGINE_QUALITY_xxx), with enough headroom for a while 
+// it is raised again. The thresholds are apart, and a raise which has to be taken back soon doubles the time
+// required before the next one, i.e. a configuration at its limit does not oscillate.
+//
+#define GOVERNOR_WINDOW_MS		100		// evaluated after every 100ms of emulated C64 time
+#define GOVERNOR_LOAD_HIGH		900		// load (per mille of the real time of the window) for lowering the quality
+#define GOVERNOR_LOAD_LOW		450		// ... and below which it may be raised
+#define GOVERNOR_LAG_HIGH_MS	20		// the emulation is behind the C64 by more than this
+#define GOVERNOR_RING_HIGH		8		// more than 1/8 of the ring buffer waiting
+#define GOVERNOR_HOLD			2		// windows after lowering before the effect is judged
+#define GOVERNOR_CALM			30		// calm windows before raising the quality (3s)
+#define GOVERNOR_CALM_MAX		1200	// ... doubled after every raise that did not hold, up to 2min
+#define GOVERNOR_RAISE_FAILED	10		// a raise is taken back within this many windows
+
+typedef struct
+{
+	// the quality levels which change something in this configuration (e.g. no OPL, or 8-cycle steps anyway)
+	u32 levels[ ENGINE_QUALITY_LEVELS ];
+	u32 nLevels, cur;
+
+	// current window
+	u64 windowStart;
+	u64 armCycles;
+	u32 maxLag, maxRing;
+
+	u32 load;
+	u32 hold, calm, calmNeeded;
+	u32 sinceRaise;
+	boolean warned;
+
+	// number of changes (informative)
+	u32 changes;
+} QUALITY_GOVERNOR;
+
+extern void governorInit( QUALITY_GOVERNOR *g, SID_ENGINE *e );
+
+// ARM cycles spent emulating (e.g. BUS::readCycleCounter() around engineRenderSample)
+static __attribute__( ( always_inline ) ) inline void governorAccount( QUALITY_GOVERNOR *g, u32 armCycles )
+{
+	g->armCycles += armCycles;
+}
+
+// once per iteration of the main loop: lag = C64 cycles not yet emulated, ring = register writes waiting (of ringSize),
+// sets the quality of the engine and returns TRUE if it changed
+extern boolean governorUpdate( QUALITY_GOVERNOR *g, SID_ENGINE *e, u32 lag, u32 ring, u32 ringSize, u32 armClock, u32 clockFreq, CLogger *logger );
+
+#endif
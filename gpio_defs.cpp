@@ -27,6 +27,11 @@
 #include <circle/gpiopin.h>
 #include <circle/memio.h>
 #include "gpio_defs.h"
+#include "bus.h"
+
+u32 gpfsel2Shadow;
+
+DATA_MASK dataMask[ 256 ] AA;
 
 static void INP_GPIO( int pin )
 {
@@ -54,8 +59,15 @@ void gpioInit()
 	// D0 - D7
 	INP_GPIO( D0 );	INP_GPIO( D1 ); INP_GPIO( D2 );	INP_GPIO( D3 );
 	INP_GPIO( D4 );	INP_GPIO( D5 );	INP_GPIO( D6 );	INP_GPIO( D7 );
+	gpfsel2Shadow = read32( ARM_GPIO_GPFSEL2 ) & ~( GPFSEL2_D_OUTPUT * 7 );
 	SET_BANK2_INPUT
 
+	for ( u32 i = 0; i < 256; i++ )
+	{
+		dataMask[ i ].set = encodeGPIO( i );
+		dataMask[ i ].clr = D_FLAG & ~encodeGPIO( i );
+	}
+
 	// A0-A7 (A8-A12, ROML, ROMH use the same GPIOs)
 	INP_GPIO( A0 );	INP_GPIO( A1 );	INP_GPIO( A2 );	INP_GPIO( A3 );
 	INP_GPIO( A4 ); INP_GPIO( A5 ); INP_GPIO( A6 ); INP_GPIO( A7 );
@@ -116,24 +116,22 @@
 
 #define ARM_GPIO_GPFSEL2	(ARM_GPIO_BASE + 0x08) 
 
-// set bank 2 GPIOs to input (D0-D7)
-#define SET_BANK2_INPUT { \
-		const unsigned int b1 = ~( ( 7 << 0 ) | ( 7 << 3 ) | ( 7 << 6 ) | ( 7 << 9 ) | ( 7 << 12 ) | ( 7 << 15 ) | ( 7 << 18 ) | ( 7 << 21 ) ); \
-		u32 t2 = read32( ARM_GPIO_GPFSEL2 ) & b1; \
-		write32( ARM_GPIO_GPFSEL2, t2 ); }
+// set bank 2 GPIOs to input (D0-D7), uses the bus backend (see bus.h)
+#define SET_BANK2_INPUT { BUS::dataInput(); }
 
 // set bank 2 GPIOs to output (D0-D7)
-#define SET_BANK2_OUTPUT { \
-			u32 gpio = ARM_GPIO_BASE; \
-			const unsigned int b2 = ( 1 << 0 ) | ( 1 << 3 ) | ( 1 << 6 ) | ( 1 << 9 ) | ( 1 << 12 ) | ( 1 << 15 ) | ( 1 << 18 ) | ( 1 << 21 ); \
-			asm( \
-				"LDR R1, %[gpio]\n" \
-				"LDR R0, [R1, #8]\n"   \
-				"AND R0, #4278190080\n" /* hardcoded b1 from above */ \
-				"LDR R2, %[b2]\n" \
-				"ORR R0, R2\n" \
-				"STR R0, [R1, #8]\n" \
-			: : [gpio] "m" ( gpio ), [b2] "m" ( b2 ) : "r0", "r1", "r2", "cc" ); } 
+#define SET_BANK2_OUTPUT { BUS::dataOutput(); }
+
+// GPSET0/GPCLR0 masks for putting a byte onto D0-D7 (filled in gpioInit)
+typedef struct
+{
+	u32 set, clr;
+} DATA_MASK;
+
+extern DATA_MASK dataMask[ 256 ];
+
+// put byte v onto D0-D7 with two table loads, g are additional GPIOs which are cleared in the same write (e.g. GPIO_OE)
+#define WRITE_D0D7( v, g ) { const DATA_MASK *dm = &dataMask[ (v) ]; BUS::setPins( dm->set ); BUS::clrPins( dm->clr | ( g ) ); }
 
 void gpioInit();
 void decodeGPIOData( u32 g, u8 *d );
@@ -0,0 +1,221 @@
+//
+// bench.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "bench.h"
+
+//
+// host driver of the micro-benchmarks (bench.cpp, the same cases as kernel=bench on the RPi): prints a table, writes the 
+// results as JSON, and compares them against a baseline (e.g. of the previous commit, or SD:bench.json of the RPi)
+//
+// usage: bench [-filter prefix] [-o results.json] [-baseline base.json] [-threshold percent]
+//        bench -compare base.json results.json [-threshold percent]
+//
+// a case counts as slower/faster if the medians differ by more than the threshold (default 5%) and by more than
+// three times the noise (MAD) of either measurement; the exit code is 1 if any case got slower
+//
+
+// gpio_defs.cpp is linked for encodeGPIO/decodeGPIO, gpioInit() (the only user of MMIO) is never called
+u32 simRead32( uintptr nAddress ) { return 0; }
+void simWrite32( uintptr nAddress, u32 nValue ) {}
+
+typedef struct
+{
+	std::string	name, unit;
+	double		ns, min, mad, nsSample;
+} RESULT;
+
+static u64 clockNS()
+{
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (u64)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static bool loadJSON( const char *fn, std::vector<RESULT> &results )
+{
+	FILE *f = fopen( fn, "r" );
+	if ( !f )
+	{
+		fprintf( stderr, "cannot open %s\n", fn );
+		return false;
+	}
+
+	char line[ 512 ], name[ 128 ], unit[ 32 ];
+	RESULT r;
+	while ( fgets( line, sizeof( line ), f ) )
+		if ( sscanf( line, " { \"name\": \"%127[^\"]\", \"unit\": \"%31[^\"]\", \"ns\": %lf, \"min\": %lf, \"mad\": %lf, \"ns_sample\": %lf",
+					 name, unit, &r.ns, &r.min, &r.mad, &r.nsSample ) == 6 )
+		{
+			r.name = name;
+			r.unit = unit;
+			results.push_back( r );
+		}
+
+	fclose( f );
+	return true;
+}
+
+static bool saveJSON( const char *fn, const std::vector<BENCH_RESULT> &results )
+{
+	FILE *f = fopen( fn, "w" );
+	if ( !f )
+	{
+		fprintf( stderr, "cannot write %s\n", fn );
+		return false;
+	}
+
+	fprintf( f, "{\n  \"platform\": \"host\",\n  \"cases\": [\n" );
+	for ( size_t i = 0; i < results.size(); i++ )
+	{
+		fprintf( f, BENCH_JSON_CASE, BENCH_JSON_ARGS( results[ i ] ) );
+		fprintf( f, i + 1 < results.size() ? ",\n" : "\n" );
+	}
+	fprintf( f, "  ]\n}\n" );
+
+	return fclose( f ) == 0;
+}
+
+static RESULT toResult( const BENCH_RESULT &b )
+{
+	RESULT r;
+	r.name = b.name;
+	r.unit = b.unit;
+	r.ns = b.ps / 1000.0;
+	r.min = b.psMin / 1000.0;
+	r.mad = b.madPermille / 10.0;
+	r.nsSample = b.psSample / 1000.0;
+	return r;
+}
+
+// returns the number of cases which got slower
+static int compare( const std::vector<RESULT> &base, const std::vector<RESULT> &cur, double threshold )
+{
+	int slower = 0, faster = 0, missing = 0;
+
+	printf( "%-36s %12s %12s %9s\n", "case", "baseline", "current", "change" );
+	for ( size_t i = 0; i < cur.size(); i++ )
+	{
+		const RESULT *b = 0;
+		for ( size_t j = 0; j < base.size(); j++ )
+			if ( base[ j ].name == cur[ i ].name )
+				b = &base[ j ];
+
+		if ( !b || b->ns <= 0.0 )
+		{
+			printf( "%-36s %12s %9.3f ns\n", cur[ i ].name.c_str(), "-", cur[ i ].ns );
+			missing ++;
+			continue;
+		}
+
+		double change = ( cur[ i ].ns - b->ns ) * 100.0 / b->ns;
+		double tolerance = threshold;
+		if ( 3.0 * b->mad > tolerance ) tolerance = 3.0 * b->mad;
+		if ( 3.0 * cur[ i ].mad > tolerance ) tolerance = 3.0 * cur[ i ].mad;
+
+		const char *verdict = "";
+		if ( change > tolerance )
+		{
+			verdict = "  SLOWER";
+			slower ++;
+		} else
+		if ( change < -tolerance )
+		{
+			verdict = "  faster";
+			faster ++;
+		}
+
+		printf( "%-36s %9.3f ns %9.3f ns %+8.1f%%%s\n", cur[ i ].name.c_str(), b->ns, cur[ i ].ns, change, verdict );
+	}
+
+	printf( "%d slower, %d faster, %d not in the baseline (threshold %.1f%%)\n", slower, faster, missing, threshold );
+	return slower;
+}
+
+int main( int argc, char **argv )
+{
+	const char *filter = "", *output = 0, *baseline = 0, *compareWith = 0;
+	double threshold = 5.0;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !strcmp( argv[ i ], "-filter" ) && i + 1 < argc ) filter = argv[ ++ i ]; else
+		if ( !strcmp( argv[ i ], "-o" ) && i + 1 < argc ) output = argv[ ++ i ]; else
+		if ( !strcmp( argv[ i ], "-baseline" ) && i + 1 < argc ) baseline = argv[ ++ i ]; else
+		if ( !strcmp( argv[ i ], "-threshold" ) && i + 1 < argc ) threshold = atof( argv[ ++ i ] ); else
+		if ( !strcmp( argv[ i ], "-compare" ) && i + 2 < argc ) { baseline = argv[ ++ i ]; compareWith = argv[ ++ i ]; } else
+		{
+			fprintf( stderr, "usage: %s [-filter prefix] [-o results.json] [-baseline base.json] [-threshold percent]\n"
+							 "       %s -compare base.json results.json [-threshold percent]\n", argv[ 0 ], argv[ 0 ] );
+			return 2;
+		}
+	}
+
+	std::vector<RESULT> base, cur;
+
+	// two stored results, nothing is measured
+	if ( compareWith )
+	{
+		if ( !loadJSON( baseline, base ) || !loadJSON( compareWith, cur ) )
+			return 2;
+		return compare( base, cur, threshold ) ? 1 : 0;
+	}
+
+	if ( baseline && !loadJSON( baseline, base ) )
+		return 2;
+
+	std::vector<BENCH_RESULT> results;
+
+	printf( "%-36s %12s %12s %7s %14s\n", "case", "median", "min", "MAD", "per sample" );
+	for ( u32 c = 0; c < benchNumCases(); c++ )
+	{
+		if ( strncmp( benchCaseName( c ), filter, strlen( filter ) ) )
+			continue;
+
+		BENCH_RESULT r;
+		benchRun( c, clockNS, &r );
+		results.push_back( r );
+
+		char perUnit[ 16 ];
+		snprintf( perUnit, sizeof( perUnit ), "ns/%s", r.unit );
+		printf( "%-36s %9.3f %-6s %9.3f %6.1f%%", r.name, r.ps / 1000.0, perUnit, r.psMin / 1000.0, r.madPermille / 10.0 );
+		if ( r.psSample )
+			printf( " %9.1f ns", r.psSample / 1000.0 );
+		printf( "\n" );
+		fflush( stdout );
+	}
+
+	if ( output && !saveJSON( output, results ) )
+		return 2;
+
+	if ( baseline )
+	{
+		for ( size_t i = 0; i < results.size(); i++ )
+			cur.push_back( toResult( results[ i ] ) );
+		printf( "\n" );
+		return compare( base, cur, threshold ) ? 1 : 0;
+	}
+
+	return 0;
+}
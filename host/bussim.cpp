@@ -0,0 +1,847 @@
+//
+// bussim.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <circle/bcm2835.h>
+#include <circle/memio.h>
+#include <circle/gpiopin.h>
+#include "../gpio_defs.h"
+#include "bussim.h"
+
+// defaults resemble a RPi 3B+ and a PAL C64, all of them can be changed in the script ("set <name> <value>")
+SIM_CONFIG simConfig = {
+	1400e6,			// armClock
+	60.0,			// fiqLatency
+	40.0, 20.0,		// readCost, readSample
+	8.0, 40.0,		// writeCost, writeLatency
+	2.0,			// counterCost
+	10.0, 7.0, 35.0,// muxDelay, bufferDelay, plaDelay
+	1015.0, 490.0,	// phi2Cycle, phi2High
+	200.0, 30.0,	// dataValid, dataHold
+	100.0, 400.0	// dataSetup, releaseLatest
+};
+
+static const struct { const char *name; double *value; } configNames[] = {
+	{ "armClock", &simConfig.armClock }, { "fiqLatency", &simConfig.fiqLatency },
+	{ "readCost", &simConfig.readCost }, { "readSample", &simConfig.readSample },
+	{ "writeCost", &simConfig.writeCost }, { "writeLatency", &simConfig.writeLatency },
+	{ "counterCost", &simConfig.counterCost }, { "muxDelay", &simConfig.muxDelay },
+	{ "bufferDelay", &simConfig.bufferDelay }, { "plaDelay", &simConfig.plaDelay },
+	{ "phi2Cycle", &simConfig.phi2Cycle }, { "phi2High", &simConfig.phi2High },
+	{ "dataValid", &simConfig.dataValid }, { "dataHold", &simConfig.dataHold },
+	{ "dataSetup", &simConfig.dataSetup }, { "releaseLatest", &simConfig.releaseLatest },
+};
+
+const char *simSDPath = ".";
+static int verbose = 0;
+
+//
+// bus script: one C64 bus cycle (or a repeated one) per command
+//
+#define OP_READ		0
+#define OP_WRITE	1
+#define OP_IDLE		2
+#define OP_RESET	3
+
+typedef struct
+{
+	u8	type;
+	u16	addr;
+	u8	data;		// written value, or expected value for reads
+	u8	expect;		// 1 if data of a read is checked
+	u32	count;
+	u32	line;
+} BUS_OP;
+
+#define MAX_OPS		65536
+static BUS_OP script[ MAX_OPS ];
+static u32 nOps = 0, curOp = 0, curOpCount = 0;
+
+// number of reads with an expected value in the script, all of them must have been checked when the simulation ends
+static u64 nExpected = 0;
+static const char *failure = 0;
+
+// events counted by the kernel (see BusSim::countEvent), and the minimum counts required by the script
+#define MAX_EVENTS	16
+static struct { char name[ 32 ]; u64 count, expect; } events[ MAX_EVENTS ];
+static u32 nEvents = 0;
+
+// the bus cycle currently simulated
+typedef struct
+{
+	u16	addr;
+	u8	rw;			// 1 = read (from the CPU's perspective)
+	u8	data;
+	u8	expect;
+	u8	reset;		// 1 = RESET pulled low
+	u32	line;
+	u64	index;
+	double T;		// PHI2 rising edge
+} BUS_CYCLE;
+
+static BUS_CYCLE cur, prev;
+static u64 cycleIndex = 0;
+static int cycleValid = 0;
+
+//
+// the Pi's side: time, GPIO state, and the pending writes (which change the pins after writeLatency)
+//
+static double now = 0.0;
+
+static u32 gpioOut = 0;
+static u32 fsel[ 6 ], fselShadow[ 6 ];
+
+// multiplexer: previous/current selection, and time when the outputs switched
+static int dirPrev = 0, dirCur = 0;
+static double dirAt = 0.0;
+
+#define REG_SET		0
+#define REG_CLR		1
+#define REG_FSEL	2
+
+typedef struct
+{
+	double	t;
+	u32		reg, value;
+} PENDING_WRITE;
+
+#define MAX_PENDING	256
+static PENDING_WRITE pending[ MAX_PENDING ];
+static u32 pendingFirst = 0, pendingLast = 0;
+
+// bus side of the 74LVC245: history of OE, D0-D7 direction and values (times include the buffer delay)
+typedef struct
+{
+	double	t;
+	u8		oeLow, outD, d;
+} BUS_STATE;
+
+#define MAX_HISTORY	1024
+static BUS_STATE history[ MAX_HISTORY ];
+static u32 nHistory = 0;
+
+// FIQ handler
+static TGPIOInterruptHandler *fiqHandler = 0;
+static void *fiqParam = 0;
+static int fiqEnabled = 0;
+static double handlerEnd = 0.0;
+static int inHandler = 0;
+
+//
+// statistics and violations
+//
+static u64 nFIQ = 0, nCycles = 0, nChecked = 0, nMismatch = 0;
+static double handlerCyclesMax = 0.0, handlerCyclesSum = 0.0;
+static double minSetupMargin = 1e9, minHoldMargin = 1e9, minReleaseMargin = 1e9, minSampleMargin = 1e9;
+
+// time from PHI2 rising to valid data in read cycles served by the Pi, per select line (the FIQ handler's entry-to-data latency
+// plus fiqLatency and the GPIO/74LVC245 delays of the model)
+enum { DV_ROML, DV_ROMH, DV_IO1, DV_IO2, DV_CS, DV_COUNT };
+static const char *dataValidNames[ DV_COUNT ] = { "ROML", "ROMH", "IO1", "IO2", "CS" };
+static struct { u64 n; double sum, min, max; } dataValid[ DV_COUNT ];
+
+#define V_LATE_DATA			0
+#define V_NO_DATA			1
+#define V_EARLY_RELEASE		2
+#define V_LATE_RELEASE		3
+#define V_BUS_CONFLICT		4
+#define V_WRITE_CONFLICT	5
+#define V_EARLY_SAMPLE		6
+#define V_LATE_SAMPLE		7
+#define V_OVERRUN			8
+#define V_COUNT				9
+
+static const char *violationNames[ V_COUNT ] = {
+	"data not stable before PHI2 setup time",
+	"no data on bus in read cycle",
+	"bus released before hold time",
+	"bus released too late (VIC phase)",
+	"bus driven although not selected",
+	"data lines driven in write cycle",
+	"data sampled before valid",
+	"data sampled after hold time",
+	"FIQ handler overrun",
+};
+
+static u64 violations[ V_COUNT ];
+static u32 nReported = 0;
+
+static void violation( int v, const BUS_CYCLE &c, double t )
+{
+	violations[ v ] ++;
+	if ( nReported ++ < 50 )
+		fprintf( stderr, "[bussim] cycle %llu (script line %u, %c $%04x): %s (at %.1f ns)\n", 
+			(unsigned long long)c.index, c.line, c.rw ? 'r' : 'w', c.addr, violationNames[ v ], t - c.T );
+}
+
+//
+// C64 side: PLA decode and the input levels seen by the Pi
+//
+typedef struct
+{
+	u8 roml, romh, io1, io2, cs;
+} SELECT;
+
+static void decode( const BUS_CYCLE &c, SELECT &s )
+{
+	// GAME/EXROM are driven by the Pi (low = active), the GPIOs are assumed to be outputs (the kernels never configure them)
+	int gameLow  = !( gpioOut & bGAME );
+	int exromLow = !( gpioOut & bEXROM );
+	int ultimax  = gameLow && !exromLow;
+
+	u16 a = c.addr;
+	s.io1 = ( a >> 8 ) == 0xde;
+	s.io2 = ( a >> 8 ) == 0xdf;
+	s.cs  = a >= 0xd400 && a < 0xd800;
+	s.roml = a >= 0x8000 && a < 0xa000 && ( ( exromLow && c.rw ) || ultimax );
+	s.romh = ( a >= 0xa000 && a < 0xc000 && gameLow && exromLow && c.rw ) || ( a >= 0xe000 && ultimax );
+}
+
+static int isSelected( const BUS_CYCLE &c )
+{
+	SELECT s;
+	decode( c, s );
+	return s.roml | s.romh | s.io1 | s.io2 | s.cs;
+}
+
+static BUS_STATE busState( void )
+{
+	BUS_STATE b;
+	b.t = now;
+	b.oeLow = !( gpioOut & ( 1 << GPIO_OE ) );
+	b.outD = ( fsel[ 2 ] & 7 ) == 1;
+	b.d = ( gpioOut >> D0 ) & 255;
+	return b;
+}
+
+static void applyWrite( const PENDING_WRITE &w )
+{
+	BUS_STATE before = busState();
+
+	if ( w.reg == REG_SET ) gpioOut |= w.value; else
+	if ( w.reg == REG_CLR ) gpioOut &= ~w.value; else
+		fsel[ w.reg - REG_FSEL ] = w.value;
+
+	int dir = ( gpioOut >> DIR_CTRL_257 ) & 1;
+	if ( dir != dirCur )
+	{
+		dirPrev = dirCur;
+		dirCur = dir;
+		dirAt = w.t + simConfig.muxDelay;
+	}
+
+	BUS_STATE after = busState();
+	if ( after.oeLow != before.oeLow || after.outD != before.outD || ( after.outD && after.d != before.d ) )
+	{
+		after.t = w.t + simConfig.bufferDelay;
+		if ( nHistory == MAX_HISTORY )
+		{
+			memmove( &history[ 0 ], &history[ MAX_HISTORY / 2 ], sizeof( BUS_STATE ) * MAX_HISTORY / 2 );
+			nHistory = MAX_HISTORY / 2;
+		}
+		history[ nHistory ++ ] = after;
+	}
+}
+
+static void flushPending( double t )
+{
+	while ( pendingFirst != pendingLast && pending[ pendingFirst ].t <= t )
+	{
+		applyWrite( pending[ pendingFirst ] );
+		pendingFirst = ( pendingFirst + 1 ) % MAX_PENDING;
+	}
+}
+
+static u32 readLevels( double t )
+{
+	const BUS_CYCLE &c = cur;
+	double rel = t - c.T;
+
+	u32 outMask = 0;
+	for ( u32 p = 0; p < 30; p++ )
+		if ( ( ( fsel[ p / 10 ] >> ( ( p % 10 ) * 3 ) ) & 7 ) == 1 ) outMask |= 1 << p;
+
+	SELECT s;
+	decode( c, s );
+
+	// PLA outputs are valid after the PLA delay, and until the address changes after PHI2 falling (VIC accesses are not simulated)
+	int phi2 = rel >= 0.0 && rel < simConfig.phi2High;
+	int valid = rel >= simConfig.plaDelay && rel < simConfig.phi2High + simConfig.dataHold + simConfig.plaDelay;
+
+	u32 g = bPHI * phi2;
+	if ( c.rw ) g |= bRW;
+	if ( !c.reset ) g |= bRESET;
+	if ( !( valid && s.io1 ) ) g |= bIO1;
+	if ( !( valid && s.io2 ) ) g |= bIO2;
+	if ( !( valid && s.cs ) ) g |= bCS;
+
+	// 74LVC257: A0-A7, or FREE/ROML/ROMH/A8-A12
+	int mux = ( t >= dirAt ) ? dirCur : dirPrev;
+	if ( !mux )
+		g |= ( c.addr & 255 ) << A0; else
+	{
+		g |= 1 << A0;
+		if ( !( valid && s.roml ) ) g |= bROML;
+		if ( !( valid && s.romh ) ) g |= bROMH;
+		g |= ( ( c.addr >> 8 ) & 31 ) << A8;
+	}
+
+	// D0-D7 as inputs: CPU data in write cycles (if the 74LVC245 is enabled), pull-ups otherwise
+	u32 d = 255;
+	int oeLow = !( gpioOut & ( 1 << GPIO_OE ) );
+	if ( ( fsel[ 2 ] & 7 ) != 1 && oeLow && !c.rw )
+	{
+		double validFrom = simConfig.dataValid, validUntil = simConfig.phi2High + simConfig.dataHold;
+
+		if ( rel >= validFrom && rel <= validUntil )
+			d = c.data; else
+			d = ~c.data & 255;
+
+		if ( cycleValid && isSelected( c ) )
+		{
+			if ( rel < validFrom ) violation( V_EARLY_SAMPLE, c, t );
+			if ( rel > validUntil ) violation( V_LATE_SAMPLE, c, t );
+
+			double m = rel - validFrom;
+			if ( validUntil - rel < m ) m = validUntil - rel;
+			if ( m < minSampleMargin ) minSampleMargin = m;
+
+			if ( verbose )
+				fprintf( stderr, "[bussim] cycle %llu: w $%04x sampled at %.1f ns\n", (unsigned long long)c.index, c.addr, rel );
+		}
+	}
+	g |= d << D0;
+
+	return ( g & ~outMask ) | ( gpioOut & outMask );
+}
+
+static void runCycle( void );
+
+// code outside the FIQ handler is interrupted as soon as the next FIQ is due
+static void preempt( void )
+{
+	if ( !inHandler )
+		while ( cycleIndex * simConfig.phi2Cycle + simConfig.fiqLatency <= now )
+			runCycle();
+}
+
+//
+// MMIO, called via read32/write32
+//
+u32 simRead32( uintptr nAddress )
+{
+	double sample = now + simConfig.readSample;
+	now += simConfig.readCost;
+
+	if ( nAddress == ARM_GPIO_GPLEV0 )
+	{
+		flushPending( sample );
+		u32 g = readLevels( sample );
+		preempt();
+		return g;
+	}
+
+	preempt();
+
+	if ( nAddress >= ARM_GPIO_GPFSEL0 && nAddress < ARM_GPIO_GPFSEL0 + 24 )
+		return fselShadow[ ( nAddress - ARM_GPIO_GPFSEL0 ) / 4 ];
+
+	// everything else (e.g. PWM status) reads as 0
+	return 0;
+}
+
+void simWrite32( uintptr nAddress, u32 nValue )
+{
+	u32 reg;
+
+	if ( nAddress == ARM_GPIO_GPSET0 ) reg = REG_SET; else
+	if ( nAddress == ARM_GPIO_GPCLR0 ) reg = REG_CLR; else
+	if ( nAddress >= ARM_GPIO_GPFSEL0 && nAddress < ARM_GPIO_GPFSEL0 + 24 )
+	{
+		reg = REG_FSEL + ( nAddress - ARM_GPIO_GPFSEL0 ) / 4;
+		fselShadow[ reg - REG_FSEL ] = nValue;
+	} else
+	{
+		now += simConfig.writeCost;
+		preempt();
+		return;
+	}
+
+	u32 next = ( pendingLast + 1 ) % MAX_PENDING;
+	if ( next == pendingFirst )
+		flushPending( 1e300 );
+
+	pending[ pendingLast ].t = now + simConfig.writeLatency;
+	pending[ pendingLast ].reg = reg;
+	pending[ pendingLast ].value = nValue;
+	pendingLast = ( pendingLast + 1 ) % MAX_PENDING;
+
+	now += simConfig.writeCost;
+	preempt();
+}
+
+u32 simReadCycleCounter()
+{
+	now += simConfig.counterCost * 1e9 / simConfig.armClock;
+	u32 cc = (u32)(u64)( now * simConfig.armClock * 1e-9 );
+	preempt();
+	return cc;
+}
+
+void simCachePreload( const void *ptr )
+{
+	now += 1e9 / simConfig.armClock;
+	preempt();
+}
+
+void simConnectFIQ( TGPIOInterruptHandler *pHandler, void *pParam )
+{
+	fiqHandler = pHandler;
+	fiqParam = pParam;
+}
+
+void simEnableFIQ( boolean bEnable )
+{
+	fiqEnabled = bEnable;
+}
+
+double simTime( void )
+{
+	return now;
+}
+
+//
+// checks the bus cycle after the FIQ handler (and the main loop) finished with it
+//
+static void evaluateCycle( const BUS_CYCLE &c, double T2 )
+{
+	flushPending( T2 + simConfig.fiqLatency );
+
+	double fall = c.T + simConfig.phi2High;
+	double releaseLimit = fall + simConfig.releaseLatest;
+	int selected = isSelected( c );
+
+	// find the state at PHI2 falling
+	int f = -1;
+	for ( u32 i = 0; i < nHistory; i++ )
+		if ( history[ i ].t <= fall ) f = i;
+
+	int driven = 0, value = -1;
+	double stableFrom = c.T, stableUntil = 1e300, releaseAt = 1e300;
+
+	if ( f >= 0 && history[ f ].oeLow )
+	{
+		driven = 1;
+		const BUS_STATE &s = history[ f ];
+
+		if ( s.outD ) 
+		{
+			value = s.d;
+
+			// data must be stable from (PHI2 falling - setup) ...
+			int j = f;
+			while ( j > 0 && history[ j - 1 ].oeLow && history[ j - 1 ].outD && history[ j - 1 ].d == s.d ) j --;
+			stableFrom = history[ j ].t;
+
+			// ... to (PHI2 falling + hold)
+			j = f;
+			while ( j + 1 < (int)nHistory && history[ j + 1 ].oeLow && history[ j + 1 ].outD && history[ j + 1 ].d == s.d ) j ++;
+			if ( j + 1 < (int)nHistory ) stableUntil = history[ j + 1 ].t;
+		}
+
+		for ( u32 i = f + 1; i < nHistory; i++ )
+			if ( !history[ i ].oeLow ) { releaseAt = history[ i ].t; break; }
+	}
+
+	// the bus is driven by the 74LVC245 whenever OE is low and the CPU reads
+	int conflict = 0, lateRelease = 0;
+	for ( u32 i = 0; i < nHistory; i++ )
+	{
+		double a = history[ i ].t, b = ( i + 1 < nHistory ) ? history[ i + 1 ].t : 1e300;
+		if ( a < c.T ) a = c.T;
+		if ( b > T2 ) b = T2;
+		if ( a >= b || !history[ i ].oeLow ) continue;
+
+		if ( c.rw && !selected && a < releaseLimit ) conflict = 1;
+		if ( !c.rw && history[ i ].outD && a < fall + simConfig.dataHold ) violation( V_WRITE_CONFLICT, c, a );
+		if ( b > releaseLimit ) lateRelease = 1;
+	}
+
+	if ( conflict ) violation( V_BUS_CONFLICT, c, c.T );
+
+	if ( c.rw && driven && selected )
+	{
+		if ( value < 0 )
+			violation( V_NO_DATA, c, fall ); else
+		{
+			double setup = fall - simConfig.dataSetup - stableFrom;
+			double hold = ( stableUntil < releaseAt ? stableUntil : releaseAt ) - fall - simConfig.dataHold;
+			double release = releaseLimit - releaseAt;
+
+			if ( setup < 0.0 ) violation( V_LATE_DATA, c, stableFrom );
+			if ( hold < 0.0 ) violation( V_EARLY_RELEASE, c, fall + simConfig.dataHold + hold );
+
+			if ( setup < minSetupMargin ) minSetupMargin = setup;
+			if ( hold < minHoldMargin ) minHoldMargin = hold;
+			if ( release < minReleaseMargin ) minReleaseMargin = release;
+
+			SELECT sel;
+			decode( c, sel );
+			u32 k = sel.roml ? DV_ROML : sel.romh ? DV_ROMH : sel.io1 ? DV_IO1 : sel.io2 ? DV_IO2 : DV_CS;
+			double t = stableFrom - c.T;
+			if ( dataValid[ k ].n == 0 || t < dataValid[ k ].min ) dataValid[ k ].min = t;
+			if ( dataValid[ k ].n == 0 || t > dataValid[ k ].max ) dataValid[ k ].max = t;
+			dataValid[ k ].sum += t;
+			dataValid[ k ].n ++;
+		}
+
+		if ( verbose )
+			fprintf( stderr, "[bussim] cycle %llu: r $%04x -> $%02x, stable at %.1f ns, released at %.1f ns\n", 
+				(unsigned long long)c.index, c.addr, value & 255, stableFrom - c.T, releaseAt - c.T );
+	}
+
+	if ( lateRelease ) violation( V_LATE_RELEASE, c, releaseLimit );
+
+	if ( c.rw && c.expect )
+	{
+		nChecked ++;
+		if ( !driven || value != c.data )
+		{
+			nMismatch ++;
+			if ( nReported ++ < 50 )
+			{
+				if ( driven && value >= 0 )
+					fprintf( stderr, "[bussim] script line %u: r $%04x returned $%02x, expected $%02x\n", c.line, c.addr, value, c.data ); else
+					fprintf( stderr, "[bussim] script line %u: r $%04x returned nothing, expected $%02x\n", c.line, c.addr, c.data );
+			}
+		}
+	}
+
+	// keep the last state before the next cycle
+	u32 k = 0;
+	while ( k + 1 < nHistory && history[ k + 1 ].t <= T2 ) k ++;
+	if ( k > 0 )
+	{
+		memmove( &history[ 0 ], &history[ k ], sizeof( BUS_STATE ) * ( nHistory - k ) );
+		nHistory -= k;
+	}
+}
+
+static int nextOp( BUS_CYCLE &c )
+{
+	c.addr = 0x0800;
+	c.rw = 1;
+	c.data = 0;
+	c.expect = 0;
+	c.reset = 0;
+	c.line = 0;
+
+	// no bus activity for the kernel until its FIQ handler is installed
+	if ( !fiqHandler || !fiqEnabled )
+		return 1;
+
+	while ( curOp < nOps && curOpCount >= script[ curOp ].count )
+	{
+		curOp ++;
+		curOpCount = 0;
+	}
+
+	if ( curOp >= nOps )
+		return 0;
+
+	const BUS_OP &op = script[ curOp ];
+	curOpCount ++;
+
+	c.line = op.line;
+	switch ( op.type )
+	{
+	case OP_READ:	c.addr = op.addr; c.data = op.data; c.expect = op.expect; break;
+	case OP_WRITE:	c.addr = op.addr; c.data = op.data; c.rw = 0; break;
+	case OP_RESET:	c.reset = 1; break;
+	}
+	return 1;
+}
+
+static void runCycle( void )
+{
+	if ( inHandler )
+		return;
+
+	double T = cycleIndex * simConfig.phi2Cycle;
+
+	if ( cycleValid )
+		evaluateCycle( cur, T );
+
+	prev = cur;
+
+	if ( !nextOp( cur ) )
+		simFinish();
+
+	cur.index = cycleIndex ++;
+	cur.T = T;
+	cycleValid = 1;
+	nCycles ++;
+
+	if ( !fiqHandler || !fiqEnabled )
+		return;
+
+	// the previous handler is still running
+	if ( handlerEnd > T + simConfig.fiqLatency )
+		violation( V_OVERRUN, prev, handlerEnd );
+
+	double start = T + simConfig.fiqLatency;
+	if ( now < start ) now = start;
+
+	double fiqStart = now;
+	inHandler = 1;
+	fiqHandler( fiqParam );
+	inHandler = 0;
+	handlerEnd = now;
+	nFIQ ++;
+
+	double cycles = ( handlerEnd - fiqStart ) * simConfig.armClock * 1e-9;
+	handlerCyclesSum += cycles;
+	if ( cycles > handlerCyclesMax ) handlerCyclesMax = cycles;
+}
+
+void simAdvanceTo( double t )
+{
+	while ( cycleIndex * simConfig.phi2Cycle + simConfig.fiqLatency <= t )
+		runCycle();
+	if ( now < t ) now = t;
+}
+
+void simWaitForInterrupt()
+{
+	simAdvanceTo( cycleIndex * simConfig.phi2Cycle + simConfig.fiqLatency );
+}
+
+static u32 findEvent( const char *name )
+{
+	u32 i;
+	for ( i = 0; i < nEvents; i++ )
+		if ( !strcmp( events[ i ].name, name ) )
+			return i;
+
+	if ( nEvents == MAX_EVENTS )
+		return MAX_EVENTS;
+
+	snprintf( events[ i ].name, sizeof( events[ i ].name ), "%s", name );
+	return nEvents ++;
+}
+
+void simCountEvent( const char *name )
+{
+	u32 i = findEvent( name );
+	if ( i < MAX_EVENTS )
+		events[ i ].count ++;
+}
+
+void simFail( const char *reason )
+{
+	if ( !failure )
+		failure = reason;
+	simFinish();
+}
+
+void simFinish( void )
+{
+	u64 total = nMismatch;
+	for ( u32 i = 0; i < V_COUNT; i++ )
+		total += violations[ i ];
+
+	// a kernel which stops early (panic, halt) must not pass because it never saw the interesting cycles
+	if ( !failure && nChecked < nExpected )
+		failure = "not all expected reads have been checked";
+	for ( u32 i = 0; i < nEvents; i++ )
+		if ( !failure && events[ i ].count < events[ i ].expect )
+			failure = "expected events missing";
+	if ( failure )
+		total ++;
+
+	printf( "bus cycles          %llu\n", (unsigned long long)nCycles );
+	printf( "FIQ handler calls   %llu\n", (unsigned long long)nFIQ );
+	if ( nFIQ )
+		printf( "handler ARM cycles  max %.0f, avg %.1f\n", handlerCyclesMax, handlerCyclesSum / nFIQ );
+	if ( minSetupMargin < 1e9 )
+		printf( "read margins (ns)   setup %.1f, hold %.1f, release %.1f\n", minSetupMargin, minHoldMargin, minReleaseMargin );
+	if ( minSampleMargin < 1e9 )
+		printf( "write margin (ns)   %.1f\n", minSampleMargin );
+	for ( u32 i = 0; i < DV_COUNT; i++ )
+		if ( dataValid[ i ].n )
+			printf( "data valid %-4s (ns) min %.1f, avg %.1f, max %.1f (%llu reads)\n", dataValidNames[ i ],
+				dataValid[ i ].min, dataValid[ i ].sum / dataValid[ i ].n, dataValid[ i ].max, (unsigned long long)dataValid[ i ].n );
+	printf( "checked reads       %llu of %llu (%llu mismatches)\n", (unsigned long long)nChecked, (unsigned long long)nExpected, (unsigned long long)nMismatch );
+	for ( u32 i = 0; i < nEvents; i++ )
+		printf( "event %-13s %llu (expected %llu)\n", events[ i ].name, (unsigned long long)events[ i ].count, (unsigned long long)events[ i ].expect );
+	if ( failure )
+		printf( "failure             %s\n", failure );
+
+	for ( u32 i = 0; i < V_COUNT; i++ )
+		if ( violations[ i ] )
+			printf( "violation           %s: %llu\n", violationNames[ i ], (unsigned long long)violations[ i ] );
+
+	printf( total ? "FAILED\n" : "OK\n" );
+	fflush( stdout );
+	exit( total ? 1 : 0 );
+}
+
+//
+// script parser
+//
+static int parseNumber( const char *s, double *v )
+{
+	char *end;
+	if ( s[ 0 ] == '$' )
+		*v = (double)strtoul( s + 1, &end, 16 ); else
+		*v = strtod( s, &end );
+	return end != s && *end == 0;
+}
+
+static int loadScript( const char *name )
+{
+	FILE *f = fopen( name, "r" );
+	if ( !f )
+	{
+		fprintf( stderr, "[bussim] cannot open %s\n", name );
+		return 0;
+	}
+
+	char line[ 256 ];
+	u32 lineNr = 0;
+	int ok = 1;
+
+	while ( ok && fgets( line, sizeof( line ), f ) )
+	{
+		lineNr ++;
+
+		char *hash = strchr( line, '#' );
+		if ( hash ) *hash = 0;
+
+		char *tok[ 4 ];
+		int n = 0;
+		for ( char *t = strtok( line, " \t\r\n=" ); t && n < 4; t = strtok( 0, " \t\r\n=" ) )
+			tok[ n ++ ] = t;
+
+		if ( n == 0 )
+			continue;
+
+		if ( nOps == MAX_OPS )
+		{
+			fprintf( stderr, "[bussim] %s: too many commands\n", name );
+			ok = 0;
+			break;
+		}
+
+		BUS_OP &op = script[ nOps ];
+		memset( &op, 0, sizeof( BUS_OP ) );
+		op.count = 1;
+		op.line = lineNr;
+
+		double v[ 3 ] = { 0, 0, 0 };
+		for ( int i = 1; i < n && i < 4; i++ )
+			if ( strcmp( tok[ 0 ], "set" ) && strcmp( tok[ 0 ], "expect" ) && !parseNumber( tok[ i ], &v[ i - 1 ] ) )
+				ok = 0;
+
+		if ( !strcmp( tok[ 0 ], "r" ) && ( n == 2 || n == 3 ) )
+		{
+			op.type = OP_READ;
+			op.addr = (u16)v[ 0 ];
+			op.data = (u8)v[ 1 ];
+			op.expect = n == 3;
+			nExpected += op.expect;
+			nOps ++;
+		} else
+		if ( !strcmp( tok[ 0 ], "w" ) && n == 3 )
+		{
+			op.type = OP_WRITE;
+			op.addr = (u16)v[ 0 ];
+			op.data = (u8)v[ 1 ];
+			nOps ++;
+		} else
+		if ( ( !strcmp( tok[ 0 ], "idle" ) || !strcmp( tok[ 0 ], "reset" ) ) && n == 2 )
+		{
+			op.type = tok[ 0 ][ 0 ] == 'i' ? OP_IDLE : OP_RESET;
+			op.count = (u32)v[ 0 ];
+			nOps ++;
+		} else
+		if ( !strcmp( tok[ 0 ], "expect" ) && n == 3 )
+		{
+			u32 i = findEvent( tok[ 1 ] );
+			if ( i == MAX_EVENTS || !parseNumber( tok[ 2 ], &v[ 0 ] ) )
+				ok = 0; else
+				events[ i ].expect = (u64)v[ 0 ];
+		} else
+		if ( !strcmp( tok[ 0 ], "set" ) && n == 3 )
+		{
+			u32 i;
+			for ( i = 0; i < sizeof( configNames ) / sizeof( configNames[ 0 ] ); i++ )
+				if ( !strcmp( tok[ 1 ], configNames[ i ].name ) && parseNumber( tok[ 2 ], configNames[ i ].value ) )
+					break;
+			if ( i == sizeof( configNames ) / sizeof( configNames[ 0 ] ) )
+				ok = 0;
+		} else
+			ok = 0;
+
+		if ( !ok )
+			fprintf( stderr, "[bussim] %s:%u: syntax error\n", name, lineNr );
+	}
+
+	fclose( f );
+	return ok;
+}
+
+extern int kernel_main( void );
+
+int main( int argc, char **argv )
+{
+	const char *scriptName = 0;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !strcmp( argv[ i ], "-v" ) )
+			verbose = 1; else
+		if ( !strcmp( argv[ i ], "-sd" ) && i + 1 < argc )
+			simSDPath = argv[ ++ i ]; else
+			scriptName = argv[ i ];
+	}
+
+	if ( !scriptName )
+	{
+		fprintf( stderr, "usage: %s [-v] [-sd directory] script.bus\n", argv[ 0 ] );
+		return 2;
+	}
+
+	if ( !loadScript( scriptName ) )
+		return 2;
+
+	// GPIOs power up as inputs, outputs are high
+	memset( fsel, 0, sizeof( fsel ) );
+	memset( fselShadow, 0, sizeof( fselShadow ) );
+	gpioOut = 0xffffffff & ~( 1 << DIR_CTRL_257 );
+	history[ 0 ] = busState();
+	nHistory = 1;
+
+	kernel_main();
+
+	simFinish();
+	return 0;
+}
@@ -0,0 +1,74 @@
+//
+// bussim.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _bussim_h
+#define _bussim_h
+
+#include <circle/types.h>
+
+//
+// cycle-level simulation of the C64 expansion port as seen by a RasPIC64 kernel running on the host:
+// the kernel's FIQ handler is called once per PHI2 cycle, GPIO reads/writes are timestamped with a simple cost model,
+// and the resulting bus timing is checked against the 6510 requirements
+//
+// all times are in nanoseconds relative to the rising edge of PHI2 unless stated otherwise
+//
+typedef struct
+{
+	// ARM clock, the cycle counter is derived from the simulated time
+	double armClock;
+	// delay from PHI2 rising to the first instruction of the FIQ handler
+	double fiqLatency;
+	// a GPIO read takes this long, the levels are sampled after readSample
+	double readCost, readSample;
+	// a GPIO write takes writeCost (CPU side), the pins change after writeLatency
+	double writeCost, writeLatency;
+	// one iteration of a busy waiting loop (reading the cycle counter), in ARM cycles
+	double counterCost;
+
+	// external logic: 74LVC257 multiplexer switching, 74LVC245 enable/disable, PLA output delay
+	double muxDelay, bufferDelay, plaDelay;
+
+	// PHI2 cycle and high phase
+	double phi2Cycle, phi2High;
+	// CPU write cycles: data valid after dataValid, held until PHI2 falling + dataHold
+	double dataValid, dataHold;
+	// CPU read cycles: data must be stable dataSetup before PHI2 falling, and held until PHI2 falling + dataHold,
+	// the bus must be released before PHI2 falling + releaseLatest (when the VIC needs it)
+	double dataSetup, releaseLatest;
+} SIM_CONFIG;
+
+extern SIM_CONFIG simConfig;
+
+// directory used for "SD:"
+extern const char *simSDPath;
+
+// current simulated time (ns since start)
+extern double simTime( void );
+
+// lets simulated time pass until the given time, running the FIQ handler for every PHI2 cycle
+extern void simAdvanceTo( double t );
+
+// prints the report and terminates the simulation
+extern void simFinish( void );
+
+// terminates the simulation as failed (e.g. on a kernel panic), even if the bus timing was fine
+extern void simFail( const char *reason );
+
+#endif
@@ -0,0 +1,126 @@
+//
+// cachesim.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <string.h>
+#include "cachesim.h"
+
+typedef struct
+{
+	u32 sets, ways;
+	u64 *tag;			// line address + 1 (0 = empty), sets * ways
+	u64 *age;			// last use
+} CACHE_LEVEL;
+
+static u64 l1Tag[ CACHESIM_L1_SIZE / CACHESIM_LINE ], l2Tag[ CACHESIM_L2_SIZE / CACHESIM_LINE ];
+static u64 l1Age[ CACHESIM_L1_SIZE / CACHESIM_LINE ], l2Age[ CACHESIM_L2_SIZE / CACHESIM_LINE ];
+
+static CACHE_LEVEL l1 = { CACHESIM_L1_SIZE / CACHESIM_LINE / CACHESIM_L1_WAYS, CACHESIM_L1_WAYS, l1Tag, l1Age };
+static CACHE_LEVEL l2 = { CACHESIM_L2_SIZE / CACHESIM_LINE / CACHESIM_L2_WAYS, CACHESIM_L2_WAYS, l2Tag, l2Age };
+
+static boolean active = FALSE;
+static u64 now;
+static CACHESIM_COUNTS counts;
+
+// returns TRUE on a hit, otherwise the least recently used way is refilled
+static boolean lookup( CACHE_LEVEL &c, u64 line )
+{
+	u32 set = (u32)( line % c.sets ) * c.ways;
+	u64 *tag = &c.tag[ set ];
+	u64 *age = &c.age[ set ];
+
+	u32 victim = 0;
+	for ( u32 w = 0; w < c.ways; w++ )
+	{
+		if ( tag[ w ] == line + 1 )
+		{
+			age[ w ] = now;
+			return TRUE;
+		}
+		if ( age[ w ] < age[ victim ] || !tag[ w ] )
+			victim = w;
+	}
+
+	tag[ victim ] = line + 1;
+	age[ victim ] = now;
+	return FALSE;
+}
+
+static void access( const void *addr, u32 size )
+{
+	if ( !active )
+		return;
+
+	u64 first = (u64)(uintptr)addr / CACHESIM_LINE, last = ( (u64)(uintptr)addr + size - 1 ) / CACHESIM_LINE;
+	for ( u64 line = first; line <= last; line++ )
+	{
+		now ++;
+		counts.accesses ++;
+		if ( lookup( l1, line ) )
+			continue;
+		counts.l1Refills ++;
+		if ( !lookup( l2, line ) )
+			counts.l2Refills ++;
+	}
+}
+
+void cacheSimStart()
+{
+	memset( l1Tag, 0, sizeof( l1Tag ) );
+	memset( l2Tag, 0, sizeof( l2Tag ) );
+	memset( l1Age, 0, sizeof( l1Age ) );
+	memset( l2Age, 0, sizeof( l2Age ) );
+	memset( &counts, 0, sizeof( counts ) );
+	now = 0;
+	active = TRUE;
+}
+
+void cacheSimStop( CACHESIM_COUNTS *c )
+{
+	active = FALSE;
+	*c = counts;
+}
+
+//
+// the hooks called by code compiled with -fsanitize=thread (the runtime is not linked)
+//
+extern "C"
+{
+void __tsan_init() {}
+void __tsan_func_entry( void *pc ) {}
+void __tsan_func_exit() {}
+void __tsan_vptr_update( void **vptr, void *value ) { access( vptr, sizeof( void * ) ); }
+void __tsan_vptr_read( void **vptr ) { access( vptr, sizeof( void * ) ); }
+
+#define CACHESIM_HOOKS( n ) \
+	void __tsan_read##n( void *addr ) { access( addr, n ); } \
+	void __tsan_write##n( void *addr ) { access( addr, n ); } \
+	void __tsan_unaligned_read##n( void *addr ) { access( addr, n ); } \
+	void __tsan_unaligned_write##n( void *addr ) { access( addr, n ); } \
+	void __tsan_volatile_read##n( void *addr ) { access( addr, n ); } \
+	void __tsan_volatile_write##n( void *addr ) { access( addr, n ); }
+
+CACHESIM_HOOKS( 1 )
+CACHESIM_HOOKS( 2 )
+CACHESIM_HOOKS( 4 )
+CACHESIM_HOOKS( 8 )
+CACHESIM_HOOKS( 16 )
+
+void __tsan_read_range( void *addr, unsigned long size ) { access( addr, (u32)size ); }
+void __tsan_write_range( void *addr, unsigned long size ) { access( addr, (u32)size ); }
+}
@@ -0,0 +1,52 @@
+//
+// cachesim.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _cachesim_h
+#define _cachesim_h
+
+#include <circle/types.h>
+
+//
+// model of the data caches of the Cortex-A53 of the RPi 3 (L1D 32k 4-way, L2 512k 16-way, 64 byte lines, LRU) for 
+// counting refills on the host, where the PMU is not available: code compiled with -fsanitize=thread calls
+// __tsan_readN/__tsan_writeN for every load and store, cachesim.cpp implements these hooks instead of the ThreadSanitizer 
+// runtime (see "make sidrender-cache")
+//
+// the model sees the host's memory layout (64-bit pointers, x86 alignment) and ignores the stack accesses the compiler
+// does not instrument, i.e. the numbers are comparable with each other, not with those of the PMU
+//
+#define CACHESIM_LINE		64
+#define CACHESIM_L1_SIZE	( 32 * 1024 )
+#define CACHESIM_L1_WAYS	4
+#define CACHESIM_L2_SIZE	( 512 * 1024 )
+#define CACHESIM_L2_WAYS	16
+
+typedef struct
+{
+	u64 accesses;
+	u64 l1Refills;
+	u64 l2Refills;
+} CACHESIM_COUNTS;
+
+// starts counting with empty caches
+extern void cacheSimStart();
+// stops counting and returns the counts since cacheSimStart
+extern void cacheSimStop( CACHESIM_COUNTS *c );
+
+#endif
@@ -0,0 +1,175 @@
+//
+// circle_host.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <circle/startup.h>
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/cputhrottle.h>
+#include <fatfs/ff.h>
+#include "bussim.h"
+
+//
+// host implementations of the few Circle and FatFs functions used by the kernels
+//
+void CLogger::Write( const char *pSource, TLogSeverity Severity, const char *pMessage, ... )
+{
+	static const char *severity[] = { "panic", "error", "warning", "notice", "debug" };
+
+	va_list var;
+	va_start( var, pMessage );
+	fprintf( stderr, "%10.3f ms %s (%s): ", simTime() * 1e-6, pSource, severity[ Severity ] );
+	vfprintf( stderr, pMessage, var );
+	fprintf( stderr, "\n" );
+	va_end( var );
+
+	if ( Severity == LogPanic )
+		simFail( "kernel panic" );
+}
+
+unsigned CTimer::GetClockTicks( void ) const
+{
+	// polling the timer lets at least one bus cycle pass
+	simAdvanceTo( simTime() + 1000.0 );
+	return (unsigned)(u64)( simTime() * 1e-3 );
+}
+
+void CTimer::SimpleusDelay( unsigned nMicroSeconds )
+{
+	simAdvanceTo( simTime() + nMicroSeconds * 1000.0 );
+}
+
+unsigned CCPUThrottle::GetClockRate( void ) const
+{
+	return (unsigned)simConfig.armClock;
+}
+
+void halt( void )
+{
+	simFinish();
+}
+
+void reboot( void )
+{
+	simFinish();
+}
+
+//
+// FatFs on top of stdio, "SD:" is mapped to simSDPath
+//
+static void hostPath( const char *path, char *buf, u32 size )
+{
+	if ( !strncmp( path, "SD:", 3 ) )
+		path += 3;
+	while ( *path == '/' ) path ++;
+	snprintf( buf, size, "%s/%s", simSDPath, path );
+}
+
+FRESULT f_mount( FATFS *fs, const char *path, BYTE opt )
+{
+	if ( fs ) fs->mounted = 1;
+	return FR_OK;
+}
+
+FRESULT f_open( FIL *fp, const char *path, BYTE mode )
+{
+	char name[ 1024 ];
+	hostPath( path, name, sizeof( name ) );
+
+	const char *m;
+	if ( !( mode & FA_WRITE ) ) m = "rb"; else
+	if ( ( mode & FA_OPEN_APPEND ) == FA_OPEN_APPEND ) m = "ab"; else
+	if ( mode & FA_CREATE_ALWAYS ) m = ( mode & FA_READ ) ? "w+b" : "wb"; else
+		m = "r+b";
+
+	fp->fp = fopen( name, m );
+
+	// FA_OPEN_ALWAYS creates the file if it does not exist
+	if ( !fp->fp && ( mode & FA_OPEN_ALWAYS ) )
+		fp->fp = fopen( name, "w+b" );
+
+	if ( !fp->fp )
+		return FR_NO_FILE;
+
+	fseek( fp->fp, 0, SEEK_END );
+	fp->obj_size = (FSIZE_t)ftell( fp->fp );
+	fseek( fp->fp, 0, SEEK_SET );
+	fp->fptr = 0;
+	return FR_OK;
+}
+
+FRESULT f_close( FIL *fp )
+{
+	if ( !fp->fp ) return FR_INT_ERR;
+	int r = fclose( fp->fp );
+	fp->fp = 0;
+	return r == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_read( FIL *fp, void *buff, UINT btr, UINT *br )
+{
+	*br = (UINT)fread( buff, 1, btr, fp->fp );
+	fp->fptr += *br;
+	return ferror( fp->fp ) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_write( FIL *fp, const void *buff, UINT btw, UINT *bw )
+{
+	*bw = (UINT)fwrite( buff, 1, btw, fp->fp );
+	fp->fptr += *bw;
+	if ( fp->fptr > fp->obj_size ) fp->obj_size = fp->fptr;
+	return ferror( fp->fp ) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_lseek( FIL *fp, FSIZE_t ofs )
+{
+	if ( fseek( fp->fp, ofs, SEEK_SET ) ) return FR_DISK_ERR;
+	fp->fptr = ofs;
+	if ( ofs > fp->obj_size ) fp->obj_size = ofs;
+	return FR_OK;
+}
+
+FRESULT f_sync( FIL *fp )
+{
+	return fflush( fp->fp ) == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_stat( const char *path, FILINFO *fno )
+{
+	FIL f;
+	if ( f_open( &f, path, FA_READ ) != FR_OK )
+		return FR_NO_FILE;
+	if ( fno )
+	{
+		fno->fsize = f.obj_size;
+		strncpy( fno->fname, path, sizeof( fno->fname ) - 1 );
+		fno->fname[ sizeof( fno->fname ) - 1 ] = 0;
+	}
+	return f_close( &f );
+}
+
+FRESULT f_unlink( const char *path )
+{
+	char name[ 1024 ];
+	hostPath( path, name, sizeof( name ) );
+	return remove( name ) == 0 ? FR_OK : FR_NO_FILE;
+}
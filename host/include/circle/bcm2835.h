@@ -0,0 +1,45 @@
+//
+// bcm2835.h (host replacement of Circle's header) part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_bcm2835_h
+#define _circle_bcm2835_h
+
+#define ARM_IO_BASE			0x3F000000
+
+#define ARM_GPIO_BASE		(ARM_IO_BASE + 0x200000)
+#define ARM_GPIO_GPFSEL0	(ARM_GPIO_BASE + 0x00)
+#define ARM_GPIO_GPFSEL1	(ARM_GPIO_BASE + 0x04)
+#define ARM_GPIO_GPSET0		(ARM_GPIO_BASE + 0x1C)
+#define ARM_GPIO_GPCLR0		(ARM_GPIO_BASE + 0x28)
+#define ARM_GPIO_GPLEV0		(ARM_GPIO_BASE + 0x34)
+
+#define ARM_PWM_BASE		(ARM_IO_BASE + 0x20C000)
+#define ARM_PWM_CTL			(ARM_PWM_BASE + 0x00)
+#define ARM_PWM_STA			(ARM_PWM_BASE + 0x04)
+#define ARM_PWM_DMAC		(ARM_PWM_BASE + 0x08)
+#define ARM_PWM_RNG1		(ARM_PWM_BASE + 0x10)
+#define ARM_PWM_DAT1		(ARM_PWM_BASE + 0x14)
+#define ARM_PWM_FIF1		(ARM_PWM_BASE + 0x18)
+#define ARM_PWM_RNG2		(ARM_PWM_BASE + 0x20)
+#define ARM_PWM_DAT2		(ARM_PWM_BASE + 0x24)
+
+#define CLOCKHZ				1000000
+#define HZ					100
+
+#endif
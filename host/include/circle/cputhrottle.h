@@ -0,0 +1,50 @@
+//
+// cputhrottle.h (host replacement of Circle's header) part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_cputhrottle_h
+#define _circle_cputhrottle_h
+
+#include <circle/types.h>
+
+enum TCPUSpeed
+{
+	CPUSpeedLow,
+	CPUSpeedMaximum,
+	CPUSpeedUnknown
+};
+
+// the simulated ARM clock is set in the bus script ("set armclock ...")
+class CCPUThrottle
+{
+public:
+	CCPUThrottle( TCPUSpeed InitialSpeed = CPUSpeedUnknown ) {}
+
+	boolean IsDynamic( void ) const { return FALSE; }
+	unsigned GetClockRate( void ) const;
+	unsigned GetMinClockRate( void ) const { return GetClockRate(); }
+	unsigned GetMaxClockRate( void ) const { return GetClockRate(); }
+	unsigned GetTemperature( void ) const { return 50; }
+	unsigned GetMaxTemperature( void ) const { return 85; }
+	TCPUSpeed SetSpeed( TCPUSpeed Speed, boolean bWait = TRUE ) { return CPUSpeedMaximum; }
+	boolean SetOnTemperature( void ) { return TRUE; }
+	boolean Update( void ) { return TRUE; }
+	void DumpStatus( boolean bAll = TRUE ) {}
+};
+
+#endif
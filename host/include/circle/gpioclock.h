@@ -0,0 +1,43 @@
+//
+// gpioclock.h (host replacement of Circle's header) part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_gpioclock_h
+#define _circle_gpioclock_h
+
+enum TGPIOClock
+{
+	GPIOClockPWM
+};
+
+enum TGPIOClockSource
+{
+	GPIOClockSourcePLLD
+};
+
+class CGPIOClock
+{
+public:
+	CGPIOClock( TGPIOClock Clock, TGPIOClockSource Source ) {}
+	void Start( unsigned nDivI, unsigned nDivF = 0, unsigned nMASH = 0 ) {}
+};
+
+static inline void PeripheralEntry( void ) {}
+static inline void PeripheralExit( void ) {}
+
+#endif
@@ -0,0 +1,49 @@
+//
+// gpiopin.h (host replacement of Circle's header) part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_gpiopin_h
+#define _circle_gpiopin_h
+
+#include <circle/types.h>
+
+enum TGPIOMode
+{
+	GPIOModeInput,
+	GPIOModeOutput,
+	GPIOModeAlternateFunction0
+};
+
+enum TGPIOInterrupt
+{
+	GPIOInterruptOnRisingEdge,
+	GPIOInterruptOnFallingEdge
+};
+
+#define GPIOPinAudioLeft	40
+#define GPIOPinAudioRight	45
+
+typedef void TGPIOInterruptHandler( void *pParam );
+
+class CGPIOPin
+{
+public:
+	CGPIOPin( unsigned nPin, TGPIOMode Mode ) {}
+};
+
+#endif
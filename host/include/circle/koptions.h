@@ -0,0 +1,35 @@
+//
+// koptions.h (host replacement of Circle's header) part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_koptions_h
+#define _circle_koptions_h
+
+#include <circle/cputhrottle.h>
+#include <circle/logger.h>
+
+class CKernelOptions
+{
+public:
+	unsigned GetWidth( void ) const { return 0; }
+	unsigned GetHeight( void ) const { return 0; }
+	const char *GetLogDevice( void ) const { return "tty1"; }
+	unsigned GetLogLevel( void ) const { return LogDebug; }
+};
+
+#endif
@@ -0,0 +1,46 @@
+//
+// logger.h (host replacement of Circle's header) part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_logger_h
+#define _circle_logger_h
+
+#include <circle/device.h>
+#include <circle/timer.h>
+
+enum TLogSeverity
+{
+	LogPanic,
+	LogError,
+	LogWarning,
+	LogNotice,
+	LogDebug
+};
+
+// writes to stderr, LogPanic terminates the program
+class CLogger
+{
+public:
+	CLogger( unsigned nLogLevel, CTimer *pTimer = 0, boolean bOverwriteOldest = TRUE ) {}
+
+	boolean Initialize( CDevice *pTarget ) { return TRUE; }
+
+	void Write( const char *pSource, TLogSeverity Severity, const char *pMessage, ... );
+};
+
+#endif
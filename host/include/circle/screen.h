@@ -0,0 +1,42 @@
+//
+// screen.h (host replacement of Circle's header) part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_screen_h
+#define _circle_screen_h
+
+#include <circle/device.h>
+#include <circle/types.h>
+
+#define COLOR16(red, green, blue)	  (((red) & 0x1F) << 11 | ((green) & 0x1F) << 6 | ((blue) & 0x1F))
+typedef u16 TScreenColor;
+
+class CScreenDevice : public CDevice
+{
+public:
+	CScreenDevice( unsigned nWidth, unsigned nHeight, boolean bVirtual = FALSE ) {}
+
+	boolean Initialize( void ) { return TRUE; }
+
+	unsigned GetWidth( void ) const { return 640; }
+	unsigned GetHeight( void ) const { return 480; }
+
+	void SetPixel( unsigned nPosX, unsigned nPosY, TScreenColor Color ) {}
+};
+
+#endif
@@ -0,0 +1,82 @@
+//
+// ff.h (host replacement of the FatFs header, files are accessed via stdio) part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _fatfs_ff_h
+#define _fatfs_ff_h
+
+#include <stdio.h>
+
+typedef unsigned int	UINT;
+typedef unsigned char	BYTE;
+typedef unsigned int	DWORD;
+typedef DWORD			FSIZE_t;
+
+typedef struct
+{
+	int mounted;
+} FATFS;
+
+typedef struct
+{
+	FILE	*fp;
+	FSIZE_t	fptr;
+	FSIZE_t	obj_size;
+} FIL;
+
+typedef struct
+{
+	FSIZE_t	fsize;
+	char	fname[ 256 ];
+} FILINFO;
+
+typedef enum
+{
+	FR_OK = 0,
+	FR_DISK_ERR,
+	FR_INT_ERR,
+	FR_NOT_READY,
+	FR_NO_FILE,
+	FR_NO_PATH,
+	FR_INVALID_NAME,
+	FR_DENIED
+} FRESULT;
+
+#define FA_READ				0x01
+#define FA_WRITE			0x02
+#define FA_OPEN_EXISTING	0x00
+#define FA_CREATE_NEW		0x04
+#define FA_CREATE_ALWAYS	0x08
+#define FA_OPEN_ALWAYS		0x10
+#define FA_OPEN_APPEND		0x30
+
+// "SD:" refers to the directory given with -sd (default: current directory)
+FRESULT f_mount( FATFS *fs, const char *path, BYTE opt );
+FRESULT f_open( FIL *fp, const char *path, BYTE mode );
+FRESULT f_close( FIL *fp );
+FRESULT f_read( FIL *fp, void *buff, UINT btr, UINT *br );
+FRESULT f_write( FIL *fp, const void *buff, UINT btw, UINT *bw );
+FRESULT f_lseek( FIL *fp, FSIZE_t ofs );
+FRESULT f_sync( FIL *fp );
+FRESULT f_stat( const char *path, FILINFO *fno );
+FRESULT f_unlink( const char *path );
+
+#define f_size( fp )	( ( fp )->obj_size )
+#define f_tell( fp )	( ( fp )->fptr )
+
+#endif
@@ -0,0 +1,113 @@
+//
+// mkcrt.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// generates the .CRT files for the bus scripts in scripts/: every 8k chip of bank b loaded to address adr
+// contains ( offset * 7 + b * 16 + adr / 8192 ) & 255, i.e. the result of each read tells from where it has been served
+//
+// usage: mkcrt {easyflash|magicdesk|ocean|funplay|system3|dinamic|simonsbasic} file.crt
+//
+
+static const struct
+{
+	const char *name;
+	int type, exrom, game;
+	int banks;			// number of banks
+	int romh;			// 1 = ROML and ROMH for every bank, 0 = ROML only
+	int upperAtA000;	// banks from here on are stored with load address $a000 (ocean)
+} carts[] = {
+	{ "easyflash",   32, 1, 0, 64, 1, 0 },
+	{ "magicdesk",   19, 0, 1, 64, 0, 0 },
+	{ "ocean",        5, 0, 0, 32, 0, 16 },
+	{ "funplay",      7, 0, 1, 16, 0, 0 },
+	{ "system3",     15, 0, 1, 64, 0, 0 },
+	{ "dinamic",     17, 0, 1, 16, 0, 0 },
+	{ "simonsbasic",  4, 0, 0,  1, 1, 0 },
+};
+
+static void putU32( unsigned char *buf, unsigned v ) { buf[ 0 ] = v >> 24; buf[ 1 ] = v >> 16; buf[ 2 ] = v >> 8; buf[ 3 ] = v; }
+static void putU16( unsigned char *buf, unsigned v ) { buf[ 0 ] = v >> 8; buf[ 1 ] = v; }
+
+// chip type 0 = ROM, 2 = flash ROM
+static void writeChip( FILE *f, int type, int bank, int adr )
+{
+	unsigned char chip[ 16 + 8192 ];
+	memcpy( chip, "CHIP", 4 );
+	putU32( &chip[ 4 ], 16 + 8192 );
+	putU16( &chip[ 8 ], type );
+	putU16( &chip[ 10 ], bank );
+	putU16( &chip[ 12 ], adr );
+	putU16( &chip[ 14 ], 8192 );
+
+	for ( int i = 0; i < 8192; i++ )
+		chip[ 16 + i ] = ( i * 7 + bank * 16 + adr / 8192 ) & 255;
+
+	fwrite( chip, 1, sizeof( chip ), f );
+}
+
+int main( int argc, char **argv )
+{
+	int c = sizeof( carts ) / sizeof( carts[ 0 ] );
+	if ( argc == 3 )
+		for ( c = 0; c < (int)( sizeof( carts ) / sizeof( carts[ 0 ] ) ); c++ )
+			if ( !strcmp( argv[ 1 ], carts[ c ].name ) )
+				break;
+
+	if ( c == sizeof( carts ) / sizeof( carts[ 0 ] ) )
+	{
+		fprintf( stderr, "usage: %s {easyflash|magicdesk|ocean|funplay|system3|dinamic|simonsbasic} file.crt\n", argv[ 0 ] );
+		return 2;
+	}
+
+	FILE *f = fopen( argv[ 2 ], "wb" );
+	if ( !f )
+	{
+		fprintf( stderr, "mkcrt: cannot create %s\n", argv[ 2 ] );
+		return 1;
+	}
+
+	unsigned char header[ 64 ];
+	memset( header, 0, sizeof( header ) );
+	memcpy( header, "C64 CARTRIDGE   ", 16 );
+	putU32( &header[ 16 ], 64 );
+	putU16( &header[ 20 ], 0x0100 );
+	putU16( &header[ 22 ], carts[ c ].type );
+	header[ 24 ] = carts[ c ].exrom;
+	header[ 25 ] = carts[ c ].game;
+	snprintf( (char *)&header[ 32 ], 32, "RASPIC64 TEST %s", carts[ c ].name );
+	fwrite( header, 1, sizeof( header ), f );
+
+	int chipType = carts[ c ].type == 32 ? 2 : 0;
+	for ( int b = 0; b < carts[ c ].banks; b++ )
+	{
+		if ( carts[ c ].upperAtA000 && b >= carts[ c ].upperAtA000 )
+			writeChip( f, chipType, b, 0xa000 ); else
+			writeChip( f, chipType, b, 0x8000 );
+
+		if ( carts[ c ].romh )
+			writeChip( f, chipType, b, 0xa000 );
+	}
+
+	fclose( f );
+	return 0;
+}
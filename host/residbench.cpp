@@ -0,0 +1,256 @@
+//
+// residbench.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <thread>
+#include "resid/sid.h"
+#include "sidpipe.h"
+
+//
+// benchmark of the reSID clock kernels (SID::clock(delta_t) as used by sidengine.h): every register configuration is 
+// emulated with the generic code and with the specialized kernels from the same state, the outputs must be identical
+//
+// with -pipeline: SAMPLE_RESAMPLE with SID::clock( delta_t, buf, n ) vs. the two stages of sidpipe.h, once in turns on
+// one thread and once on two threads (producer and consumer), again with identical outputs
+//
+// usage: residbench [-cycles n] [-step cycles] [-runs n] [-pipeline]
+//
+
+using namespace reSID;
+
+typedef struct
+{
+	const char	*name;
+	u8			reg[ 25 ];
+} SID_SETUP;
+
+// voices: freq lo/hi, pw lo/hi, control, attack/decay, sustain/release; then fc lo/hi, res/filt, mode/vol
+static const SID_SETUP setups[] = {
+	{ "pulse+saw+tri, no filter",	{ 0x00, 0x12, 0x00, 0x08, 0x41, 0x09, 0xa8,  0x00, 0x09, 0x00, 0x04, 0x21, 0x22, 0xc6,  0x80, 0x04, 0x00, 0x00, 0x11, 0x00, 0xf0,  0x00, 0x00, 0x00, 0x0f } },
+	{ "lowpass voice 1",			{ 0x00, 0x12, 0x00, 0x08, 0x41, 0x09, 0xa8,  0x00, 0x09, 0x00, 0x04, 0x21, 0x22, 0xc6,  0x80, 0x04, 0x00, 0x00, 0x11, 0x00, 0xf0,  0x03, 0x40, 0xf1, 0x1f } },
+	{ "bandpass all voices",		{ 0x00, 0x12, 0x00, 0x08, 0x41, 0x09, 0xa8,  0x00, 0x09, 0x00, 0x04, 0x21, 0x22, 0xc6,  0x80, 0x04, 0x00, 0x00, 0x11, 0x00, 0xf0,  0x05, 0x60, 0x87, 0x2f } },
+	{ "hard sync voice 2",			{ 0x00, 0x12, 0x00, 0x08, 0x41, 0x09, 0xa8,  0x30, 0x2d, 0x00, 0x04, 0x23, 0x22, 0xc6,  0x80, 0x04, 0x00, 0x00, 0x11, 0x00, 0xf0,  0x03, 0x40, 0xf2, 0x1f } },
+	{ "ring modulation voice 3",	{ 0x00, 0x12, 0x00, 0x08, 0x41, 0x09, 0xa8,  0x00, 0x09, 0x00, 0x04, 0x21, 0x22, 0xc6,  0x13, 0x07, 0x00, 0x00, 0x15, 0x00, 0xf0,  0x00, 0x00, 0x00, 0x0f } },
+	{ "noise, highpass",			{ 0x00, 0x30, 0x00, 0x08, 0x81, 0x09, 0xa8,  0x00, 0x09, 0x00, 0x04, 0x21, 0x22, 0xc6,  0x80, 0x04, 0x00, 0x00, 0x11, 0x00, 0xf0,  0x07, 0x20, 0x41, 0x4f } },
+	{ "voices silent (digi)",		{ 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00,  0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00,  0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00,  0x00, 0x00, 0x00, 0x0f } },
+};
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// clocks in steps as the engine does, returns the time and a hash of the outputs
+static double run( SID *sid, u32 cycles, u32 step, u64 *hash )
+{
+	u64 h = 0xcbf29ce484222325ull;
+	double t0 = now();
+	for ( u32 c = 0; c < cycles; c += step )
+	{
+		sid->clock( step );
+		h = ( h ^ (u16)sid->output() ) * 0x100000001b3ull;
+	}
+	*hash = h;
+	return now() - t0;
+}
+
+#define HASH_INIT			0xcbf29ce484222325ull
+#define HASH( h, v )		( ( (h) ^ (u16)(v) ) * 0x100000001b3ull )
+
+// SAMPLE_RESAMPLE in one piece
+static double runResample( SID *sid, u32 cycles, u64 *hash )
+{
+	static short buf[ 1024 ];
+	u64 h = HASH_INIT;
+	double t0 = now();
+	cycle_count delta_t = cycles;
+	while ( delta_t > 0 )
+	{
+		int n = sid->clock( delta_t, buf, 1024 );
+		for ( int i = 0; i < n; i++ )
+			h = HASH( h, buf[ i ] );
+	}
+	*hash = h;
+	return now() - t0;
+}
+
+static SID_PIPE pipe;
+
+static void consume( u64 *h )
+{
+	s16 buf[ SIDPIPE_MAX_SAMPLES ];
+	u32 n;
+	while ( sidPipeDecimate( &pipe, buf, &n ) )
+		for ( u32 i = 0; i < n; i++ )
+			*h = HASH( *h, buf[ i ] );
+}
+
+// the stages of sidpipe.h: clocked in chunks of 'step' cycles, as the engine would, the consumer on its own thread or in turns
+static double runPipeline( SID *sid, u32 cycles, u32 step, boolean threaded, u64 *hash )
+{
+	sidPipeInit( &pipe, sid );
+	u64 h = HASH_INIT;
+	volatile boolean done = FALSE;
+
+	double t0 = now();
+	std::thread consumer;
+	if ( threaded )
+		consumer = std::thread( [ & ] { 
+			while ( !done ) 
+			{
+				if ( pipe.consumed == pipe.produced ) std::this_thread::yield();
+				consume( &h );
+			}
+			consume( &h );
+		} );
+
+	for ( u32 c = 0; c < cycles; c += step )
+	{
+		cycle_count delta_t = step;
+		while ( true )
+		{
+			sidPipeClock( &pipe, delta_t );
+			if ( delta_t == 0 ) break;
+			if ( threaded ) std::this_thread::yield(); else consume( &h );
+		}
+	}
+	while ( !sidPipeFlush( &pipe ) )
+		if ( threaded ) std::this_thread::yield(); else consume( &h );
+
+	if ( threaded )
+	{
+		done = TRUE;
+		consumer.join();
+	} else
+		consume( &h );
+
+	*hash = h;
+	return now() - t0;
+}
+
+static int benchPipeline( SID *sid, u32 cycles, u32 step, u32 runs )
+{
+	sid->set_sampling_parameters( 985248, SAMPLE_RESAMPLE, 44100 );
+	std::vector<u8> state( sid->raw_state_size() );
+
+	int failed = 0;
+	printf( "%-28s %5s %12s %12s %12s %8s\n", "configuration", "model", "resample", "2 stages", "pipelined", "speedup" );
+	for ( int model = 0; model < 2; model++ )
+		for ( u32 s = 0; s < sizeof( setups ) / sizeof( setups[ 0 ] ); s++ )
+		{
+			sid->set_chip_model( model ? MOS8580 : MOS6581 );
+			sid->reset();
+			for ( int r = 0; r < 25; r++ )
+				sid->write( r, setups[ s ].reg[ r ] );
+			sid->clock( 20000 );
+			sid->read_raw_state( state.data() );
+
+			double t[ 3 ] = { 1e9, 1e9, 1e9 };
+			u64 hash[ 3 ];
+			for ( u32 r = 0; r < runs; r++ )
+				for ( int k = 0; k < 3; k++ )
+				{
+					sid->write_raw_state( state.data() );
+					double d = k == 0 ? runResample( sid, cycles, &hash[ k ] ) : runPipeline( sid, cycles, step, k == 2, &hash[ k ] );
+					if ( d < t[ k ] ) t[ k ] = d;
+				}
+
+			boolean same = hash[ 0 ] == hash[ 1 ] && hash[ 0 ] == hash[ 2 ];
+			printf( "%-28s %5s %9.2f ns %9.2f ns %9.2f ns %7.2fx%s\n", setups[ s ].name, model ? "8580" : "6581",
+				t[ 0 ] * 1e9 / cycles, t[ 1 ] * 1e9 / cycles, t[ 2 ] * 1e9 / cycles, t[ 0 ] / t[ 2 ], same ? "" : "  MISMATCH" );
+			failed += !same;
+		}
+
+	printf( "ns per emulated cycle at 44100 Hz, clocked in steps of %u cycles, %u hardware threads\n", step, std::thread::hardware_concurrency() );
+	printf( failed ? "FAILED (%d outputs differ)\n" : "OK\n", failed );
+	return failed ? 1 : 0;
+}
+
+int main( int argc, char **argv )
+{
+	u32 cycles = 4000000, step = 2, runs = 3;
+	boolean pipeline = FALSE;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !strcmp( argv[ i ], "-cycles" ) && i + 1 < argc ) cycles = atoi( argv[ ++ i ] ); else
+		if ( !strcmp( argv[ i ], "-step" ) && i + 1 < argc ) step = atoi( argv[ ++ i ] ); else
+		if ( !strcmp( argv[ i ], "-runs" ) && i + 1 < argc ) runs = atoi( argv[ ++ i ] ); else
+		if ( !strcmp( argv[ i ], "-pipeline" ) ) pipeline = TRUE; else
+		{
+			fprintf( stderr, "usage: %s [-cycles n] [-step cycles] [-runs n] [-pipeline]\n", argv[ 0 ] );
+			return 2;
+		}
+	}
+	if ( step == 0 ) step = 1;
+	if ( runs == 0 ) runs = 1;
+
+	// one SID for all measurements: reSID recomputes its static tables for every new SID
+	SID *sid = new SID;
+
+	if ( pipeline )
+	{
+		int r = benchPipeline( sid, cycles, step, runs );
+		delete sid;
+		return r;
+	}
+
+	sid->set_sampling_parameters( 985248, SAMPLE_INTERPOLATE, 44100 );
+	std::vector<u8> state( sid->raw_state_size() );
+
+	int failed = 0;
+	printf( "%-28s %5s %12s %12s %8s\n", "configuration", "model", "generic", "kernel", "speedup" );
+	for ( int model = 0; model < 2; model++ )
+		for ( u32 s = 0; s < sizeof( setups ) / sizeof( setups[ 0 ] ); s++ )
+		{
+			sid->set_chip_model( model ? MOS8580 : MOS6581 );
+			sid->reset();
+			for ( int r = 0; r < 25; r++ )
+				sid->write( r, setups[ s ].reg[ r ] );
+			sid->clock( 20000 );	// let the envelopes rise
+			sid->read_raw_state( state.data() );
+
+			// best of several runs, each from the same state
+			double t[ 2 ] = { 1e9, 1e9 };
+			u64 hash[ 2 ];
+			for ( u32 r = 0; r < runs; r++ )
+				for ( int k = 0; k < 2; k++ )
+				{
+					sid->enable_clock_kernels( k == 1 );
+					sid->write_raw_state( state.data() );
+					double d = run( sid, cycles, step, &hash[ k ] );
+					if ( d < t[ k ] ) t[ k ] = d;
+				}
+
+			printf( "%-28s %5s %9.2f ns %9.2f ns %7.2fx%s\n", setups[ s ].name, model ? "8580" : "6581",
+				t[ 0 ] * 1e9 / cycles, t[ 1 ] * 1e9 / cycles, t[ 0 ] / t[ 1 ], hash[ 0 ] == hash[ 1 ] ? "" : "  MISMATCH" );
+			failed += hash[ 0 ] != hash[ 1 ];
+		}
+
+	delete sid;
+	printf( "ns per emulated cycle, clocked in steps of %u cycles\n", step );
+	printf( failed ? "FAILED (%d outputs differ)\n" : "OK\n", failed );
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+//
+// residcheck.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <circle/types.h>
+#include "resid/wave.h"
+#include "resid/dac.h"
+
+//
+// exhaustive check of reSID's compact waveform and DAC tables against the tables of the original reSID (the 16-bit
+// model_wave[2][8][4096] and model_dac[2][4096]): wave_sample() for every chip model, waveform (control register bits 4-7)
+// and accumulator index, and the split waveform DAC for every model and 12-bit input (see build_dac_split()).
+//
+// The original tables are rebuilt as the original WaveformGenerator() did it: the combined waveforms from the 8-bit
+// tables shifted up by 4 bits, the DAC with build_dac_table(). Their FNV-1a hashes must match the ones of the
+// original reSID (computed with the code before the table changes), otherwise the reference itself is wrong.
+//
+// The DAC split relies on how the two fixed-point halves round, which is why this runs as part of 'make test':
+// a different compiler or floating-point unit must not change the result silently.
+//
+// usage: residcheck
+//
+
+using namespace reSID;
+
+// hashes of the original tables (all 16-bit values, little-endian)
+#define ORIGINAL_WAVE_HASH	0x8255ad3fd201278eULL
+#define ORIGINAL_DAC_HASH	0x6b5d38a7438092d3ULL
+
+static u64 fnv1a( u64 h, unsigned short v )
+{
+	h = ( h ^ ( v & 255 ) ) * 0x100000001b3ULL;
+	return ( h ^ ( v >> 8 ) ) * 0x100000001b3ULL;
+}
+
+static unsigned short originalWave[ 2 ][ 8 ][ 1 << 12 ];
+static unsigned short originalDAC[ 2 ][ 1 << 12 ];
+
+// access to the protected tables and wave_sample()
+struct WaveCheck : WaveformGenerator
+{
+	static void buildOriginal()
+	{
+		// index of the combined waveforms in model_wave (see set_wave_table())
+		static const int combined[ 8 ] = { -1, -1, -1, 0, -1, 1, 2, 3 };
+
+		for ( int m = 0; m < 2; m++ )
+		{
+			reg24 accumulator = 0;
+			for ( int i = 0; i < ( 1 << 12 ); i++ )
+			{
+				reg24 msb = accumulator & 0x800000;
+
+				// noise mask, triangle, sawtooth, pulse mask as in the original constructor
+				originalWave[ m ][ 0 ][ i ] = 0xfff;
+				originalWave[ m ][ 1 ][ i ] = ( ( accumulator ^ -!!msb ) >> 11 ) & 0xffe;
+				originalWave[ m ][ 2 ][ i ] = accumulator >> 12;
+				originalWave[ m ][ 4 ][ i ] = 0xfff;
+				for ( int w = 0; w < 8; w++ )
+					if ( combined[ w ] >= 0 )
+						originalWave[ m ][ w ][ i ] = model_wave[ m ][ combined[ w ] ][ i ] << 4;
+
+				accumulator += 0x1000;
+			}
+		}
+
+		build_dac_table( originalDAC[ 0 ], 12, 2.20, false );
+		build_dac_table( originalDAC[ 1 ], 12, 2.00, true );
+	}
+
+	int checkWave( int m, int control )
+	{
+		set_chip_model( m ? MOS8580 : MOS6581 );
+		writeCONTROL_REG( control << 4 );
+
+		int errors = 0;
+		for ( int ix = 0; ix < ( 1 << 12 ); ix++ )
+			if ( wave_sample( ix ) != originalWave[ m ][ control & 7 ][ ix ] )
+			{
+				if ( errors++ < 4 )
+					printf( "wave: model %d, waveform %x, index %03x: %03x instead of %03x\n", m, control, ix, wave_sample( ix ), originalWave[ m ][ control & 7 ][ ix ] );
+			}
+		return errors;
+	}
+
+	static int checkDAC( int m )
+	{
+		int errors = 0;
+		for ( int x = 0; x < ( 1 << 12 ); x++ )
+		{
+			unsigned int v = ( model_dac[ m ][ 0 ][ x & 0x3f ] + model_dac[ m ][ 1 ][ x >> 6 ] ) >> 16;
+			if ( v != originalDAC[ m ][ x ] )
+			{
+				if ( errors++ < 4 )
+					printf( "dac: model %d, input %03x: %04x instead of %04x\n", m, x, v, originalDAC[ m ][ x ] );
+			}
+		}
+		return errors;
+	}
+};
+
+int main()
+{
+	// the constructor builds the split DAC tables
+	WaveCheck wave;
+	WaveCheck::buildOriginal();
+
+	u64 hw = 0xcbf29ce484222325ULL, hd = hw;
+	for ( int m = 0; m < 2; m++ )
+	{
+		for ( int w = 0; w < 8; w++ )
+			for ( int i = 0; i < ( 1 << 12 ); i++ )
+				hw = fnv1a( hw, originalWave[ m ][ w ][ i ] );
+		for ( int i = 0; i < ( 1 << 12 ); i++ )
+			hd = fnv1a( hd, originalDAC[ m ][ i ] );
+	}
+
+	int errors = 0;
+	if ( hw != ORIGINAL_WAVE_HASH || hd != ORIGINAL_DAC_HASH )
+	{
+		printf( "reference tables differ from the original reSID (wave %016llx, dac %016llx)\n", (unsigned long long)hw, (unsigned long long)hd );
+		errors++;
+	}
+
+	int nWave = 0, nDAC = 0;
+	for ( int m = 0; m < 2; m++ )
+	{
+		for ( int control = 0; control < 16; control++, nWave += 1 << 12 )
+			errors += wave.checkWave( m, control );
+		errors += WaveCheck::checkDAC( m );
+		nDAC += 1 << 12;
+	}
+
+	printf( "residcheck: %d waveform samples, %d DAC inputs, %d mismatches\n", nWave, nDAC, errors );
+	if ( errors )
+	{
+		printf( "FAILED\n" );
+		return 1;
+	}
+	printf( "OK\n" );
+	return 0;
+}
@@ -0,0 +1,240 @@
+//
+// sidcapdec.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../sidcapture.h"
+
+//
+// decoder for the register writes captured by kernel=sid (CAPTURE_SID_WRITES): prints the writes, a summary, or a table 
+// of the SID registers per frame in the style of SIDdump (which is what players and regression tools usually compare)
+//
+// usage: sidcapdec [-info | -writes | -sid n [-frame cycles]] sidw000.rsw
+//
+
+static u8 *file;
+static size_t fileSize;
+
+static CAPTURE_WRITE *writes;
+static u64 nWrites;
+
+// decodes all blocks (stops at the first corrupt one, e.g. the end of a capture which has not been closed)
+static u32 decodeFile( const CAPTURE_HEADER *h )
+{
+	static u8 raw[ CAPTURE_BLOCK_BYTES ];
+	u64 capacity = 65536;
+	writes = (CAPTURE_WRITE *)malloc( capacity * sizeof( CAPTURE_WRITE ) );
+	nWrites = 0;
+
+	u32 nBlocks = 0;
+	for ( size_t ofs = h->headerSize; ofs + sizeof( CAPTURE_BLOCK ) <= fileSize; nBlocks ++ )
+	{
+		const CAPTURE_BLOCK *b = (const CAPTURE_BLOCK *)( file + ofs );
+		size_t bytes = sizeof( CAPTURE_BLOCK ) + b->size;
+		if ( b->magic != CAPTURE_BLOCK_MAGIC || ofs + bytes > fileSize || b->writes > CAPTURE_BLOCK_WRITES || b->rawSize > CAPTURE_BLOCK_BYTES )
+			break;
+
+		if ( nWrites + b->writes > capacity )
+		{
+			capacity *= 2;
+			writes = (CAPTURE_WRITE *)realloc( writes, capacity * sizeof( CAPTURE_WRITE ) );
+		}
+
+		u32 n = traceDecompress( (const u8 *)( b + 1 ), b->size, raw, CAPTURE_BLOCK_BYTES );
+		u32 c = n == b->rawSize ? captureDecodeRecords( raw, n, b->firstCycle, b->writes, &writes[ nWrites ] ) : 0;
+		if ( c != b->writes )
+		{
+			fprintf( stderr, "sidcapdec: block %u is corrupt\n", nBlocks );
+			break;
+		}
+		nWrites += c;
+
+		ofs += bytes + TRACE_PADDING( bytes );
+	}
+
+	if ( h->nBlocks == 0 )
+		fprintf( stderr, "sidcapdec: capture has not been closed, found %u blocks\n", nBlocks );
+	return nBlocks;
+}
+
+static void printWrites()
+{
+	static const char *chips[] = { "SID1", "SID2", "OPL" };
+	static const u32 base[] = { 0xd400, 0xd420, 0xdf40 };
+
+	printf( "cycle\tchip\taddr\tdata\n" );
+	for ( u64 i = 0; i < nWrites; i++ )
+	{
+		u32 chip = writes[ i ].target >> 5, reg = writes[ i ].target & 31;
+		printf( "%10llu\t%s\t$%04x\t$%02x\n", (unsigned long long)writes[ i ].cycle, chips[ chip ], base[ chip ] + reg, writes[ i ].data );
+	}
+}
+
+//
+// SIDdump-style table: the registers at the end of every frame, unchanged values are shown as dots
+//
+static const char *noteNames[] = { "C-", "C#", "D-", "D#", "E-", "F-", "F#", "G-", "G#", "A-", "A#", "B-" };
+static const char *filterNames[] = { "Off", "Low", "Bnd", "L+B", "Hi ", "L+H", "B+H", "LBH" };
+
+// nearest note to a frequency register value (0 = C-0), -1 if out of range
+static int noteFromFreq( u32 freq, u32 clock )
+{
+	if ( freq == 0 ) return -1;
+	double hz = (double)freq * clock / 16777216.0;
+	int note = (int)floor( 12.0 * log2( hz / 16.3516 ) + 0.5 );
+	return ( note >= 0 && note < 96 ) ? note : -1;
+}
+
+static void printDump( u32 chip, u32 clock, u32 frameCycles )
+{
+	u8 reg[ 32 ] = { 0 }, prev[ 32 ] = { 0 };
+	int prevNote[ 3 ] = { -1, -1, -1 };
+
+	printf( "| Frame | Freq Note/Abs WF ADSR Pul | Freq Note/Abs WF ADSR Pul | Freq Note/Abs WF ADSR Pul | FCut RC Typ V |\n" );
+	printf( "+-------+---------------------------+---------------------------+---------------------------+---------------+\n" );
+
+	u64 last = nWrites ? writes[ nWrites - 1 ].cycle : 0;
+	u64 w = 0;
+
+	for ( u32 frame = 0; (u64)frame * frameCycles <= last; frame ++ )
+	{
+		u64 end = (u64)( frame + 1 ) * frameCycles;
+		u8 gateOn = 0;
+		for ( ; w < nWrites && writes[ w ].cycle < end; w ++ )
+		{
+			if ( ( writes[ w ].target >> 5 ) != chip )
+				continue;
+			u32 r = writes[ w ].target & 31;
+			// a gate which has been switched on during the frame retriggers the note, even if it is off again
+			if ( r < 21 && r % 7 == 4 && ( writes[ w ].data & 1 ) && !( reg[ r ] & 1 ) )
+				gateOn |= 1 << ( r / 7 );
+			reg[ r ] = writes[ w ].data;
+		}
+
+		printf( "| %5u | ", frame );
+		for ( u32 v = 0; v < 3; v++ )
+		{
+			const u8 *r = &reg[ v * 7 ], *p = &prev[ v * 7 ];
+			u32 freq = r[ 0 ] | ( r[ 1 ] << 8 ), pulse = ( r[ 2 ] | ( r[ 3 ] << 8 ) ) & 0xfff;
+			u32 freqChanged = frame == 0 || r[ 0 ] != p[ 0 ] || r[ 1 ] != p[ 1 ];
+
+			if ( freqChanged ) printf( "%04X ", freq ); else printf( ".... " );
+
+			int note = noteFromFreq( freq, clock );
+			if ( note >= 0 && ( note != prevNote[ v ] || ( gateOn & ( 1 << v ) ) ) )
+				printf( "%s%d %02X   ", noteNames[ note % 12 ], note / 12, note | 0x80 ); else
+				printf( "... ..   " );
+			prevNote[ v ] = note;
+
+			if ( frame == 0 || r[ 4 ] != p[ 4 ] ) printf( "%02X ", r[ 4 ] ); else printf( ".. " );
+			if ( frame == 0 || r[ 5 ] != p[ 5 ] || r[ 6 ] != p[ 6 ] ) printf( "%02X%02X ", r[ 5 ], r[ 6 ] ); else printf( ".... " );
+			if ( frame == 0 || r[ 2 ] != p[ 2 ] || ( r[ 3 ] & 15 ) != ( p[ 3 ] & 15 ) ) printf( "%03X ", pulse ); else printf( "... " );
+			printf( "| " );
+		}
+
+		u32 cutoff = ( reg[ 21 ] & 7 ) | ( reg[ 22 ] << 3 );
+		if ( frame == 0 || reg[ 21 ] != prev[ 21 ] || reg[ 22 ] != prev[ 22 ] ) printf( "%04X ", cutoff ); else printf( ".... " );
+		if ( frame == 0 || reg[ 23 ] != prev[ 23 ] ) printf( "%02X ", reg[ 23 ] ); else printf( ".. " );
+		if ( frame == 0 || ( reg[ 24 ] & 0x70 ) != ( prev[ 24 ] & 0x70 ) ) printf( "%s ", filterNames[ ( reg[ 24 ] >> 4 ) & 7 ] ); else printf( "... " );
+		if ( frame == 0 || ( reg[ 24 ] & 15 ) != ( prev[ 24 ] & 15 ) ) printf( "%X ", reg[ 24 ] & 15 ); else printf( ". " );
+		printf( "|\n" );
+
+		memcpy( prev, reg, 32 );
+	}
+}
+
+int main( int argc, char **argv )
+{
+	const char *name = 0;
+	int info = 0, list = 0;
+	u32 chip = 0, frameCycles = 0;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !strcmp( argv[ i ], "-info" ) ) info = 1; else
+		if ( !strcmp( argv[ i ], "-writes" ) ) list = 1; else
+		if ( !strcmp( argv[ i ], "-sid" ) && i + 1 < argc ) chip = atoi( argv[ ++ i ] ) == 2 ? CAPTURE_SID2 : CAPTURE_SID1; else
+		if ( !strcmp( argv[ i ], "-frame" ) && i + 1 < argc ) frameCycles = strtoul( argv[ ++ i ], 0, 0 ); else
+			name = argv[ i ];
+	}
+
+	if ( !name )
+	{
+		fprintf( stderr, "usage: %s [-info | -writes | -sid n [-frame cycles]] capture.rsw\n", argv[ 0 ] );
+		return 2;
+	}
+
+	FILE *f = fopen( name, "rb" );
+	if ( !f )
+	{
+		fprintf( stderr, "sidcapdec: cannot open %s\n", name );
+		return 1;
+	}
+	fseek( f, 0, SEEK_END );
+	fileSize = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	file = (u8 *)malloc( fileSize + 1 );
+	if ( fread( file, 1, fileSize, f ) != fileSize )
+		fileSize = 0;
+	fclose( f );
+
+	const CAPTURE_HEADER *h = (const CAPTURE_HEADER *)file;
+	if ( fileSize < sizeof( CAPTURE_HEADER ) || h->magic != CAPTURE_MAGIC || h->version != CAPTURE_VERSION || h->headerSize < sizeof( CAPTURE_HEADER ) )
+	{
+		fprintf( stderr, "sidcapdec: %s is not a capture of register writes\n", name );
+		return 1;
+	}
+
+	u32 nBlocks = decodeFile( h );
+
+	if ( info )
+	{
+		u64 perChip[ 3 ] = { 0 };
+		for ( u64 i = 0; i < nWrites; i++ )
+			perChip[ writes[ i ].target >> 5 ] ++;
+		double seconds = nWrites && h->c64Clock ? (double)writes[ nWrites - 1 ].cycle / h->c64Clock : 0.0;
+
+		printf( "blocks              %u\n", nBlocks );
+		printf( "writes              %llu (SID1 %llu, SID2 %llu, OPL %llu)\n", (unsigned long long)nWrites,
+			(unsigned long long)perChip[ 0 ], (unsigned long long)perChip[ 1 ], (unsigned long long)perChip[ 2 ] );
+		printf( "dropped writes      %llu\n", (unsigned long long)h->droppedWrites );
+		printf( "length              %.1f s at %u Hz\n", seconds, h->c64Clock );
+		printf( "chips               %u", h->sidModel[ 0 ] );
+		if ( h->flags & CAPTURE_FLAG_SID2 ) printf( ", %u", h->sidModel[ 1 ] );
+		printf( "%s\n", ( h->flags & CAPTURE_FLAG_OPL ) ? ", OPL2" : "" );
+		printf( "bytes per write     %.2f\n", nWrites ? (double)( fileSize - h->headerSize ) / nWrites : 0.0 );
+		return 0;
+	}
+
+	if ( list )
+	{
+		printWrites();
+		return 0;
+	}
+
+	// one frame of the VIC: PAL 312 lines of 63 cycles, NTSC 263 lines of 65 cycles
+	if ( frameCycles == 0 )
+		frameCycles = h->c64Clock > 1000000 ? 263 * 65 : 312 * 63;
+
+	printDump( chip, h->c64Clock ? h->c64Clock : 985248, frameCycles );
+
+	return 0;
+}
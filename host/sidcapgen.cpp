@@ -0,0 +1,229 @@
+//
+// sidcapgen.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "../sidcapture.h"
+
+//
+// generates synthetic captures of register writes (see sidcapture.h) as regression corpus for sidrender: every capture
+// initializes the SIDs (and the OPL2) and then plays random notes, pulse widths and filter settings once per frame. 
+// Songs 8-11 also use sync, ring modulation, combined waveforms, the test bit and random filter routings (incl. EXT IN),
+// i.e. the specialized clock kernels and the combined-waveform tables of reSID.
+// The output only depends on the song number, i.e. the captures (and the golden hashes of sidrender, see host/Makefile) 
+// are the same on every machine.
+//
+// usage: sidcapgen dir        writes dir/song0.rsw ... dir/song11.rsw
+//
+
+#define SONGS			12
+#define C64_CLOCK		985248
+#define FRAME_CYCLES	19656
+
+// xorshift32, rand() differs between C libraries
+static u32 rng;
+static u32 rnd( u32 n ) { rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; return rng % n; }
+
+static std::vector<CAPTURE_WRITE> w;
+
+static void write( u64 cycle, u32 chip, u32 reg, u8 data )
+{
+	CAPTURE_WRITE cw = { cycle, (u8)CAPTURE_TARGET( chip, reg ), data };
+	w.push_back( cw );
+}
+
+static void makeSong( u32 song, u32 seconds, int opl, int extended )
+{
+	rng = 0x9e3779b9 * ( song + 1 );
+	w.clear();
+
+	// volume, and envelopes of all voices
+	u64 c = 1000;
+	write( c, CAPTURE_SID1, 24, 0x0f );
+	write( c + 10, CAPTURE_SID2, 24, 0x0f );
+	for ( u32 v = 0; v < 3; v++ )
+	{
+		write( c + 20 + v, CAPTURE_SID1, v * 7 + 5, 0x09 );
+		write( c + 30 + v, CAPTURE_SID1, v * 7 + 6, 0xa8 );
+		write( c + 40 + v, CAPTURE_SID2, v * 7 + 5, 0x22 );
+		write( c + 50 + v, CAPTURE_SID2, v * 7 + 6, 0xf4 );
+	}
+
+	// one OPL2 instrument (address port = register 0, data port = register 16)
+	static const u8 oplInit[][ 2 ] = { { 0x20, 0x01 }, { 0x40, 0x10 }, { 0x60, 0xf0 }, { 0x80, 0x77 }, { 0xa0, 0x98 }, 
+		{ 0x23, 0x01 }, { 0x43, 0x00 }, { 0x63, 0xf0 }, { 0x83, 0x77 }, { 0xc0, 0x06 } };
+	if ( opl )
+		for ( u32 i = 0; i < sizeof( oplInit ) / 2; i++ )
+		{
+			c += 40;
+			write( c, CAPTURE_OPL, 0, oplInit[ i ][ 0 ] );
+			write( c + 20, CAPTURE_OPL, 16, oplInit[ i ][ 1 ] );
+		}
+
+	static const u8 waveforms[] = { 0x11, 0x21, 0x41, 0x81 };
+
+	// sync (bit 1) and ring modulation (bit 2), and the combined waveforms
+	static const u8 waveformsExt[] = { 0x13, 0x15, 0x17, 0x23, 0x43, 0x31, 0x51, 0x61, 0x71, 0x53, 0x65, 0x11, 0x41, 0x81 };
+	const u32 nWaveforms = extended ? sizeof( waveformsExt ) : sizeof( waveforms );
+	for ( u64 f = 1; ( c = f * FRAME_CYCLES + rnd( 3000 ) ) < (u64)seconds * C64_CLOCK; f++ )
+	{
+		for ( u32 v = 0; v < 3; v++ )
+		{
+			// new note with gate on, or gate off
+			u32 r = rnd( 100 );
+			if ( r < 30 )
+			{
+				u32 freq = 0x400 + rnd( 0x3c00 );
+				write( c, CAPTURE_SID1, v * 7, freq & 255 );
+				write( c + 6, CAPTURE_SID1, v * 7 + 1, freq >> 8 );
+				write( c + 12, CAPTURE_SID1, v * 7 + 4, ( extended ? waveformsExt : waveforms )[ rnd( nWaveforms ) ] );
+				write( c + 18, CAPTURE_SID1, v * 7 + 2, rnd( 256 ) );
+				write( c + 24, CAPTURE_SID1, v * 7 + 3, extended ? rnd( 16 ) : 8 );
+				c += 30;
+			} else
+			if ( extended && r < 40 )
+			{
+				// test bit: holds the oscillator at zero (and resets the noise LFSR), then releases it
+				u8 wave = waveformsExt[ rnd( nWaveforms ) ];
+				write( c, CAPTURE_SID1, v * 7 + 4, wave | 0x08 );
+				write( c + 100 + rnd( 2000 ), CAPTURE_SID1, v * 7 + 4, wave );
+				c += 8;
+			} else
+			if ( r < 51 )
+			{
+				write( c, CAPTURE_SID1, v * 7 + 4, 0x40 );
+				c += 8;
+			}
+
+			if ( rnd( 100 ) < 20 )
+			{
+				u32 freq = 0x400 + rnd( 0x3c00 );
+				write( c, CAPTURE_SID2, v * 7, freq & 255 );
+				write( c + 6, CAPTURE_SID2, v * 7 + 1, freq >> 8 );
+				write( c + 12, CAPTURE_SID2, v * 7 + 4, extended ? waveformsExt[ rnd( nWaveforms ) ] : 0x21 );
+				c += 20;
+			}
+		}
+
+		// filter sweeps
+		if ( rnd( 100 ) < 50 )
+		{
+			static const u8 modeVol[] = { 0x1f, 0x3f, 0x5f };
+			write( c, CAPTURE_SID1, 21, rnd( 8 ) );
+			write( c + 6, CAPTURE_SID1, 22, rnd( 256 ) );
+			write( c + 12, CAPTURE_SID1, 23, extended ? rnd( 256 ) : 0xf7 );
+			write( c + 18, CAPTURE_SID1, 24, modeVol[ rnd( 3 ) ] );
+			c += 24;
+		}
+
+		// OPL2 note
+		if ( opl && rnd( 100 ) < 20 )
+		{
+			u32 fnum = 300 + rnd( 401 );
+			write( c, CAPTURE_OPL, 0, 0xa0 );
+			write( c + 20, CAPTURE_OPL, 16, fnum & 255 );
+			write( c + 40, CAPTURE_OPL, 0, 0xb0 );
+			write( c + 60, CAPTURE_OPL, 16, 0x30 | ( fnum >> 8 ) );
+			c += 80;
+		}
+	}
+
+	std::stable_sort( w.begin(), w.end(), []( const CAPTURE_WRITE &a, const CAPTURE_WRITE &b ) { return a.cycle < b.cycle; } );
+}
+
+static int writeCapture( const char *name, u32 sidModel, int opl )
+{
+	FILE *f = fopen( name, "wb" );
+	if ( !f )
+	{
+		fprintf( stderr, "sidcapgen: cannot create %s\n", name );
+		return 0;
+	}
+
+	CAPTURE_HEADER header;
+	memset( &header, 0, sizeof( header ) );
+	header.magic = CAPTURE_MAGIC;
+	header.version = CAPTURE_VERSION;
+	header.headerSize = sizeof( CAPTURE_HEADER );
+	header.c64Clock = C64_CLOCK;
+	header.sidModel[ 0 ] = header.sidModel[ 1 ] = sidModel;
+	header.flags = CAPTURE_FLAG_SID2 | ( opl ? CAPTURE_FLAG_OPL : 0 );
+	header.nBlocks = (u32)( ( w.size() + CAPTURE_BLOCK_WRITES - 1 ) / CAPTURE_BLOCK_WRITES );
+	header.writes = w.size();
+	fwrite( &header, sizeof( header ), 1, f );
+
+	static u8 raw[ CAPTURE_BLOCK_BYTES ], compressed[ TRACE_COMPRESSED_BYTES( CAPTURE_BLOCK_BYTES ) + 8 ];
+	for ( size_t i = 0; i < w.size(); i += CAPTURE_BLOCK_WRITES )
+	{
+		size_t n = std::min( w.size() - i, (size_t)CAPTURE_BLOCK_WRITES );
+
+		// records as written by captureWrite
+		u8 shadow[ CAPTURE_TARGETS ] = { 0 };
+		u64 last = w[ i ].cycle - 5;
+		u8 *p = raw;
+		for ( size_t j = i; j < i + n; j++ )
+		{
+			p = traceEncodeRecord( p, (u32)( w[ j ].cycle - last ) );
+			*p++ = w[ j ].target;
+			*p++ = w[ j ].data ^ shadow[ w[ j ].target ];
+			shadow[ w[ j ].target ] = w[ j ].data;
+			last = w[ j ].cycle;
+		}
+
+		CAPTURE_BLOCK block;
+		block.magic = CAPTURE_BLOCK_MAGIC;
+		block.rawSize = (u32)( p - raw );
+		block.size = traceCompress( raw, block.rawSize, compressed );
+		block.writes = (u32)n;
+		block.firstCycle = w[ i ].cycle - 5;
+
+		memset( &compressed[ block.size ], 0, 8 );
+		fwrite( &block, sizeof( block ), 1, f );
+		fwrite( compressed, 1, block.size + TRACE_PADDING( sizeof( block ) + block.size ), f );
+	}
+
+	fclose( f );
+	return 1;
+}
+
+int main( int argc, char **argv )
+{
+	if ( argc != 2 )
+	{
+		fprintf( stderr, "usage: %s dir\n", argv[ 0 ] );
+		return 2;
+	}
+
+	for ( u32 s = 0; s < SONGS; s++ )
+	{
+		// 10 to 24 seconds (songs 8-11 with sync, ring modulation etc.: 6 to 12 seconds), OPL2 in every other song, 6581 in every third
+		int opl = ( s & 1 ) == 0;
+		int extended = s >= 8;
+		makeSong( s, extended ? 6 + ( s - 8 ) * 2 : 10 + s * 2, opl, extended );
+
+		char name[ 1024 ];
+		snprintf( name, sizeof( name ), "%s/song%u.rsw", argv[ 1 ], s );
+		if ( !writeCapture( name, ( s % 3 ) == 0 ? 6581 : 8580, opl ) )
+			return 1;
+	}
+	return 0;
+}
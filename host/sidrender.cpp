@@ -0,0 +1,942 @@
+//
+// sidrender.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <vector>
+#include <string>
+#include "../sidengine.h"
+#ifdef CACHE_SIMULATION
+#include "cachesim.h"
+#endif
+
+//
+// offline renderer for the register writes captured by kernel=sid (see sidcapture.h): renders them with the sound emulation
+// of the kernel (sidengine.h, i.e. the same code) to WAV files, or compares the rendered audio with golden hashes
+//
+// usage: sidrender [-c config]... [-o dir [-compare]] [-golden file [-update]] [-tail seconds] [-rate hz] [-j processes] 
+//                  [-chunk seconds] [-checkpoints dir] [-from seconds] [-length seconds] capture.rsw ...
+//
+// every capture is rendered with every configuration, in parallel on all cores. Every job runs in a new process: fmopl keeps 
+// the state of the current chip in globals (i.e. it is not thread-safe), and reSID recomputes static tables whenever a SID is
+// created, with results depending on the previous ones -- a new process starts like the kernel. A configuration is a comma separated list of
+//   sid2        second SID at $D420      same     second SID plays the writes of the first      nosid2   single SID
+//   opl         OPL2                     noopl    no OPL2
+//   mono        MIXER_MONO               stereo   MIXER_SID_STEREO
+//   pwm         8 cycles per step        hdmi     2 cycles per step
+//   6581, 8580  model of both SIDs       boost    digi boost (8580)
+//   q1, q2, q3  reduced emulation quality (ENGINE_QUALITY_xxx in sidengine.h, as chosen by the governor of the kernel)
+//   lite        both SIDs emulated by CLiteSID (litesid.h) instead of reSID
+// the default is the configuration of the kernel which made the capture (SIDs, OPL2 from the header), stereo, hdmi, no boost
+//
+// with -compare the WAV files of every configuration are compared with those of the first one: the signal-to-noise ratio 
+// (the difference as noise) and the level, e.g. to weigh the speed of a configuration against its accuracy
+//
+// golden files have one line per capture and configuration: hash, capture file name (without path), configuration
+//
+// with -chunk a long capture is rendered in chunks by several processes (the captures one after another): a first pass 
+// emulates without output and records a checkpoint (engineSaveState) at the beginning of every chunk, and starts a process 
+// rendering the chunk from it. The samples are stitched in shared memory, and every chunk renderer stores the state at its 
+// end, which must be identical to the next checkpoint, i.e. the samples are the same as rendering in one go. The first pass 
+// takes as long as the emulation without mixing and output, with -checkpoints dir the checkpoints are stored 
+// (dir/capture.config.rcp) and later runs skip the first pass: all chunks are rendered in parallel right away, and -from/-length 
+// start rendering at the checkpoint before the window (instant seek). Checkpoint files are only valid for the same build 
+// of sidrender.
+//
+// "make sidrender-cache" builds sidrender-cache, which additionally counts the refills of the L1 and L2 data caches of the 
+// RPi 3 during rendering (a model of the caches, see cachesim.h) and prints them per emulated second, e.g. for comparing 
+// the cache footprint of two versions of the emulation (not with -chunk)
+//
+
+typedef struct
+{
+	std::string	spec;
+	u32			flags, flagsSet;		// flags given in the spec, and which of them have been given at all
+	u32			model;					// 0: from the capture
+	u32			boost;
+	u32			quality;
+	u32			chip;					// ENGINE_CHIP_xxx of both SIDs
+} CONFIG;
+
+typedef struct
+{
+	const char	*name;
+	u8			*file;
+	size_t		fileSize;
+	CAPTURE_HEADER header;
+	std::vector<CAPTURE_WRITE> writes;
+} CAPTURE;
+
+typedef struct
+{
+	u32			capture, config;
+	u64			hash;
+	u64			samples;
+	double		seconds;
+	u32			chunks, chunksVerified;
+	boolean		checkpointsLoaded;
+	boolean		ok;
+#ifdef CACHE_SIMULATION
+	CACHESIM_COUNTS cache;
+#endif
+} JOB;
+
+// checkpoint files (-checkpoints): the engine states every 'interval' samples of one capture and configuration
+typedef struct
+{
+	u32			magic, version;
+	char		build[ 24 ];
+	u32			stateSize;
+	u32			flags, model[ 2 ], boost;
+	u32			clock, sampleRate;
+	u32			interval;
+	u32			nCheckpoints;
+	u64			nWrites, lastCycle;		// of the capture
+} CHECKPOINT_HEADER;
+
+#define CHECKPOINT_MAGIC	0x54504352		// "RCPT"
+#define CHECKPOINT_VERSION	1
+
+// a checkpoint is the engine state before sample k * interval (followed by engineStateSize bytes), and the next write of the capture
+typedef struct
+{
+	u64			write;
+	u32			valid;
+	u32			done;					// state at the end of a chunk: the chunk has been rendered
+} CHECKPOINT;
+
+static std::vector<CONFIG> configs;
+static std::vector<CAPTURE> captures;
+// in memory shared with the worker processes
+static JOB *jobs;
+static u32 nJobs;
+
+static const char *outDir = 0;
+static double tailSeconds = 1.0;
+static u32 nWorkers = 1;
+
+// chunked rendering and seeking
+static double chunkSeconds = 0;
+static const char *checkpointDir = 0;
+static double fromSeconds = 0, lengthSeconds = 0;
+
+// SAMPLERATE of kernel_sid.h
+static u32 sampleRate = 44100;
+
+// writes of a capture for engineRenderSample, with the same reads of the first SID as the kernel's ring buffer
+struct CCaptureSource
+{
+	const CAPTURE_WRITE *w;
+	u64 n, i;
+
+	void clocked( SID_ENGINE *e )
+	{
+		e->sid[ 0 ]->read( 27 );
+		e->sid[ 0 ]->read( 28 );
+	}
+
+	boolean next( u64 nCyclesEmulated, u32 &chip, u32 &A, u8 &D )
+	{
+		if ( i == n || nCyclesEmulated < w[ i ].cycle )
+			return FALSE;
+		chip = w[ i ].target >> 5;
+		A = w[ i ].target & 31;
+		D = w[ i ].data;
+		i ++;
+		return TRUE;
+	}
+
+	void sampled( SID_ENGINE *e )
+	{
+		if ( e->opl )
+			ym3812_read( e->opl, 0 );
+	}
+};
+
+// FNV-1a over the samples as they are written to the WAV file (16 bit little endian, left/right)
+static inline u64 hashSample( u64 h, s16 l, s16 r )
+{
+	u8 b[ 4 ] = { (u8)l, (u8)( (u16)l >> 8 ), (u8)r, (u8)( (u16)r >> 8 ) };
+	for ( int i = 0; i < 4; i++ )
+		h = ( h ^ b[ i ] ) * 0x100000001b3ull;
+	return h;
+}
+
+// renders to a WAV file and/or a buffer, and the hash of the samples (all optional)
+typedef u64 TRenderFunc( SID_ENGINE *e, CCaptureSource &src, u64 nSamples, FILE *wav, s16 *out, u64 *hash );
+// emulates without output (e.g. up to the next checkpoint)
+typedef void TEmulateFunc( SID_ENGINE *e, CCaptureSource &src, u64 nSamples );
+
+template <u32 FLAGS>
+static u64 render( SID_ENGINE *e, CCaptureSource &src, u64 nSamples, FILE *wav, s16 *out, u64 *hash )
+{
+	static const u32 BUFFER = 4096;
+	s16 buf[ BUFFER * 2 ];
+	u64 h = 0xcbf29ce484222325ull;
+
+	for ( u64 i = 0; i < nSamples; )
+	{
+		u32 n = 0;
+		for ( ; n < BUFFER && i < nSamples; n++, i++ )
+		{
+			SID_ENGINE_SAMPLE smp;
+			engineRenderSample<FLAGS>( e, src, &smp );
+
+			// putSample() of the kernel truncates the mixer output to 16 bit
+			buf[ n * 2 + 0 ] = (s16)smp.left;
+			buf[ n * 2 + 1 ] = (s16)smp.right;
+			h = hashSample( h, buf[ n * 2 ], buf[ n * 2 + 1 ] );
+		}
+		if ( wav )
+			fwrite( buf, sizeof( s16 ) * 2, n, wav );
+		if ( out )
+		{
+			memcpy( out, buf, n * sizeof( s16 ) * 2 );
+			out += n * 2;
+		}
+	}
+
+	if ( hash )
+		*hash = h;
+	return nSamples;
+}
+
+template <u32 FLAGS>
+static void emulate( SID_ENGINE *e, CCaptureSource &src, u64 nSamples )
+{
+	for ( u64 i = 0; i < nSamples; i++ )
+	{
+		SID_ENGINE_SAMPLE smp;
+		engineRenderSample<FLAGS>( e, src, &smp );
+	}
+}
+
+#define RENDER( n ) render<n>
+static TRenderFunc * const renderFuncs[ ENGINE_CONFIGS ] = {
+	RENDER( 0 ), RENDER( 1 ), RENDER( 2 ), RENDER( 3 ), RENDER( 4 ), RENDER( 5 ), RENDER( 6 ), RENDER( 7 ), 
+	RENDER( 8 ), RENDER( 9 ), RENDER( 10 ), RENDER( 11 ), RENDER( 12 ), RENDER( 13 ), RENDER( 14 ), RENDER( 15 ), 
+	RENDER( 16 ), RENDER( 17 ), RENDER( 18 ), RENDER( 19 ), RENDER( 20 ), RENDER( 21 ), RENDER( 22 ), RENDER( 23 ), 
+	RENDER( 24 ), RENDER( 25 ), RENDER( 26 ), RENDER( 27 ), RENDER( 28 ), RENDER( 29 ), RENDER( 30 ), RENDER( 31 ) };
+#undef RENDER
+
+#define EMULATE( n ) emulate<n>
+static TEmulateFunc * const emulateFuncs[ ENGINE_CONFIGS ] = {
+	EMULATE( 0 ), EMULATE( 1 ), EMULATE( 2 ), EMULATE( 3 ), EMULATE( 4 ), EMULATE( 5 ), EMULATE( 6 ), EMULATE( 7 ), 
+	EMULATE( 8 ), EMULATE( 9 ), EMULATE( 10 ), EMULATE( 11 ), EMULATE( 12 ), EMULATE( 13 ), EMULATE( 14 ), EMULATE( 15 ), 
+	EMULATE( 16 ), EMULATE( 17 ), EMULATE( 18 ), EMULATE( 19 ), EMULATE( 20 ), EMULATE( 21 ), EMULATE( 22 ), EMULATE( 23 ), 
+	EMULATE( 24 ), EMULATE( 25 ), EMULATE( 26 ), EMULATE( 27 ), EMULATE( 28 ), EMULATE( 29 ), EMULATE( 30 ), EMULATE( 31 ) };
+#undef EMULATE
+
+static void writeWAVHeader( FILE *f, u32 sampleRate, u64 nSamples )
+{
+	u32 dataBytes = (u32)( nSamples * 4 );
+	u8 h[ 44 ];
+	memcpy( h, "RIFF", 4 );
+	u32 v[] = { 36 + dataBytes, 0, 16, 0, sampleRate, sampleRate * 4, 0, dataBytes };
+	memcpy( h + 4, &v[ 0 ], 4 );
+	memcpy( h + 8, "WAVEfmt ", 8 );
+	memcpy( h + 16, &v[ 2 ], 4 );
+	u16 fmt[] = { 1, 2 };
+	memcpy( h + 20, fmt, 4 );
+	memcpy( h + 24, &v[ 4 ], 4 );
+	memcpy( h + 28, &v[ 5 ], 4 );
+	u16 align[] = { 4, 16 };
+	memcpy( h + 32, align, 4 );
+	memcpy( h + 36, "data", 4 );
+	memcpy( h + 40, &v[ 7 ], 4 );
+	fwrite( h, 1, 44, f );
+}
+
+static u32 jobFlags( const CAPTURE &c, const CONFIG &cfg )
+{
+	u32 flags = 0;
+	if ( c.header.flags & CAPTURE_FLAG_SID2 ) flags |= ENGINE_FLAG_SID2;
+	if ( c.header.flags & CAPTURE_FLAG_OPL ) flags |= ENGINE_FLAG_OPL;
+	return ( flags & ~cfg.flagsSet ) | cfg.flags;
+}
+
+// dir/capture (without .rsw), with the configuration if 'spec' is set or there are several configurations
+static std::string jobFileName( const char *dir, const CAPTURE &c, const CONFIG &cfg, boolean spec, const char *ext )
+{
+	const char *base = strrchr( c.name, '/' ) ? strrchr( c.name, '/' ) + 1 : c.name;
+	std::string fn = std::string( dir ) + "/" + base;
+	if ( fn.size() > 4 && fn.compare( fn.size() - 4, 4, ".rsw" ) == 0 ) fn.resize( fn.size() - 4 );
+	if ( spec || configs.size() > 1 || !cfg.spec.empty() ) fn += "." + ( cfg.spec.empty() ? std::string( "default" ) : cfg.spec );
+	return fn + ext;
+}
+
+static boolean loadCheckpoints( const std::string &fn, const CHECKPOINT_HEADER *h, u8 *ckpt, size_t stride )
+{
+	FILE *f = fopen( fn.c_str(), "rb" );
+	if ( !f )
+		return FALSE;
+
+	CHECKPOINT_HEADER fh;
+	boolean ok = fread( &fh, sizeof( fh ), 1, f ) == 1 && memcmp( &fh, h, sizeof( fh ) ) == 0 &&
+		fread( ckpt, stride, h->nCheckpoints, f ) == h->nCheckpoints;
+	fclose( f );
+
+	for ( u32 k = 0; ok && k < h->nCheckpoints; k++ )
+		ok = ( (CHECKPOINT *)( ckpt + k * stride ) )->valid;
+
+	if ( !ok )
+		fprintf( stderr, "sidrender: ignoring %s (other capture, configuration or build)\n", fn.c_str() );
+	return ok;
+}
+
+static void saveCheckpoints( const std::string &fn, const CHECKPOINT_HEADER *h, const u8 *ckpt, size_t stride )
+{
+	FILE *f = fopen( fn.c_str(), "wb" );
+	if ( !f || fwrite( h, sizeof( *h ), 1, f ) != 1 || fwrite( ckpt, stride, h->nCheckpoints, f ) != h->nCheckpoints )
+		fprintf( stderr, "sidrender: cannot write %s\n", fn.c_str() );
+	if ( f ) fclose( f );
+}
+
+static void *sharedAlloc( size_t size )
+{
+	void *p = mmap( 0, size ? size : 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	return p == MAP_FAILED ? 0 : p;
+}
+
+// renders the samples [first, last) of nSamples in chunks, see the comment at the top
+static boolean renderChunked( JOB *j, SID_ENGINE *e, u32 flags, const u32 *model, u32 boost, u64 nSamples, u64 first, u64 last, FILE *wav )
+{
+	const CAPTURE &c = captures[ j->capture ];
+	const CONFIG &cfg = configs[ j->config ];
+
+	CHECKPOINT_HEADER h;
+	memset( &h, 0, sizeof( h ) );
+	h.magic = CHECKPOINT_MAGIC;
+	h.version = CHECKPOINT_VERSION;
+	snprintf( h.build, sizeof( h.build ), "%s %s", __DATE__, __TIME__ );
+	h.stateSize = engineStateSize( e );
+	h.flags = flags;
+	h.model[ 0 ] = model[ 0 ];
+	h.model[ 1 ] = model[ 1 ];
+	h.boost = boost;
+	h.clock = e->clockFreq;
+	h.sampleRate = sampleRate;
+	h.interval = (u32)( ( chunkSeconds > 0 ? chunkSeconds : 10.0 ) * sampleRate );
+
+	// without -chunk the interval of a checkpoint file is used
+	std::string fn = checkpointDir ? jobFileName( checkpointDir, c, cfg, TRUE, ".rcp" ) : "";
+	FILE *f = chunkSeconds > 0 || fn.empty() ? 0 : fopen( fn.c_str(), "rb" );
+	if ( f )
+	{
+		CHECKPOINT_HEADER fh;
+		if ( fread( &fh, sizeof( fh ), 1, f ) == 1 && fh.magic == CHECKPOINT_MAGIC )
+			h.interval = fh.interval;
+		fclose( f );
+	}
+	if ( h.interval == 0 ) h.interval = 1;
+	h.nCheckpoints = (u32)( ( nSamples + h.interval - 1 ) / h.interval );
+	h.nWrites = c.writes.size();
+	h.lastCycle = c.writes.empty() ? 0 : c.writes.back().cycle;
+
+	// shared with the chunk renderers: the checkpoints, the states at the end of the chunks, and the samples
+	size_t stride = ( sizeof( CHECKPOINT ) + h.stateSize + 15 ) & ~15;
+	u8 *ckpt = (u8 *)sharedAlloc( h.nCheckpoints * stride );
+	u8 *endState = (u8 *)sharedAlloc( h.nCheckpoints * stride );
+	s16 *samples = (s16 *)sharedAlloc( ( last - first ) * sizeof( s16 ) * 2 );
+	if ( !ckpt || !endState || !samples )
+	{
+		fprintf( stderr, "sidrender: out of memory\n" );
+		return FALSE;
+	}
+
+	boolean loaded = !fn.empty() && loadCheckpoints( fn, &h, ckpt, stride );
+	// the checkpoints are only stored if the first pass went through the whole capture
+	boolean save = !fn.empty() && !loaded && first == 0 && last == nSamples;
+
+	// chunks [firstChunk, lastChunk) contain the samples to render
+	u32 firstChunk = (u32)( first / h.interval );
+	u32 lastChunk = (u32)( ( last + h.interval - 1 ) / h.interval );
+	u32 nPass = save ? h.nCheckpoints : lastChunk;
+
+	TRenderFunc *renderFunc = renderFuncs[ flags ];
+	TEmulateFunc *emulateFunc = emulateFuncs[ flags ];
+
+	CCaptureSource src = { c.writes.data(), c.writes.size(), 0 };
+	u32 running = 0, maxRunning = nWorkers > 1 ? nWorkers - 1 : 1;
+	boolean ok = TRUE;
+
+	fflush( stdout );
+	for ( u32 k = loaded ? firstChunk : 0; k < ( loaded ? lastChunk : nPass ); k++ )
+	{
+		CHECKPOINT *cp = (CHECKPOINT *)( ckpt + k * stride );
+		if ( !loaded )
+		{
+			// first pass: emulate up to the checkpoint
+			if ( k > 0 )
+				emulateFunc( e, src, h.interval );
+			cp->write = src.i;
+			engineSaveState( e, cp + 1 );
+			cp->valid = 1;
+		}
+		if ( k < firstChunk || k >= lastChunk )
+			continue;
+
+		if ( running == maxRunning )
+		{
+			wait( 0 );
+			running --;
+		}
+
+		pid_t pid = fork();
+		if ( pid == 0 )
+		{
+			// a chunk always starts from the stored checkpoint (also when this process is at its state already)
+			engineLoadState( e, cp + 1 );
+			src.i = cp->write;
+
+			u64 s0 = (u64)k * h.interval, s1 = s0 + h.interval;
+			if ( s1 > nSamples ) s1 = nSamples;
+			if ( s0 < first )
+			{
+				emulateFunc( e, src, first - s0 );
+				s0 = first;
+			}
+			u64 end = s1 < last ? s1 : last;
+			renderFunc( e, src, end - s0, 0, samples + ( s0 - first ) * 2, 0 );
+
+			CHECKPOINT *es = (CHECKPOINT *)( endState + k * stride );
+			if ( end == s1 && k + 1 < h.nCheckpoints )
+			{
+				es->write = src.i;
+				engineSaveState( e, es + 1 );
+				es->valid = 1;
+			}
+			es->done = 1;
+			_exit( 0 );
+		}
+		if ( pid < 0 )
+		{
+			fprintf( stderr, "sidrender: cannot start a process\n" );
+			ok = FALSE;
+			break;
+		}
+		running ++;
+	}
+	for ( ; running; running -- )
+		wait( 0 );
+
+	//
+	// the state at the end of a chunk must be the checkpoint of the next one
+	//
+	j->chunks = j->chunksVerified = 0;
+	for ( u32 k = firstChunk; ok && k < lastChunk; k++ )
+	{
+		const CHECKPOINT *es = (const CHECKPOINT *)( endState + k * stride );
+		const CHECKPOINT *next = (const CHECKPOINT *)( ckpt + ( k + 1 ) * stride );
+		j->chunks ++;
+
+		if ( !es->done )
+		{
+			fprintf( stderr, "sidrender: rendering chunk %u of %s failed\n", k, c.name );
+			ok = FALSE;
+		} else
+		if ( es->valid && k + 1 < h.nCheckpoints && next->valid )
+		{
+			if ( es->write != next->write || memcmp( es + 1, next + 1, h.stateSize ) != 0 )
+			{
+				fprintf( stderr, "sidrender: chunk %u of %s does not end in the state of the next checkpoint\n", k, c.name );
+				ok = FALSE;
+			} else
+				j->chunksVerified ++;
+		}
+	}
+
+	if ( ok && save )
+		saveCheckpoints( fn, &h, ckpt, stride );
+	j->checkpointsLoaded = loaded;
+
+	// stitched samples
+	u64 hash = 0xcbf29ce484222325ull;
+	for ( u64 i = 0; i < last - first; i++ )
+		hash = hashSample( hash, samples[ i * 2 ], samples[ i * 2 + 1 ] );
+	if ( wav )
+		fwrite( samples, sizeof( s16 ) * 2, last - first, wav );
+	j->hash = hash;
+	j->samples = last - first;
+
+	munmap( ckpt, h.nCheckpoints * stride );
+	munmap( endState, h.nCheckpoints * stride );
+	munmap( samples, ( last - first ) * sizeof( s16 ) * 2 );
+	return ok;
+}
+
+static boolean runJob( JOB *j )
+{
+	const CAPTURE &c = captures[ j->capture ];
+	const CONFIG &cfg = configs[ j->config ];
+	u32 flags = jobFlags( c, cfg );
+
+	u32 model[ 2 ] = { c.header.sidModel[ 0 ], c.header.sidModel[ 1 ] };
+	if ( cfg.model ) model[ 0 ] = model[ 1 ] = cfg.model;
+	u32 boost[ 2 ] = { cfg.boost, cfg.boost };
+	u32 clock = c.header.c64Clock ? c.header.c64Clock : 985248;
+
+	SID_ENGINE e;
+	engineInit( &e, flags, model, boost, sampleRate );
+	engineSetClock( &e, clock );
+	engineSetQuality( &e, cfg.quality );
+	for ( u32 i = 0; i < ENGINE_NUM_SIDS; i++ )
+		engineSetChip( &e, i, cfg.chip );
+
+	u64 lastCycle = c.writes.empty() ? 0 : c.writes.back().cycle;
+	u64 nSamples = ( lastCycle + (u64)( tailSeconds * clock ) ) * sampleRate / clock;
+
+	// the window to render
+	u64 first = (u64)( fromSeconds * sampleRate ), last = nSamples;
+	if ( lengthSeconds > 0 && first + (u64)( lengthSeconds * sampleRate ) < last )
+		last = first + (u64)( lengthSeconds * sampleRate );
+	if ( first > last )
+		first = last;
+
+	FILE *wav = 0;
+	if ( outDir )
+	{
+		std::string fn = jobFileName( outDir, c, cfg, FALSE, ".wav" );
+		wav = fopen( fn.c_str(), "wb" );
+		if ( !wav )
+			fprintf( stderr, "sidrender: cannot create %s\n", fn.c_str() ); else
+			writeWAVHeader( wav, sampleRate, last - first );
+	}
+
+	struct timespec t0, t1;
+	clock_gettime( CLOCK_MONOTONIC, &t0 );
+
+	boolean ok = TRUE;
+	if ( chunkSeconds > 0 || checkpointDir )
+	{
+		ok = renderChunked( j, &e, flags, model, cfg.boost, nSamples, first, last, wav );
+	} else
+	{
+		CCaptureSource src = { c.writes.data(), c.writes.size(), 0 };
+#ifdef CACHE_SIMULATION
+		cacheSimStart();
+#endif
+		emulateFuncs[ flags ]( &e, src, first );
+		j->samples = renderFuncs[ flags ]( &e, src, last - first, wav, 0, &j->hash );
+#ifdef CACHE_SIMULATION
+		cacheSimStop( &j->cache );
+#endif
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &t1 );
+	j->seconds = ( t1.tv_sec - t0.tv_sec ) + ( t1.tv_nsec - t0.tv_nsec ) * 1e-9;
+
+	if ( wav ) fclose( wav );
+	engineFree( &e );
+	return ok;
+}
+
+static boolean parseConfig( const char *spec, CONFIG *cfg )
+{
+	static const struct { const char *name; u32 set, clear; } tokens[] = {
+		{ "sid2", ENGINE_FLAG_SID2, ENGINE_FLAG_SID2_SAME }, { "same", ENGINE_FLAG_SID2 | ENGINE_FLAG_SID2_SAME, 0 }, 
+		{ "nosid2", 0, ENGINE_FLAG_SID2 | ENGINE_FLAG_SID2_SAME },
+		{ "opl", ENGINE_FLAG_OPL, 0 }, { "noopl", 0, ENGINE_FLAG_OPL },
+		{ "mono", ENGINE_FLAG_MONO, 0 }, { "stereo", 0, ENGINE_FLAG_MONO },
+		{ "pwm", ENGINE_FLAG_PWM, 0 }, { "hdmi", 0, ENGINE_FLAG_PWM } };
+
+	cfg->spec = spec;
+	cfg->flags = cfg->flagsSet = 0;
+	cfg->model = cfg->boost = cfg->quality = 0;
+	cfg->chip = ENGINE_CHIP_RESID;
+
+	char buf[ 256 ];
+	snprintf( buf, sizeof( buf ), "%s", spec );
+	for ( char *t = strtok( buf, "," ); t; t = strtok( 0, "," ) )
+	{
+		u32 i;
+		for ( i = 0; i < sizeof( tokens ) / sizeof( tokens[ 0 ] ); i++ )
+			if ( !strcmp( t, tokens[ i ].name ) )
+			{
+				u32 bits = tokens[ i ].set | tokens[ i ].clear;
+				cfg->flags = ( cfg->flags & ~bits ) | tokens[ i ].set;
+				cfg->flagsSet |= bits;
+				break;
+			}
+		if ( i < sizeof( tokens ) / sizeof( tokens[ 0 ] ) ) continue;
+
+		if ( !strcmp( t, "6581" ) || !strcmp( t, "8580" ) ) cfg->model = atoi( t ); else
+		if ( !strcmp( t, "boost" ) ) cfg->boost = 1; else
+		if ( !strcmp( t, "lite" ) ) cfg->chip = ENGINE_CHIP_LITE; else
+		if ( t[ 0 ] == 'q' && t[ 1 ] >= '1' && t[ 1 ] < '0' + ENGINE_QUALITY_LEVELS && !t[ 2 ] ) cfg->quality = t[ 1 ] - '0'; else
+		{
+			fprintf( stderr, "sidrender: unknown option '%s' in configuration '%s'\n", t, spec );
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static boolean loadCapture( const char *name, CAPTURE *c )
+{
+	static u8 raw[ CAPTURE_BLOCK_BYTES ];
+
+	c->name = name;
+	FILE *f = fopen( name, "rb" );
+	if ( !f )
+	{
+		fprintf( stderr, "sidrender: cannot open %s\n", name );
+		return FALSE;
+	}
+	fseek( f, 0, SEEK_END );
+	size_t size = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	std::vector<u8> file( size + 1 );
+	if ( fread( file.data(), 1, size, f ) != size )
+		size = 0;
+	fclose( f );
+
+	const CAPTURE_HEADER *h = (const CAPTURE_HEADER *)file.data();
+	if ( size < sizeof( CAPTURE_HEADER ) || h->magic != CAPTURE_MAGIC || h->version != CAPTURE_VERSION || h->headerSize < sizeof( CAPTURE_HEADER ) )
+	{
+		fprintf( stderr, "sidrender: %s is not a capture of register writes\n", name );
+		return FALSE;
+	}
+	c->header = *h;
+
+	for ( size_t ofs = h->headerSize; ofs + sizeof( CAPTURE_BLOCK ) <= size; )
+	{
+		const CAPTURE_BLOCK *b = (const CAPTURE_BLOCK *)( file.data() + ofs );
+		size_t bytes = sizeof( CAPTURE_BLOCK ) + b->size;
+		if ( b->magic != CAPTURE_BLOCK_MAGIC || ofs + bytes > size || b->writes > CAPTURE_BLOCK_WRITES || b->rawSize > CAPTURE_BLOCK_BYTES )
+			break;
+
+		size_t first = c->writes.size();
+		c->writes.resize( first + b->writes );
+		u32 n = traceDecompress( (const u8 *)( b + 1 ), b->size, raw, CAPTURE_BLOCK_BYTES );
+		u32 w = n == b->rawSize ? captureDecodeRecords( raw, n, b->firstCycle, b->writes, &c->writes[ first ] ) : 0;
+		if ( w != b->writes )
+		{
+			fprintf( stderr, "sidrender: %s is corrupt\n", name );
+			c->writes.resize( first );
+			break;
+		}
+		ofs += bytes + TRACE_PADDING( bytes );
+	}
+	return TRUE;
+}
+
+// samples of a WAV file written by sidrender (16 bit stereo)
+static boolean loadWAV( const std::string &fn, std::vector<s16> &samples )
+{
+	FILE *f = fopen( fn.c_str(), "rb" );
+	if ( !f )
+		return FALSE;
+	fseek( f, 0, SEEK_END );
+	long size = ftell( f ) - 44;
+	fseek( f, 44, SEEK_SET );
+	samples.resize( size > 0 ? size / 2 : 0 );
+	boolean ok = fread( samples.data(), 2, samples.size(), f ) == samples.size();
+	fclose( f );
+	return ok;
+}
+
+// -compare: SNR and level of every configuration against the first one, over all captures
+static void compareConfigs()
+{
+	printf( "%-24s %8s %10s %10s %8s\n", "configuration", "captures", "SNR dB", "min dB", "level" );
+	for ( u32 c = 1; c < configs.size(); c++ )
+	{
+		double sumSNR = 0, minSNR = 1e9, sumRef = 0, sumCfg = 0;
+		u32 n = 0;
+		for ( u32 k = 0; k < captures.size(); k++ )
+		{
+			std::vector<s16> ref, cfg;
+			if ( !loadWAV( jobFileName( outDir, captures[ k ], configs[ 0 ], FALSE, ".wav" ), ref ) ||
+				 !loadWAV( jobFileName( outDir, captures[ k ], configs[ c ], FALSE, ".wav" ), cfg ) || ref.size() != cfg.size() )
+			{
+				fprintf( stderr, "sidrender: cannot compare %s\n", captures[ k ].name );
+				continue;
+			}
+
+			double signal = 0, noise = 0, level = 0;
+			for ( size_t i = 0; i < ref.size(); i++ )
+			{
+				double d = (double)cfg[ i ] - ref[ i ];
+				signal += (double)ref[ i ] * ref[ i ];
+				level += (double)cfg[ i ] * cfg[ i ];
+				noise += d * d;
+			}
+			double snr = noise > 0 ? 10.0 * log10( signal / noise ) : 99.0;
+			sumSNR += snr;
+			if ( snr < minSNR ) minSNR = snr;
+			sumRef += signal;
+			sumCfg += level;
+			n ++;
+		}
+		printf( "%-24s %8u %10.1f %10.1f %8.2f\n", configs[ c ].spec.empty() ? "default" : configs[ c ].spec.c_str(), n,
+			n ? sumSNR / n : 0.0, n ? minSNR : 0.0, sumRef > 0 ? sqrt( sumCfg / sumRef ) : 0.0 );
+	}
+}
+
+int main( int argc, char **argv )
+{
+	const char *goldenName = 0;
+	int update = 0, compare = 0;
+	nWorkers = (u32)sysconf( _SC_NPROCESSORS_ONLN );
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !strcmp( argv[ i ], "-c" ) && i + 1 < argc )
+		{
+			CONFIG cfg;
+			if ( !parseConfig( argv[ ++ i ], &cfg ) ) return 2;
+			configs.push_back( cfg );
+		} else
+		if ( !strcmp( argv[ i ], "-o" ) && i + 1 < argc ) outDir = argv[ ++ i ]; else
+		if ( !strcmp( argv[ i ], "-golden" ) && i + 1 < argc ) goldenName = argv[ ++ i ]; else
+		if ( !strcmp( argv[ i ], "-update" ) ) update = 1; else
+		if ( !strcmp( argv[ i ], "-compare" ) ) compare = 1; else
+		if ( !strcmp( argv[ i ], "-tail" ) && i + 1 < argc ) tailSeconds = atof( argv[ ++ i ] ); else
+		if ( !strcmp( argv[ i ], "-rate" ) && i + 1 < argc ) sampleRate = atoi( argv[ ++ i ] ); else
+		if ( !strcmp( argv[ i ], "-j" ) && i + 1 < argc ) nWorkers = atoi( argv[ ++ i ] ); else
+		if ( !strcmp( argv[ i ], "-chunk" ) && i + 1 < argc ) chunkSeconds = atof( argv[ ++ i ] ); else
+		if ( !strcmp( argv[ i ], "-checkpoints" ) && i + 1 < argc ) checkpointDir = argv[ ++ i ]; else
+		if ( !strcmp( argv[ i ], "-from" ) && i + 1 < argc ) fromSeconds = atof( argv[ ++ i ] ); else
+		if ( !strcmp( argv[ i ], "-length" ) && i + 1 < argc ) lengthSeconds = atof( argv[ ++ i ] ); else
+		{
+			CAPTURE c;
+			if ( !loadCapture( argv[ i ], &c ) ) return 1;
+			captures.push_back( c );
+		}
+	}
+
+	if ( captures.empty() )
+	{
+		fprintf( stderr, "usage: %s [-c config]... [-o dir [-compare]] [-golden file [-update]] [-tail seconds] [-rate hz] [-j processes]\n"
+			"       [-chunk seconds] [-checkpoints dir] [-from seconds] [-length seconds] capture.rsw ...\n", argv[ 0 ] );
+		return 2;
+	}
+
+	if ( configs.empty() )
+	{
+		CONFIG cfg;
+		parseConfig( "", &cfg );
+		configs.push_back( cfg );
+	}
+	nJobs = (u32)( captures.size() * configs.size() );
+	if ( nWorkers == 0 ) nWorkers = 1;
+
+	// rendering in chunks uses the processes for the chunks of one job
+	boolean chunked = chunkSeconds > 0 || checkpointDir;
+	u32 nJobWorkers = chunked ? 1 : ( nWorkers < nJobs ? nWorkers : nJobs );
+
+	jobs = (JOB *)mmap( 0, nJobs * sizeof( JOB ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	if ( jobs == MAP_FAILED )
+	{
+		fprintf( stderr, "sidrender: out of memory\n" );
+		return 1;
+	}
+
+	for ( u32 i = 0; i < captures.size(); i++ )
+		for ( u32 j = 0; j < configs.size(); j++ )
+		{
+			JOB *job = &jobs[ i * configs.size() + j ];
+			job->capture = i;
+			job->config = j;
+			job->ok = FALSE;
+			job->chunks = job->chunksVerified = 0;
+			job->checkpointsLoaded = FALSE;
+		}
+
+	struct timespec t0, t1;
+	clock_gettime( CLOCK_MONOTONIC, &t0 );
+
+	fflush( stdout );
+	for ( u32 j = 0, running = 0; j < nJobs || running; )
+	{
+		if ( j < nJobs && running < nJobWorkers )
+		{
+			pid_t pid = fork();
+			if ( pid == 0 )
+			{
+				jobs[ j ].ok = runJob( &jobs[ j ] );
+				_exit( 0 );
+			}
+			if ( pid < 0 )
+			{
+				fprintf( stderr, "sidrender: cannot start a process\n" );
+				return 1;
+			}
+			j ++;
+			running ++;
+		} else
+		{
+			wait( 0 );
+			running --;
+		}
+	}
+
+	int failed = 0;
+	for ( u32 i = 0; i < nJobs; i++ )
+		if ( !jobs[ i ].ok )
+		{
+			fprintf( stderr, "sidrender: rendering %s failed\n", captures[ jobs[ i ].capture ].name );
+			failed ++;
+		}
+
+	clock_gettime( CLOCK_MONOTONIC, &t1 );
+	double wall = ( t1.tv_sec - t0.tv_sec ) + ( t1.tv_nsec - t0.tv_nsec ) * 1e-9;
+
+	//
+	// golden hashes
+	//
+	if ( goldenName && !failed )
+	{
+		std::vector<std::string> lines;
+		for ( u32 i = 0; i < nJobs; i++ )
+		{
+			const JOB &j = jobs[ i ];
+			const char *name = captures[ j.capture ].name;
+			const char *base = strrchr( name, '/' ) ? strrchr( name, '/' ) + 1 : name;
+			const std::string &spec = configs[ j.config ].spec;
+			char line[ 512 ];
+			snprintf( line, sizeof( line ), "%016llx %s %s", (unsigned long long)j.hash, base, spec.empty() ? "default" : spec.c_str() );
+			// a window is part of the configuration
+			if ( fromSeconds > 0 || lengthSeconds > 0 )
+				snprintf( line + strlen( line ), sizeof( line ) - strlen( line ), " from=%g length=%g", fromSeconds, lengthSeconds );
+			lines.push_back( line );
+		}
+
+		if ( update )
+		{
+			FILE *f = fopen( goldenName, "w" );
+			if ( !f )
+			{
+				fprintf( stderr, "sidrender: cannot write %s\n", goldenName );
+				return 1;
+			}
+			for ( auto &l : lines )
+				fprintf( f, "%s\n", l.c_str() );
+			fclose( f );
+			printf( "wrote %u golden hashes to %s\n", (u32)lines.size(), goldenName );
+		} else
+		{
+			FILE *f = fopen( goldenName, "r" );
+			if ( !f )
+			{
+				fprintf( stderr, "sidrender: cannot read %s\n", goldenName );
+				return 1;
+			}
+			std::vector<std::string> golden;
+			char buf[ 512 ];
+			while ( fgets( buf, sizeof( buf ), f ) )
+			{
+				buf[ strcspn( buf, "\r\n" ) ] = 0;
+				golden.push_back( buf );
+			}
+			fclose( f );
+
+			for ( u32 i = 0; i < nJobs; i++ )
+			{
+				// compare with the entry of the same capture and configuration (i.e. everything after the hash)
+				const std::string &l = lines[ i ];
+				const std::string *ref = 0;
+				for ( auto &g : golden )
+					if ( g.size() > 17 && g.compare( 17, std::string::npos, l, 17, std::string::npos ) == 0 )
+						ref = &g;
+
+				if ( !ref )
+				{
+					printf( "MISSING  %s\n", l.c_str() + 17 );
+					jobs[ i ].ok = FALSE;
+				} else
+				if ( ref->compare( 0, 16, l, 0, 16 ) != 0 )
+				{
+					printf( "MISMATCH %s (expected %.16s, rendered %.16s)\n", l.c_str() + 17, ref->c_str(), l.c_str() );
+					jobs[ i ].ok = FALSE;
+				}
+				failed += !jobs[ i ].ok;
+			}
+		}
+	}
+
+	//
+	// performance per configuration: samples per second of one process (with -chunk: of the processes rendering one job), and in real time
+	//
+	printf( "%-24s %8s %12s %14s %8s\n", "configuration", "captures", "samples", "samples/s", "x real" );
+	for ( u32 c = 0; c < configs.size(); c++ )
+	{
+		u64 samples = 0;
+		double seconds = 0;
+		u32 n = 0;
+		for ( u32 i = 0; i < nJobs; i++ )
+			if ( jobs[ i ].config == c )
+			{
+				samples += jobs[ i ].samples;
+				seconds += jobs[ i ].seconds;
+				n ++;
+			}
+		double rate = seconds > 0 ? samples / seconds : 0;
+		printf( "%-24s %8u %12llu %14.0f %8.1f\n", configs[ c ].spec.empty() ? "default" : configs[ c ].spec.c_str(), n,
+			(unsigned long long)samples, rate, rate / sampleRate );
+	}
+#ifdef CACHE_SIMULATION
+	// refills per emulated second (from the first sample to be emulated, i.e. including -from)
+	if ( !chunked )
+	{
+		printf( "%-24s %8s %14s %14s %14s\n", "configuration", "captures", "accesses/s", "L1D refills/s", "L2 refills/s" );
+		for ( u32 c = 0; c < configs.size(); c++ )
+		{
+			CACHESIM_COUNTS sum = { 0, 0, 0 };
+			double seconds = 0;
+			u32 n = 0;
+			for ( u32 i = 0; i < nJobs; i++ )
+				if ( jobs[ i ].config == c )
+				{
+					sum.accesses += jobs[ i ].cache.accesses;
+					sum.l1Refills += jobs[ i ].cache.l1Refills;
+					sum.l2Refills += jobs[ i ].cache.l2Refills;
+					seconds += (double)( jobs[ i ].samples + (u64)( fromSeconds * sampleRate ) ) / sampleRate;
+					n ++;
+				}
+			if ( seconds <= 0 ) seconds = 1;
+			printf( "%-24s %8u %14.0f %14.0f %14.0f\n", configs[ c ].spec.empty() ? "default" : configs[ c ].spec.c_str(), n,
+				sum.accesses / seconds, sum.l1Refills / seconds, sum.l2Refills / seconds );
+		}
+	}
+#endif
+	if ( chunked )
+	{
+		for ( u32 i = 0; i < nJobs; i++ )
+			printf( "%s: %u chunks (checkpoints %s), %u chunk boundaries verified\n", captures[ jobs[ i ].capture ].name, jobs[ i ].chunks,
+				jobs[ i ].checkpointsLoaded ? "loaded" : "recorded", jobs[ i ].chunksVerified );
+		printf( "%u jobs in chunks of %u processes in %.2f s\n", nJobs, nWorkers, wall );
+	} else
+		printf( "%u jobs in %u processes in %.2f s\n", nJobs, nJobWorkers, wall );
+
+	if ( compare && outDir && !failed )
+		compareConfigs();
+
+	if ( goldenName && !update )
+		printf( failed ? "FAILED (%d of %u)\n" : "OK\n", failed, nJobs );
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,262 @@
+//
+// tracedec.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../trace.h"
+
+//
+// decoder for the traces of the bus logic analyzer (kernel=trace): prints a table with one bus cycle per line,
+// or a bus script for the simulator (the cycles which concern the expansion port, see scripts/), or a summary
+//
+// usage: tracedec [-info | -bus [-ultimax]] [-from cycle] [-count n] trace000.rtr
+//
+
+static const u8 *file;
+static size_t fileSize;
+
+// the index of the trace file, or rebuilt by scanning the blocks if the trace has not been closed
+static TRACE_INDEX *blocks;
+static u32 nBlocks;
+
+static int buildIndex( const TRACE_HEADER *h )
+{
+	if ( h->indexOffset && (u64)h->indexOffset + (u64)h->nBlocks * sizeof( TRACE_INDEX ) <= fileSize && ( h->indexOffset & 7 ) == 0 )
+	{
+		blocks = (TRACE_INDEX *)( file + h->indexOffset );
+		nBlocks = h->nBlocks;
+		return 1;
+	}
+
+	u32 capacity = 1024;
+	blocks = (TRACE_INDEX *)malloc( capacity * sizeof( TRACE_INDEX ) );
+	nBlocks = 0;
+
+	for ( size_t ofs = h->headerSize; ofs + sizeof( TRACE_BLOCK ) <= fileSize; )
+	{
+		const TRACE_BLOCK *b = (const TRACE_BLOCK *)( file + ofs );
+		size_t bytes = sizeof( TRACE_BLOCK ) + b->size;
+		if ( b->magic != TRACE_BLOCK_MAGIC || ofs + bytes > fileSize )
+			break;
+
+		if ( nBlocks == capacity )
+		{
+			capacity *= 2;
+			blocks = (TRACE_INDEX *)realloc( blocks, capacity * sizeof( TRACE_INDEX ) );
+		}
+		blocks[ nBlocks ].firstCycle = b->firstCycle;
+		blocks[ nBlocks ].offset = (u32)ofs;
+		blocks[ nBlocks ].cycles = b->cycles;
+		nBlocks ++;
+
+		ofs += bytes + TRACE_PADDING( bytes );
+	}
+
+	fprintf( stderr, "tracedec: trace has not been closed, found %u blocks\n", nBlocks );
+	return 0;
+}
+
+// decodes a block, returns the number of samples
+static u32 decodeBlock( u32 i, u32 *samples )
+{
+	static u8 raw[ TRACE_BLOCK_BYTES ];
+
+	const TRACE_BLOCK *b = (const TRACE_BLOCK *)( file + blocks[ i ].offset );
+	if ( b->magic != TRACE_BLOCK_MAGIC || b->cycles > TRACE_BLOCK_CYCLES || b->rawSize > TRACE_BLOCK_BYTES ||
+		 blocks[ i ].offset + sizeof( TRACE_BLOCK ) + b->size > fileSize )
+	{
+		fprintf( stderr, "tracedec: block %u is corrupt\n", i );
+		return 0;
+	}
+
+	u32 n = traceDecompress( (const u8 *)( b + 1 ), b->size, raw, TRACE_BLOCK_BYTES );
+	u32 c = n == b->rawSize ? traceDecodeRecords( raw, n, b->cycles, samples ) : 0;
+	if ( c != b->cycles )
+		fprintf( stderr, "tracedec: block %u is corrupt\n", i );
+	return c;
+}
+
+// the C64 address (if it can be reconstructed from the select lines: A13-A15 are not connected), or -1
+static int ultimax = 0;
+
+static int fullAddress( u32 s )
+{
+	u32 a = s & TRACE_A_MASK;
+	if ( s & ( TRACE_IO1 | TRACE_IO2 | TRACE_CS ) ) return 0xc000 | a;
+	if ( s & TRACE_ROML ) return 0x8000 | a;
+	if ( s & TRACE_ROMH ) return ( ultimax ? 0xe000 : 0xa000 ) | a;
+	return -1;
+}
+
+// output of bus scripts: consecutive idle/reset cycles are merged
+static u32 runType = 0, runLength = 0, nCommands = 0;
+
+static void flushRun()
+{
+	if ( runLength )
+	{
+		printf( "%s %u\n", runType ? "reset" : "idle", runLength );
+		nCommands ++;
+	}
+	runLength = 0;
+}
+
+static void printBusScript( u32 s )
+{
+	int addr = fullAddress( s );
+
+	if ( ( s & TRACE_RESET ) || addr < 0 )
+	{
+		u32 type = ( s & TRACE_RESET ) ? 1 : 0;
+		if ( type != runType ) flushRun();
+		runType = type;
+		runLength ++;
+		return;
+	}
+
+	flushRun();
+	if ( s & TRACE_WRITE )
+		printf( "w $%04x $%02x\n", addr, ( s >> TRACE_D_SHIFT ) & 255 ); else
+		printf( "r $%04x\n", addr );
+	nCommands ++;
+}
+
+static void printCycle( u64 cycle, u32 s )
+{
+	int addr = fullAddress( s );
+	char a[ 8 ], d[ 8 ];
+
+	if ( addr >= 0 ) sprintf( a, "$%04x", addr ); else sprintf( a, "?%04x", s & TRACE_A_MASK );
+	if ( s & TRACE_WRITE ) sprintf( d, "$%02x", ( s >> TRACE_D_SHIFT ) & 255 ); else strcpy( d, "-" );
+
+	printf( "%10llu\t%s\t%s\t%c\t%d\t%d\t%d\t%d\t%d\t%d\n", (unsigned long long)cycle, a, d, ( s & TRACE_WRITE ) ? 'w' : 'r',
+		!!( s & TRACE_IO1 ), !!( s & TRACE_IO2 ), !!( s & TRACE_ROML ), !!( s & TRACE_ROMH ), !!( s & TRACE_CS ), !!( s & TRACE_RESET ) );
+}
+
+int main( int argc, char **argv )
+{
+	const char *name = 0;
+	int info = 0, bus = 0;
+	u64 from = 0, count = ~0ull;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !strcmp( argv[ i ], "-info" ) ) info = 1; else
+		if ( !strcmp( argv[ i ], "-bus" ) ) bus = 1; else
+		if ( !strcmp( argv[ i ], "-ultimax" ) ) ultimax = 1; else
+		if ( !strcmp( argv[ i ], "-from" ) && i + 1 < argc ) from = strtoull( argv[ ++ i ], 0, 0 ); else
+		if ( !strcmp( argv[ i ], "-count" ) && i + 1 < argc ) count = strtoull( argv[ ++ i ], 0, 0 ); else
+			name = argv[ i ];
+	}
+
+	if ( !name )
+	{
+		fprintf( stderr, "usage: %s [-info | -bus [-ultimax]] [-from cycle] [-count n] trace.rtr\n", argv[ 0 ] );
+		return 2;
+	}
+
+	int fd = open( name, O_RDONLY );
+	struct stat st;
+	if ( fd < 0 || fstat( fd, &st ) != 0 || (size_t)st.st_size < sizeof( TRACE_HEADER ) )
+	{
+		fprintf( stderr, "tracedec: cannot open %s\n", name );
+		return 1;
+	}
+	fileSize = st.st_size;
+	file = (const u8 *)mmap( 0, fileSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if ( file == MAP_FAILED )
+	{
+		fprintf( stderr, "tracedec: cannot map %s\n", name );
+		return 1;
+	}
+
+	const TRACE_HEADER *h = (const TRACE_HEADER *)file;
+	if ( h->magic != TRACE_MAGIC || h->version != TRACE_VERSION || h->headerSize < sizeof( TRACE_HEADER ) )
+	{
+		fprintf( stderr, "tracedec: %s is not a trace file\n", name );
+		return 1;
+	}
+
+	buildIndex( h );
+
+	if ( info )
+	{
+		u64 cycles = 0, raw = 0, bytes = 0;
+		for ( u32 i = 0; i < nBlocks; i++ )
+		{
+			const TRACE_BLOCK *b = (const TRACE_BLOCK *)( file + blocks[ i ].offset );
+			cycles += b->cycles;
+			raw += b->rawSize;
+			bytes += b->size;
+		}
+		u64 last = nBlocks ? blocks[ nBlocks - 1 ].firstCycle + blocks[ nBlocks - 1 ].cycles : 0;
+		printf( "blocks              %u (index %s)\n", nBlocks, h->indexOffset ? "present" : "rebuilt" );
+		printf( "cycles              %llu (%llu dropped)\n", (unsigned long long)cycles, (unsigned long long)( last - cycles ) );
+		printf( "bytes per cycle     %.3f (records %.3f)\n", cycles ? (double)bytes / cycles : 0.0, cycles ? (double)raw / cycles : 0.0 );
+		printf( "recorded at         %u MHz\n", h->armClock / 1000000 );
+		return 0;
+	}
+
+	// binary search for the first block which contains 'from'
+	u32 lo = 0, hi = nBlocks;
+	while ( lo < hi )
+	{
+		u32 mid = ( lo + hi ) / 2;
+		if ( blocks[ mid ].firstCycle + blocks[ mid ].cycles <= from ) lo = mid + 1; else hi = mid;
+	}
+
+	if ( !bus )
+		printf( "cycle\taddr\tdata\trw\tio1\tio2\troml\tromh\tcs\treset\n" );
+
+	static u32 samples[ TRACE_BLOCK_CYCLES ];
+	u64 printed = 0;
+
+	for ( u32 i = lo; i < nBlocks && printed < count; i++ )
+	{
+		// dropped cycles are idle cycles as far as a bus script is concerned
+		u64 gap = i > lo && blocks[ i ].firstCycle > blocks[ i - 1 ].firstCycle + blocks[ i - 1 ].cycles ? 
+				  blocks[ i ].firstCycle - ( blocks[ i - 1 ].firstCycle + blocks[ i - 1 ].cycles ) : 0;
+		if ( gap && !bus )
+			printf( "# %llu cycles dropped\n", (unsigned long long)gap );
+
+		u32 n = decodeBlock( i, samples );
+		for ( u32 j = 0; j < n && printed < count; j++ )
+		{
+			u64 cycle = blocks[ i ].firstCycle + j;
+			if ( cycle < from )
+				continue;
+			if ( bus ) printBusScript( samples[ j ] ); else printCycle( cycle, samples[ j ] );
+			printed ++;
+		}
+	}
+
+	if ( bus )
+	{
+		flushRun();
+		if ( nCommands > 65536 )
+			fprintf( stderr, "tracedec: %u commands, the simulator reads at most 65536 (use -from/-count)\n", nCommands );
+	}
+
+	return 0;
+}
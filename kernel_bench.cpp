@@ -0,0 +1,158 @@
+//
+// kernel_bench.cpp
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+//          - RasPI Bench: micro-benchmarks of the sound emulation and the codecs of the FIQ handlers
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel_bench.h"
+#include "bench.h"
+
+static const char DRIVE[] = "SD:";
+static const char FILENAME[] = "SD:bench.json";
+
+CLogger	*logger;
+
+// the cycle counter extended to 64 bits (it wraps around after ~3s, a run takes ~10ms) and converted to ns with the 
+// ARM clock measured at boot: there is no FIQ handler and nothing else running, i.e. the measurements are undisturbed
+static u64 cycles64 = 0;
+static u32 lastCycles = 0;
+
+static u64 clockNS()
+{
+	u32 c = BUS::readCycleCounter();
+	cycles64 += (u32)( c - lastCycles );
+	lastCycles = c;
+	return cycles64 * 1000 / ( busTimings.armClock / 1000000 );
+}
+
+boolean CKernel::Initialize( void )
+{
+	boolean bOK = TRUE;
+
+	m_CPUThrottle.SetSpeed( CPUSpeedMaximum );
+
+	if ( bOK ) bOK = m_Screen.Initialize();
+
+	if ( bOK )
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice( m_Options.GetLogDevice(), FALSE );
+		if ( pTarget == 0 )
+			pTarget = &m_Screen;
+
+		bOK = m_Logger.Initialize( pTarget );
+		logger = &m_Logger;
+	}
+
+	if ( bOK ) bOK = m_Interrupt.Initialize();
+	if ( bOK ) bOK = m_Timer.Initialize();
+
+	// initialize ARM cycle counters and measure the ARM clock (the time base of the benchmarks)
+	initCycleCounter();
+	initBusClock( &m_Timer );
+
+	m_EMMC.Initialize();
+
+	return bOK;
+}
+
+static boolean writeResults( BENCH_RESULT *results, u32 nResults )
+{
+	FATFS m_FileSystem;
+
+	if ( f_mount( &m_FileSystem, DRIVE, 1 ) != FR_OK )
+	{
+		logger->Write( "RaspiBench", LogError, "Cannot mount drive: %s", DRIVE );
+		return FALSE;
+	}
+
+	boolean ok = FALSE;
+
+	FIL file;
+	if ( f_open( &file, FILENAME, FA_WRITE | FA_CREATE_ALWAYS ) == FR_OK )
+	{
+		ok = TRUE;
+		for ( u32 i = 0; i <= nResults + 1 && ok; i++ )
+		{
+			CString line;
+			if ( i == 0 )
+				line.Format( "{\n  \"platform\": \"rpi\",\n  \"clock_mhz\": %u,\n  \"cases\": [\n", busTimings.armClock / 1000000 ); else
+			if ( i <= nResults )
+			{
+				line.Format( BENCH_JSON_CASE, BENCH_JSON_ARGS( results[ i - 1 ] ) );
+				line.Append( i < nResults ? ",\n" : "\n" );
+			} else
+				line = "  ]\n}\n";
+
+			u32 nBytesWritten;
+			if ( f_write( &file, (const char *)line, line.GetLength(), &nBytesWritten ) != FR_OK || nBytesWritten != line.GetLength() )
+				ok = FALSE;
+		}
+
+		if ( f_close( &file ) != FR_OK )
+			ok = FALSE;
+	}
+
+	if ( !ok )
+		logger->Write( "RaspiBench", LogError, "Cannot write file: %s", FILENAME );
+
+	if ( f_mount( 0, DRIVE, 0 ) != FR_OK )
+		logger->Write( "RaspiBench", LogWarning, "Cannot unmount drive: %s", DRIVE );
+
+	return ok;
+}
+
+void CKernel::Run( void )
+{
+	u32 nCases = benchNumCases();
+	BENCH_RESULT *results = new BENCH_RESULT[ nCases ];
+	u32 armClock = busTimings.armClock;
+
+	logger->Write( "RaspiBench", LogNotice, "%u cases at %u MHz, median/min per unit, MAD, per sample", nCases, armClock / 1000000 );
+
+	for ( u32 c = 0; c < nCases; c++ )
+	{
+		BENCH_RESULT &r = results[ c ];
+		benchRun( c, clockNS, &r );
+
+		logger->Write( "RaspiBench", LogNotice, "%-36s %6u.%03u ns/%-6s %6u.%03u %3u.%u%% %8u.%u ns",
+			r.name, r.ps / 1000, r.ps % 1000, r.unit, r.psMin / 1000, r.psMin % 1000,
+			r.madPermille / 10, r.madPermille % 10, r.psSample / 1000, ( r.psSample % 1000 ) / 100 );
+	}
+
+	// if the firmware throttled the ARM in the meantime (temperature, undervoltage), the times are not comparable
+	initBusClock( &m_Timer );
+	if ( busTimings.armClock + armClock / BUS_CLOCK_TOLERANCE < armClock || busTimings.armClock > armClock + armClock / BUS_CLOCK_TOLERANCE )
+		logger->Write( "RaspiBench", LogWarning, "ARM clock changed from %u to %u MHz, results are not reliable", armClock / 1000000, busTimings.armClock / 1000000 );
+
+	if ( writeResults( results, nCases ) )
+		logger->Write( "RaspiBench", LogNotice, "results written to %s (compare with host/bench -compare)", FILENAME );
+
+	while ( true )
+	{
+		WAIT_FOR_INTERRUPT
+	}
+}
+
+int main( void )
+{
+	CKernel kernel;
+	if ( kernel.Initialize() )
+		kernel.Run();
+
+	halt();
+	return EXIT_HALT;
+}
@@ -0,0 +1,585 @@
+/*
+__________               __________.___      _________        .__  ._____.
+\______   \_____    _____\______   \   |     \_   ___ \_____  |  | |__\_ |__
+ |       _/\__  \  /  ___/|     ___/   |     /    \  \/\__  \ |  | |  || __ \
+ |    |   \ / __ \_\___ \ |    |   |   |     \     \____/ __ \|  |_|  || \_\ \
+ |____|_  /(____  /____  >|____|   |___|      \______  (____  /____/__||___  /
+        \/      \/     \/                            \/     \/             \/
+
+ kernel_calib.cpp
+
+ RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+          - RasPI Calibration: measures the bus timings of a RPi/C64/PLA combination
+ Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//
+// how it works:
+// the RPi emulates a CBM80 cartridge with a tiny test program which copies itself to $C000 and runs from RAM
+// (such that broken ROM reads do not crash the C64). The program loops forever:
+//   - sums up $DE00-$DEFF (the RPi returns a known pattern) and writes the result to $DE00
+//   - sums up $9F00-$9FFF (ROML, requires A8-A12 from the multiplexer) and writes the result to $DE01
+//   - writes X to $DF00+X for X = 0..255
+//   - writes to $DE02 to mark the end of a round
+// Each timing parameter is swept while the other ones are kept fixed, a setting is good if all rounds are correct.
+// The profile uses the midpoint of the valid window and is stored on SD where all other kernels load it at boot.
+//
+
+// define this if you use a RaspberryPi 3B+
+#define TIMINGS_RPI3B_PLUS
+
+#include "kernel_calib.h"
+
+static const char DRIVE[] = "SD:";
+
+// number of rounds which must be correct for a setting to be considered valid
+#define CALIB_ROUNDS		16
+// step width of the sweeps
+#define CALIB_STEP			5
+
+// probing the multiplexer outputs: the late sample (outputs definitely stable) and the range of the early ones,
+// in ns after PHI2 rising (converted to ARM cycles for the measured clock)
+#define CALIB_PROBE_LATE_NS		435
+#define CALIB_PROBE_FIRST_NS	395
+#define CALIB_PROBE_LAST_NS		80
+
+// the read release sweep has no detectable upper end (a late release collides with the VIC in PHI1, which we can't see),
+// the release is set to the earliest passing value plus this hold margin
+#define CALIB_RELEASE_MARGIN_NS	50
+
+// timeout (in microseconds) when waiting for the C64, e.g. PHI2 stopped
+#define CALIB_TIMEOUT			2000000
+
+// what the FIQ handler is doing right now
+#define CALIB_BOOT			0	// C64 boots from our ROM, nothing to measure
+#define CALIB_MEASURE		1	// measure PHI2 and the settle time of the multiplexer
+#define CALIB_MUXSTYLE		2	// handler switches the multiplexers (like kernel_cart and kernel_ef)
+#define CALIB_ADDRSTYLE		3	// handler waits for the PLA and reads IO1, IO2 without the multiplexers (like kernel_georam and kernel_sid)
+
+static volatile u32 calibPhase;
+
+// the timings the FIQ handler currently uses
+static BUS_TIMINGS cur AA;
+
+// the cartridge ROM (the CBM80 header and the test program)
+static u8 calibROM[ 8192 ];
+static u8 calib_cacheoptimized_pool[ 8192 + 64 ];
+static u8 *calib_cacheoptimized;
+
+// what we return when the C64 reads from IO1
+static u8 io1Pattern[ 256 ] AA;
+static u32 io1Expected, romExpected;
+
+// results of the current round (written by the C64)
+static u32 io1Result, romResult;
+static u32 patternErrors, patternCount;
+static u32 checkROM;
+
+// statistics read by the main loop
+static volatile u32 roundsOK, roundsFailed, roundsTotal;
+
+// statistics of the measurement phase
+static volatile u32 phi2CycleMin, phi2HighSum, phi2HighCount;
+static volatile u32 muxProbe, muxProbeLate, muxProbeMismatches, muxProbeCount;
+
+//
+// CBM80 header + copy loop at $8000, the copy loop transfers the test program from $8100 to $C000
+//
+static const u8 calibBoot[] = {
+	0x09, 0x80, 0x09, 0x80, 0xc3, 0xc2, 0xcd, 0x38, 0x30,	// cold/warm start vector $8009, "CBM80"
+	0x78,													// $8009: SEI
+	0xa2, 0x00,												//        LDX #$00
+	0xbd, 0x00, 0x81,										// copy:  LDA $8100,X
+	0x9d, 0x00, 0xc0,										//        STA $C000,X
+	0xe8,													//        INX
+	0xd0, 0xf7,												//        BNE copy
+	0x4c, 0x00, 0xc0										//        JMP $C000
+};
+
+//
+// the test program (running at $C000)
+//
+static const u8 calibTest[] = {
+	0xa9, 0x00,												// $C000: LDA #$00
+	0xaa,													//        TAX
+	0x18,													// l1:    CLC
+	0x7d, 0x00, 0xde,										//        ADC $DE00,X
+	0xe8,													//        INX
+	0xd0, 0xf9,												//        BNE l1
+	0x8d, 0x00, 0xde,										//        STA $DE00
+	0xa9, 0x00,												//        LDA #$00
+	0x18,													// l2:    CLC
+	0x7d, 0x00, 0x9f,										//        ADC $9F00,X
+	0xe8,													//        INX
+	0xd0, 0xf9,												//        BNE l2
+	0x8d, 0x01, 0xde,										//        STA $DE01
+	0x8a,													// l3:    TXA
+	0x9d, 0x00, 0xdf,										//        STA $DF00,X
+	0xe8,													//        INX
+	0xd0, 0xf9,												//        BNE l3
+	0xee, 0x20, 0xd0,										//        INC $D020
+	0x8d, 0x02, 0xde,										//        STA $DE02
+	0x4c, 0x00, 0xc0										//        JMP $C000
+};
+
+static void initCalibROM()
+{
+	for ( u32 i = 0; i < 8192; i++ )
+		calibROM[ i ] = ( i * 29 + ( i >> 8 ) * 7 + 0x3c ) & 255;
+
+	memcpy( &calibROM[ 0x0000 ], calibBoot, sizeof( calibBoot ) );
+	memcpy( &calibROM[ 0x0100 ], calibTest, sizeof( calibTest ) );
+
+	// same layout as in kernel_cart: A8..A12 become the lower bits of the address
+	calib_cacheoptimized = (u8 *)( ( (u32)&calib_cacheoptimized_pool + 64 ) & ~63 );
+
+	for ( u32 i = 0; i < 8192; i++ )
+	{
+		u32 realAdr = ( ( i & 255 ) << 5 ) | ( ( i >> 8 ) & 31 );
+		calib_cacheoptimized[ realAdr ] = calibROM[ i ];
+	}
+
+	io1Expected = romExpected = 0;
+	for ( u32 i = 0; i < 256; i++ )
+	{
+		io1Pattern[ i ] = ( i * 7 + 0x5b ) & 255;
+		io1Expected += io1Pattern[ i ];
+		romExpected += calibROM[ 0x1f00 + i ];
+	}
+	io1Expected &= 255;
+	romExpected &= 255;
+}
+
+static void resetRound()
+{
+	io1Result = romResult = 0xffff;
+	patternErrors = patternCount = 0;
+}
+
+CLogger	*logger;
+
+boolean CKernel::Initialize( void )
+{
+	boolean bOK = TRUE;
+
+	m_CPUThrottle.SetSpeed( CPUSpeedMaximum );
+
+#ifdef USE_HDMI_VIDEO
+	if ( bOK ) bOK = m_Screen.Initialize();
+
+	if ( bOK )
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice( m_Options.GetLogDevice(), FALSE );
+		if ( pTarget == 0 )
+			pTarget = &m_Screen;
+
+		bOK = m_Logger.Initialize( pTarget );
+		logger = &m_Logger;
+	}
+#endif
+
+	if ( bOK ) bOK = m_Interrupt.Initialize();
+	if ( bOK ) bOK = m_Timer.Initialize();
+
+	// initialize ARM cycle counters (for accurate timing), and measure the ARM clock for deriving the bus timings
+	initCycleCounter();
+	initBusClock( &m_Timer );
+
+	// initialize GPIOs
+	gpioInit();
+	SET_BANK2_OUTPUT
+
+	m_EMMC.Initialize();
+
+	// the defaults used to boot the C64 and for the parameters which are not being swept right now
+	#ifndef TIMINGS_RPI3B_PLUS
+	setBusTimings( 131, 193, 560, 468 );
+	#else
+	setBusTimings( 125, 203, 578, 467 );
+	#endif
+	memcpy( &cur, &busTimings, sizeof( BUS_TIMINGS ) );
+
+	initCalibROM();
+	resetRound();
+	calibPhase = CALIB_BOOT;
+
+	// initialize latch and software I2C buffer
+	#ifdef USE_LATCH_OUTPUT
+	initLatch();
+
+	#ifdef USE_OLED
+	splashScreen( raspi_cart_splash );
+	#endif
+	#endif
+
+	// 8k cartridge: EXROM low, GAME high
+	BUS::setPins( bGAME );
+	BUS::clrPins( bEXROM );
+
+	return bOK;
+}
+
+// run CALIB_ROUNDS rounds with the current setting, returns false if the C64 does not respond at all
+static boolean testSetting( CTimer *timer, boolean *pass )
+{
+	// the first round might have been run with mixed settings
+	u32 r = roundsTotal;
+	unsigned startTime = timer->GetClockTicks();
+	while ( roundsTotal == r )
+		if ( timer->GetClockTicks() - startTime > CALIB_TIMEOUT )
+			return FALSE;
+
+	roundsOK = roundsFailed = 0;
+
+	startTime = timer->GetClockTicks();
+	while ( roundsOK + roundsFailed < CALIB_ROUNDS )
+		if ( timer->GetClockTicks() - startTime > CALIB_TIMEOUT )
+			return FALSE;
+
+	*pass = ( roundsFailed == 0 );
+	return TRUE;
+}
+
+// sweeps one parameter and returns the midpoint of the largest valid window, or (holdMargin > 0) its lower end plus holdMargin
+// for windows whose upper end is only the limit of the sweep
+static boolean sweep( CTimer *timer, const char *name, u32 *param, u32 from, u32 to, u32 *windowLow, u32 *windowHigh, u32 holdMargin = 0 )
+{
+	u32 bestLow = 0, bestHigh = 0, bestLength = 0;
+	u32 runLow = 0, runLength = 0;
+
+	for ( u32 v = from; v <= to; v += CALIB_STEP )
+	{
+		*param = v;
+
+		boolean pass = FALSE;
+		if ( !testSetting( timer, &pass ) )
+		{
+			logger->Write( "RaspiCalib", LogError, "C64 does not respond (%s = %u), please reset the C64 and restart", name, v );
+			return FALSE;
+		}
+
+		if ( pass )
+		{
+			if ( runLength++ == 0 )
+				runLow = v;
+			if ( runLength > bestLength )
+			{
+				bestLength = runLength;
+				bestLow = runLow;
+				bestHigh = v;
+			}
+		} else
+			runLength = 0;
+	}
+
+	if ( bestLength == 0 )
+	{
+		logger->Write( "RaspiCalib", LogError, "no valid setting found for %s in [%u, %u]", name, from, to );
+		return FALSE;
+	}
+
+	*windowLow = bestLow;
+	*windowHigh = bestHigh;
+
+	if ( holdMargin )
+	{
+		*param = bestLow + holdMargin < bestHigh ? bestLow + holdMargin : bestHigh;
+		logger->Write( "RaspiCalib", LogNotice, "%s: earliest valid %u (upper end %u%s) => %u", name, bestLow, bestHigh,
+			bestHigh + CALIB_STEP > to ? " = end of the sweep, not measured" : "", *param );
+		return TRUE;
+	}
+
+	*param = ( bestLow + bestHigh ) / 2;
+
+	logger->Write( "RaspiCalib", LogNotice, "%s: valid window [%u, %u] => %u", name, bestLow, bestHigh, *param );
+	return TRUE;
+}
+
+void CKernel::Run( void )
+{
+	// setup FIQ
+	m_InputPin.ConnectInterrupt( FIQHandler<BUS>, this );
+	m_InputPin.EnableInterrupt( GPIOInterruptOnRisingEdge );
+
+	logger->Write( "RaspiCalib", LogNotice, "please turn on the C64..." );
+
+	// wait until the test program runs from RAM
+	while ( roundsTotal < 4 )
+		m_Timer.MsDelay( 10 );
+
+	//
+	// measure PHI2 and when the multiplexer outputs (A8-A12, ROML, ROMH) are stable
+	// (this is done passively, i.e. without reacting to ROML, because reading too early would mistake A1 for ROML)
+	//
+	calibPhase = CALIB_MEASURE;
+
+	phi2CycleMin = 0xffffffff;
+	phi2HighSum = phi2HighCount = 0;
+	m_Timer.MsDelay( 500 );
+
+	muxProbeLate = BUS_NS2CYCLES( CALIB_PROBE_LATE_NS - BUS_FIQ_LATENCY_NS );
+	u32 probeFirst = BUS_NS2CYCLES( CALIB_PROBE_FIRST_NS - BUS_FIQ_LATENCY_NS );
+	u32 probeLast = BUS_NS2CYCLES( CALIB_PROBE_LAST_NS - BUS_FIQ_LATENCY_NS );
+
+	boolean ok = TRUE;
+
+	u32 muxSettle = 0;
+	for ( u32 p = probeFirst; p >= probeLast && ok; p -= CALIB_STEP )
+	{
+		muxProbeMismatches = muxProbeCount = 0;
+		muxProbe = p;
+
+		unsigned startTime = m_Timer.GetClockTicks();
+		while ( muxProbeCount < 10000 )
+			if ( m_Timer.GetClockTicks() - startTime > CALIB_TIMEOUT )
+			{
+				logger->Write( "RaspiCalib", LogError, "C64 does not respond (multiplexer probe), please reset the C64 and restart" );
+				ok = FALSE;
+				break;
+			}
+
+		if ( !ok || muxProbeMismatches )
+			break;
+		muxSettle = p;
+	}
+
+	// not even the latest probe was stable: the multiplexer seems to be broken, start at the default
+	if ( muxSettle == 0 )
+		muxSettle = cur.muxSample;
+
+	cur.phi2Cycle = phi2CycleMin;
+	cur.phi2High = phi2HighCount ? phi2HighSum / phi2HighCount : 0;
+	cur.armClock = busTimings.armClock;
+
+	logger->Write( "RaspiCalib", LogNotice, "ARM clock %u MHz, PHI2 cycle %u, high %u, multiplexer settles after %u (ARM cycles)",
+		cur.armClock / 1000000, cur.phi2Cycle, cur.phi2High, muxSettle );
+
+	//
+	// sweep the timings (writes first, because the results are reported by writes)
+	//
+	u32 lo, hi;
+
+	calibPhase = CALIB_MUXSTYLE;
+	checkROM = 1;
+
+	// sampling D0-D7 must happen before the end of the cycle, the handler must be done before the next one
+	ok = ok && sweep( &m_Timer, "write sample", &cur.writeSample, 100, cur.phi2Cycle - 150, &lo, &hi );
+
+	// releasing too late would collide with the VIC in PHI1 (which we can't detect), limit the sweep to the first half of PHI1:
+	// this limit is not a measured failure, hence the earliest valid release plus a margin instead of the window's midpoint
+	ok = ok && sweep( &m_Timer, "read release", &cur.readRelease, cur.muxSample + 50, cur.phi2High + ( cur.phi2Cycle - cur.phi2High ) / 2, &lo, &hi,
+		BUS_NS2CYCLES( CALIB_RELEASE_MARGIN_NS ) );
+
+	// the lower bound of the multiplexer sampling is the passively measured settle time
+	ok = ok && sweep( &m_Timer, "mux sample", &cur.muxSample, muxSettle, cur.readRelease - 50, &lo, &hi );
+
+	// GeoRAM/SID-like handler: the cartridge ROM at $9Fxx is not served here. Sampling before IO1/IO2 are decoded
+	// would react to the previous cycle's levels and drive D0-D7 in cycles which are not ours (a bus fight), i.e. the
+	// sweep starts at the earliest time the PLA and the 74LS139 guarantee
+	calibPhase = CALIB_ADDRSTYLE;
+	checkROM = 0;
+	u32 addrFrom = BUS_NS2CYCLES( BUS_ADDR_SAMPLE_MIN_NS - BUS_FIQ_LATENCY_NS );
+	ok = ok && sweep( &m_Timer, "addr sample", &cur.addrSample, addrFrom, cur.readRelease - 100, &lo, &hi );
+
+	calibPhase = CALIB_MUXSTYLE;
+	checkROM = 1;
+
+	if ( ok )
+	{
+		if ( saveBusTimings( logger, DRIVE, BUS_TIMINGS_FILENAME, &cur ) )
+			logger->Write( "RaspiCalib", LogNotice, "profile written to %s: addr=%u mux=%u release=%u write=%u",
+				BUS_TIMINGS_FILENAME, cur.addrSample, cur.muxSample, cur.readRelease, cur.writeSample );
+	} else
+		logger->Write( "RaspiCalib", LogError, "calibration failed, profile not written" );
+
+	// keep the test running (the border color shows that the C64 is happy)
+	while ( true )
+	{
+		WAIT_FOR_INTERRUPT
+	}
+
+	// and we'll never reach this...
+	m_InputPin.DisableInterrupt();
+}
+
+__attribute__( ( always_inline ) ) inline void calibWrite( u32 A, u32 D, u32 io1 )
+{
+	if ( io1 )
+	{
+		switch ( A & 3 ) {
+		case 0: io1Result = D; break;
+		case 1: romResult = D; break;
+		case 2:
+			if ( io1Result == io1Expected && ( !checkROM || romResult == romExpected ) &&
+				 patternErrors == 0 && patternCount == 256 )
+				roundsOK ++; else
+				roundsFailed ++;
+			roundsTotal ++;
+			resetRound();
+			break;
+		}
+	} else
+	{
+		if ( D != A ) patternErrors ++;
+		patternCount ++;
+	}
+}
+
+template <class BUS>
+void CKernel::FIQHandler (void *pParam)
+{
+	register u32 g2, g3, D;
+
+	BEGIN_CYCLE_COUNTER
+
+	static u32 lastFIQ = 0;
+	u32 delta = armCycleCounter - lastFIQ;
+	lastFIQ = armCycleCounter;
+
+	//
+	// variant 1: wait for the PLA, then read IO1, IO2 and A0-A7 (no multiplexer)
+	//
+	if ( calibPhase == CALIB_ADDRSTYLE )
+	{
+		WAIT_UP_TO_CYCLE( cur.addrSample );
+
+		g2 = BUS::getLevels();
+
+		if ( !( g2 & bPHI ) ) return;
+		if ( ( g2 & bIO1 ) && ( g2 & bIO2 ) ) return;
+
+		u32 A = ( g2 >> A0 ) & 255;
+
+		if ( g2 & bRW )
+		{
+			if ( !( g2 & bIO1 ) )
+			{
+				WRITE_D0D7( io1Pattern[ A ], ( 1 << GPIO_OE ) );
+				WAIT_UP_TO_CYCLE( cur.readRelease );
+				BUS::setPins( 1 << GPIO_OE );
+			}
+		} else
+		{
+			SET_BANK2_INPUT
+			BUS::clrPins( 1 << GPIO_OE );
+			WAIT_UP_TO_CYCLE( cur.writeSample );
+			g3 = BUS::getLevels();
+			BUS::setPins( 1 << GPIO_OE );
+			SET_BANK2_OUTPUT
+
+			calibWrite( A, ( g3 >> D0 ) & 255, !( g2 & bIO1 ) );
+		}
+		return;
+	}
+
+	//
+	// variant 2: switch the multiplexer immediately (see kernel_cart.cpp)
+	//
+	BUS::setPins( 1 << DIR_CTRL_257 );
+	g2 = BUS::getLevels();
+
+	if ( !( g2 & bPHI ) )
+	{
+		BUS::clrPins( 1 << DIR_CTRL_257 );
+		return;
+	}
+
+	if ( delta < phi2CycleMin && calibPhase == CALIB_MEASURE )
+		phi2CycleMin = delta;
+
+	u32 A = ( g2 >> A0 ) & 255;
+	u32 addr = A << 5;
+	CACHE_PRELOAD( &calib_cacheoptimized[ addr ] );
+
+	if ( calibPhase == CALIB_MEASURE )
+	{
+		// compare an early sample of the multiplexer outputs with a late one (when they're definitely stable)
+		const u32 muxMask = ( 255 << A0 );
+		WAIT_UP_TO_CYCLE( muxProbe );
+		g2 = BUS::getLevels();
+		WAIT_UP_TO_CYCLE( muxProbeLate );
+		g3 = BUS::getLevels();
+
+		// only in cycles where nobody drives anything on our behalf
+		if ( ( g3 & bIO1 ) && ( g3 & bIO2 ) && ( g3 & bROML ) )
+		{
+			if ( ( g2 ^ g3 ) & muxMask ) muxProbeMismatches ++;
+			muxProbeCount ++;
+
+			// wait until PHI2 goes low
+			u32 cc;
+			do {
+				g2 = BUS::getLevels();
+			} while ( g2 & bPHI );
+			READ_CYCLE_COUNTER( cc );
+			phi2HighSum += cc - armCycleCounter;
+			phi2HighCount ++;
+		}
+		BUS::clrPins( 1 << DIR_CTRL_257 );
+		return;
+	}
+
+	WAIT_UP_TO_CYCLE( cur.muxSample );
+	g3 = BUS::getLevels();
+
+	// read cartridge ROM
+	if ( ( g3 & bRW ) && !( g3 & bROML ) )
+	{
+		addr |= ( g3 >> A8 ) & 31;
+		D = calib_cacheoptimized[ addr ];
+
+		WRITE_D0D7( D, ( 1 << GPIO_OE ) | ( 1 << DIR_CTRL_257 ) );
+		WAIT_UP_TO_CYCLE( cur.readRelease );
+		BUS::setPins( 1 << GPIO_OE );
+		return;
+	}
+
+	// read IO1 (IO2 reads are dummy reads of "STA $DF00,X" and ignored)
+	if ( ( g3 & bRW ) && !( g3 & bIO1 ) )
+	{
+		WRITE_D0D7( io1Pattern[ A ], ( 1 << GPIO_OE ) | ( 1 << DIR_CTRL_257 ) );
+		WAIT_UP_TO_CYCLE( cur.readRelease );
+		BUS::setPins( 1 << GPIO_OE );
+		return;
+	}
+
+	// write to IO1 or IO2
+	if ( !( g3 & bRW ) && ( !( g3 & bIO1 ) || !( g3 & bIO2 ) ) )
+	{
+		SET_BANK2_INPUT
+		BUS::clrPins( ( 1 << GPIO_OE ) | ( 1 << DIR_CTRL_257 ) );
+		WAIT_UP_TO_CYCLE( cur.writeSample );
+		u32 g1 = BUS::getLevels();
+		BUS::setPins( 1 << GPIO_OE );
+		SET_BANK2_OUTPUT
+
+		calibWrite( A, ( g1 >> D0 ) & 255, !( g3 & bIO1 ) );
+		return;
+	}
+
+	BUS::clrPins( 1 << DIR_CTRL_257 );
+}
+
+int main( void )
+{
+	CKernel kernel;
+	if ( kernel.Initialize() )
+		kernel.Run();
+
+	halt();
+	return EXIT_HALT;
+}
@@ -34,13 +34,12 @@ __________               __________.___     _________                __
 
 #include "kernel_cart.h"
 
+static const char DRIVE[] = "SD:";
+
 // setting EXROM and GAME (low = 0, high = 1)
 #define SET_EXROM	0
 #define SET_GAME	1
 
-// cartridge memory window bROML or bROMH
-#define ROM_LH		bROML
-
 // simply defines "const unsigned char cart[8192]", a binary dump of a 8k cartridge
 #include "Cartridges/cart_d020.h" //  ROML, EXROM closed
 //#include "Cartridges/cart_1541.h" //  ROML, EXROM closed
@@ -57,6 +56,28 @@ __________               __________.___     _________                __
 unsigned char cart_cacheoptimized_pool[ 16384 ];
 unsigned char *cart_cacheoptimized;
 
+// the cartridge as a device (see device.h): 8k in the ROML window (use ROMH_READ/ROMHRead for ROMH cartridges)
+struct DeviceCart : DeviceBase
+{
+	enum { ROML_READ = 1, ROML_READ_CYCLES = 4, PREFETCH_CYCLES = 6 };
+
+	// MUX_SAMPLE is very critical! 
+	// too low => switching to A8..12 not ready and you'll read A0..A7 again (or some mess)
+	// too high => you'll be late for writing to the bus
+	// 160 cycles work well fr RPi 3B, 200 for a 3B+ (or use a calibrated profile), the timings are in ns after PHI2 rising
+	#ifndef TIMINGS_RPI3B_PLUS
+	enum { ADDR_SAMPLE_NS = 131, MUX_SAMPLE_NS = 193, READ_RELEASE_NS = 560, WRITE_SAMPLE_NS = 468 };
+	#else
+	enum { ADDR_SAMPLE_NS = 125, MUX_SAMPLE_NS = 203, READ_RELEASE_NS = 578, WRITE_SAMPLE_NS = 467 }; // 407: mux 200 cycles
+	#endif
+
+	// we got the A0..A7 part of the address which we will access and preload this chunk of 32 bytes into the cache
+	// (otherwise cache misses may occur and the bus write cycle might be missed)
+	static void prefetchAddress( u32 A ) { CACHE_PRELOAD( &cart_cacheoptimized[ A << 5 ] ); }
+
+	static u8 ROMLRead( u32 addr ) { return cart_cacheoptimized[ addr ]; }
+};
+
 CLogger	*logger;
 
 boolean CKernel::Initialize( void )
@@ -82,13 +103,20 @@ boolean CKernel::Initialize( void )
 	if ( bOK ) bOK = m_Interrupt.Initialize();
 	if ( bOK ) bOK = m_Timer.Initialize();
 
-	// initialize ARM cycle counters (for accurate timing)
+	// initialize ARM cycle counters (for accurate timing), and measure the ARM clock for deriving the bus timings
 	initCycleCounter();
+	initBusClock( &m_Timer );
 
 	// initialize GPIOs
 	gpioInit();
 	SET_BANK2_OUTPUT 
 
+	// default bus timings, a calibrated profile on SD overrides them (see kernel_calib.cpp)
+	Device<DeviceCart, BUS>::setDefaultTimings();
+
+	m_EMMC.Initialize();
+	loadBusTimings( logger, DRIVE, BUS_TIMINGS_FILENAME );
+
 	// initialize latch and software I2C buffer
 	#ifdef USE_LATCH_OUTPUT
 	initLatch();
@@ -118,8 +146,8 @@ boolean CKernel::Initialize( void )
 			clr |= bGAME; else
 			set |= bGAME; 
 
-		write32( ARM_GPIO_GPSET0, set );
-		write32( ARM_GPIO_GPCLR0, clr ); 
+		BUS::setPins( set );
+		BUS::clrPins( clr ); 
 
 		#endif
 	#endif
@@ -144,18 +172,19 @@ __attribute__( ( always_inline ) ) inline void warmCache()
 		CACHE_PRELOAD( ptr );
 		ptr += 64;
 	}
+	warmDataMask();
 }
 
 // instruction cache prefetching
 __attribute__( ( always_inline ) ) inline void prefetchI( const void *ptr )
 {
-	asm volatile( "pli [%0]\n" : : "r" ( ptr ) );
+	CACHE_PRELOADI( ptr );
 }
 
 void CKernel::Run( void )
 {
 	// setup FIQ
-	m_InputPin.ConnectInterrupt( this->FIQHandler, this );
+	m_InputPin.ConnectInterrupt( Device<DeviceCart, BUS>::FIQHandler, this );
 	m_InputPin.EnableInterrupt( GPIOInterruptOnRisingEdge );
 
 	warmCache();
@@ -164,9 +193,12 @@ void CKernel::Run( void )
 	while ( true )
 	{
 		warmCache();
-		prefetchI( *((void**)this->FIQHandler) ); 
+		// derive the bus timings again if the ARM clock changed (e.g. throttling), busClockChanges counts how often
+		updateBusClock( &m_Timer );
+		prefetchI( (void*)&Device<DeviceCart, BUS>::FIQHandler ); 
+		prefetchI( (void*)&Device<DeviceCart, BUS>::BusCycle<CYCLE_ROM_READ> ); 
 		//asm volatile ("loop:");
-		asm volatile ("wfi");
+		WAIT_FOR_INTERRUPT
 		//asm volatile ("B loop");
 	}
 
@@ -174,81 +206,6 @@ void CKernel::Run( void )
 	m_InputPin.DisableInterrupt();
 }
 
-void CKernel::FIQHandler (void *pParam)
-{
-	register u32 g2;
-	register u32 g3;
-	register u32 D;
-
-	prefetchI( &&cachesetup ); 
-	prefetchI( &&romaccess ); 
-
-	BEGIN_CYCLE_COUNTER
-
-	// here's a really nasty trick:
-	// we switch the multiplexers to A8..12, but because of some external delay we read the signals before they switch :-P (relaxes timing)
-	write32( ARM_GPIO_GPSET0, 1 << DIR_CTRL_257 ); 
-
-	// get A0-A7 immediately -- caution: IO1, IO2, ... etc. are not yet valid (the PLA delay is very likely not yet over)
-	g2 = read32( ARM_GPIO_GPLEV0 );
-
-	// block wrong executions
-	if ( !( g2 & bPHI ) ) 
-	{
-		write32( ARM_GPIO_GPCLR0, 1 << DIR_CTRL_257 ); 
-		return;
-	}
-
-	// we got the A0..A7 part of the address which we will access
-	// and preload this chunk of 32 bytes into the cache
-	// (otherwise cache misses may occur and the bus write cycle might be missed)
-	//
-	// slightly slower version (only assuming A0-A7 map to consecutive GPIOs):
-	// u32 addr = ( ( g2 >> A0 ) & 255 ) << 5;
-	// slightly faster, but be careful: the following line assumes that A0 == 5 (!) -- then it matches to position where we want A0-A7 shifted to
-cachesetup:
-	register u32 addr = g2 & ( 255 << 5 );
-	CACHE_PRELOAD( &cart_cacheoptimized[ addr ] );
-
-	// this value is very critical! 
-	// too low => switching to A8..12 not ready and you'll read A0..A7 again (or some mess)
-	// too high => you'll be late for writing to the bus
-	// 160 works well fr RPi 3B, for a 3B+ choose ... TODO
-	#ifndef TIMINGS_RPI3B_PLUS
-	WAIT_UP_TO_CYCLE( 160 );
-	#else
-	WAIT_UP_TO_CYCLE( 200 ); // 407: 200
-	#endif
-	g3 = read32( ARM_GPIO_GPLEV0 );
-
-romaccess:
-	if ( ( g3 & ROM_LH ) || !( g3 & bRW ) )
-	{
-		write32( ARM_GPIO_GPCLR0, 1 << DIR_CTRL_257 ); 
-		return;
-	}
-
-	// make our address complete
-	addr |= ( g3 >> A8 ) & 31;
-
-	// read cartridge rom
-	D = cart_cacheoptimized[ addr ] << D0;
-
-	// and put it onto the c64-bus, enable the 74LVC245, and switch the multiplexer back to A0..A7
-	write32( ARM_GPIO_GPSET0, D );
-	write32( ARM_GPIO_GPCLR0, (D_FLAG & ( ~D )) | (1 << GPIO_OE) | (1 << DIR_CTRL_257) );
-
-	// TODO: timings for RPi 3B+ are different!
-	#ifndef TIMINGS_RPI3B_PLUS
-	WAIT_UP_TO_CYCLE( 600 );
-	#else
-	WAIT_UP_TO_CYCLE( 725 ); 
-	#endif
-
-	// disable 74LVC245 
-	write32( ARM_GPIO_GPSET0, (1 << GPIO_OE) );
-}
-
 int main( void )
 {
 	CKernel kernel;
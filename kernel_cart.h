@@ -51,9 +51,15 @@
 #include <circle/gpiomanager.h>
 #include <circle/util.h>
 
+#include <SDCard/emmc.h>
+#include <fatfs/ff.h>
+
 #include "lowlevel_arm.h"
 #include "gpio_defs.h"
+#include "bus.h"
+#include "device.h"
 #include "latch.h"
+#include "timings.h"
 
 #ifdef USE_OLED
 #include "oled.h"
@@ -70,7 +76,8 @@ public:
 	#endif
 		m_Timer( &m_Interrupt ),
 		m_Logger( m_Options.GetLogLevel(), &m_Timer ),
-		m_InputPin( PHI2, GPIOModeInput, &m_Interrupt )
+		m_InputPin( PHI2, GPIOModeInput, &m_Interrupt ),
+		m_EMMC( &m_Interrupt, &m_Timer, 0 )
 	{
 	}
 
@@ -83,8 +90,6 @@ public:
 	void Run( void );
 
 private:
-	static void FIQHandler( void *pParam );
-
 	// do not change this order
 	CMemorySystem		m_Memory;
 	CKernelOptions		m_Options;
@@ -98,6 +103,7 @@ private:
 	CLogger				m_Logger;
 	CScheduler			m_Scheduler;
 	CGPIOPinFIQ			m_InputPin;
+	CEMMCDevice			m_EMMC;
 };
 
 #endif
@@ -35,21 +35,19 @@ __________               __________.___      ___________.__                .__
 
 #include "kernel_ef.h"
 #include "crt.h"
+#include "mappers.h"
 
 // we will read this .CRT file
 static const char DRIVE[] = "SD:";
 static const char FILENAME[] = "SD:test.crt";
 
-// temporary buffers to read cartridge data from SD
 CRT_HEADER header;
 
-static u8 ef_low_raw[ 1024 * 1024 ];
-static u8 ef_high_raw[ 1024 * 1024 ];
-
 static u32 bankswitchType = BS_NONE;
 
-// are we reacting to ROML and/or ROMH?
+// are we reacting to ROML and/or ROMH? (ROM_OFF are the other ones)
 static u32 ROM_LH = 0;
+static u32 ROM_OFF = bROML | bROMH;
 
 //
 // easyflash (note: generic and magic desk carts are "mapped" to easyflash carts)
@@ -57,10 +55,9 @@ static u32 ROM_LH = 0;
 #define EASYFLASH_BANKS			64
 #define EASYFLASH_BANK_MASK		( EASYFLASH_BANKS - 1 )
 
-// easyflash states
-static u32 ef_jumper;
-static u8  ef_reg0, ef_reg2;
-static u8  ef_mode, ef_modeOld;
+// state of the cartridge mapper (see mappers.h)
+static CART_STATE cart AA;
+static u8  ef_modeOld;
 
 // ... flash
 u8 flash_cacheoptimized_pool[ 1024 * 1024 * 2 + 1024 ] AA;
@@ -73,21 +70,66 @@ static u8  *ef_ram AA;
 // counts the #cycles when the C64-reset line is pulled down (to detect a reset)
 u32 resetCounter;
 
-// table with EF memory configurations adapted from Vice
-#define M_EXROM	2
-#define M_GAME	1
-static const u8 ef_memconfig[] = {
-    (M_EXROM|M_GAME), (M_EXROM|M_GAME), (M_GAME), (M_GAME),
-    (M_EXROM), (M_EXROM|M_GAME), 0, (M_GAME),
-    (M_EXROM), (M_EXROM|M_GAME), 0, (M_GAME), 
-    (M_EXROM), (M_EXROM|M_GAME), 0, (M_GAME),
-};
+//
+// flash emulation (AM29F040, one chip for ROML and one for ROMH) such that EAPI can program and erase the flash
+//
+#define FLASH_READ				0
+#define FLASH_MAGIC1			1	// received $AA at $555
+#define FLASH_MAGIC2			2	// received $55 at $2AA
+#define FLASH_PROGRAM			3	// next write programs a byte
+#define FLASH_ERASE_MAGIC1		4	// received $80
+#define FLASH_ERASE_MAGIC2		5	// received $AA at $555
+#define FLASH_ERASE_MAGIC3		6	// received $55 at $2AA, now waiting for $30 (sector) or $10 (chip erase)
+#define FLASH_AUTOSELECT		7
+#define FLASH_BUSY				8	// erasing (done by the main loop)
+
+// 8 sectors of 64k per chip (= 8 banks each)
+#define FLASH_SECTORS			8
+
+// written by the FIQ handler, except while a chip is FLASH_BUSY: then the FIQ handler ignores the chip, and the background
+// task (which erases) owns flashState and flashSectorWrites of the chip until it sets FLASH_READ as its last step
+static u32 flashState[ 2 ];
+
+// != 0 if reads from a chip return status information (autoselect, erase in progress) instead of the array
+static u32 flashStatusRead[ 2 ];
+static u32 flashToggle[ 2 ];
+
+// sectors which are to be erased by the main loop
+static u32 flashErasePending[ 2 ];
+
+// incremented for every modification of a sector, the main loop writes a sector back if it differs from flashSectorWritten
+// (programming is counted by the FIQ handler, erasing by the background task, see flashState for the hand-over)
+static u32 flashSectorWrites[ 2 * FLASH_SECTORS ];
+static u32 flashSectorWritten[ 2 * FLASH_SECTORS ];
+
+//
+// bank prefetcher: the FIQ handler only counts bank switches, the main loop warms the caches for the new bank and 
+// keeps a set of hot banks (most recently and most frequently selected ones) in L2
+//
+#define PREFETCH_HOT_BANKS		6
+// ROM reads whose data is put onto the bus later than this (after reading A8-A12) most likely missed the caches
+#define PREFETCH_LATE_CYCLES	120
+
+// written by the FIQ handler only
+static u32 bankSwitchCount = 0;
+static u32 bankStatLate[ EASYFLASH_BANKS ];
+
+// written by the main loop only
+static u32 bankStatSwitches[ EASYFLASH_BANKS ];
+static u32 bankStatMisses[ EASYFLASH_BANKS ];
+static u32 bankScore[ EASYFLASH_BANKS ];
+static u32 hotBanks[ PREFETCH_HOT_BANKS ];
+static u32 nHotBanks = 0;
+
+// file offsets and lengths of the data of all CHIP packets in the .CRT (for writing back)
+static u32 crtChipOffsets[ 2 * CRT_MAX_BANKS ];
+static u32 crtChipLengths[ 2 * CRT_MAX_BANKS ];
 
 static u32 updateGAMEEXROM = 0;
 
 __attribute__( ( always_inline ) ) inline void setGAMEEXROM()
 {
-	ef_mode = ef_memconfig[ ( ef_jumper << 3 ) | ( ef_reg2 & 7 ) ];
+	u8 ef_mode = cart.mode;
 
 #ifdef USE_LATCH_FOR_GAMEEXROM
 	if ( ( ef_mode & 2 ) != ( ef_modeOld & 2 ) )
@@ -122,57 +164,139 @@ __attribute__( ( always_inline ) ) inline void setGAMEEXROM()
 			set |= bGAME;
 	}
 
-	if ( set ) write32( ARM_GPIO_GPSET0, set );
-	if ( clr ) write32( ARM_GPIO_GPCLR0, clr ); 
+	if ( set ) BUS::setPins( set );
+	if ( clr ) BUS::clrPins( clr ); 
 #endif
 
 	ef_modeOld = ef_mode;
 }
 
-__attribute__( ( always_inline ) ) inline u8 easyflash_IO1_Read( u32 addr )
+__attribute__( ( always_inline ) ) inline u8 flashReadStatus( u32 chip, u32 addr )
 {
-	return ( addr & 2 ) ? ef_reg2 : ef_reg0;
-}
+	if ( flashState[ chip ] == FLASH_BUSY )
+	{
+		// DQ7 = 0 (complement of the erased data), DQ6 toggles with every read, DQ3 = 1 (erase started)
+		flashToggle[ chip ] ^= 0x40;
+		return flashToggle[ chip ] | 0x08;
+	}
 
-__attribute__( ( always_inline ) ) inline void easyflash_IO1_Write( u32 addr, u8 value )
-{
-	switch ( addr & 2 ) {
-	case 0:
-		ef_reg0 = (u8)( value & EASYFLASH_BANK_MASK );
-		break;
-	default:
-		ef_reg2 = value & 0x87;
-		ef_mode = ef_memconfig[ ( ef_jumper << 3 ) | ( ef_reg2 & 7 ) ];
+	// autoselect: manufacturer AMD, device ID AM29F040, sector not protected
+	switch ( addr & 3 )
+	{
+	case 0: return 0x01;
+	case 1: return 0xa4;
+	default: return 0x00;
 	}
 }
 
-__attribute__( ( always_inline ) ) inline u8 easyflash_IO2_Read( u32 addr )
+// chip = 0 (ROML) or 1 (ROMH), addr = A0..A12, ofs = position in flash_cacheoptimized
+__attribute__( ( always_inline ) ) inline void flashWrite( u32 chip, u32 addr, u32 ofs, u8 D )
 {
-	return ef_ram[ addr & 0xff ];
-}
+	u32 cmdAddr = addr & 0x7ff;
 
-__attribute__( ( always_inline ) ) inline  void easyflash_IO2_Write( u32 addr, u8 value )
-{
-	ef_ram[ addr & 0xff ] = value;
+	switch ( flashState[ chip ] )
+	{
+	case FLASH_BUSY:
+		return;
+
+	case FLASH_READ:
+	case FLASH_AUTOSELECT:
+		if ( cmdAddr == 0x555 && D == 0xaa && flashState[ chip ] == FLASH_READ )
+		{
+			flashState[ chip ] = FLASH_MAGIC1;
+			return;
+		}
+		break;
+
+	case FLASH_MAGIC1:
+		if ( cmdAddr == 0x2aa && D == 0x55 )
+		{
+			flashState[ chip ] = FLASH_MAGIC2;
+			return;
+		}
+		break;
+
+	case FLASH_MAGIC2:
+		if ( cmdAddr == 0x555 )
+		{
+			switch ( D )
+			{
+			case 0xa0: flashState[ chip ] = FLASH_PROGRAM; return;
+			case 0x80: flashState[ chip ] = FLASH_ERASE_MAGIC1; return;
+			case 0x90: flashState[ chip ] = FLASH_AUTOSELECT; flashStatusRead[ chip ] = 1; return;
+			}
+		}
+		break;
+
+	case FLASH_PROGRAM:
+		// programming can only clear bits
+		flash_cacheoptimized[ ofs * 2 + chip ] &= D;
+		flashSectorWrites[ chip * FLASH_SECTORS + ( cart.bank >> 3 ) ] ++;
+		flashState[ chip ] = FLASH_READ;
+		BUS::countEvent( "flash.program" );
+		return;
+
+	case FLASH_ERASE_MAGIC1:
+		if ( cmdAddr == 0x555 && D == 0xaa )
+		{
+			flashState[ chip ] = FLASH_ERASE_MAGIC2;
+			return;
+		}
+		break;
+
+	case FLASH_ERASE_MAGIC2:
+		if ( cmdAddr == 0x2aa && D == 0x55 )
+		{
+			flashState[ chip ] = FLASH_ERASE_MAGIC3;
+			return;
+		}
+		break;
+
+	case FLASH_ERASE_MAGIC3:
+		if ( D == 0x30 || ( D == 0x10 && cmdAddr == 0x555 ) )
+		{
+			// erasing 64k is too slow for the FIQ handler, the main loop does it while we report "busy"
+			flashErasePending[ chip ] = ( D == 0x30 ) ? ( 1 << ( cart.bank >> 3 ) ) : ( ( 1 << FLASH_SECTORS ) - 1 );
+			flashState[ chip ] = FLASH_BUSY;
+			flashStatusRead[ chip ] = 1;
+			return;
+		}
+		break;
+	}
+
+	// $F0 (reset) or an invalid sequence: back to read mode
+	flashState[ chip ] = FLASH_READ;
+	flashStatusRead[ chip ] = 0;
 }
 
 void initEF()
 {
-	ef_jumper = 0;
-	ef_reg0   = 0;
-	ef_reg2   = 0;
+	// memory configuration of generic carts as given in the .CRT header (0 = line active)
+	cart.headerMode = ( header.game ? 0 : CART_MODE_16K ) | ( header.exrom ? CART_MODE_OFF : 0 );
+	cart.ram = ef_ram;
 
-	if ( bankswitchType == BS_NONE )
+	switch ( bankswitchType )
 	{
-		ef_reg2 = 4;
-		if ( !header.exrom ) ef_reg2 |= 2;
-		if ( !header.game )  ef_reg2 |= 1;
+	case BS_EASYFLASH:		MapperEasyFlash::reset( cart ); break;
+	case BS_MAGICDESK:		MapperMagicDesk::reset( cart ); break;
+	case BS_OCEAN:			MapperOcean::reset( cart ); break;
+	case BS_FUNPLAY:		MapperFunPlay::reset( cart ); break;
+	case BS_SYSTEM3:		MapperSystem3::reset( cart ); break;
+	case BS_DINAMIC:		MapperDinamic::reset( cart ); break;
+	case BS_SIMONSBASIC:	MapperSimonsBasic::reset( cart ); break;
+	default:				MapperNormal::reset( cart ); break;
 	}
 
 	resetCounter = 0;
 
-	ef_mode = ef_memconfig[ ( ef_jumper << 3 ) | ( ef_reg2 & 7 ) ];
-	ef_modeOld = ~ef_mode;
+	for ( u32 c = 0; c < 2; c++ )
+		if ( flashState[ c ] != FLASH_BUSY )
+		{
+			flashState[ c ] = FLASH_READ;
+			flashStatusRead[ c ] = 0;
+		}
+
+	ef_modeOld = ~cart.mode;
 	for ( u32 i = 0; i < 256; i++ )
 		ef_ram[ i ] = 0xff;
 }
@@ -202,40 +326,33 @@ boolean CKernel::Initialize( void )
 	if ( bOK ) bOK = m_Interrupt.Initialize();
 	if ( bOK ) bOK = m_Timer.Initialize();
 
-	// initialize ARM cycle counters (for accurate timing)
+	// initialize ARM cycle counters (for accurate timing), and measure the ARM clock for deriving the bus timings
 	initCycleCounter();
+	initBusClock( &m_Timer );
 
 	// initialize GPIOs
 	gpioInit();
 	SET_BANK2_OUTPUT 
 
-	// read .CRT
-	//readCRTFile();
-	m_EMMC.Initialize();
-	readCRTFile( logger, &header, (char*)DRIVE, (char*)FILENAME, (u8*)&ef_low_raw[0], (u8*)&ef_high_raw[0], &bankswitchType, &ROM_LH );
+	// default bus timings (ns after PHI2 rising), a calibrated profile on SD overrides them (see kernel_calib.cpp)
+	#ifndef TIMINGS_RPI3B_PLUS
+	setBusTimings( 131, 202, 577, 468 );
+	#else
+	setBusTimings( 125, 203, 578, 467 );
+	#endif
 
 	// get aligned memory for easyflash ram
 	ef_ram = (u8*)( ( (u32)&ef_rampool + 64 ) & ~63 );
 
-	// convert flash roms into a cache-friendly format
+	// flash roms are stored in a cache-friendly format, banks not contained in the .CRT are erased flash
 	flash_cacheoptimized = (u8 *)( ( (u32)&flash_cacheoptimized_pool + 64 ) & ~63 );
+	memset( flash_cacheoptimized, 0xff, EASYFLASH_BANKS * 8192 * 2 );
 
-	// we always copy the max flash size
-	u32 nBlocks = 64;
-
-	for ( u32 b = 0; b < nBlocks; b++ )
-		for ( u32 i = 0; i < 8192; i++ )
-		{
-			u32 realAdr = ( ( i & 255 ) << 5 ) | ( ( i >> 8 ) & 31 );
-			flash_cacheoptimized[ ( b * 8192 + realAdr ) * 2 + 0 ] = ef_low_raw[ b * 8192 + i ];
-		}
-
-	for ( u32 b = 0; b < nBlocks; b++ )
-		for ( u32 i = 0; i < 8192; i++ )
-		{
-			u32 realAdr = ( ( i & 255 ) << 5 ) | ( ( i >> 8 ) & 31 );
-			flash_cacheoptimized[ ( b * 8192 + realAdr ) * 2 + 1 ] = ef_high_raw[ b * 8192 + i ];
-		}
+	// read .CRT (directly into the cache-friendly format)
+	m_EMMC.Initialize();
+	loadBusTimings( logger, DRIVE, BUS_TIMINGS_FILENAME );
+	readCRTFile( logger, &header, (char*)DRIVE, (char*)FILENAME, flash_cacheoptimized, &bankswitchType, &ROM_LH, crtChipOffsets, crtChipLengths );
+	ROM_OFF = ( bROML | bROMH ) & ~ROM_LH;
 
 	// initialize latch and software I2C buffer
 	#ifdef USE_LATCH_OUTPUT
@@ -256,20 +373,249 @@ boolean CKernel::Initialize( void )
 }
 
 
-__attribute__( ( always_inline ) ) inline void warmCache4FlashBanks()
+__attribute__( ( always_inline ) ) inline void warmCache4FlashBanks( u32 bank = cart.bank, u32 first = 0, u32 lines = 8192 * 2 / 64 )
 {
-	u8 *ptr = (u8*)&flash_cacheoptimized[ ef_reg0 * 8192 * 2 ];
-	for ( register u32 i = 0; i < 8192 * 2 / 64; i++ )
+	u8 *ptr = (u8*)&flash_cacheoptimized[ bank * 8192 * 2 + first * 64 ];
+	for ( register u32 i = 0; i < lines; i++ )
 	{
 		CACHE_PRELOAD( ptr );
 		ptr += 64;
 	}
 }
 
+//
+// runs in the main loop after every FIQ (which wakes the core from wfi):
+// after a bank switch the new bank is warmed completely, otherwise the hot set is re-warmed piece by piece
+//
+void bankPrefetchTask()
+{
+	static u32 lastSwitchCount = 0;
+	static u32 nSwitches = 0;
+	static u32 warmBank = 0, warmLine = 0;
+
+	if ( bankSwitchCount != lastSwitchCount )
+	{
+		lastSwitchCount = bankSwitchCount;
+
+		u32 bank = cart.bank;
+		warmCache4FlashBanks( bank );
+		CACHE_PRELOAD( &ef_ram[ 0 ] );
+		CACHE_PRELOAD( &ef_ram[ 64 ] );
+		CACHE_PRELOAD( &ef_ram[ 128 ] );
+		CACHE_PRELOAD( &ef_ram[ 192 ] );
+
+		// statistics: a switch to a bank outside the hot set is a miss
+		bankStatSwitches[ bank ] ++;
+		u32 hit = 0;
+		for ( u32 i = 0; i < nHotBanks; i++ )
+			if ( hotBanks[ i ] == bank ) hit = 1;
+		if ( !hit ) bankStatMisses[ bank ] ++;
+
+		// scores combine frequency and recency: every switch adds to the score, all scores decay over time
+		bankScore[ bank ] += 16;
+		if ( ( ++ nSwitches & 63 ) == 0 )
+			for ( u32 i = 0; i < EASYFLASH_BANKS; i++ )
+				bankScore[ i ] >>= 1;
+
+		// hot set = most recently selected bank + highest scores
+		hotBanks[ 0 ] = bank;
+		nHotBanks = 1;
+		for ( u32 i = 0; i < EASYFLASH_BANKS; i++ )
+		{
+			if ( i == bank || bankScore[ i ] == 0 ) continue;
+
+			u32 j = nHotBanks;
+			if ( j == PREFETCH_HOT_BANKS )
+			{
+				if ( bankScore[ i ] <= bankScore[ hotBanks[ j - 1 ] ] ) continue;
+				j --;
+			} else
+				nHotBanks ++;
+
+			while ( j > 1 && bankScore[ hotBanks[ j - 1 ] ] < bankScore[ i ] )
+			{
+				hotBanks[ j ] = hotBanks[ j - 1 ];
+				j --;
+			}
+			hotBanks[ j ] = i;
+		}
+
+		warmBank = warmLine = 0;
+		return;
+	}
+
+	// re-warm 1k of the hot set per call (the current bank is always part of it)
+	if ( nHotBanks == 0 )
+	{
+		hotBanks[ 0 ] = cart.bank;
+		nHotBanks = 1;
+	}
+
+	warmCache4FlashBanks( hotBanks[ warmBank ], warmLine, 16 );
+	warmLine += 16;
+	if ( warmLine == 8192 * 2 / 64 )
+	{
+		warmLine = 0;
+		if ( ++ warmBank >= nHotBanks )
+		{
+			warmBank = 0;
+			CACHE_PRELOAD( &ef_ram[ 0 ] );
+			CACHE_PRELOAD( &ef_ram[ 64 ] );
+			CACHE_PRELOAD( &ef_ram[ 128 ] );
+			CACHE_PRELOAD( &ef_ram[ 192 ] );
+		}
+	}
+}
+
+void CKernel::LogBankStatistics( void )
+{
+	static unsigned lastLog = 0;
+	static u32 lastSwitches = 0;
+
+	unsigned now = m_Timer.GetClockTicks();
+	if ( now - lastLog < 10000000 || bankSwitchCount == lastSwitches )
+		return;
+	lastLog = now;
+	lastSwitches = bankSwitchCount;
+
+	u32 switches = 0, misses = 0, late = 0;
+	for ( u32 i = 0; i < EASYFLASH_BANKS; i++ )
+	{
+		switches += bankStatSwitches[ i ];
+		misses += bankStatMisses[ i ];
+		late += bankStatLate[ i ];
+
+		#ifdef CONSOLE_DEBUG
+		if ( bankStatSwitches[ i ] || bankStatLate[ i ] )
+			m_Logger.Write( "RaspiFlash", LogNotice, "bank %d: switches=%u misses=%u late=%u", i, bankStatSwitches[ i ], bankStatMisses[ i ], bankStatLate[ i ] );
+		#endif
+	}
+
+	m_Logger.Write( "RaspiFlash", LogNotice, "bank switches=%u prefetch misses=%u late ROM reads=%u", switches, misses, late );
+}
+
+//
+// background task of the flash emulation (called from the main loop, never from the FIQ handler):
+// performs pending erase operations, and writes modified sectors back to the .CRT once the C64 stopped writing for a while
+//
+static u8 writeBackBank[ 8192 ];
+
+void CKernel::FlashBackgroundTask( void )
+{
+	for ( u32 c = 0; c < 2; c++ )
+		if ( flashState[ c ] == FLASH_BUSY )
+		{
+			u32 sectors = flashErasePending[ c ];
+
+			for ( u32 b = 0; b < EASYFLASH_BANKS; b++ )
+				if ( sectors & ( 1 << ( b >> 3 ) ) )
+				{
+					u8 *p = &flash_cacheoptimized[ b * 8192 * 2 + c ];
+					for ( u32 i = 0; i < 8192; i++, p += 2 )
+						*p = 0xff;
+				}
+
+			for ( u32 i = 0; i < FLASH_SECTORS; i++ )
+				if ( sectors & ( 1 << i ) )
+				{
+					flashSectorWrites[ c * FLASH_SECTORS + i ] ++;
+					BUS::countEvent( "flash.erase" );
+				}
+
+			flashErasePending[ c ] = 0;
+			flashStatusRead[ c ] = 0;
+
+			// hand the chip back to the FIQ handler only after all of the above is stored
+			DataMemBarrier();
+			flashState[ c ] = FLASH_READ;
+		}
+
+	// check every 500ms if there's something to write back
+	static unsigned lastCheck = 0;
+	static u32 lastWrites = 0;
+
+	unsigned now = m_Timer.GetClockTicks();
+	if ( now - lastCheck < 500000 )
+		return;
+	lastCheck = now;
+
+	u32 writes = 0, dirty = 0;
+	for ( u32 i = 0; i < 2 * FLASH_SECTORS; i++ )
+	{
+		writes += flashSectorWrites[ i ];
+		if ( flashSectorWrites[ i ] != flashSectorWritten[ i ] )
+			dirty |= 1 << i;
+	}
+
+	// wait until the C64 is done (e.g. EAPI writes a highscore byte by byte)
+	if ( writes != lastWrites || dirty == 0 )
+	{
+		lastWrites = writes;
+		return;
+	}
+
+	if ( f_mount( &m_FileSystem, DRIVE, 1 ) != FR_OK )
+	{
+		m_Logger.Write( "RaspiFlash", LogError, "Cannot mount drive: %s", DRIVE );
+		return;
+	}
+
+	FIL file;
+	if ( f_open( &file, FILENAME, FA_READ | FA_WRITE | FA_OPEN_EXISTING ) != FR_OK )
+	{
+		m_Logger.Write( "RaspiFlash", LogError, "Cannot open file: %s", FILENAME );
+		f_mount( 0, DRIVE, 0 );
+		return;
+	}
+
+	u32 nBanks = 0;
+	for ( u32 i = 0; i < 2 * FLASH_SECTORS; i++ )
+		if ( dirty & ( 1 << i ) )
+		{
+			u32 c = i / FLASH_SECTORS;
+			u32 version = flashSectorWrites[ i ];
+			boolean ok = TRUE;
+
+			for ( u32 b = ( i % FLASH_SECTORS ) * 8; b < ( i % FLASH_SECTORS ) * 8 + 8; b++ )
+			{
+				gatherCacheOptimized( flash_cacheoptimized, b, c, writeBackBank, 8192 );
+
+				if ( !writeCRTBank( &file, crtChipOffsets, crtChipLengths, c, b, writeBackBank ) )
+					ok = FALSE;
+				nBanks ++;
+			}
+
+			// if the C64 modified the sector in the meantime, it stays dirty
+			if ( ok )
+			{
+				flashSectorWritten[ i ] = version;
+				BUS::countEvent( "flash.writeback" );
+			}
+		}
+
+	if ( f_close( &file ) != FR_OK )
+		m_Logger.Write( "RaspiFlash", LogError, "Cannot close file" );
+
+	f_mount( 0, DRIVE, 0 );
+
+	m_Logger.Write( "RaspiFlash", LogNotice, "wrote %u banks back to %s", nBanks, FILENAME );
+}
+
 void CKernel::Run( void )
 {
 	// setup FIQ
-	m_InputPin.ConnectInterrupt( this->FIQHandler, this );
+	// the FIQ handler is instantiated for each cartridge type
+	switch ( bankswitchType )
+	{
+	case BS_EASYFLASH:		m_InputPin.ConnectInterrupt( FIQHandler<MapperEasyFlash, BUS>, this ); break;
+	case BS_MAGICDESK:		m_InputPin.ConnectInterrupt( FIQHandler<MapperMagicDesk, BUS>, this ); break;
+	case BS_OCEAN:			m_InputPin.ConnectInterrupt( FIQHandler<MapperOcean, BUS>, this ); break;
+	case BS_FUNPLAY:		m_InputPin.ConnectInterrupt( FIQHandler<MapperFunPlay, BUS>, this ); break;
+	case BS_SYSTEM3:		m_InputPin.ConnectInterrupt( FIQHandler<MapperSystem3, BUS>, this ); break;
+	case BS_DINAMIC:		m_InputPin.ConnectInterrupt( FIQHandler<MapperDinamic, BUS>, this ); break;
+	case BS_SIMONSBASIC:	m_InputPin.ConnectInterrupt( FIQHandler<MapperSimonsBasic, BUS>, this ); break;
+	default:				m_InputPin.ConnectInterrupt( FIQHandler<MapperNormal, BUS>, this ); break;
+	}
 	m_InputPin.EnableInterrupt( GPIOInterruptOnRisingEdge );
 
 	CACHE_PRELOAD( &ef_ram[ 0 ] );
@@ -289,39 +635,81 @@ void CKernel::Run( void )
 			warmCache4FlashBanks();
 			setGAMEEXROM();
 		}
-		asm volatile ("wfi");
+
+		{
+			PMU_SCOPE( PMU_BANK_PREFETCH, "bank prefetch" )
+			bankPrefetchTask();
+			warmDataMask();
+		}
+
+		if ( bankswitchType == BS_EASYFLASH )
+		{
+			PMU_SCOPE( PMU_FLASH_TASK, "flash task" )
+			FlashBackgroundTask();
+		}
+
+		LogBankStatistics();
+		PMU_REPORT( &m_Logger, "RaspiFlash", m_Timer.GetClockTicks() )
+
+		// derive the bus timings again if the ARM clock changed (e.g. throttling)
+		if ( updateBusClock( &m_Timer ) )
+			m_Logger.Write( "RaspiFlash", LogNotice, "ARM clock changed to %u MHz, bus timings derived again (%u times)", busTimings.armClock / 1000000, busClockChanges );
+
+		WAIT_FOR_INTERRUPT
 	}
 
 	// and we'll never reach this...
 	m_InputPin.DisableInterrupt();
 }
 
+// classifies a dispatch index for mapper M, cycles which the mapper ignores share the idle handler
+template <class M>
+constexpr u32 cycleType( u32 ctrl )
+{
+	u32 t = classifyCycle( ctrl, CTRL_ROML | CTRL_ROMH | CTRL_IO1 | CTRL_IO2 );
+
+	if ( ( t == CYCLE_ROM_WRITE && !M::ROM_WRITE ) ||
+		 ( t == CYCLE_IO1_READ && !M::IO1_READ ) || ( t == CYCLE_IO1_WRITE && !M::IO1_WRITE ) ||
+		 ( t == CYCLE_IO2_READ && !M::IO2_READ ) || ( t == CYCLE_IO2_WRITE && !M::IO2_WRITE ) )
+		return CYCLE_IDLE;
+
+	return t;
+}
+
+template <class M, class BUS>
 void CKernel::FIQHandler (void *pParam)
 {
 	register u32 g2 AA;
 	register u32 g3 AA;
-	register u32 D AA;
+
+	// one handler per kind of bus cycle (see dispatch.h)
+	#define EF_CYCLE( n ) BusCycle<M, BUS, cycleType<M>( n )>
+	static TBusCycleHandler * const dispatch[ CTRL_SIZE ] AA = { DISPATCH_TABLE( EF_CYCLE ) };
+	#undef EF_CYCLE
 
 	// not really necessary, but doesn't hurt either
 	CACHE_PRELOADI( &&cachesetup ); 
-	CACHE_PRELOADI( &&flashrom ); 
-	CACHE_PRELOADI( &&efram ); 
+	CACHE_PRELOAD( &dispatch[ 0 ] );
+	CACHE_PRELOAD( &dispatch[ 16 ] );
+	CACHE_PRELOAD( &dispatch[ 32 ] );
+	CACHE_PRELOAD( &dispatch[ 48 ] );
+	SlotWorkPrefetch::prepare();
 	
 	BEGIN_CYCLE_COUNTER
 
 	// here's a really nasty trick:
 	// we switch the multiplexers to A8..12, but because of some external delay we read the signals before they switch :-P (relaxes timing)
-	write32( ARM_GPIO_GPSET0, 1 << DIR_CTRL_257 ); 
+	BUS::setPins( 1 << DIR_CTRL_257 ); 
 
 	// so let's get A0-A7 immediately -- caution: IO1, IO2, ... etc. may not yet be valid (PLA delay, although the FIQ often takes longer to fire up)
-	g2 = read32( ARM_GPIO_GPLEV0 );
+	g2 = BUS::getLevels();
 
 	if ( !( g2 & bRESET ) ) resetCounter ++;
 
 	// block wrong executions
 	if ( !( g2 & bPHI ) ) 
 	{
-		write32( ARM_GPIO_GPCLR0, 1 << DIR_CTRL_257 ); 
+		BUS::clrPins( 1 << DIR_CTRL_257 ); 
 		return;
 	}
 
@@ -329,134 +717,148 @@ cachesetup:
 
 	// here would be the logical time to switch multiplexer to A8..12
 	// but the nasty trick (see above) relaxes the timing a lot!
-	// write32( ARM_GPIO_GPSET0, 1 << DIR_CTRL_257 ); 
+	// BUS::setPins( 1 << DIR_CTRL_257 ); 
 
 	// we got the A0..A7 part of the address which we will access
 	register u32 A = ( g2 >> A0 ) & 255;
 	register u32 addr = A << 5;
 	
-	CACHE_PRELOAD( &flash_cacheoptimized[ ( ( ef_reg0 * 8192 + addr ) * 2 ) ] );
-	CACHE_PRELOAD( &ef_ram[ A & ~63 ] );
-	CACHE_PRELOADW( &ef_ram[ A & ~63 ] );
+	CACHE_PRELOAD( &flash_cacheoptimized[ ( ( cart.bank * 8192 + addr ) * 2 ) ] );
+	if ( M::IO2_READ || M::IO2_WRITE )
+	{
+		CACHE_PRELOAD( &ef_ram[ A & ~63 ] );
+		CACHE_PRELOADW( &ef_ram[ A & ~63 ] );
+	}
 
-	#ifndef TIMINGS_RPI3B_PLUS
-	WAIT_UP_TO_CYCLE( 170 );
-	#else
-	WAIT_UP_TO_CYCLE( 200 ); 
-	#endif
+	WAIT_UP_TO_CYCLE( busTimings.muxSample );
+
+	g3 = BUS::getLevels();
 
-	g3 = read32( ARM_GPIO_GPLEV0 );
+	// ROM chips which are not present in the .CRT are treated as inactive
+	dispatch[ CTRL_INDEX( g3 | ROM_OFF ) ]( g2, g3, armCycleCounter );
+}
+
+template <class M, class BUS, u32 T>
+void CKernel::BusCycle( u32 g2, u32 g3, unsigned long armCycleCounter )
+{
+	register u32 A = ( g2 >> A0 ) & 255;
+	register u32 addr = A << 5;
 
-#if 1
 	// access to flash roms
-	flashrom:
-	//if ( ( g2 & bPHI ) && ( g3 & bRW ) && ( !( g3 & bROML ) || !( g3 & bROMH ) ) )
-	if ( ( g2 & bPHI ) && ( g3 & bRW ) && ( ~g3 & ROM_LH ) )
+	if ( T == CYCLE_ROM_READ )
 	{
 		// make our address complete
 		addr |= ( g3 >> A8 ) & 31;
 
 		// read cartridge rom
-		if ( !( g3 & bROMH ) )
-			D = flash_cacheoptimized[ (ef_reg0 * 8192 + addr)*2+1 ] << D0; else
-			D = flash_cacheoptimized[ (ef_reg0 * 8192 + addr)*2+0 ] << D0;
+		PMU_BEGIN( pmuStart )
+		u32 D;
+		u32 chip = ( g3 & bROMH ) ? 0 : (u32)M::ROMH_PLANE;
+		if ( M::ROM_WRITE && flashStatusRead[ chip ] )
+			D = flashReadStatus( chip, A ); else
+			D = flash_cacheoptimized[ (cart.bank * 8192 + addr)*2+chip ];
+		PMU_END( pmuEnd )
 		
 		// and put it onto the c64-bus, enable the 74LVC245, and switch the multiplexer back to A0..A7
-		write32( ARM_GPIO_GPSET0, D );
-		write32( ARM_GPIO_GPCLR0, (D_FLAG & ( ~D )) | (1 << GPIO_OE) | (1 << DIR_CTRL_257) );
-
-		// TODO: timings for RPi 3B+ are different!
-		#ifndef TIMINGS_RPI3B_PLUS
-		WAIT_UP_TO_CYCLE( 620 );
-		#else
-		WAIT_UP_TO_CYCLE( 725 ); 
-		#endif
+		WRITE_D0D7( D, (1 << GPIO_OE) | (1 << DIR_CTRL_257) );
+
+		// count reads which were most likely served from DRAM
+		u32 cc;
+		READ_CYCLE_COUNTER( cc );
+		if ( cc - armCycleCounter > busTimings.muxSample + PREFETCH_LATE_CYCLES )
+			bankStatLate[ cart.bank ] ++;
+
+		WAIT_UP_TO_CYCLE_WORK( busTimings.readRelease, SlotWorkPrefetch );
 
 		// disable 74LVC245 
-		write32( ARM_GPIO_GPSET0, (1 << GPIO_OE) );
+		BUS::setPins( (1 << GPIO_OE) );
+
+		PMU_ADD( PMU_ROM_READ, "flash read", pmuStart, pmuEnd )
 		return;
 	}
-#endif
-	efram:
-	if ( ( g2 & bPHI ) && (!( g3 & bIO1 ) || !( g3 & bIO2 )) )
+
+	// write to flash roms (EAPI switches to Ultimax mode, then ROML/ROMH are also active for write accesses)
+	if ( T == CYCLE_ROM_WRITE )
 	{
-		if ( ( bankswitchType == BS_EASYFLASH ) && ( g3 & bRW ) ) // read from periphery / write-to-bus cycle?
-		{
-			D = (u32)( ef_ram[ A ] ) << D0;
+		SET_BANK2_INPUT 
 
-			if ( !( g3 & bIO1 ) ) 
-				D = easyflash_IO1_Read( A ) << D0; 
+		// enable 74LVC245 and switch the multiplexer back to A0..A7
+		BUS::clrPins( (1 << GPIO_OE) | (1 << DIR_CTRL_257) );
 
-			write32( ARM_GPIO_GPSET0, D );
-			write32( ARM_GPIO_GPCLR0, (D_FLAG & ( ~D )) | (1 << GPIO_OE) | (1 << DIR_CTRL_257) );
+		u32 chip = ( g3 & bROMH ) ? 0 : 1;
+		u32 A8_12 = ( g3 >> A8 ) & 31;
 
-			// TODO: tweak this timing!
-			#ifndef TIMINGS_RPI3B_PLUS
-			WAIT_UP_TO_CYCLE( 620 );
-			#else
-			WAIT_UP_TO_CYCLE( 725 ); 
-			#endif
+		WAIT_UP_TO_CYCLE_WORK( busTimings.writeSample, SlotWorkPrefetch );
 
-			// disable 74LV245
-			write32( ARM_GPIO_GPSET0, 1 << GPIO_OE ); 
-			return;
-		} else
-		{	// read-from-bus (= write to periphery) cycle
+		u32 g1 = BUS::getLevels();
 
-			// set bank 2 GPIOs to input (D0-D7)
-			SET_BANK2_INPUT 
+		// disable 74LV245
+		BUS::setPins( 1 << GPIO_OE ); 
 
-			// enable 74LVC245
-			write32( ARM_GPIO_GPCLR0, (1 << GPIO_OE) | ( 1 << DIR_CTRL_257 ) ); 
+		SET_BANK2_OUTPUT 
 
-			#ifndef TIMINGS_RPI3B_PLUS
-			WAIT_UP_TO_CYCLE( 490 );
-			#else
-			WAIT_UP_TO_CYCLE( 570 ); 
-			#endif
+		flashWrite( chip, A | ( A8_12 << 8 ), cart.bank * 8192 + ( addr | A8_12 ), ( g1 >> D0 ) & 255 );
+		return;
+	}
 
-			g3 = read32( ARM_GPIO_GPLEV0 );
+	u32 mapperResult = 0;
 
-			// disable 74LV245
-			write32( ARM_GPIO_GPSET0, 1 << GPIO_OE ); 
+	if ( T == CYCLE_IO1_READ || T == CYCLE_IO2_READ )
+	{
+		// read from periphery / write-to-bus cycle
+		u8 value = 0;
 
-			SET_BANK2_OUTPUT 
+		if ( T == CYCLE_IO1_READ ) 
+			mapperResult = M::IO1Read( cart, A, value ); else
+			mapperResult = M::IO2Read( cart, A, value );
 
-			// decode data
-			u8 D = ( g3 >> D0 ) & 255;
+		if ( mapperResult & MAPPER_DRIVE_BUS )
+		{
+			WRITE_D0D7( value, (1 << GPIO_OE) | (1 << DIR_CTRL_257) );
 
-			// write to easyflash register
-			if ( !( g3 & bIO1 ) ) 
-			{
-				if ( bankswitchType == BS_EASYFLASH )
-				{
-					// easyflash register in IO1
-					easyflash_IO1_Write( A, D );
-
-					if ( ( A & 2 ) == 0 )
-					{
-						warmCache4FlashBanks();
-					} else 
-						updateGAMEEXROM = 1;
-				} else
-				{
-					ef_reg0 = (u8)( D & 127 );
-					warmCache4FlashBanks();
-
-					if ( !(D & 128) )
-						ef_reg2 |= 2; else
-						ef_reg2 |= 0;
-					
-					updateGAMEEXROM = 1;
-				}
+			WAIT_UP_TO_CYCLE_WORK( busTimings.readRelease, SlotWorkPrefetch );
 
-			} else
-				// write to easyflash RAM
-				easyflash_IO2_Write( A, D );
+			// disable 74LV245
+			BUS::setPins( 1 << GPIO_OE ); 
 		}
+	} else
+	if ( T == CYCLE_IO1_WRITE || T == CYCLE_IO2_WRITE )
+	{	// read-from-bus (= write to periphery) cycle
+
+		// set bank 2 GPIOs to input (D0-D7)
+		SET_BANK2_INPUT 
+
+		// enable 74LVC245
+		BUS::clrPins( (1 << GPIO_OE) | ( 1 << DIR_CTRL_257 ) ); 
+
+		WAIT_UP_TO_CYCLE_WORK( busTimings.writeSample, SlotWorkPrefetch );
+
+		u32 g1 = BUS::getLevels();
+
+		// disable 74LV245
+		BUS::setPins( 1 << GPIO_OE ); 
+
+		SET_BANK2_OUTPUT 
+
+		// decode data
+		u8 value = ( g1 >> D0 ) & 255;
+
+		if ( T == CYCLE_IO1_WRITE ) 
+			mapperResult = M::IO1Write( cart, A, value ); else
+			mapperResult = M::IO2Write( cart, A, value );
 	}
 
-	write32( ARM_GPIO_GPCLR0, 1 << DIR_CTRL_257 ); 
+	BUS::clrPins( 1 << DIR_CTRL_257 ); 
+
+	// the main loop warms the caches for the new bank (see bankPrefetchTask), and the next FIQs preload it while they wait
+	if ( mapperResult & MAPPER_BANK_CHANGED )
+	{
+		bankSwitchCount ++;
+		slotPrefetch( &flash_cacheoptimized[ cart.bank * 8192 * 2 ], 8192 * 2 );
+	}
+
+	if ( mapperResult & MAPPER_MODE_CHANGED )
+		updateGAMEEXROM = 1;
 
 	if ( updateGAMEEXROM )
 	{
@@ -466,9 +868,6 @@ cachesetup:
 		outputLatch();
 		#endif
 	}
-
-	return;
-
 }
 
 int main( void )
@@ -50,19 +50,29 @@
 #include <circle/gpiopinfiq.h>
 #include <circle/gpiomanager.h>
 #include <circle/util.h>
+#include <circle/synchronize.h>
 
 #include <SDCard/emmc.h>
 #include <fatfs/ff.h>
 
 #include "lowlevel_arm.h"
 #include "gpio_defs.h"
+#include "bus.h"
+#include "dispatch.h"
+#include "slotwork.h"
 #include "latch.h"
+#include "timings.h"
 
 #ifdef USE_OLED
 #include "oled.h"
 #include "splash_raspiflash.h"
 #endif
 
+typedef void TBusCycleHandler( u32 g2, u32 g3, unsigned long armCycleCounter );
+
+// code regions for PMU profiling (make kernel=ef PMU_PROFILING=1, see lowlevel_arm.h)
+enum { PMU_ROM_READ = 0, PMU_BANK_PREFETCH, PMU_FLASH_TASK };
+
 class CKernel
 {
 public:
@@ -89,7 +99,10 @@ public:
 	void Run( void );
 
 private:
-	static void FIQHandler( void *pParam );
+	template <class M, class BUS> static void FIQHandler( void *pParam );
+	template <class M, class BUS, u32 T> static void BusCycle( u32 g2, u32 g3, unsigned long armCycleCounter );
+	void FlashBackgroundTask( void );
+	void LogBankStatistics( void );
 
 	// do not change this order
 	CMemorySystem		m_Memory;
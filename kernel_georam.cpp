@@ -32,6 +32,11 @@
 
 #include "kernel_georam.h"
 
+static const char DRIVE[] = "SD:";
+
+// GeoRAM contents are loaded from and written back to this image (this makes it a persistent RAM disk)
+static const char FILENAME[] = "SD:georam.img";
+
 // size of GeoRAM/NeoRAM in Kilobytes
 const int geoSizeKB = 2048;
 
@@ -44,14 +49,80 @@ u8  geoReg[ 2 ] AA;
 u8  geoRAM_Pool[ geoSizeKB * 1024 + 64 ] AA;
 u8 *geoRAM AA;
 
-// u8* to current window
-#define GEORAM_WINDOW (&geoRAM[ ( geoReg[ 1 ] * 16384 ) + ( geoReg[ 0 ] * 256 ) ])
+// u8* to current window, only recomputed when $dffe/$dfff are written
+u8 *geoWindow AA;
+#define GEORAM_WINDOW geoWindow
+
+// page prefetcher: if the page registers change with a constant stride (GEOS increments $dffe when copying blocks), 
+// the next window is preloaded before the C64 selects it
+// (the stride is that of the combined page: writes which leave the page unchanged, e.g. rewriting $dfff, are ignored)
+u32 geoPage;
+s32 geoStride;
+u8 *geoNextWindow;
+
+// one byte per 256-byte page, set by the FIQ handler on every write, cleared by the main loop before flushing a page
+// (a plain store instead of setting bits avoids read-modify-write races between FIQ handler and main loop)
+#define GEORAM_PAGES	( geoSizeKB * 4 )
+u8  geoDirty[ GEORAM_PAGES ] AA;
+
+// current page (= index into geoDirty)
+#define GEORAM_PAGE geoPage
+
+// flush dirty pages every 2 seconds
+#define GEORAM_FLUSH_INTERVAL	2000000
+
+// counts the #cycles when the C64-reset line is pulled down (to detect a reset)
+u32 resetCounter;
+
+#ifdef GEORAM_STREAMING_PORT
+#define GEORAM_STREAM_DATA	0xf0
+#define GEORAM_STREAM_ADDR0	0xf1
+#define GEORAM_STREAM_ADDR2	0xf3
+#define GEORAM_STREAM_STEP	0xf4
+
+// address of the streaming port (within GeoRAM)
+u32 geoStreamAddr;
+#endif
 
 // GeoRAM helper routines
 void geoRAM_Init()
 {
 	geoReg[ 0 ] = geoReg[ 1 ] = 0;
 	geoRAM = (u8*)( ( (u32)&geoRAM_Pool + 64 ) & ~63 );
+
+	geoPage = 0;
+	geoStride = 1;
+	geoWindow = geoRAM;
+	geoNextWindow = geoRAM + 256;
+
+	#ifdef GEORAM_STREAMING_PORT
+	geoStreamAddr = 0;
+	#endif
+}
+
+__attribute__( ( always_inline ) ) inline void geoRAM_SelectWindow()
+{
+	u32 page = ( geoReg[ 1 ] << 6 ) | geoReg[ 0 ];
+	s32 stride = (s32)page - (s32)geoPage;
+
+	if ( stride == 0 )
+		return;
+
+	geoPage = page;
+	geoWindow = &geoRAM[ page * 256 ];
+
+	// same stride twice in a row => expect it again
+	if ( stride == geoStride )
+	{
+		u32 next = ( page + stride ) & ( GEORAM_PAGES - 1 );
+		geoNextWindow = &geoRAM[ next * 256 ];
+		CACHE_PRELOAD( &geoNextWindow[ 0 ] );
+		CACHE_PRELOAD( &geoNextWindow[ 64 ] );
+		CACHE_PRELOAD( &geoNextWindow[ 128 ] );
+		CACHE_PRELOAD( &geoNextWindow[ 192 ] );
+		BUS::countEvent( "georam.prefetch" );
+	}
+	geoStride = stride;
 }
 
 __attribute__( ( always_inline ) ) inline u8 geoRAM_IO1_Read( u32 A )
@@ -62,10 +133,61 @@ __attribute__( ( always_inline ) ) inline u8 geoRAM_IO1_Read( u32 A )
 __attribute__( ( always_inline ) ) inline void geoRAM_IO1_Write( u32 A, u8 D )
 {
 	GEORAM_WINDOW[ A ] = D;
+	geoDirty[ GEORAM_PAGE ] = 1;
+}
+
+#ifdef GEORAM_STREAMING_PORT
+__attribute__( ( always_inline ) ) inline void geoRAM_Stream_Advance( u32 step )
+{
+	geoStreamAddr = ( geoStreamAddr + step ) & ( geoSizeKB * 1024 - 1 );
+	CACHE_PRELOAD( &geoRAM[ geoStreamAddr + 64 ] );
+	if ( ( geoStreamAddr & 255 ) < step )
+		slotPrefetch( &geoRAM[ ( geoStreamAddr & ~255 ) + 256 ], 256 );
+}
+
+// a read of $dff0 never advances the address: the 6510 repeats a read cycle as long as RDY is low (badlines, sprite DMA),
+// and without BA we cannot tell a repeated cycle from the next read -- writes are never repeated, so they advance it
+__attribute__( ( always_inline ) ) inline u8 geoRAM_Stream_Read( u32 A )
+{
+	if ( A == GEORAM_STREAM_DATA )
+		return geoRAM[ geoStreamAddr ];
+	if ( A == GEORAM_STREAM_STEP )
+		return 0;
+	return geoStreamAddr >> ( ( A - GEORAM_STREAM_ADDR0 ) * 8 );
+}
+
+__attribute__( ( always_inline ) ) inline void geoRAM_Stream_Write( u32 A, u8 D )
+{
+	if ( A == GEORAM_STREAM_DATA )
+	{
+		geoRAM[ geoStreamAddr ] = D;
+		geoDirty[ geoStreamAddr >> 8 ] = 1;
+		geoRAM_Stream_Advance( 1 );
+		return;
+	}
+
+	if ( A == GEORAM_STREAM_STEP )
+	{
+		geoRAM_Stream_Advance( D );
+		return;
+	}
+
+	u32 shift = ( A - GEORAM_STREAM_ADDR0 ) * 8;
+	geoStreamAddr = ( ( geoStreamAddr & ~( 255 << shift ) ) | ( D << shift ) ) & ( geoSizeKB * 1024 - 1 );
+	CACHE_PRELOAD( &geoRAM[ geoStreamAddr ] );
+
+	// the next 512 bytes are preloaded while the FIQ handler waits (the range may exceed geoRAM by 256 bytes, preloads don't fault)
+	slotPrefetch( &geoRAM[ geoStreamAddr ], 512 );
 }
+#endif
 
 __attribute__( ( always_inline ) ) inline u8 geoRAM_IO2_Read( u32 A )
 {
+	#ifdef GEORAM_STREAMING_PORT
+	if ( A >= GEORAM_STREAM_DATA && A <= GEORAM_STREAM_STEP )
+		return geoRAM_Stream_Read( A );
+	#endif
+
     if ( A < 2 )
 		return geoReg[ A & 1 ];
 	return 0;
@@ -73,14 +195,139 @@ __attribute__( ( always_inline ) ) inline u8 geoRAM_IO2_Read( u32 A )
 
 __attribute__( ( always_inline ) ) inline void geoRAM_IO2_Write( u32 A, u8 D )
 {
+	#ifdef GEORAM_STREAMING_PORT
+	if ( A >= GEORAM_STREAM_DATA && A <= GEORAM_STREAM_STEP )
+	{
+		geoRAM_Stream_Write( A, D );
+		return;
+	}
+	#endif
+
 	if ( ( A & 1 ) == 1 )
 		geoReg[ 1 ] = D & ( ( geoSizeKB / 16 ) - 1 ); else
 		geoReg[ 0 ] = D & 63;
+
+	geoRAM_SelectWindow();
 }
 
+// the GeoRAM as a device (see device.h): reads and writes in IO1 (memory page) and IO2 (registers), the FIQ handler is generated
+struct DeviceGeoRAM : DeviceBase
+{
+	enum { IO1_READ = 1, IO1_WRITE = 1, IO2_READ = 1, IO2_WRITE = 1 };
+
+	// IO2 writes may select a new window (and preload the next one)
+	enum { IO1_READ_CYCLES = 8, IO1_WRITE_CYCLES = 12, IO2_READ_CYCLES = 24, IO2_WRITE_CYCLES = 48 };
+
+	// PLS100-based PLAs (+ similar ones, and presumably modern replacements) are fast enough so that ADDR_SAMPLE is fine with 45 cycles (98ns). 
+	// For an EEPROM-PLA I needed to go higher (85 cycles = 131ns worked well in this particular case) -- for GeoRAM timing is relatively relaxed
+	#ifndef TIMINGS_RPI3B_PLUS
+	enum { ADDR_SAMPLE_NS = 131, MUX_SAMPLE_NS = 193, READ_RELEASE_NS = 810, WRITE_SAMPLE_NS = 477 };
+	#else
+	enum { ADDR_SAMPLE_NS = 125, MUX_SAMPLE_NS = 203, READ_RELEASE_NS = 792, WRITE_SAMPLE_NS = 467 }; // 407: release 1050, write 580 cycles
+	#endif
+
+	static void prefetch()
+	{
+		CACHE_PRELOAD( &GEORAM_WINDOW[ 0 ] );
+		CACHE_PRELOAD( &GEORAM_WINDOW[ 64 ] );
+		CACHE_PRELOAD( &GEORAM_WINDOW[ 128 ] );
+		CACHE_PRELOAD( &GEORAM_WINDOW[ 192 ] );
+	}
+
+	static void onReset() { resetCounter ++; }
+
+	// preloads the data ahead of the streaming port
+	#ifdef GEORAM_STREAMING_PORT
+	typedef SlotWorkPrefetch SlotWork;
+	#endif
+
+	static u8   IO1Read( u32 A ) { return geoRAM_IO1_Read( A ); }
+	static void IO1Write( u32 A, u8 D ) { geoRAM_IO1_Write( A, D ); }
+	static u8   IO2Read( u32 A ) { return geoRAM_IO2_Read( A ); }
+	static void IO2Write( u32 A, u8 D ) { geoRAM_IO2_Write( A, D ); }
+};
+
 
 CLogger	*logger;
 
+void CKernel::LoadGeoRAM( void )
+{
+	if ( f_mount( &m_FileSystem, DRIVE, 1 ) != FR_OK )
+	{
+		m_Logger.Write( "RaspiGeoRAM", LogError, "Cannot mount drive: %s", DRIVE );
+		return;
+	}
+
+	FIL file;
+	if ( f_open( &file, FILENAME, FA_READ | FA_OPEN_EXISTING ) == FR_OK )
+	{
+		u32 nBytesRead;
+		if ( f_read( &file, geoRAM, geoSizeKB * 1024, &nBytesRead ) != FR_OK )
+			m_Logger.Write( "RaspiGeoRAM", LogError, "Read error" ); else
+			m_Logger.Write( "RaspiGeoRAM", LogNotice, "loaded %u KB from %s", nBytesRead / 1024, FILENAME );
+		f_close( &file );
+	} else
+		m_Logger.Write( "RaspiGeoRAM", LogNotice, "no image %s, starting with empty GeoRAM", FILENAME );
+
+	f_mount( 0, DRIVE, 0 );
+}
+
+// writes all dirty pages to the image (called from the main loop only, this never interferes with the FIQ handler)
+void CKernel::FlushGeoRAM( void )
+{
+	u32 p = 0;
+	while ( p < GEORAM_PAGES && !geoDirty[ p ] ) p ++;
+
+	if ( p == GEORAM_PAGES )
+		return;
+
+	if ( f_mount( &m_FileSystem, DRIVE, 1 ) != FR_OK )
+	{
+		m_Logger.Write( "RaspiGeoRAM", LogError, "Cannot mount drive: %s", DRIVE );
+		return;
+	}
+
+	FIL file;
+	if ( f_open( &file, FILENAME, FA_WRITE | FA_OPEN_ALWAYS ) != FR_OK )
+	{
+		m_Logger.Write( "RaspiGeoRAM", LogError, "Cannot open file: %s", FILENAME );
+		f_mount( 0, DRIVE, 0 );
+		return;
+	}
+
+	u32 nPages = 0;
+	boolean ok = TRUE;
+
+	while ( p < GEORAM_PAGES && ok )
+	{
+		// write consecutive dirty pages at once
+		u32 first = p;
+		while ( p < GEORAM_PAGES && geoDirty[ p ] )
+			geoDirty[ p ++ ] = 0;
+
+		// the flags are cleared before the data is written: if the C64 writes to these pages now, they are flushed again next time
+		DataMemBarrier();
+
+		u32 nBytesWritten, bytes = ( p - first ) * 256;
+		if ( f_lseek( &file, first * 256 ) != FR_OK ||
+			 f_write( &file, &geoRAM[ first * 256 ], bytes, &nBytesWritten ) != FR_OK || nBytesWritten != bytes )
+			ok = FALSE;
+
+		nPages += p - first;
+
+		while ( p < GEORAM_PAGES && !geoDirty[ p ] ) p ++;
+	}
+
+	if ( f_close( &file ) != FR_OK )
+		ok = FALSE;
+
+	f_mount( 0, DRIVE, 0 );
+
+	if ( !ok )
+		m_Logger.Write( "RaspiGeoRAM", LogError, "Cannot write file: %s", FILENAME ); else
+		m_Logger.Write( "RaspiGeoRAM", LogNotice, "wrote %u pages to %s", nPages, FILENAME );
+}
+
 boolean CKernel::Initialize( void )
 {
 	boolean bOK = TRUE;
@@ -102,13 +349,20 @@ boolean CKernel::Initialize( void )
 	if ( bOK ) bOK = m_Interrupt.Initialize();
 	if ( bOK ) bOK = m_Timer.Initialize();
 	
-	// initialize ARM cycle counters (for accurate timing)
+	// initialize ARM cycle counters (for accurate timing), and measure the ARM clock for deriving the bus timings
 	initCycleCounter();
+	initBusClock( &m_Timer );
 
 	// initialize GPIOs
 	gpioInit();
 	SET_BANK2_OUTPUT 
 
+	// default bus timings, a calibrated profile on SD overrides them (see kernel_calib.cpp)
+	Device<DeviceGeoRAM, BUS>::setDefaultTimings();
+
+	m_EMMC.Initialize();
+	loadBusTimings( &m_Logger, DRIVE, BUS_TIMINGS_FILENAME );
+
 	// initialize latch and software I2C buffer
 	#ifdef USE_LATCH_OUTPUT
 	initLatch();
@@ -126,6 +380,7 @@ boolean CKernel::Initialize( void )
 
 	// GeoRAM initialization
 	geoRAM_Init();
+	LoadGeoRAM();
 
 	return bOK;
 }
@@ -133,121 +388,49 @@ boolean CKernel::Initialize( void )
 void CKernel::Run( void )
 {
 	// setup FIQ
-	m_InputPin.ConnectInterrupt( this->FIQHandler, this );
+	m_InputPin.ConnectInterrupt( Device<DeviceGeoRAM, BUS>::FIQHandler, this );
 	m_InputPin.EnableInterrupt( GPIOInterruptOnRisingEdge );
 
+	resetCounter = 0;
+	unsigned lastFlush = m_Timer.GetClockTicks();
+
 	// wait forever
 	while ( true )
 	{
-		asm volatile ("wfi");
-	}
-
-	// and we'll never reach this...
-	m_InputPin.DisableInterrupt();
-}
-
-
-void CKernel::FIQHandler (void *pParam)
-{
-	u32 g2;
-
-	BEGIN_CYCLE_COUNTER
-
-	// preload cache
-	CACHE_PRELOAD( GEORAM_WINDOW[ 0 ] );
-	CACHE_PRELOAD( GEORAM_WINDOW[ 64 ] );
-	CACHE_PRELOAD( GEORAM_WINDOW[ 128 ] );
-	CACHE_PRELOAD( GEORAM_WINDOW[ 192 ] );
-
-	// wait until 25ns after FIQ start
-	// PLS100-based PLAs (+ similar ones, and presumably modern replacements) are fast enough so that this delay is fine with 45 cycles. 
-	// For an EEPROM-PLA I needed to go higher (85 worked well in this particular case) -- for GeoRAM timing is relatively relaxed
-	#ifndef TIMINGS_RPI3B_PLUS
-	WAIT_UP_TO_CYCLE( 45+40 );
-	#else
-	WAIT_UP_TO_CYCLE( 91 );
-	#endif
-
-	// get A0-A7, IO1, IO2, ...
-	g2 = read32( ARM_GPIO_GPLEV0 );
-
-	// block wrong executions
-	if ( !( g2 & bPHI ) ) return;
-
-	// no access to GeoRAM => exit
-	if ( ( g2 & bIO1 ) && ( g2 & bIO2 ) ) return;
-
-	// ... and figure out whether it's a read-from-periphery / write-to-bus cycle
-	if ( g2 & bRW )
-	{
-		u32 A = ( g2 >> A0 ) & 255;
-		u8 byte;
-
-		// GeoRAM read from memory page
-		if ( !( g2 & bIO1 ) ) 
+		// flush dirty pages periodically, and when the C64 is reset
+		unsigned now = m_Timer.GetClockTicks();
+		if ( resetCounter > 3 || now - lastFlush >= GEORAM_FLUSH_INTERVAL )
 		{
-			byte = geoRAM_IO1_Read( A );
-		} else
-		// GeoRAM read register
-		//if ( !( g2 & bIO2 ) ) // always true here
-		{
-			byte = geoRAM_IO2_Read( A );
+			resetCounter = 0;
+			lastFlush = now;
+			FlushGeoRAM();
 		}
 
-		u32 D = encodeGPIO( byte );
-
-		write32( ARM_GPIO_GPSET0, D );
-		write32( ARM_GPIO_GPCLR0, (D_FLAG & ( ~D )) | (1 << GPIO_OE) );
-
-		// TODO: tweak this timing!
-		#ifndef TIMINGS_RPI3B_PLUS
-		WAIT_UP_TO_CYCLE( 900 );
-		#else
-		WAIT_UP_TO_CYCLE( 1025 ); // 407: 1050
+		// derive the bus timings again if the ARM clock changed (e.g. throttling)
+		if ( updateBusClock( &m_Timer ) )
+			m_Logger.Write( "RaspiGeoRAM", LogNotice, "ARM clock changed to %u MHz, bus timings derived again (%u times)", busTimings.armClock / 1000000, busClockChanges );
+
+		// keep the current and the predicted next window warm
+		CACHE_PRELOAD( &geoWindow[ 0 ] );
+		CACHE_PRELOAD( &geoWindow[ 64 ] );
+		CACHE_PRELOAD( &geoWindow[ 128 ] );
+		CACHE_PRELOAD( &geoWindow[ 192 ] );
+		CACHE_PRELOAD( &geoNextWindow[ 0 ] );
+		CACHE_PRELOAD( &geoNextWindow[ 64 ] );
+		CACHE_PRELOAD( &geoNextWindow[ 128 ] );
+		CACHE_PRELOAD( &geoNextWindow[ 192 ] );
+		warmDataMask();
+
+		#ifdef GEORAM_STREAMING_PORT
+		CACHE_PRELOAD( &geoRAM[ geoStreamAddr ] );
+		CACHE_PRELOAD( &geoRAM[ geoStreamAddr + 64 ] );
 		#endif
 
-		// disable 74LV245
-		write32( ARM_GPIO_GPSET0, 1 << GPIO_OE ); 
-	} else
-	// if ( !( g2 & bRW ) ) // always true here
-	{
-		// read-from-bus (= write to periphery) cycle
-
-		// set bank 2 GPIOs to input (D0-D7)
-		SET_BANK2_INPUT 
-
-		// enable 74LVC245
-		write32( ARM_GPIO_GPCLR0, (1 << GPIO_OE) );
-
-		u32 A = ( g2 >> A0 ) & 255;
-
-		#ifndef TIMINGS_RPI3B_PLUS
-		WAIT_UP_TO_CYCLE( 500 );
-		#else
-		WAIT_UP_TO_CYCLE( 570 ); // 407: 580
-		#endif
-
-		g2 = read32( ARM_GPIO_GPLEV0 );
-
-		// disable 74LV245
-		write32( ARM_GPIO_GPSET0, 1 << GPIO_OE ); 
-
-		SET_BANK2_OUTPUT 
-
-		// decode data
-		u8 D = ( g2 >> D0 ) & 255;
-
-		// GeoRAM write to memory page
-		if ( !( g2 & bIO1 ) ) 
-		{
-			geoRAM_IO1_Write( A, D );
-		} else
-		// GeoRAM write register
-		//if ( !( g2 & bIO2 ) ) // always true here
-		{
-			geoRAM_IO2_Write( A, D );
-		}	
+		WAIT_FOR_INTERRUPT
 	}
+
+	// and we'll never reach this...
+	m_InputPin.DisableInterrupt();
 }
 
 int main( void )
@@ -33,6 +33,12 @@
 
 #define USE_HDMI_VIDEO
 
+// extension (not part of the original GeoRAM): streaming data port with a 24-bit address in IO2
+// $dff0 = data (a write increments the address, a read does not), $dff1-$dff3 = address bits 0-7, 8-15, 16-23,
+// $dff4 = step (a write adds the value to the address, this is how a read loop advances)
+// off by default: it takes over the mirrors of the GeoRAM registers in $dff0-$dff4
+//#define GEORAM_STREAMING_PORT
+
 #include <circle/startup.h>
 #include <circle/bcm2835.h>
 #include <circle/memio.h>
@@ -50,10 +56,17 @@
 #include <circle/gpiopinfiq.h>
 #include <circle/gpiomanager.h>
 #include <circle/util.h>
+#include <circle/synchronize.h>
+
+#include <SDCard/emmc.h>
+#include <fatfs/ff.h>
 
 #include "lowlevel_arm.h"
 #include "gpio_defs.h"
+#include "bus.h"
+#include "device.h"
 #include "latch.h"
+#include "timings.h"
 
 #ifdef USE_OLED
 #include "oled.h"
@@ -70,7 +83,8 @@ public:
 	#endif
 		m_Timer( &m_Interrupt ),
 		m_Logger( m_Options.GetLogLevel(), &m_Timer ),
-		m_InputPin( PHI2, GPIOModeInput, &m_Interrupt )
+		m_InputPin( PHI2, GPIOModeInput, &m_Interrupt ),
+		m_EMMC( &m_Interrupt, &m_Timer, 0 )
 	{
 	}
 
@@ -83,7 +97,8 @@ public:
 	void Run( void );
 
 private:
-	static void FIQHandler( void *pParam );
+	void LoadGeoRAM( void );
+	void FlushGeoRAM( void );
 
 	// do not change this order
 	CMemorySystem		m_Memory;
@@ -98,6 +113,8 @@ private:
 	CLogger				m_Logger;
 	CScheduler			m_Scheduler;
 	CGPIOPinFIQ			m_InputPin;
+	CEMMCDevice			m_EMMC;
+	FATFS				m_FileSystem;
 };
 
 #endif
@@ -34,23 +34,24 @@
 
 #include "kernel_sid.h"
 
+static const char DRIVE[] = "SD:";
+
 //                 _________.___________         ____                      ________    ______  ____________  
 //_______   ____  /   _____/|   \______ \       /  _ \       ___.__. _____ \_____  \  /  __  \/_   \_____  \ 
 //\_  __ \_/ __ \ \_____  \ |   ||    |  \      >  _ </\    <   |  |/     \  _(__  <  >      < |   |/  ____/ 
 // |  | \/\  ___/ /        \|   ||    `   \    /  <_\ \/     \___  |  Y Y  \/       \/   --   \|   /       \ 
 // |__|    \___  >_______  /|___/_______  /    \_____\ \     / ____|__|_|  /______  /\______  /|___\_______ \
 //             \/        \/             \/            \/     \/          \/       \/        \/             \/
-#include "resid/sid.h"
-using namespace reSID;
-
 u32 CLOCKFREQ = 985248;	// exact clock frequency of the C64 will be measured at start up
 
+// reSID, OPL2 and mixer (see sidengine.h)
+SID_ENGINE engine;
 
-#define NUM_SIDS 2
-SID *sid[ NUM_SIDS ];
+#ifdef ADAPTIVE_QUALITY
+QUALITY_GOVERNOR governor;
+#endif
 
 #ifdef EMULATE_OPL2
-FM_OPL *pOPL;
 u32 fmOutRegister;
 #endif
 
@@ -75,35 +76,9 @@ void initSID()
 {
 	resetCounter = 0;
 
-	for ( int i = 0; i < NUM_SIDS; i++ )
-	{
-		sid[ i ] = new SID;
-
-		for ( int j = 0; j < 24; j++ )
-			sid[ i ]->write( j, 0 );
-
-		if ( SID_MODEL[ i ] == 6581 )
-		{
-			sid[ i ]->set_chip_model( MOS6581 );
-		} else
-		{
-			sid[ i ]->set_chip_model( MOS8580 );
-			if ( SID_DigiBoost[ i ] == 0 )
-			{
-				sid[ i ]->set_voice_mask( 0x07 );
-				sid[ i ]->input( 0 );
-			} else
-			{
-				sid[ i ]->set_voice_mask( 0x0f );
-				sid[ i ]->input( -32768 );
-			}
-		}
-	}
-
-#ifdef EMULATE_OPL2
-	pOPL = ym3812_init( 3579545, SAMPLERATE );
-	ym3812_reset_chip( pOPL );
-#endif
+	engineInit( &engine, ENGINE_FLAGS, SID_MODEL, SID_DigiBoost, SAMPLERATE );
+	for ( int i = 0; i < ENGINE_NUM_SIDS; i++ )
+		engineSetChip( &engine, i, SID_EMULATION[ i ] );
 
 	// ring buffer init
 	ringWrite = 0;
@@ -114,6 +89,56 @@ void initSID()
 
 unsigned long long cycleCountC64;
 
+// the register writes stored by the FIQ handler, for the sound emulation (see engineRenderSample)
+struct CRingSource
+{
+	u32 ringRead;
+
+	__attribute__( ( always_inline ) ) inline void clocked( SID_ENGINE *e )
+	{
+		outRegisters[ 27 ] = encodeGPIO( e->sid[ 0 ]->read( 27 ) );
+		outRegisters[ 28 ] = encodeGPIO( e->sid[ 0 ]->read( 28 ) );
+	}
+
+	__attribute__( ( always_inline ) ) inline boolean next( u64 nCyclesEmulated, u32 &chip, u32 &A, u8 &D )
+	{
+		unsigned int readUpTo = ringWrite;
+
+		if ( ringRead == readUpTo || nCyclesEmulated < ringTime[ ringRead ] )
+			return FALSE;
+
+		u32 g = ringBufGPIO[ ringRead ];
+		unsigned char a, d;
+		decodeGPIO( g, &a, &d );
+		A = a;
+		D = d;
+
+		#ifdef EMULATE_OPL2
+		if ( g & bIO2 )
+			chip = CAPTURE_OPL; else
+		#endif
+		// TODO: generic masks
+		chip = ( g & SID2_MASK ) ? CAPTURE_SID2 : CAPTURE_SID1;
+
+		if ( engineWritesSID1<ENGINE_FLAGS>( chip ) )
+			outRegisters[ A & 31 ] = encodeGPIO( D );
+
+		SID_CAPTURE( ringTime[ ringRead ], chip, A, D )
+
+		ringRead++;
+		ringRead &= ( RING_SIZE - 1 );
+		return TRUE;
+	}
+
+	__attribute__( ( always_inline ) ) inline void sampled( SID_ENGINE *e )
+	{
+		#ifdef EMULATE_OPL2
+		// TODO asynchronous read back is an issue, needs to be fixed
+		fmOutRegister = encodeGPIO( ym3812_read( e->opl, 0 ) ); 
+		#endif
+	}
+};
+
 
 boolean CKernel::Initialize( void )
 {
@@ -138,13 +163,24 @@ boolean CKernel::Initialize( void )
 	if ( bOK ) bOK = m_VCHIQ.Initialize();
 #endif
 
-	// initialize ARM cycle counters (for accurate timing)
+	// initialize ARM cycle counters (for accurate timing), and measure the ARM clock for deriving the bus timings
 	initCycleCounter();
+	initBusClock( &m_Timer );
 
 	// initialize GPIOs
 	gpioInit();
 	SET_BANK2_OUTPUT
 
+	// default bus timings (ns after PHI2 rising), a calibrated profile on SD overrides them (see kernel_calib.cpp)
+	#ifndef TIMINGS_RPI3B_PLUS
+	setBusTimings( 98, 193, 635, 477 );
+	#else
+	setBusTimings( 124, 203, 635, 467 );
+	#endif
+
+	m_EMMC.Initialize();
+	loadBusTimings( &m_Logger, DRIVE, BUS_TIMINGS_FILENAME );
+
 	// initialize latch and software I2C buffer
 	#ifdef USE_LATCH_OUTPUT
 	initLatch();
@@ -171,7 +207,7 @@ void CKernel::Run( void )
 	//
 	// setup FIQ
 	//
-	m_InputPin.ConnectInterrupt( this->FIQHandler, this );
+	m_InputPin.ConnectInterrupt( FIQHandler<BUS>, this );
 	m_InputPin.EnableInterrupt( GPIOInterruptOnRisingEdge );
 
 	cycleCountC64 = 0;
@@ -196,22 +232,26 @@ void CKernel::Run( void )
 	CLOCKFREQ = clockFreq;
 	m_Logger.Write( "", LogNotice, "Measured C64 clock frequency: %u Hz", (u32)CLOCKFREQ );
 
-	for ( int i = 0; i < NUM_SIDS; i++ )
-		sid[ i ]->set_sampling_parameters( CLOCKFREQ, SAMPLE_INTERPOLATE, SAMPLERATE );
+	engineSetClock( &engine, CLOCKFREQ );
+
+	#ifdef ADAPTIVE_QUALITY
+	governorInit( &governor, &engine );
+	#endif
 
 	//
 	// initialize sound output (either PWM which is output in the FIQ handler, or via HDMI)
 	//
 	initSoundOutput( &m_pSound, &m_VCHIQ );
 
+	// the register writes are captured with the measured clock
+	SID_CAPTURE_START( &m_Logger, CLOCKFREQ, SID_MODEL, CAPTURE_FLAGS )
+
 	m_Logger.Write( "", LogNotice, "start emulating..." );
 	cycleCountC64 = 0;
 
-	unsigned long long nCyclesEmulated = 0;
-	unsigned long long samplesElapsed = 0;
-
 	// how far did we consume the commands in the ring buffer?
-	unsigned int ringRead = 0;
+	CRingSource ring;
+	ring.ringRead = 0;
 
 	// new main loop mainloop
 	while ( true )
@@ -219,15 +259,20 @@ void CKernel::Run( void )
 		if ( resetCounter > 3 )
 		{
 			resetCounter = 0;
-			for ( int i = 0; i < NUM_SIDS; i++ )
-				for ( int j = 0; j < 24; j++ )
-					sid[ i ]->write( j, 0 );
+			engineReset( &engine );
 
-			#ifdef EMULATE_OPL2
-			ym3812_reset_chip( pOPL );
-			#endif
+			SID_CAPTURE_RESET( &m_Logger )
 		}
 
+		// derive the bus timings again if the ARM clock changed (e.g. throttling)
+		if ( updateBusClock( &m_Timer ) )
+			m_Logger.Write( "", LogNotice, "ARM clock changed to %u MHz, bus timings derived again (%u times)", busTimings.armClock / 1000000, busClockChanges );
+
+		PMU_REPORT( &m_Logger, "", m_Timer.GetClockTicks() )
+
+		// writes captured register writes to SD (at most one sector per iteration, see sidcapture.cpp)
+		SID_CAPTURE_UPDATE( &m_Logger, cycleCountC64 )
+
 	#ifdef USE_OLED
 		static u32 renderDone = 0;
 		if ( bufferEmptyI2C() && renderDone )
@@ -244,7 +289,14 @@ void CKernel::Run( void )
 		#endif
 
 		unsigned long long cycleCount = cycleCountC64;
-		while ( cycleCount > nCyclesEmulated )
+
+		#ifdef ADAPTIVE_QUALITY
+		// the emulation may be ahead by up to one step
+		u32 lag = cycleCount > engine.nCyclesEmulated ? (u32)( cycleCount - engine.nCyclesEmulated ) : 0;
+		governorUpdate( &governor, &engine, lag, ( ringWrite - ring.ringRead ) & ( RING_SIZE - 1 ), RING_SIZE, busTimings.armClock, CLOCKFREQ, &m_Logger );
+		#endif
+
+		while ( cycleCount > engine.nCyclesEmulated )
 		{
 		#ifndef USE_PWM_DIRECT
 			static int start = 0;
@@ -264,95 +316,20 @@ void CKernel::Run( void )
 			nSamplesInThisRun++;
 		#endif
 
-			unsigned long long samplesElapsedBefore = samplesElapsed;
-
-			do { // do SID emulation until time passed to create an additional sample (i.e. there may be several cycles until a sample value is created)
-				#ifdef USE_PWM_DIRECT
-				u32 cyclesToEmulate = 8;
-				#else			
-				u32 cyclesToEmulate = 2;
-				#endif
-				sid[ 0 ]->clock( cyclesToEmulate );
-				#ifndef SID2_DISABLED
-				sid[ 1 ]->clock( cyclesToEmulate );
-				#endif
-
-				outRegisters[ 27 ] = encodeGPIO( sid[ 0 ]->read( 27 ) );
-				outRegisters[ 28 ] = encodeGPIO( sid[ 0 ]->read( 28 ) );
-
-				nCyclesEmulated += cyclesToEmulate;
-
-				// apply register updates (we do one-cycle emulation steps, but in case we need to catch up...)
-				unsigned int readUpTo = ringWrite;
-
-				if ( ringRead != readUpTo && nCyclesEmulated >= ringTime[ ringRead ] )
-				{
-					unsigned char A, D;
-					decodeGPIO( ringBufGPIO[ ringRead ], &A, &D );
-
-					#ifdef EMULATE_OPL2
-					if ( ringBufGPIO[ ringRead ] & bIO2 )
-					{
-						if ( ( ( A & ( 1 << 4 ) ) == 0 ) )
-							ym3812_write( pOPL, 0, D ); else
-							ym3812_write( pOPL, 1, D );
-					} else
-					#endif
-					#if !defined(SID2_DISABLED) && !defined(SID2_PLAY_SAME_AS_SID1)
-					// TODO: generic masks
-					if ( ringBufGPIO[ ringRead ] & SID2_MASK )
-					{
-						sid[ 1 ]->write( A & 31, D );
-					} else
-					#endif
-					{
-						sid[ 0 ]->write( A & 31, D );
-						outRegisters[ A & 31 ] = encodeGPIO( D );
-						#if !defined(SID2_DISABLED) && defined(SID2_PLAY_SAME_AS_SID1)
-						sid[ 1 ]->write( A & 31, D );
-						#endif
-					}
-
-					ringRead++;
-					ringRead &= ( RING_SIZE - 1 );
-				}
-
-				samplesElapsed = ( ( unsigned long long )nCyclesEmulated * ( unsigned long long )SAMPLERATE ) / ( unsigned long long )CLOCKFREQ;
-
-			} while ( samplesElapsed == samplesElapsedBefore );
-
-			s16 val1 = sid[ 0 ]->output();
-			s16 val2 = 0;
-			s16 valOPL = 0;
-
-		#ifndef SID2_DISABLED
-			val2 = sid[ 1 ]->output();
-		#endif
-
-		#ifdef EMULATE_OPL2
-			ym3812_update_one( pOPL, &valOPL, 1 );
-			// TODO asynchronous read back is an issue, needs to be fixed
-			fmOutRegister = encodeGPIO( ym3812_read( pOPL, 0 ) ); 
-		#endif
-
-			//
-			// mixer
-			//
-			s32 left, right;
-
-			#ifdef MIXER_MONO
-			left = right = ( (s32)val1 + (s32)val2 + (s32)valOPL ) / 3;
-			#endif
-			#ifdef MIXER_SID_STEREO
-			#ifdef EMULATE_OPL2
-			left  = ( (s32)val1 + (s32)valOPL / 2 ) * 2 / 3;
-			right = ( (s32)val2 + (s32)valOPL / 2 ) * 2 / 3;
+			SID_ENGINE_SAMPLE smp;
+			#ifdef ADAPTIVE_QUALITY
+			u32 armCycles = BUS::readCycleCounter();
+			engineRenderSample<ENGINE_FLAGS>( &engine, ring, &smp );
+			governorAccount( &governor, BUS::readCycleCounter() - armCycles );
 			#else
-			left  = (s32)val1;
-			right = (s32)val2;
-			#endif
+			engineRenderSample<ENGINE_FLAGS>( &engine, ring, &smp );
 			#endif
 
+			s16 val1 = smp.sid1;
+			s16 val2 = smp.sid2;
+			s16 valOPL = smp.opl;
+			s32 left = smp.left, right = smp.right;
+
 			#ifdef USE_PWM_DIRECT
 			putSample( left, right );
 			#else
@@ -370,24 +347,37 @@ void CKernel::Run( void )
 }
 
 
-void CKernel::FIQHandler( void *pParam )
+// SID accesses use CS, the OPL2 emulation additionally IO2
+#ifdef EMULATE_OPL2
+#define SID_DECODED_LINES	( CTRL_CS | CTRL_IO2 )
+#else
+#define SID_DECODED_LINES	( CTRL_CS )
+#endif
+
+static u32 latchDelayOut = 10;
+
+template <class BUS>
+void CKernel::FIQHandler ( void *pParam )
 {
 	u32 g2;
 
+	// one handler per kind of bus cycle (see dispatch.h)
+	#define SID_CYCLE( n ) BusCycle<BUS, classifyCycle( n, SID_DECODED_LINES )>
+	static TBusCycleHandler * const dispatch[ CTRL_SIZE ] AA = { DISPATCH_TABLE( SID_CYCLE ) };
+	#undef SID_CYCLE
+
 	BEGIN_CYCLE_COUNTER
 
-	static u32 latchDelayOut = 10;
+	CACHE_PRELOAD( &dispatch[ 0 ] );
+	CACHE_PRELOAD( &dispatch[ 16 ] );
+	CACHE_PRELOAD( &dispatch[ 32 ] );
+	CACHE_PRELOAD( &dispatch[ 48 ] );
 
 	// wait >= 25ns after FIQ start
-	//WAIT_UP_TO_CYCLE( 45 );
-	#ifndef TIMINGS_RPI3B_PLUS
-	WAIT_UP_TO_CYCLE( 45 );
-	#else
-	WAIT_UP_TO_CYCLE( 90 );
-	#endif
+	WAIT_UP_TO_CYCLE( busTimings.addrSample );
 
 	// get A0-A7, IO1, IO2, ...
-	g2 = read32( ARM_GPIO_GPLEV0 );
+	g2 = BUS::getLevels();
 
 	// block wrong executions
 	if ( !( g2 & bPHI ) ) return;
@@ -398,7 +388,7 @@ void CKernel::FIQHandler( void *pParam )
 
 	// optionally: switch to A8..12 if we'd need more address lines
 	// attention: needs switching back before the FIQ handler is left
-	// write32( ARM_GPIO_GPSET0, 1 << DIR_CTRL_257 ); 
+	// BUS::setPins( 1 << DIR_CTRL_257 ); 
 	 
 	// preload cache
 	CACHE_PRELOAD( &ringWrite );
@@ -407,84 +397,128 @@ void CKernel::FIQHandler( void *pParam )
 
 	// optionally: read A8..12 if we'd need more address lines
 	//	WAIT_UP_TO_CYCLE( 220 );
-	//	g3 = read32( ARM_GPIO_GPLEV0 );
+	//	g3 = BUS::getLevels();
+
+	// handle SID/FM accesses, we're done if the cycle has been served
+	if ( dispatch[ CTRL_INDEX( g2 ) ]( g2, armCycleCounter ) )
+		return;
+
+	//  ___                      ___    __                     ___    __  
+	// |__   |\/| |  | |     /\   |  | /  \ |\ |    | |\ |    |__  | /  \ 
+	// |___  |  | \__/ |___ /~~\  |  | \__/ | \|    | | \|    |    | \__X 
+	// OPTIONAL and omitted for this release
+	//																	
+	#ifdef EMULATION_IN_FIQ
+	run_emulation:
+	#include "fragment_emulation_in_fiq.h"
+	#endif		
+
+	//  __                 __       ___  __       ___ 
+	// |__) |  |  |\/|    /  \ |  |  |  |__) |  |  |  
+	// |    |/\|  |  |    \__/ \__/  |  |    \__/  |  
+	// OPTIONAL
+	//											
+	#ifdef USE_PWM_DIRECT
+	static unsigned long long samplesElapsedBeforeFIQ = 0;
+
+	unsigned long long samplesElapsedFIQ = ( ( unsigned long long )cycleCountC64 * ( unsigned long long )SAMPLERATE ) / ( unsigned long long )CLOCKFREQ;
+
+	if ( samplesElapsedFIQ != samplesElapsedBeforeFIQ )
+	{
+		samplesElapsedBeforeFIQ = samplesElapsedFIQ;
+
+		u32 s = getSample();
+		u16 s1 = s & 65535;
+		u16 s2 = s >> 16;
+
+		s32 d1 = ( ( *(s16*)&s1 + 32768 ) * PWMRange ) >> 16;
+		s32 d2 = ( ( *(s16*)&s2 + 32768 ) * PWMRange ) >> 16;
+		write32( ARM_PWM_DAT1, d1 );
+		write32( ARM_PWM_DAT2, d2 );
+	} 
+	#endif
+
+	//           ___  __       
+	// |     /\   |  /  ` |__| 
+	// |___ /~~\  |  \__, |  | 
+	//
+	#ifdef USE_LATCH_OUTPUT
+	if ( --latchDelayOut == 0 )
+	{
+		latchDelayOut = 2;
+		outputLatch();
+	}
+	#endif
+}
 
+
+template <class BUS, u32 T>
+boolean CKernel::BusCycle( u32 g2, unsigned long armCycleCounter )
+{
 	//  __   ___       __      __     __  
 	// |__) |__   /\  |  \    /__` | |  \ 
 	// |  \ |___ /~~\ |__/    .__/ | |__/ 
 	//
-	if ( !( g2 & bCS ) && ( g2 & bRW ) )
+	if ( T == CYCLE_CS_READ )
 	{
 		latchDelayOut ++;
 
 		u32 A = ( g2 >> A0 ) & 31;
 		u32 D = outRegisters[ A ];
 
-		write32( ARM_GPIO_GPSET0, D );
-		write32( ARM_GPIO_GPCLR0, ( D_FLAG & ( ~D ) ) | ( 1 << GPIO_OE ) );
+		BUS::setPins( D );
+		BUS::clrPins( ( D_FLAG & ( ~D ) ) | ( 1 << GPIO_OE ) );
 
-		#ifndef TIMINGS_RPI3B_PLUS
-		WAIT_UP_TO_CYCLE( 690 );
-		#else
-		WAIT_UP_TO_CYCLE( 805 );
-		#endif
+		WAIT_UP_TO_CYCLE( busTimings.readRelease );
 
 		// disable 74LV245 
-		write32( ARM_GPIO_GPSET0, ( 1 << GPIO_OE ) );
+		BUS::setPins( ( 1 << GPIO_OE ) );
 
-		return;
+		return TRUE;
 	} else
 	//  __   ___       __      ___       
 	// |__) |__   /\  |  \    |__   |\/| 
 	// |  \ |___ /~~\ |__/    |     |  | 
 	//                                   
 	#ifdef EMULATE_OPL2
-	if ( ( ( g2 & bRW ) && !( g2 & bIO2 ) ) &&  
- 	     ( ( ( g2 >> A0 ) & 255 ) == 0x60 ) )
+	if ( T == CYCLE_IO2_READ )
 	{
+		// only $DF60 is handled, the address is only tested in IO2 read cycles
+		if ( ( ( g2 >> A0 ) & 255 ) != 0x60 )
+			return FALSE;
+
 		//
 		// this is not a real read of the YM3812 status register!
 		// only a fake that let's the detection routine be satisfied
 		//
 		static u32 fmFakeOutput = 0;
-		u32 D = encodeGPIO( fmFakeOutput ); 
+		WRITE_D0D7( fmFakeOutput, ( 1 << GPIO_OE ) );
 		fmFakeOutput = 0xc0 - fmFakeOutput;
 
-		write32( ARM_GPIO_GPSET0, D_FLAG & D );
-		write32( ARM_GPIO_GPCLR0, ( D_FLAG & ( ~D ) ) | ( 1 << GPIO_OE ) );
-
-		#ifndef TIMINGS_RPI3B_PLUS
-		WAIT_UP_TO_CYCLE( 690 );
-		#else
-		WAIT_UP_TO_CYCLE( 805 );
-		#endif
+		WAIT_UP_TO_CYCLE( busTimings.readRelease );
 
 		// disable 74LV245 
-		write32( ARM_GPIO_GPSET0, ( 1 << GPIO_OE ) );
-		return;
+		BUS::setPins( ( 1 << GPIO_OE ) );
+		return TRUE;
 	} else
 	//       __    ___  ___     ___       
 	// |  | |__) |  |  |__     |__   |\/| 
 	// |/\| |  \ |  |  |___    |     |  | 
 	//                                    
-	if ( !( g2 & bRW ) && !( g2 & bIO2 ) ) 
+	if ( T == CYCLE_IO2_WRITE ) 
 	{
 		// set bank 2 GPIOs to input (D0-D7)
 		SET_BANK2_INPUT 
 
 		// enable 74LVC245
-		write32( ARM_GPIO_GPCLR0, ( 1 << GPIO_OE ) );
+		BUS::clrPins( ( 1 << GPIO_OE ) );
 
-		#ifndef TIMINGS_RPI3B_PLUS
-		WAIT_UP_TO_CYCLE( 500 );
-		#else
-		WAIT_UP_TO_CYCLE( 560 );
-		#endif
+		WAIT_UP_TO_CYCLE( busTimings.writeSample );
 
-		u32 g1 = read32( ARM_GPIO_GPLEV0 );
+		u32 g1 = BUS::getLevels();
 
 		// disable 74LV245
-		write32( ARM_GPIO_GPSET0, 1 << GPIO_OE ); 
+		BUS::setPins( 1 << GPIO_OE ); 
 
 		SET_BANK2_OUTPUT 
 
@@ -492,14 +526,14 @@ void CKernel::FIQHandler( void *pParam )
 		ringTime[ ringWrite ] = cycleCountC64;
 		ringWrite ++;
 		ringWrite &= ( RING_SIZE - 1 );
-		return;
+		return TRUE;
 	} else
 	#endif // EMULATE_OPL2
 	//       __    ___  ___     __     __  
 	// |  | |__) |  |  |__     /__` | |  \ 
 	// |/\| |  \ |  |  |___    .__/ | |__/ 
 	//                                   
-	if ( !( g2 & bCS ) && !( g2 & bRW ) )
+	if ( T == CYCLE_CS_WRITE )
 	{
 		latchDelayOut ++;
 		
@@ -507,20 +541,16 @@ void CKernel::FIQHandler( void *pParam )
 		SET_BANK2_INPUT 
 
 		// enable 74LVC245
-		write32( ARM_GPIO_GPCLR0, ( 1 << GPIO_OE ) );
+		BUS::clrPins( ( 1 << GPIO_OE ) );
 
 		// wait until ... ns after FIQ start
-		#ifndef TIMINGS_RPI3B_PLUS
-		WAIT_UP_TO_CYCLE( 500 );
-		#else
-		WAIT_UP_TO_CYCLE( 570 );
-		#endif
+		WAIT_UP_TO_CYCLE( busTimings.writeSample );
 
 		// read D0..D7
-		u32 g1 = read32( ARM_GPIO_GPLEV0 );
+		u32 g1 = BUS::getLevels();
 
 		// disable 74LV245
-		write32( ARM_GPIO_GPSET0, ( 1 << GPIO_OE ) ); 
+		BUS::setPins( ( 1 << GPIO_OE ) ); 
 
 		SET_BANK2_OUTPUT 
 
@@ -532,58 +562,12 @@ void CKernel::FIQHandler( void *pParam )
 		// optionally we could directly set the SID-output registers (instead of where the emulation runs)
 		//u32 A = ( g2 >> A0 ) & 31;
 		//outRegisters[ A ] = g1 & D_FLAG;
-		return;
+		return TRUE;
 	}
 
-	//  ___                      ___    __                     ___    __  
-	// |__   |\/| |  | |     /\   |  | /  \ |\ |    | |\ |    |__  | /  \ 
-	// |___  |  | \__/ |___ /~~\  |  | \__/ | \|    | | \|    |    | \__X 
-	// OPTIONAL and omitted for this release
-	//																	
-	#ifdef EMULATION_IN_FIQ
-	run_emulation:
-	#include "fragment_emulation_in_fiq.h"
-	#endif		
-
-	//  __                 __       ___  __       ___ 
-	// |__) |  |  |\/|    /  \ |  |  |  |__) |  |  |  
-	// |    |/\|  |  |    \__/ \__/  |  |    \__/  |  
-	// OPTIONAL
-	//											
-	#ifdef USE_PWM_DIRECT
-	static unsigned long long samplesElapsedBeforeFIQ = 0;
-
-	unsigned long long samplesElapsedFIQ = ( ( unsigned long long )cycleCountC64 * ( unsigned long long )SAMPLERATE ) / ( unsigned long long )CLOCKFREQ;
-
-	if ( samplesElapsedFIQ != samplesElapsedBeforeFIQ )
-	{
-		samplesElapsedBeforeFIQ = samplesElapsedFIQ;
-
-		u32 s = getSample();
-		u16 s1 = s & 65535;
-		u16 s2 = s >> 16;
-
-		s32 d1 = ( ( *(s16*)&s1 + 32768 ) * PWMRange ) >> 16;
-		s32 d2 = ( ( *(s16*)&s2 + 32768 ) * PWMRange ) >> 16;
-		write32( ARM_PWM_DAT1, d1 );
-		write32( ARM_PWM_DAT2, d2 );
-	} 
-	#endif
-
-	//           ___  __       
-	// |     /\   |  /  ` |__| 
-	// |___ /~~\  |  \__, |  | 
-	//
-	#ifdef USE_LATCH_OUTPUT
-	if ( --latchDelayOut == 0 )
-	{
-		latchDelayOut = 2;
-		outputLatch();
-	}
-	#endif
+	return FALSE;
 }
 
-
 int main( void )
 {
 	CKernel kernel;
@@ -51,6 +51,9 @@
 static const unsigned int SID_MODEL[] = { 8580, 8580 };
 static const unsigned int SID_DigiBoost[] = { 0, 0 };
 
+// emulation of each SID: 0 = reSID (cycle exact), 1 = CLiteSID (a fraction of the cost, see litesid.h and ENGINE_CHIP_xxx)
+static const unsigned int SID_EMULATION[] = { 0, 0 };
+
 //
 // options for the 2nd SID
 //
@@ -69,6 +72,13 @@ static const unsigned int SID_DigiBoost[] = { 0, 0 };
 //#define MIXER_MONO
 #define MIXER_SID_STEREO
 
+// capture all SID/OPL register writes (with their C64 cycle) to SD:sidwNNN.rsw, see sidcapture.h and host/sidcapdec
+//#define CAPTURE_SID_WRITES
+
+// lower the emulation quality when the Pi cannot keep up (e.g. two SIDs and OPL2 at a low ARM clock), see governor.h
+// (off by default: with it the audio output depends on the load of the Pi)
+//#define ADAPTIVE_QUALITY
+
 // zero-cycle delay emulation within the FIQ handler (omitted for this release)
 //#define EMULATION_IN_FIQ
 
@@ -107,6 +117,9 @@ static const unsigned int SID_DigiBoost[] = { 0, 0 };
 #include <circle/i2ssoundbasedevice.h>
 #include <circle/util.h>
 
+#include <SDCard/emmc.h>
+#include <fatfs/ff.h>
+
 #ifdef USE_VCHIQ_SOUND
 #include <vc4/vchiq/vchiqdevice.h>
 #include <vc4/sound/vchiqsoundbasedevice.h>
@@ -114,8 +127,14 @@ static const unsigned int SID_DigiBoost[] = { 0, 0 };
 
 #include "lowlevel_arm.h"
 #include "gpio_defs.h"
+#include "bus.h"
+#include "dispatch.h"
 #include "latch.h"
+#include "timings.h"
 #include "sound.h"
+#include "sidcapture.h"
+#include "sidengine.h"
+#include "governor.h"
 
 #ifdef USE_OLED
 #include "oled.h"
@@ -126,6 +145,43 @@ static const unsigned int SID_DigiBoost[] = { 0, 0 };
 #include "fmopl.h"
 #endif
 
+// configuration of the sound emulation (see sidengine.h)
+#if defined(SID2_DISABLED)
+#define ENGINE_FLAGS_SID2	0
+#elif defined(SID2_PLAY_SAME_AS_SID1)
+#define ENGINE_FLAGS_SID2	( ENGINE_FLAG_SID2 | ENGINE_FLAG_SID2_SAME )
+#else
+#define ENGINE_FLAGS_SID2	ENGINE_FLAG_SID2
+#endif
+#ifdef EMULATE_OPL2
+#define ENGINE_FLAGS_OPL	ENGINE_FLAG_OPL
+#else
+#define ENGINE_FLAGS_OPL	0
+#endif
+#ifdef MIXER_MONO
+#define ENGINE_FLAGS_MIXER	ENGINE_FLAG_MONO
+#else
+#define ENGINE_FLAGS_MIXER	0
+#endif
+#ifdef USE_PWM_DIRECT
+#define ENGINE_FLAGS_PWM	ENGINE_FLAG_PWM
+#else
+#define ENGINE_FLAGS_PWM	0
+#endif
+#define ENGINE_FLAGS		( ENGINE_FLAGS_SID2 | ENGINE_FLAGS_OPL | ENGINE_FLAGS_MIXER | ENGINE_FLAGS_PWM )
+
+// what is in the captured register writes
+#if !defined(SID2_DISABLED) && !defined(SID2_PLAY_SAME_AS_SID1)
+#define CAPTURE_FLAGS_SID2	CAPTURE_FLAG_SID2
+#else
+#define CAPTURE_FLAGS_SID2	0
+#endif
+#ifdef EMULATE_OPL2
+#define CAPTURE_FLAGS		( CAPTURE_FLAGS_SID2 | CAPTURE_FLAG_OPL )
+#else
+#define CAPTURE_FLAGS		CAPTURE_FLAGS_SID2
+#endif
+
 #ifndef min
 #define min( a, b ) ( ((a)<(b))?(a):(b) )
 #endif
@@ -133,6 +189,9 @@ static const unsigned int SID_DigiBoost[] = { 0, 0 };
 #define max( a, b ) ( ((a)>(b))?(a):(b) )
 #endif
 
+// returns TRUE if the cycle has been served
+typedef boolean TBusCycleHandler( u32 g2, unsigned long armCycleCounter );
+
 class CKernel
 {
 public:
@@ -147,7 +206,8 @@ public:
 		m_VCHIQ( &m_Memory, &m_Interrupt ),
 	#endif
 		m_pSound( 0 ),
-		m_InputPin( PHI2, GPIOModeInput, &m_Interrupt )
+		m_InputPin( PHI2, GPIOModeInput, &m_Interrupt ),
+		m_EMMC( &m_Interrupt, &m_Timer, 0 )
 	{
 	}
 
@@ -160,7 +220,8 @@ public:
 	void Run( void );
 
 private:
-	static void FIQHandler( void *pParam );
+	template <class BUS> static void FIQHandler( void *pParam );
+	template <class BUS, u32 T> static boolean BusCycle( u32 g2, unsigned long armCycleCounter );
 	
 	// do not change this order
 	CMemorySystem		m_Memory;
@@ -179,6 +240,7 @@ private:
 #endif
 	CSoundBaseDevice	*m_pSound;
 	CGPIOPinFIQ			m_InputPin;
+	CEMMCDevice			m_EMMC;
 };
 
 #endif
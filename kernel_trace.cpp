@@ -0,0 +1,412 @@
+//
+// kernel_trace.cpp
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+//          - RasPI Trace: bus logic analyzer, streams every bus cycle to SD card
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// define this if you use a RaspberryPi 3B+
+#define TIMINGS_RPI3B_PLUS
+
+#include "kernel_trace.h"
+
+static const char DRIVE[] = "SD:";
+
+// traces are written to SD:trace000.rtr, SD:trace001.rtr, ... (the first unused name), a reset of the C64 starts the next one
+static const char FILENAME[] = "SD:trace000.rtr";
+#define TRACE_MAX_FILES		1000
+
+// the FIQ handler fills a ring of blocks in DRAM, the main loop compresses them and writes them to SD:
+// 2048 blocks of 4096 cycles buffer about 8 seconds, which bridges slow writes of the SD card
+#define TRACE_SLOTS			2048
+
+#define SLOT_FREE			0
+#define SLOT_FULL			1
+
+typedef struct
+{
+	u32	state;
+	u32	bytes;
+	u32	cycles;
+	u32	newFile;			// the block starts with a reset of the C64, i.e. in a new trace file
+	u64	firstCycle;
+} TRACE_SLOT;
+
+static u8 traceRing[ TRACE_SLOTS * TRACE_BLOCK_BYTES ] AA;
+static volatile TRACE_SLOT traceSlot[ TRACE_SLOTS ] AA;
+
+// state of the FIQ handler: current slot, write position, cycles and first cycle of the current block, previous sample
+static u32 fiqSlot = 0, fiqCycles = 0, fiqPrev = 0, fiqLastReset = 0;
+static u8 *fiqPtr = traceRing;
+static u64 fiqFirstCycle = 0;
+
+// blocks (and their cycles) which have been dropped because the ring was full
+static volatile u32 traceDroppedCycles = 0;
+
+// main loop: next slot to write, the current file and its index
+static u32 writeSlot = 0;
+static u8  compressed[ sizeof( TRACE_BLOCK ) + TRACE_COMPRESSED_BYTES( TRACE_BLOCK_BYTES ) + 8 ] AA;
+
+#define TRACE_MAX_INDEX		262144
+static TRACE_INDEX traceIndex[ TRACE_MAX_INDEX ];
+static TRACE_HEADER traceHeader;
+
+static char traceFilename[ sizeof( FILENAME ) ];
+static u32 traceFileNr = 0, traceOffset = 0;
+static u64 traceFirstCycle = 0;
+static boolean traceOpen = FALSE;
+
+// statistics
+static u64 statCycles = 0, statRawBytes = 0, statBytes = 0;
+
+static_assert( TRACE_IO1 == CTRL_IO1 << TRACE_CTRL_SHIFT && TRACE_IO2 == CTRL_IO2 << TRACE_CTRL_SHIFT &&
+			   TRACE_ROML == CTRL_ROML << TRACE_CTRL_SHIFT && TRACE_ROMH == CTRL_ROMH << TRACE_CTRL_SHIFT &&
+			   TRACE_CS == CTRL_CS << TRACE_CTRL_SHIFT && TRACE_WRITE == CTRL_RW << TRACE_CTRL_SHIFT,
+			   "the control bits of a trace sample must match dispatch.h" );
+
+CLogger	*logger;
+
+// hands the current block over to the main loop (or drops it if the ring is full) and starts a new one
+static __attribute__( ( always_inline ) ) inline void fiqEndBlock()
+{
+	volatile TRACE_SLOT *t = &traceSlot[ fiqSlot ];
+	u32 next = ( fiqSlot + 1 ) & ( TRACE_SLOTS - 1 );
+
+	if ( traceSlot[ next ].state == SLOT_FREE )
+	{
+		t->bytes = (u32)( fiqPtr - &traceRing[ fiqSlot * TRACE_BLOCK_BYTES ] );
+		t->cycles = fiqCycles;
+		t->firstCycle = fiqFirstCycle;
+		t->state = SLOT_FULL;
+		fiqSlot = next;
+	} else
+		traceDroppedCycles += fiqCycles;
+
+	fiqFirstCycle += fiqCycles;
+	fiqCycles = 0;
+	fiqPrev = 0;
+	fiqPtr = &traceRing[ fiqSlot * TRACE_BLOCK_BYTES ];
+}
+
+// samples every bus cycle: A0-A7 (before the multiplexers switch), A8-A12, ROML, ROMH and the other control lines
+// (after switching), and D0-D7 in write cycles -- this kernel never drives the bus
+template <class BUS>
+void CKernel::FIQHandler( void *pParam )
+{
+	register u32 g2, g3, D = 0;
+
+	BEGIN_CYCLE_COUNTER
+
+	// the nasty trick of kernel_cart: switch the multiplexers to A8..12 right away, A0..A7 are read before they switch
+	BUS::setPins( 1 << DIR_CTRL_257 );
+	g2 = BUS::getLevels();
+
+	// block wrong executions
+	if ( !( g2 & bPHI ) )
+	{
+		BUS::clrPins( 1 << DIR_CTRL_257 );
+		return;
+	}
+
+	CACHE_PRELOADW( fiqPtr );
+
+	WAIT_UP_TO_CYCLE( busTimings.muxSample );
+	g3 = BUS::getLevels();
+
+	if ( !( g3 & bRW ) )
+	{
+		// write cycle: the 74LVC245 passes the data from the C64 to the RPi
+		SET_BANK2_INPUT
+		BUS::clrPins( ( 1 << GPIO_OE ) | ( 1 << DIR_CTRL_257 ) );
+
+		WAIT_UP_TO_CYCLE( busTimings.writeSample );
+		D = ( BUS::getLevels() >> D0 ) & 255;
+
+		BUS::setPins( 1 << GPIO_OE );
+		SET_BANK2_OUTPUT
+	} else
+		BUS::clrPins( 1 << DIR_CTRL_257 );
+
+	u32 s = ( ( g2 >> A0 ) & 255 ) | ( ( ( g3 >> A8 ) & 31 ) << 8 ) |
+			( ( CTRL_INDEX( g3 ) ^ ( CTRL_SIZE - 1 ) ) << TRACE_CTRL_SHIFT ) |
+			( ( g3 & bRESET ) ? 0 : TRACE_RESET ) | ( D << TRACE_D_SHIFT );
+
+	// a reset of the C64 starts a new block, which goes into a new file
+	if ( ( s & TRACE_RESET ) && !fiqLastReset )
+	{
+		if ( fiqCycles )
+			fiqEndBlock();
+		traceSlot[ fiqSlot ].newFile = 1;
+	}
+	fiqLastReset = s & TRACE_RESET;
+
+	fiqPtr = traceEncodeRecord( fiqPtr, s ^ fiqPrev );
+	fiqPrev = s;
+
+	if ( ++ fiqCycles == TRACE_BLOCK_CYCLES )
+		fiqEndBlock();
+}
+
+boolean CKernel::OpenTrace( void )
+{
+	// the first unused file name
+	FILINFO info;
+	memcpy( traceFilename, FILENAME, sizeof( FILENAME ) );
+	char *digits = traceFilename + 8;
+	for ( ; traceFileNr < TRACE_MAX_FILES; traceFileNr ++ )
+	{
+		digits[ 0 ] = '0' + traceFileNr / 100;
+		digits[ 1 ] = '0' + ( traceFileNr / 10 ) % 10;
+		digits[ 2 ] = '0' + traceFileNr % 10;
+		if ( f_stat( traceFilename, &info ) != FR_OK )
+			break;
+	}
+
+	if ( traceFileNr == TRACE_MAX_FILES || f_open( &m_File, traceFilename, FA_WRITE | FA_CREATE_ALWAYS ) != FR_OK )
+	{
+		m_Logger.Write( "RaspiTrace", LogError, "Cannot create trace file" );
+		return FALSE;
+	}
+
+	memset( &traceHeader, 0, sizeof( TRACE_HEADER ) );
+	traceHeader.magic = TRACE_MAGIC;
+	traceHeader.version = TRACE_VERSION;
+	traceHeader.headerSize = sizeof( TRACE_HEADER );
+	traceHeader.blockCycles = TRACE_BLOCK_CYCLES;
+	traceHeader.armClock = busTimings.armClock;
+
+	u32 nBytesWritten;
+	if ( f_write( &m_File, &traceHeader, sizeof( TRACE_HEADER ), &nBytesWritten ) != FR_OK || nBytesWritten != sizeof( TRACE_HEADER ) )
+	{
+		m_Logger.Write( "RaspiTrace", LogError, "Cannot write file: %s", traceFilename );
+		f_close( &m_File );
+		return FALSE;
+	}
+
+	traceOffset = sizeof( TRACE_HEADER );
+	traceOpen = TRUE;
+	m_Logger.Write( "RaspiTrace", LogNotice, "tracing to %s", traceFilename );
+
+	return TRUE;
+}
+
+// appends the index and completes the header, a trace which is not closed can still be decoded (by scanning the blocks)
+void CKernel::CloseTrace( void )
+{
+	if ( !traceOpen )
+		return;
+	traceOpen = FALSE;
+
+	u32 nBytesWritten, bytes = traceHeader.nBlocks * sizeof( TRACE_INDEX );
+	if ( traceHeader.nBlocks <= TRACE_MAX_INDEX &&
+		 f_write( &m_File, traceIndex, bytes, &nBytesWritten ) == FR_OK && nBytesWritten == bytes )
+		traceHeader.indexOffset = traceOffset;
+
+	if ( f_lseek( &m_File, 0 ) != FR_OK ||
+		 f_write( &m_File, &traceHeader, sizeof( TRACE_HEADER ), &nBytesWritten ) != FR_OK || nBytesWritten != sizeof( TRACE_HEADER ) )
+		m_Logger.Write( "RaspiTrace", LogError, "Cannot write file: %s", traceFilename );
+
+	if ( f_close( &m_File ) != FR_OK )
+		m_Logger.Write( "RaspiTrace", LogError, "Cannot close file: %s", traceFilename );
+
+	m_Logger.Write( "RaspiTrace", LogNotice, "%s: %u blocks, %u cycles (%u dropped)", traceFilename,
+		traceHeader.nBlocks, (u32)traceHeader.cycles, (u32)traceHeader.droppedCycles );
+}
+
+// compresses and writes the blocks completed by the FIQ handler (called from the main loop only)
+void CKernel::WriteBlocks( void )
+{
+	while ( traceSlot[ writeSlot ].state == SLOT_FULL )
+	{
+		volatile TRACE_SLOT *t = &traceSlot[ writeSlot ];
+
+		if ( t->newFile && traceHeader.nBlocks )
+		{
+			CloseTrace();
+			OpenTrace();
+		}
+
+		if ( traceOpen )
+		{
+			if ( traceHeader.nBlocks == 0 )
+				traceFirstCycle = t->firstCycle;
+
+			TRACE_BLOCK *b = (TRACE_BLOCK*)compressed;
+			b->magic = TRACE_BLOCK_MAGIC;
+			b->rawSize = t->bytes;
+			b->cycles = t->cycles;
+			b->firstCycle = t->firstCycle - traceFirstCycle;
+			b->size = traceCompress( &traceRing[ writeSlot * TRACE_BLOCK_BYTES ], t->bytes, &compressed[ sizeof( TRACE_BLOCK ) ] );
+
+			u32 bytes = sizeof( TRACE_BLOCK ) + b->size;
+			u32 padding = TRACE_PADDING( bytes );
+			memset( &compressed[ bytes ], 0, padding );
+			bytes += padding;
+
+			if ( traceHeader.nBlocks < TRACE_MAX_INDEX )
+			{
+				TRACE_INDEX *idx = &traceIndex[ traceHeader.nBlocks ];
+				idx->firstCycle = b->firstCycle;
+				idx->offset = traceOffset;
+				idx->cycles = b->cycles;
+			}
+
+			// cycles missing since the previous block have been dropped
+			traceHeader.droppedCycles += b->firstCycle - traceHeader.cycles;
+			traceHeader.cycles = b->firstCycle + b->cycles;
+			traceHeader.nBlocks ++;
+
+			u32 nBytesWritten;
+			if ( f_write( &m_File, compressed, bytes, &nBytesWritten ) != FR_OK || nBytesWritten != bytes )
+			{
+				m_Logger.Write( "RaspiTrace", LogError, "Cannot write file: %s, tracing stopped", traceFilename );
+				f_close( &m_File );
+				traceOpen = FALSE;
+			}
+			traceOffset += bytes;
+
+			statCycles += b->cycles;
+			statRawBytes += b->rawSize;
+			statBytes += bytes;
+		}
+
+		t->newFile = 0;
+		DataMemBarrier();
+		t->state = SLOT_FREE;
+		writeSlot = ( writeSlot + 1 ) & ( TRACE_SLOTS - 1 );
+	}
+}
+
+void CKernel::LogStatistics( void )
+{
+	u32 ratio = statBytes ? (u32)( statRawBytes * 100 / statBytes ) : 0;
+	m_Logger.Write( "RaspiTrace", LogNotice, "%u cycles, %u KB written (records compressed %u.%02u:1), %u cycles dropped",
+		(u32)statCycles, (u32)( statBytes / 1024 ), ratio / 100, ratio % 100, traceDroppedCycles );
+}
+
+boolean CKernel::Initialize( void )
+{
+	boolean bOK = TRUE;
+
+#ifdef USE_HDMI_VIDEO
+	if ( bOK ) bOK = m_Screen.Initialize();
+
+	if ( bOK )
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice( m_Options.GetLogDevice(), FALSE );
+		if ( pTarget == 0 )
+			pTarget = &m_Screen;
+
+		bOK = m_Logger.Initialize( pTarget );
+		logger = &m_Logger;
+	}
+#endif
+
+	if ( bOK ) bOK = m_Interrupt.Initialize();
+	if ( bOK ) bOK = m_Timer.Initialize();
+
+	// initialize ARM cycle counters (for accurate timing), and measure the ARM clock for deriving the bus timings
+	initCycleCounter();
+	initBusClock( &m_Timer );
+
+	// initialize GPIOs
+	gpioInit();
+	SET_BANK2_OUTPUT
+
+	// default bus timings (ns after PHI2 rising, only the multiplexer and the write sample are used),
+	// a calibrated profile on SD overrides them (see kernel_calib.cpp)
+	#ifndef TIMINGS_RPI3B_PLUS
+	setBusTimings( 131, 193, 560, 468 );
+	#else
+	setBusTimings( 125, 203, 578, 467 );
+	#endif
+
+	m_EMMC.Initialize();
+	loadBusTimings( &m_Logger, DRIVE, BUS_TIMINGS_FILENAME );
+
+	// initialize latch and software I2C buffer, GAME and EXROM are inactive
+	#ifdef USE_LATCH_OUTPUT
+	initLatch();
+
+	setLatch( LATCH_EXROM );
+	setLatch( LATCH_GAME );
+	outputLatch();
+	#endif
+
+	// the SD card stays mounted while tracing
+	if ( bOK && f_mount( &m_FileSystem, DRIVE, 1 ) != FR_OK )
+	{
+		m_Logger.Write( "RaspiTrace", LogError, "Cannot mount drive: %s", DRIVE );
+		bOK = FALSE;
+	}
+
+	if ( bOK ) bOK = OpenTrace();
+
+	return bOK;
+}
+
+// the trace files are synced to SD this often (a trace of a C64 which has been turned off can still be decoded)
+#define TRACE_SYNC_INTERVAL		2000000
+#define TRACE_LOG_INTERVAL		10000000
+
+void CKernel::Run( void )
+{
+	// setup FIQ
+	m_InputPin.ConnectInterrupt( FIQHandler<BUS>, this );
+	m_InputPin.EnableInterrupt( GPIOInterruptOnRisingEdge );
+
+	unsigned lastSync = m_Timer.GetClockTicks(), lastLog = lastSync;
+
+	// wait forever
+	while ( true )
+	{
+		WriteBlocks();
+
+		unsigned now = m_Timer.GetClockTicks();
+		if ( now - lastSync >= TRACE_SYNC_INTERVAL )
+		{
+			lastSync = now;
+			if ( traceOpen )
+				f_sync( &m_File );
+		}
+
+		if ( now - lastLog >= TRACE_LOG_INTERVAL )
+		{
+			lastLog = now;
+			LogStatistics();
+		}
+
+		// derive the bus timings again if the ARM clock changed (e.g. throttling)
+		if ( updateBusClock( &m_Timer ) )
+			m_Logger.Write( "RaspiTrace", LogNotice, "ARM clock changed to %u MHz, bus timings derived again (%u times)", busTimings.armClock / 1000000, busClockChanges );
+
+		WAIT_FOR_INTERRUPT
+	}
+
+	// and we'll never reach this...
+	m_InputPin.DisableInterrupt();
+}
+
+int main( void )
+{
+	CKernel kernel;
+	if ( kernel.Initialize() )
+		kernel.Run();
+
+	halt();
+	return EXIT_HALT;
+}
@@ -32,7 +32,8 @@
 #include <circle/gpiopin.h>
 #include <circle/memio.h>
 #include "gpio_defs.h"
-#include "lowlevel_arm.h"
+#include "bus.h"
+#include "timings.h"
 
 #define LATCH_RESET		(1<<D0)
 #define LATCH_GAME		(1<<D1)
@@ -136,14 +137,14 @@ NothingToDo:;
 	{
 		latchDOld = latchD;
 
-		write32( ARM_GPIO_GPSET0, ( D_FLAG & latchD ) );
-		write32( ARM_GPIO_GPCLR0, ( D_FLAG & ( ~latchD ) ) );
+		BUS::setPins( ( D_FLAG & latchD ) );
+		BUS::clrPins( ( D_FLAG & ( ~latchD ) ) );
 
 		BEGIN_CYCLE_COUNTER
-		write32( ARM_GPIO_GPSET0, (1 << LATCH_CONTROL) );
+		BUS::setPins( (1 << LATCH_CONTROL) );
 //		WAIT_UP_TO_CYCLE( 50 );
-		WAIT_UP_TO_CYCLE( 60 );
-		write32( ARM_GPIO_GPCLR0, (1 << LATCH_CONTROL) ); 
+		WAIT_UP_TO_CYCLE( latchPulseCycles );
+		BUS::clrPins( (1 << LATCH_CONTROL) ); 
 	}
 }
 
@@ -0,0 +1,405 @@
+//
+// litesid.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/util.h>
+#include <math.h>
+#include "litesid.h"
+
+using namespace reSID;
+
+// envelope rate periods (in cycles) and sustain levels, as in reSID
+static const u32 ratePeriod[ 16 ] = { 9, 32, 63, 95, 149, 220, 267, 313, 392, 977, 1954, 3126, 3907, 11720, 19532, 31251 };
+
+// exponential decay: envelope steps per rate period step, by envelope value
+static u8 expPeriod[ 256 ];
+
+// filter cutoff (in Hz) over the 11-bit FC register: points of the curves of reSID 0.16, linearly interpolated
+typedef struct { u16 fc, hz; } CUTOFF_POINT;
+
+static const CUTOFF_POINT cutoff6581[] = {
+	{ 0, 220 }, { 128, 230 }, { 256, 250 }, { 384, 300 }, { 512, 420 }, { 640, 780 }, { 768, 1600 }, { 832, 2300 }, 
+	{ 896, 3200 }, { 960, 4300 }, { 992, 5000 }, { 1008, 5400 }, { 1016, 5700 }, { 1023, 6000 }, { 1024, 4600 }, 
+	{ 1032, 4800 }, { 1056, 5300 }, { 1088, 6000 }, { 1120, 6600 }, { 1152, 7200 }, { 1280, 9500 }, { 1408, 12000 }, 
+	{ 1536, 14500 }, { 1664, 16000 }, { 1792, 17100 }, { 1920, 17700 }, { 2047, 18000 } };
+
+static const CUTOFF_POINT cutoff8580[] = {
+	{ 0, 0 }, { 2047, 12500 } };
+
+static float cutoffHz( const CUTOFF_POINT *p, u32 n, u32 fc )
+{
+	u32 i = 1;
+	while ( i < n - 1 && p[ i ].fc < fc )
+		i ++;
+	if ( fc >= p[ i ].fc )
+		return p[ i ].hz;
+	return p[ i - 1 ].hz + (float)( p[ i ].hz - p[ i - 1 ].hz ) * ( fc - p[ i - 1 ].fc ) / ( p[ i ].fc - p[ i - 1 ].fc );
+}
+
+// 2-sample polyBLEP: correction of a step by -1 at phase 0 (t and dt as fractions of a period)
+static inline float polyBLEP( float t, float dt )
+{
+	if ( t < dt )
+	{
+		t /= dt;
+		return t + t - t * t - 1.0f;
+	}
+	if ( t > 1.0f - dt )
+	{
+		t = ( t - 1.0f ) / dt;
+		return t * t + t + t + 1.0f;
+	}
+	return 0.0f;
+}
+
+// scale of the voices and the mixer (levels of reSID per model)
+#define VOICE_SHIFT		7
+#define OUTPUT_6581		( 1.0f / 14.1f )
+#define OUTPUT_8580		( 1.0f / 22.8f )
+#define EXT_IN_SHIFT	4
+
+#define PI				3.14159265f
+
+CLiteSID::CLiteSID()
+{
+	if ( expPeriod[ 0 ] == 0 )
+		for ( u32 e = 0; e < 256; e++ )
+			expPeriod[ e ] = e > 0x5d ? 1 : e > 0x36 ? 2 : e > 0x1a ? 4 : e > 0x0e ? 8 : e > 0x06 ? 16 : e > 0 ? 30 : 1;
+
+	memset( &s, 0, sizeof( s ) );
+	s.voiceMask = 0x07;
+	model = MOS6581;
+	set_sampling_parameters( 985248, 44100 );
+	set_chip_model( MOS6581 );
+	reset();
+}
+
+void CLiteSID::set_chip_model( chip_model m )
+{
+	model = m;
+	if ( model == MOS6581 )
+	{
+		// the waveform DACs are not centered, the voices have a DC offset (which makes volume register digis audible)
+		waveZero = 0x380;
+		voiceDC = 0x800 * 0xff;
+		outputScale = OUTPUT_6581;
+	} else
+	{
+		waveZero = 0x800;
+		voiceDC = 0;
+		outputScale = OUTPUT_8580;
+	}
+	updateFilter();
+}
+
+void CLiteSID::set_voice_mask( reg4 mask )
+{
+	s.voiceMask = mask;
+}
+
+void CLiteSID::input( short sample )
+{
+	s.extIn = sample;
+}
+
+void CLiteSID::set_sampling_parameters( double clockFreq, double sampleFreq )
+{
+	this->sampleFreq = (float)sampleFreq;
+	cyclesPerSample = (float)( clockFreq / sampleFreq );
+	// one pole highpass at 16Hz (reSID's external filter)
+	hpCoeff = 1.0f / ( 1.0f + 2.0f * PI * 16.0f / (float)sampleFreq );
+	updateFilter();
+}
+
+void CLiteSID::reset()
+{
+	u32 mask = s.voiceMask;
+	s32 ext = s.extIn;
+	memset( &s, 0, sizeof( s ) );
+	s.voiceMask = mask;
+	s.extIn = ext;
+
+	// as reSID after power on
+	for ( u32 v = 0; v < 3; v++ )
+	{
+		s.acc[ v ] = 0x555555;
+		s.noise[ v ] = 0x7fffff;
+		s.envState[ v ] = ENV_RELEASE;
+	}
+	updateFilter();
+}
+
+void CLiteSID::updateFilter()
+{
+	u32 fc = ( s.reg[ 0x15 ] & 7 ) | ( s.reg[ 0x16 ] << 3 );
+	float hz = model == MOS6581 ? cutoffHz( cutoff6581, sizeof( cutoff6581 ) / sizeof( CUTOFF_POINT ), fc ) :
+								  cutoffHz( cutoff8580, sizeof( cutoff8580 ) / sizeof( CUTOFF_POINT ), fc );
+	if ( hz < 30.0f ) hz = 30.0f;
+	if ( hz > 0.45f * sampleFreq ) hz = 0.45f * sampleFreq;
+
+	float g = tanf( PI * hz / sampleFreq );
+	s.k = 1.0f / ( 0.707f + ( s.reg[ 0x17 ] >> 4 ) / 15.0f );
+	s.a1 = 1.0f / ( 1.0f + g * ( g + s.k ) );
+	s.a2 = g * s.a1;
+	s.a3 = g * s.a2;
+}
+
+reg8 CLiteSID::read( reg8 offset )
+{
+	switch ( offset & 31 )
+	{
+	case 0x19: case 0x1a:
+		return 0xff;
+	case 0x1b:
+		return waveform( 2, 0.0f ) >> 4;
+	case 0x1c:
+		return s.env[ 2 ];
+	default:
+		return s.reg[ offset & 31 ];
+	}
+}
+
+void CLiteSID::write( reg8 offset, reg8 value )
+{
+	offset &= 31;
+
+	// the write happens now, not at the next sample
+	advance( s.pending );
+	s.pending = 0;
+
+	if ( offset < 0x15 && offset % 7 == 4 )
+	{
+		u32 v = offset / 7;
+		u8 prev = s.reg[ offset ];
+
+		if ( ( value & 1 ) && !( prev & 1 ) )
+			s.envState[ v ] = ENV_ATTACK; else
+		if ( !( value & 1 ) && ( prev & 1 ) )
+			s.envState[ v ] = ENV_RELEASE;
+
+		if ( value & 8 )
+		{
+			s.acc[ v ] = 0;
+			s.noise[ v ] = 0x7fffff;
+		}
+	}
+
+	s.reg[ offset ] = value;
+
+	if ( offset >= 0x15 && offset <= 0x17 )
+		updateFilter();
+}
+
+void CLiteSID::advance( u32 cycles )
+{
+	// the accumulators must not overflow 32 bits
+	for ( ; cycles > 4096; cycles -= 4096 )
+		advance( 4096 );
+	if ( cycles == 0 )
+		return;
+
+	u32 total[ 3 ], rises[ 3 ];
+
+	for ( u32 v = 0; v < 3; v++ )
+	{
+		const u8 *r = &s.reg[ v * 7 ];
+
+		// oscillator
+		if ( r[ 4 ] & 8 )
+		{
+			total[ v ] = s.acc[ v ] = 0;
+			rises[ v ] = 0;
+		} else
+		{
+			u32 prev = s.acc[ v ];
+			total[ v ] = prev + ( r[ 0 ] | ( r[ 1 ] << 8 ) ) * cycles;
+			s.acc[ v ] = total[ v ] & 0xffffff;
+
+			// rising edges of bit 23 (hard sync) and bit 19 (noise)
+			rises[ v ] = ( ( total[ v ] + 0x800000 ) >> 24 ) - ( ( prev + 0x800000 ) >> 24 );
+			u32 noiseClocks = ( ( total[ v ] + 0x80000 ) >> 20 ) - ( ( prev + 0x80000 ) >> 20 );
+			if ( noiseClocks > 23 ) noiseClocks = 23;
+			while ( noiseClocks -- )
+			{
+				u32 n = s.noise[ v ];
+				s.noise[ v ] = ( ( n << 1 ) & 0x7fffff ) | ( ( ( n >> 22 ) ^ ( n >> 17 ) ) & 1 );
+			}
+		}
+
+		// envelope
+		s.rateCounter[ v ] += cycles;
+		for ( ;; )
+		{
+			u32 period = ratePeriod[ s.envState[ v ] == ENV_ATTACK ? r[ 5 ] >> 4 : s.envState[ v ] == ENV_DECAY_SUSTAIN ? r[ 5 ] & 15 : r[ 6 ] & 15 ];
+			if ( s.rateCounter[ v ] < period )
+				break;
+			s.rateCounter[ v ] -= period;
+
+			if ( s.envState[ v ] == ENV_ATTACK )
+			{
+				s.expCounter[ v ] = 0;
+				if ( ++ s.env[ v ] >= 0xff )
+				{
+					s.env[ v ] = 0xff;
+					s.envState[ v ] = ENV_DECAY_SUSTAIN;
+				}
+				continue;
+			}
+
+			if ( ++ s.expCounter[ v ] < expPeriod[ s.env[ v ] ] )
+				continue;
+			s.expCounter[ v ] = 0;
+
+			if ( s.env[ v ] > 0 && ( s.envState[ v ] == ENV_RELEASE || s.env[ v ] > ( r[ 6 ] >> 4 ) * 0x11 ) )
+				s.env[ v ] --;
+		}
+	}
+
+	// hard sync: voice v is reset by the MSB of the previous voice, continuing with the cycles since then
+	for ( u32 v = 0; v < 3; v++ )
+	{
+		u32 src = ( v + 2 ) % 3;
+		if ( ( s.reg[ v * 7 + 4 ] & 2 ) && rises[ src ] )
+		{
+			u32 freq = s.reg[ src * 7 ] | ( s.reg[ src * 7 + 1 ] << 8 );
+			u32 rise = ( ( ( total[ src ] + 0x800000 ) >> 24 ) << 24 ) - 0x800000;
+			u32 since = freq ? ( total[ src ] - rise ) / freq : 0;
+			s.acc[ v ] = ( ( s.reg[ v * 7 ] | ( s.reg[ v * 7 + 1 ] << 8 ) ) * since ) & 0xffffff;
+		}
+	}
+}
+
+// 12-bit output of the waveform generator of voice v, band-limited for a phase increment of dt per sample (0: naive)
+u32 CLiteSID::waveform( u32 v, float dt )
+{
+	const u8 *r = &s.reg[ v * 7 ];
+	u32 wave = r[ 4 ] >> 4;
+	u32 acc = s.acc[ v ];
+
+	if ( wave == 0 )
+		return s.lastWave[ v ];
+
+	u32 out = 0xfff;
+	u32 pw = ( r[ 2 ] | ( r[ 3 ] << 8 ) ) & 0xfff;
+
+	if ( wave & 1 )
+	{
+		// triangle, ring modulation replaces the MSB by the XOR with the previous voice
+		u32 msb = acc;
+		if ( r[ 4 ] & 4 )
+			msb ^= s.acc[ ( v + 2 ) % 3 ];
+		out &= ( ( acc ^ ( ( msb & 0x800000 ) ? 0xffffff : 0 ) ) >> 11 ) & 0xffe;
+	}
+	if ( wave & 2 )
+		out &= acc >> 12;
+	if ( wave & 4 )
+		out &= ( ( r[ 4 ] & 8 ) || ( acc >> 12 ) >= pw ) ? 0xfff : 0;
+	if ( wave & 8 )
+	{
+		u32 n = s.noise[ v ];
+		out &= ( ( n & 0x100000 ) >> 9 ) | ( ( n & 0x040000 ) >> 8 ) | ( ( n & 0x004000 ) >> 5 ) | ( ( n & 0x000800 ) >> 3 ) |
+			   ( ( n & 0x000200 ) >> 2 ) | ( ( n & 0x000020 ) << 1 ) | ( ( n & 0x000004 ) << 3 ) | ( ( n & 0x000001 ) << 4 );
+	}
+
+	// band-limited steps of the pure saw and pulse waveforms
+	if ( dt > 0.0f && dt < 0.5f && !( r[ 4 ] & 8 ) && ( wave == 2 || wave == 4 ) )
+	{
+		float t = acc * ( 1.0f / 16777216.0f );
+		float o = (float)out;
+		if ( wave == 2 )
+		{
+			o += 2048.0f * polyBLEP( t, dt );
+		} else
+		if ( pw > 0 && pw < 0xfff )
+		{
+			float tpw = t - pw * ( 1.0f / 4096.0f );
+			if ( tpw < 0.0f ) tpw += 1.0f;
+			o += 2048.0f * polyBLEP( t, dt ) - 2048.0f * polyBLEP( tpw, dt );
+		}
+		if ( o < 0.0f ) o = 0.0f;
+		if ( o > 4095.0f ) o = 4095.0f;
+		out = (u32)o;
+	}
+
+	s.lastWave[ v ] = out;
+	return out;
+}
+
+short CLiteSID::output()
+{
+	advance( s.pending );
+	s.pending = 0;
+
+	const u8 *r = s.reg;
+	float filtered = 0.0f, direct = 0.0f;
+
+	for ( u32 v = 0; v < 3; v++ )
+	{
+		if ( !( s.voiceMask & ( 1 << v ) ) )
+			continue;
+
+		float dt = ( r[ v * 7 ] | ( r[ v * 7 + 1 ] << 8 ) ) * cyclesPerSample * ( 1.0f / 16777216.0f );
+		s32 out = ( ( (s32)waveform( v, dt ) - waveZero ) * (s32)s.env[ v ] + voiceDC ) >> VOICE_SHIFT;
+
+		if ( r[ 0x17 ] & ( 1 << v ) )
+			filtered += out; else
+		if ( v < 2 || !( r[ 0x18 ] & 0x80 ) )
+			direct += out;
+	}
+
+	if ( s.voiceMask & 8 )
+	{
+		float ext = (float)( ( s.extIn << EXT_IN_SHIFT ) >> VOICE_SHIFT );
+		if ( r[ 0x17 ] & 8 )
+			filtered += ext; else
+			direct += ext;
+	}
+
+	// state variable filter (trapezoidal integration), its output is inverted as on the chip
+	float v3 = filtered - s.ic2;
+	float v1 = s.a1 * s.ic1 + s.a2 * v3;
+	float v2 = s.ic2 + s.a2 * s.ic1 + s.a3 * v3;
+	s.ic1 = 2.0f * v1 - s.ic1;
+	s.ic2 = 2.0f * v2 - s.ic2;
+
+	u8 mode = r[ 0x18 ];
+	if ( mode & 0x10 ) direct -= v2;
+	if ( mode & 0x20 ) direct -= v1;
+	if ( mode & 0x40 ) direct -= filtered - s.k * v1 - v2;
+
+	float mix = direct * ( mode & 15 ) * outputScale;
+
+	// external filter: DC blocker
+	float hp = hpCoeff * ( s.hpOut + mix - s.hpIn );
+	s.hpIn = mix;
+	s.hpOut = hp;
+
+	if ( hp > 32767.0f ) return 32767;
+	if ( hp < -32768.0f ) return -32768;
+	return (short)hp;
+}
+
+void CLiteSID::read_raw_state( void *buf )
+{
+	memcpy( buf, &s, sizeof( s ) );
+}
+
+void CLiteSID::write_raw_state( const void *buf )
+{
+	memcpy( &s, buf, sizeof( s ) );
+}
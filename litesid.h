@@ -0,0 +1,93 @@
+//
+// litesid.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _litesid_h
+#define _litesid_h
+
+#include <circle/types.h>
+#include "sidchip.h"
+
+//
+// a lightweight SID emulation (for more chips than reSID can run on one core): clock() only counts cycles, the 
+// oscillators and envelopes are stepped by the elapsed cycles when a sample is computed or a register is written.
+//
+//	oscillators		24-bit accumulators as on the chip, saw and pulse band-limited (polyBLEP), combined waveforms
+//					as the AND of their components, noise LFSR clocked by the number of bit 19 transitions
+//	envelopes		reSID's rate periods and exponential decay as tables, stepped once per sample (no ADSR bug)
+//	filter			state variable filter (a biquad) with a cutoff curve per model from a few points, Q from the 
+//					resonance; coefficients are only derived on writes to the filter registers
+//	mixer			voice DC and volume as on the chip (6581 volume digis work), a highpass as the external filter
+//
+// register writes take effect at the cycle they are applied (the emulation is advanced to it), but everything within 
+// one sample is approximated (e.g. hard sync, noise, test bit pulses), i.e. this is not for bit-exact playback
+//
+class CLiteSID : public CSIDChip
+{
+public:
+	CLiteSID();
+
+	void set_chip_model( reSID::chip_model model );
+	void set_voice_mask( reSID::reg4 mask );
+	void input( short sample );
+	void set_sampling_parameters( double clockFreq, double sampleFreq );
+	void reset();
+
+	reSID::reg8 read( reSID::reg8 offset );
+	void write( reSID::reg8 offset, reSID::reg8 value );
+	void clock( reSID::cycle_count delta_t ) { s.pending += delta_t; }
+	short output();
+
+	int raw_state_size() { return sizeof( s ); }
+	void read_raw_state( void *buf );
+	void write_raw_state( const void *buf );
+
+private:
+	enum { ENV_ATTACK = 0, ENV_DECAY_SUSTAIN, ENV_RELEASE };
+
+	void advance( u32 cycles );
+	u32 waveform( u32 v, float dt );
+	void updateFilter();
+
+	// everything that changes while emulating (the raw state)
+	struct
+	{
+		u8		reg[ 32 ];
+		u32		pending;				// cycles not emulated yet
+
+		u32		acc[ 3 ];
+		u32		noise[ 3 ];
+		u32		lastWave[ 3 ];			// held by the DAC with waveform 0
+
+		u32		env[ 3 ], envState[ 3 ];
+		u32		rateCounter[ 3 ], expCounter[ 3 ];
+
+		float	a1, a2, a3, k;			// filter coefficients
+		float	ic1, ic2;				// filter state
+		float	hpIn, hpOut;			// external filter state
+
+		s32		extIn;
+		u32		voiceMask;
+	} s;
+
+	reSID::chip_model model;
+	float	cyclesPerSample, sampleFreq, hpCoeff, outputScale;
+	s32		waveZero, voiceDC;
+};
+
+#endif
@@ -16,11 +16,25 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
+#include <circle/types.h>
+#include <circle/logger.h>
+#include <circle/util.h>
 #include "lowlevel_arm.h"
+#include "bus.h"
+#include "slotwork.h"
+
+// range preloaded by SlotWorkPrefetch
+SLOT_PREFETCH slotPrefetchRange AA = { 0, 0 };
+
+// PMU profiling (see lowlevel_arm.h)
+u32 pmuEvents[ PMU_COUNTERS ] = { PMU_EVENT_L1D_REFILL, PMU_EVENT_L2D_REFILL, PMU_EVENT_BR_MISPRED, PMU_EVENT_INST_RETIRED };
+PMU_REGION pmuRegions[ PMU_MAX_REGIONS ] AA;
+PMU_SAMPLE pmuOverhead AA;
 
 // initialize what we need for the performance counters
 void initCycleCounter()
 {
+#ifndef HOST_SIMULATION
 	int flag = 1;
 
 	asm volatile ( "mcr p15, 0, %0, c9, c14, 0" :: "r" ( 1 ) );
@@ -31,8 +45,85 @@ void initCycleCounter()
 
 	asm volatile ( "MCR p15, 0, %0, c9, c12, 0\t\n" :: "r"( flag ) );		// program performance counter control register
 	asm volatile ( "MCR p15, 0, %0, c9, c12, 1\t\n" :: "r"( 0x8000000f ) );	// enable all counters
-	asm volatile ( "MCR p15, 0, %0, c9, c12, 3\t\n" :: "r"( 0x80000001 ) );	// clear overflows
-	asm volatile ( "MCR p15, 0, %0, c9, c12, 5\t\n" :: "r"( 0x00 ) );		// select counter 0
-	asm volatile ( "MCR p15, 0, %0, c9, c13, 1\t\n" :: "r"( 0xD ) );		// write event (0x11 = cycle count)
+	asm volatile ( "MCR p15, 0, %0, c9, c12, 3\t\n" :: "r"( 0x8000000f ) );	// clear overflows
+#endif
+
+	initEventCounters( pmuEvents[ 0 ], pmuEvents[ 1 ], pmuEvents[ 2 ], pmuEvents[ 3 ] );
+}
+
+void initEventCounters( u32 e0, u32 e1, u32 e2, u32 e3 )
+{
+	pmuEvents[ 0 ] = e0;
+	pmuEvents[ 1 ] = e1;
+	pmuEvents[ 2 ] = e2;
+	pmuEvents[ 3 ] = e3;
+
+#ifndef HOST_SIMULATION
+	for ( u32 i = 0; i < PMU_COUNTERS; i++ )
+	{
+		asm volatile ( "MCR p15, 0, %0, c9, c12, 5\t\n" :: "r"( i ) );				// select counter i
+		asm volatile ( "ISB\t\n" );
+		asm volatile ( "MCR p15, 0, %0, c9, c13, 1\t\n" :: "r"( pmuEvents[ i ] ) );	// write event
+	}
+#endif
+
+	// the smallest cost of an empty measurement, this is subtracted from every measurement
+	PMU_SAMPLE minimum;
+	for ( u32 j = 0; j < 16; j++ )
+	{
+		PMU_SAMPLE s, e;
+		pmuSample<BUS>( s );
+		pmuSample<BUS>( e );
+		for ( u32 i = 0; i <= PMU_COUNTERS; i++ )
+		{
+			u32 d = i ? e.events[ i - 1 ] - s.events[ i - 1 ] : e.cycles - s.cycles;
+			u32 *m = i ? &minimum.events[ i - 1 ] : &minimum.cycles;
+			if ( j == 0 || d < *m ) *m = d;
+		}
+	}
+	memcpy( &pmuOverhead, &minimum, sizeof( PMU_SAMPLE ) );
+	memset( pmuRegions, 0, sizeof( pmuRegions ) );
+}
+
+static const char *pmuEventName( u32 e )
+{
+	switch ( e )
+	{
+	case PMU_EVENT_L1I_REFILL: return "L1I refill";
+	case PMU_EVENT_L1D_REFILL: return "L1D refill";
+	case PMU_EVENT_INST_RETIRED: return "instr";
+	case PMU_EVENT_BR_MISPRED: return "br mispred";
+	case PMU_EVENT_L2D_REFILL: return "L2D refill";
+	default: return "event";
+	}
+}
+
+void pmuReport( CLogger *logger, const char *source, unsigned now )
+{
+	static unsigned lastReport = 0;
+
+	if ( now - lastReport < PMU_REPORT_INTERVAL )
+		return;
+	lastReport = now;
+
+	for ( u32 r = 0; r < PMU_MAX_REGIONS; r++ )
+	{
+		PMU_REGION reg;
+		memcpy( &reg, &pmuRegions[ r ], sizeof( PMU_REGION ) );
+		if ( reg.calls == 0 )
+			continue;
+		memset( &pmuRegions[ r ], 0, sizeof( PMU_REGION ) );
+
+		// per call, with two decimals
+		u32 ev[ PMU_COUNTERS ];
+		for ( u32 i = 0; i < PMU_COUNTERS; i++ )
+			ev[ i ] = (u32)( reg.events[ i ] * 100 / reg.calls );
+
+		logger->Write( source, LogNotice, "%s: %u calls, %u cycles/call (max %u)", 
+			reg.name, reg.calls, (u32)( reg.cycles / reg.calls ), reg.maxCycles );
+		logger->Write( source, LogNotice, "  per call: %s %u.%02u, %s %u.%02u, %s %u.%02u, %s %u.%02u", 
+			pmuEventName( pmuEvents[ 0 ] ), ev[ 0 ] / 100, ev[ 0 ] % 100, pmuEventName( pmuEvents[ 1 ] ), ev[ 1 ] / 100, ev[ 1 ] % 100,
+			pmuEventName( pmuEvents[ 2 ] ), ev[ 2 ] / 100, ev[ 2 ] % 100, pmuEventName( pmuEvents[ 3 ] ), ev[ 3 ] / 100, ev[ 3 ] % 100 );
+	}
 }
 
@@ -19,39 +19,163 @@
 #ifndef _lowlevel_arm_h
 #define _lowlevel_arm_h
 
+#include <circle/types.h>
+
 #define AA __attribute__ ((aligned (64)))
 
+// the cycle counter and cache hints are provided by the bus backend (see bus.h), 
+// BUS is the template parameter of the FIQ handlers or the default backend otherwise
+#ifdef HOST_SIMULATION
+#define CYCLE_COUNTER_REG( r )
+#else
+#define CYCLE_COUNTER_REG( r ) asm ( r )
+#endif
+
 #define BEGIN_CYCLE_COUNTER \
-						  		unsigned long armCycleCounter asm ("r9"); \
-								armCycleCounter = 0; \
-								asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n": "=r"(armCycleCounter));  
+						  		unsigned long armCycleCounter CYCLE_COUNTER_REG( "r9" ); \
+								armCycleCounter = BUS::readCycleCounter();
 
 #define RESTART_CYCLE_COUNTER \
-								asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n": "=r"(armCycleCounter));  
+								armCycleCounter = BUS::readCycleCounter();
 
 #define READ_CYCLE_COUNTER( cc ) \
-								asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n": "=r"(cc));  
+								cc = BUS::readCycleCounter();
 
 
 #define WAIT_UP_TO_CYCLE( wc ) { \
-								unsigned long cc2  asm ("r10"); \
+								unsigned long cc2 CYCLE_COUNTER_REG( "r10" ); \
 								do { \
-									asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n": "=r"(cc2)); \
-								} while ( (cc2-armCycleCounter) < (wc) ); }
+									cc2 = BUS::readCycleCounter(); \
+								} while ( (u32)(cc2-armCycleCounter) < (wc) ); }
 
 #define WAIT_UP_TO_CYCLE_AFTER( wc, cc ) { \
-								unsigned long cc2  asm ("r11"); \
+								unsigned long cc2 CYCLE_COUNTER_REG( "r11" ); \
 								do { \
-									asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n": "=r"(cc2)); \
-								} while ( (cc2-cc) < (wc) ); }
+									cc2 = BUS::readCycleCounter(); \
+								} while ( (u32)(cc2-cc) < (wc) ); }
+
+// like WAIT_UP_TO_CYCLE, but runs steps of slot work (see slotwork.h) while waiting: a step is only started if it ends 
+// before the deadline even in the worst case (WORK::MAX_CYCLES), the deadline itself is met exactly as before
+#define WAIT_UP_TO_CYCLE_WORK( wc, WORK ) { \
+								while ( (u32)( BUS::readCycleCounter() - armCycleCounter ) + (u32)( WORK::MAX_CYCLES ) < (u32)( wc ) ) { \
+									if ( !WORK::run() ) break; \
+								} \
+								WAIT_UP_TO_CYCLE( wc ) }
 
-#define CACHE_PRELOAD( ptr ) { asm volatile ("pld\t[%0]" :: "r" (ptr)); }
-#define CACHE_PRELOADW( ptr ) { asm volatile ("pldw\t[%0]" :: "r" (ptr)); }
-#define CACHE_PRELOADI( ptr ) { asm volatile ("pli\t[%0]" :: "r" (ptr)); }
+#define CACHE_PRELOAD( ptr ) { BUS::preload( (const void*)(ptr) ); }
+#define CACHE_PRELOADW( ptr ) { BUS::preloadW( (const void*)(ptr) ); }
+#define CACHE_PRELOADI( ptr ) { BUS::preloadI( (const void*)(ptr) ); }
 
+#define WAIT_FOR_INTERRUPT BUS::waitForInterrupt();
 
 void initCycleCounter();
 
+//
+// PMU profiling: besides the cycle counter, 4 event counters of the Cortex-A53 count configurable events 
+// (initCycleCounter selects the default ones below), and the macros below aggregate cycles and events per code region.
+// This shows why a path is slow (e.g. cache refills when reading flash_cacheoptimized, or branch mispredictions).
+//
+// Profiling is enabled with "make kernel=... PMU_PROFILING=1" (otherwise the macros are empty), the kernels show the
+// results on HDMI (PMU_REPORT). Reading the counters takes some cycles (an ISB per event counter), which is measured
+// once and subtracted, but it delays whatever follows: in FIQ handlers only sample (PMU_BEGIN/PMU_END) in the critical
+// part and aggregate (PMU_ADD) after the bus has been released.
+//
+//	PMU_SCOPE( PMU_FLASH_TASK, "flash task" )	// aggregates until the end of the enclosing block
+//
+//	PMU_BEGIN( s ) ... PMU_END( e ) ... PMU_ADD( PMU_ROM_READ, "rom read", s, e )
+//
+#define PMU_EVENT_L1I_REFILL	0x01
+#define PMU_EVENT_L1D_REFILL	0x03
+#define PMU_EVENT_INST_RETIRED	0x08
+#define PMU_EVENT_BR_MISPRED	0x10
+#define PMU_EVENT_L2D_REFILL	0x17
+
+#define PMU_COUNTERS			4
+#define PMU_MAX_REGIONS			16
+
+// interval of PMU_REPORT in microseconds
+#define PMU_REPORT_INTERVAL		5000000
+
+typedef struct
+{
+	u32 cycles;
+	u32 events[ PMU_COUNTERS ];
+} PMU_SAMPLE;
+
+typedef struct
+{
+	const char *name;
+	u32 calls;
+	u32 maxCycles;
+	u64 cycles;
+	u64 events[ PMU_COUNTERS ];
+} PMU_REGION;
+
+extern u32 pmuEvents[ PMU_COUNTERS ];
+extern PMU_REGION pmuRegions[ PMU_MAX_REGIONS ];
+
+// cost of an empty measurement (measured by initEventCounters)
+extern PMU_SAMPLE pmuOverhead;
+
+// select the events of counters 0..3 (PMU_EVENT_xxx or any other event number of the Cortex-A53)
+void initEventCounters( u32 e0, u32 e1, u32 e2, u32 e3 );
+
+// log all regions with calls since the last report (at most every PMU_REPORT_INTERVAL), and restart aggregating
+class CLogger;
+void pmuReport( CLogger *logger, const char *source, unsigned now );
+
+template <class B>
+__attribute__( ( always_inline ) ) inline void pmuSample( PMU_SAMPLE &s )
+{
+	s.cycles = B::readCycleCounter();
+	for ( u32 i = 0; i < PMU_COUNTERS; i++ )
+		s.events[ i ] = B::readEventCounter( i );
+}
+
+// the regions are not locked: a report (or a region used in the FIQ handler and the main loop) may lose a measurement
+__attribute__( ( always_inline ) ) inline void pmuAdd( u32 id, const char *name, const PMU_SAMPLE &s, const PMU_SAMPLE &e )
+{
+	PMU_REGION *r = &pmuRegions[ id ];
+	s32 cycles = (s32)( e.cycles - s.cycles - pmuOverhead.cycles );
+	if ( cycles < 0 ) cycles = 0;
+
+	r->name = name;
+	r->calls ++;
+	r->cycles += cycles;
+	if ( (u32)cycles > r->maxCycles )
+		r->maxCycles = cycles;
+	for ( u32 i = 0; i < PMU_COUNTERS; i++ )
+	{
+		s32 n = (s32)( e.events[ i ] - s.events[ i ] - pmuOverhead.events[ i ] );
+		if ( n > 0 ) r->events[ i ] += n;
+	}
+}
+
+template <class B>
+struct PMUScope
+{
+	u32 id;
+	const char *name;
+	PMU_SAMPLE s;
+
+	__attribute__( ( always_inline ) ) PMUScope( u32 _id, const char *_name ) : id( _id ), name( _name ) { pmuSample<B>( s ); }
+	__attribute__( ( always_inline ) ) ~PMUScope() { PMU_SAMPLE e; pmuSample<B>( e ); pmuAdd( id, name, s, e ); }
+};
+
+#ifdef USE_PMU_PROFILING
+#define PMU_SCOPE( id, name )			PMUScope<BUS> pmuScope##id( id, name );
+#define PMU_BEGIN( s )					PMU_SAMPLE s; pmuSample<BUS>( s );
+#define PMU_END( e )					PMU_SAMPLE e; pmuSample<BUS>( e );
+#define PMU_ADD( id, name, s, e )		pmuAdd( id, name, s, e );
+#define PMU_REPORT( logger, source, now )	pmuReport( logger, source, now );
+#else
+#define PMU_SCOPE( id, name )
+#define PMU_BEGIN( s )
+#define PMU_END( e )
+#define PMU_ADD( id, name, s, e )
+#define PMU_REPORT( logger, source, now )
+#endif
+
 #endif
 
  
\ No newline at end of file
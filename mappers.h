@@ -0,0 +1,242 @@
+//
+// mappers.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _mappers_h
+#define _mappers_h
+
+#include <circle/types.h>
+#include "crt.h"
+
+//
+// cartridge mappers: every hardware type is a policy class with static functions describing its IO1/IO2 and ROML/ROMH behavior,
+// the FIQ handler in kernel_ef.cpp is instantiated once per mapper, i.e. there's no runtime dispatch on the cartridge type
+//
+// the mappers only modify CART_STATE (no GPIO accesses), and report what the FIQ handler has to do afterwards
+//
+
+// memory configurations (as in Vice): bit 0 = GAME active, bit 1 = EXROM inactive
+#define CART_MODE_8K		0
+#define CART_MODE_16K		1
+#define CART_MODE_OFF		2
+#define CART_MODE_ULTIMAX	3
+
+// return values of the IO functions
+#define MAPPER_BANK_CHANGED	1	// warm the cache for the new bank
+#define MAPPER_MODE_CHANGED	2	// update GAME/EXROM
+#define MAPPER_DRIVE_BUS	4	// put D onto the bus (read accesses only)
+
+typedef struct
+{
+	// current 8k bank (same for ROML and ROMH), and memory configuration (CART_MODE_xxx)
+	u8	bank;
+	u8	mode;
+
+	// easyflash specific: registers $DE02 and boot jumper, 256 bytes of RAM in IO2
+	u8	reg2;
+	u8	jumper;
+	u8	*ram;
+
+	// configuration of generic carts as given in the .CRT header
+	u8	headerMode;
+} CART_STATE;
+
+#define MAPPER_BANK_MASK	( CRT_MAX_BANKS - 1 )
+
+// defaults for all mappers: no IO, fixed bank 0, memory configuration from the .CRT header
+struct MapperBase
+{
+	// which accesses need to be handled at all
+	enum { IO1_READ = 0, IO1_WRITE = 0, IO2_READ = 0, IO2_WRITE = 0, ROM_WRITE = 0 };
+
+	// flash plane (see crt.h) from which ROMH reads are served
+	enum { ROMH_PLANE = 1 };
+
+	static void reset( CART_STATE &s ) { s.bank = 0; s.mode = s.headerMode; }
+
+	static u32 IO1Read( CART_STATE &s, u32 A, u8 &D ) { return 0; }
+	static u32 IO1Write( CART_STATE &s, u32 A, u8 D ) { return 0; }
+	static u32 IO2Read( CART_STATE &s, u32 A, u8 &D ) { return 0; }
+	static u32 IO2Write( CART_STATE &s, u32 A, u8 D ) { return 0; }
+};
+
+// normal 8k, 16k and ultimax cartridges (CRT type 0)
+struct MapperNormal : MapperBase
+{
+};
+
+// easyflash (CRT type 32): bank register $DE00, control register $DE02, RAM in IO2, flash programming via ROML/ROMH
+struct MapperEasyFlash : MapperBase
+{
+	enum { IO1_READ = 1, IO1_WRITE = 1, IO2_READ = 1, IO2_WRITE = 1, ROM_WRITE = 1 };
+
+	// table with EF memory configurations adapted from Vice
+	static u8 memconfig( CART_STATE &s )
+	{
+		static const u8 ef_memconfig[] = {
+			CART_MODE_ULTIMAX, CART_MODE_ULTIMAX, CART_MODE_16K, CART_MODE_16K,
+			CART_MODE_OFF, CART_MODE_ULTIMAX, CART_MODE_8K, CART_MODE_16K,
+			CART_MODE_OFF, CART_MODE_ULTIMAX, CART_MODE_8K, CART_MODE_16K,
+			CART_MODE_OFF, CART_MODE_ULTIMAX, CART_MODE_8K, CART_MODE_16K,
+		};
+		return ef_memconfig[ ( s.jumper << 3 ) | ( s.reg2 & 7 ) ];
+	}
+
+	static void reset( CART_STATE &s )
+	{
+		s.bank = 0;
+		s.reg2 = 0;
+		s.jumper = 0;
+		s.mode = memconfig( s );
+	}
+
+	static u32 IO1Read( CART_STATE &s, u32 A, u8 &D )
+	{
+		D = ( A & 2 ) ? s.reg2 : s.bank;
+		return MAPPER_DRIVE_BUS;
+	}
+
+	static u32 IO1Write( CART_STATE &s, u32 A, u8 D )
+	{
+		if ( ( A & 2 ) == 0 )
+		{
+			s.bank = D & MAPPER_BANK_MASK;
+			return MAPPER_BANK_CHANGED;
+		}
+		s.reg2 = D & 0x87;
+		s.mode = memconfig( s );
+		return MAPPER_MODE_CHANGED;
+	}
+
+	static u32 IO2Read( CART_STATE &s, u32 A, u8 &D )
+	{
+		D = s.ram[ A & 0xff ];
+		return MAPPER_DRIVE_BUS;
+	}
+
+	static u32 IO2Write( CART_STATE &s, u32 A, u8 D )
+	{
+		s.ram[ A & 0xff ] = D;
+		return 0;
+	}
+};
+
+// magic desk, domark, hes australia (CRT type 19): $DE00 bits 0-5 select the bank (64 banks = 512k, CHIP packets
+// of higher banks are skipped by readCRTFile), bit 7 disables the cartridge
+struct MapperMagicDesk : MapperBase
+{
+	enum { IO1_WRITE = 1 };
+
+	static void reset( CART_STATE &s ) { s.bank = 0; s.mode = CART_MODE_8K; }
+
+	static u32 IO1Write( CART_STATE &s, u32 A, u8 D )
+	{
+		s.bank = D & MAPPER_BANK_MASK;
+		s.mode = ( D & 128 ) ? CART_MODE_OFF : CART_MODE_8K;
+		return MAPPER_BANK_CHANGED | MAPPER_MODE_CHANGED;
+	}
+};
+
+// ocean type A/B (CRT type 5): $DE00 selects the bank, in 16k mode ROMH shows the same bank as ROML
+// (all banks are stored in the ROML plane, see readCRTFile)
+struct MapperOcean : MapperBase
+{
+	enum { IO1_WRITE = 1, ROMH_PLANE = 0 };
+
+	static u32 IO1Write( CART_STATE &s, u32 A, u8 D )
+	{
+		s.bank = D & MAPPER_BANK_MASK;
+		return MAPPER_BANK_CHANGED;
+	}
+};
+
+// fun play, power play (CRT type 7): bank number is scrambled in the value written to $DE00, $86 disables the cartridge
+struct MapperFunPlay : MapperBase
+{
+	enum { IO1_WRITE = 1 };
+
+	static void reset( CART_STATE &s ) { s.bank = 0; s.mode = CART_MODE_8K; }
+
+	static u32 IO1Write( CART_STATE &s, u32 A, u8 D )
+	{
+		s.bank = ( ( D >> 3 ) & 7 ) | ( ( D & 1 ) << 3 );
+
+		if ( ( D & 0xc6 ) == 0x00 )
+			s.mode = CART_MODE_8K; else
+		if ( ( D & 0xc6 ) == 0x86 )
+			s.mode = CART_MODE_OFF;
+
+		return MAPPER_BANK_CHANGED | MAPPER_MODE_CHANGED;
+	}
+};
+
+// c64 game system, system 3 (CRT type 15): writing to $DE00+n selects bank n, reading from IO1 selects bank 0
+struct MapperSystem3 : MapperBase
+{
+	enum { IO1_READ = 1, IO1_WRITE = 1 };
+
+	static void reset( CART_STATE &s ) { s.bank = 0; s.mode = CART_MODE_8K; }
+
+	static u32 IO1Read( CART_STATE &s, u32 A, u8 &D )
+	{
+		s.bank = 0;
+		return MAPPER_BANK_CHANGED;
+	}
+
+	static u32 IO1Write( CART_STATE &s, u32 A, u8 D )
+	{
+		s.bank = A & MAPPER_BANK_MASK;
+		return MAPPER_BANK_CHANGED;
+	}
+};
+
+// dinamic (CRT type 17): reading from $DE00+n selects bank n
+struct MapperDinamic : MapperBase
+{
+	enum { IO1_READ = 1 };
+
+	static void reset( CART_STATE &s ) { s.bank = 0; s.mode = CART_MODE_8K; }
+
+	static u32 IO1Read( CART_STATE &s, u32 A, u8 &D )
+	{
+		s.bank = A & 15;
+		return MAPPER_BANK_CHANGED;
+	}
+};
+
+// simons' basic (CRT type 4): reading from IO1 switches to 8k mode (ROMH off), writing switches to 16k mode
+struct MapperSimonsBasic : MapperBase
+{
+	enum { IO1_READ = 1, IO1_WRITE = 1 };
+
+	static void reset( CART_STATE &s ) { s.bank = 0; s.mode = CART_MODE_16K; }
+
+	static u32 IO1Read( CART_STATE &s, u32 A, u8 &D )
+	{
+		s.mode = CART_MODE_8K;
+		return MAPPER_MODE_CHANGED;
+	}
+
+	static u32 IO1Write( CART_STATE &s, u32 A, u8 D )
+	{
+		s.mode = CART_MODE_16K;
+		return MAPPER_MODE_CHANGED;
+	}
+};
+
+#endif
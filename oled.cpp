@@ -60,12 +60,15 @@ void splashScreen( const u8 *fb )
 		ssd1306_send_data_stop();
 	}
 
+	// 5us per latch update (7000 cycles at 1.4GHz)
+	const u32 waitCycles = BUS_NS2CYCLES( 5000 );
+
 	BEGIN_CYCLE_COUNTER
 	while ( !bufferEmptyI2C() )
 	{
 		outputLatch();
 		RESTART_CYCLE_COUNTER
-		WAIT_UP_TO_CYCLE( 7000 )
+		WAIT_UP_TO_CYCLE( waitCycles )
 	}
-	write32( ARM_GPIO_GPCLR0, (1 << LATCH_CONTROL) ); 
+	BUS::clrPins( (1 << LATCH_CONTROL) ); 
 }
\ No newline at end of file
@@ -72,13 +72,9 @@ namespace reSID
 // These DACs include the correct termination resistor, and also seem to have
 // very accurately matched R and 2R resistors (2R/R = 2.00).
 
-void build_dac_table(unsigned short* dac, int bits, double _2R_div_R, bool term)
+// Calculate voltage contribution by each individual bit in the R-2R ladder.
+static void build_dac_bits(double* vbit, int bits, double _2R_div_R, bool term)
 {
-  // FIXME: No variable length arrays in ISO C++, hardcoding to max 12 bits.
-  // double vbit[bits];
-  double vbit[12];
-
-  // Calculate voltage contribution by each individual bit in the R-2R ladder.
   for (int set_bit = 0; set_bit < bits; set_bit++) {
     int bit;
 
@@ -118,6 +114,15 @@ void build_dac_table(unsigned short* dac, int bits, double _2R_div_R, bool term)
 
     vbit[set_bit] = Vn;
   }
+}
+
+void build_dac_table(unsigned short* dac, int bits, double _2R_div_R, bool term)
+{
+  // FIXME: No variable length arrays in ISO C++, hardcoding to max 12 bits.
+  // double vbit[bits];
+  double vbit[12];
+
+  build_dac_bits(vbit, bits, _2R_div_R, term);
 
   // Calculate the voltage for any combination of bits by superpositioning.
   for (int i = 0; i < (1 << bits); i++) {
@@ -133,4 +138,33 @@ void build_dac_table(unsigned short* dac, int bits, double _2R_div_R, bool term)
   }
 }
 
+// The same DAC as two tables for the lower lo_bits and the remaining upper
+// bits, in fixed point with 16 fractional bits (rounding included in lo):
+// dac[x] = (lo[x & ((1 << lo_bits) - 1)] + hi[x >> lo_bits]) >> 16
+// For the 12-bit waveform DACs of both chip models, split into 6 + 6 bits,
+// this is identical to build_dac_table() for all inputs (host/residcheck.cpp
+// checks this, "make -C host test").
+void build_dac_split(unsigned int* lo, unsigned int* hi, int bits, int lo_bits, double _2R_div_R, bool term)
+{
+  double vbit[12];
+
+  build_dac_bits(vbit, bits, _2R_div_R, term);
+
+  for (int i = 0; i < (1 << lo_bits); i++) {
+    double Vo = 0;
+    for (int j = 0; j < lo_bits; j++) {
+      Vo += ((i >> j) & 0x1)*vbit[j];
+    }
+    lo[i] = (unsigned int)(((1 << bits) - 1)*Vo*65536 + 0.5) + 0x8000;
+  }
+
+  for (int i = 0; i < (1 << (bits - lo_bits)); i++) {
+    double Vo = 0;
+    for (int j = 0; j < bits - lo_bits; j++) {
+      Vo += ((i >> j) & 0x1)*vbit[lo_bits + j];
+    }
+    hi[i] = (unsigned int)(((1 << bits) - 1)*Vo*65536 + 0.5);
+  }
+}
+
 } // namespace reSID
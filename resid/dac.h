@@ -24,6 +24,7 @@ namespace reSID
 {
 
 void build_dac_table(unsigned short* dac, int bits, double _2R_div_R, bool term);
+void build_dac_split(unsigned int* lo, unsigned int* hi, int bits, int lo_bits, double _2R_div_R, bool term);
 
 } // namespace reSID
 
@@ -534,6 +534,10 @@ public:
 
   void clock(int voice1, int voice2, int voice3);
   void clock(cycle_count delta_t, int voice1, int voice2, int voice3);
+  // Same as clock(delta_t, ...) for an enabled filter, with the chip model
+  // and the inputs routed into the filter (sum & 0xf) as template parameters.
+  template<int MODEL, int SUM>
+  void clock_routed(cycle_count delta_t, int voice1, int voice2, int voice3);
   void reset();
 
   // Write registers.
@@ -891,6 +895,53 @@ void Filter::clock(cycle_count delta_t, int voice1, int voice2, int voice3)
 }
 
 
+// ----------------------------------------------------------------------------
+// SID clocking - delta_t cycles, specialized on chip model and filter routing.
+// ----------------------------------------------------------------------------
+template<int MODEL, int SUM>
+RESID_INLINE
+void Filter::clock_routed(cycle_count delta_t, int voice1, int voice2, int voice3)
+{
+  model_filter_t& f = model_filter[MODEL];
+
+  v1 = (voice1*f.voice_scale_s14 >> 18) + f.voice_DC;
+  v2 = (voice2*f.voice_scale_s14 >> 18) + f.voice_DC;
+  v3 = (voice3*f.voice_scale_s14 >> 18) + f.voice_DC;
+
+  // Sum inputs routed into the filter (in the order of the switch above).
+  const int Vi =
+    ((SUM & 0x8) ? ve : 0) + ((SUM & 0x4) ? v3 : 0) +
+    ((SUM & 0x2) ? v2 : 0) + ((SUM & 0x1) ? v1 : 0);
+  const int offset = summer_offset<
+    (SUM & 1) + ((SUM >> 1) & 1) + ((SUM >> 2) & 1) + ((SUM >> 3) & 1)
+  >::value;
+
+  cycle_count delta_t_flt = 3;
+
+  while (delta_t) {
+    if (unlikely(delta_t < delta_t_flt)) {
+      delta_t_flt = delta_t;
+    }
+
+    // Calculate filter outputs.
+    if (MODEL == 0) {
+      // MOS 6581.
+      Vlp = solve_integrate_6581(delta_t_flt, Vbp, Vlp_x, Vlp_vc, f);
+      Vbp = solve_integrate_6581(delta_t_flt, Vhp, Vbp_x, Vbp_vc, f);
+      Vhp = f.summer[offset + f.gain[_8_div_Q][Vbp] + Vlp + Vi];
+    }
+    else {
+      // MOS 8580.
+      Vlp = solve_integrate_8580(delta_t_flt, Vbp, Vlp_x, Vlp_vc, f);
+      Vbp = solve_integrate_8580(delta_t_flt, Vhp, Vbp_x, Vbp_vc, f);
+      Vhp = f.summer[offset + resonance[res][Vbp] + Vlp + Vi];
+    }
+
+    delta_t -= delta_t_flt;
+  }
+}
+
+
 // ----------------------------------------------------------------------------
 // SID audio input (16 bits).
 // ----------------------------------------------------------------------------
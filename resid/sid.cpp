@@ -60,6 +60,9 @@ SID::SID()
   write_pipeline = 0;
 
   databus_ttl = 0;
+
+  clock_kernels_enabled = true;
+  select_clock_kernel();
 }
 
 
@@ -97,6 +100,7 @@ void SID::set_chip_model(chip_model model)
   }
 
   filter.set_chip_model(model);
+  select_clock_kernel();
 }
 
 
@@ -113,6 +117,8 @@ void SID::reset()
 
   bus_value = 0;
   bus_value_ttl = 0;
+
+  select_clock_kernel();
 }
 
 
@@ -277,6 +283,15 @@ void SID::write()
     break;
   }
 
+  // Sync bits and filter routing select the clock kernel.
+  switch (write_address) {
+  case 0x04: case 0x0b: case 0x12: case 0x17: case 0x18:
+    select_clock_kernel();
+    break;
+  default:
+    break;
+  }
+
   // Tell clock() that the pipeline is empty.
   write_pipeline = 0;
 }
@@ -419,6 +434,84 @@ void SID::write_state(const State& state)
     voice[i].envelope.hold_zero = state.hold_zero[i];
     voice[i].envelope.envelope_pipeline = state.envelope_pipeline[i];
   }
+
+  select_clock_kernel();
+}
+
+
+// ----------------------------------------------------------------------------
+// Raw state: a copy of the object with the pointers cleared (they are
+// restored from the object the state is written to), followed by the
+// ring buffer when resampling.
+// ----------------------------------------------------------------------------
+int SID::raw_state_size()
+{
+  return sizeof(SID) + (sample ? RINGSIZE*2*sizeof(short) : 0);
+}
+
+void SID::read_raw_state(void* buf)
+{
+  char* dst = (char*)buf;
+  const char* src = (const char*)this;
+  int i;
+
+  for (i = 0; i < int(sizeof(SID)); i++) {
+    dst[i] = src[i];
+  }
+
+  SID* state = (SID*)buf;
+  for (i = 0; i < 3; i++) {
+    state->voice[i].wave.sync_source = 0;
+    state->voice[i].wave.sync_dest = 0;
+    state->voice[i].wave.wave = 0;
+  }
+  state->sample = 0;
+  state->fir = 0;
+  state->clock_kernel = 0;
+
+  if (sample) {
+    short* ring = (short*)(dst + sizeof(SID));
+    for (i = 0; i < RINGSIZE*2; i++) {
+      ring[i] = sample[i];
+    }
+  }
+}
+
+void SID::write_raw_state(const void* buf)
+{
+  const WaveformGenerator* sync_source[3];
+  WaveformGenerator* sync_dest[3];
+  short* sample_buf = sample;
+  short* fir_buf = fir;
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    sync_source[i] = voice[i].wave.sync_source;
+    sync_dest[i] = voice[i].wave.sync_dest;
+  }
+
+  const char* src = (const char*)buf;
+  char* dst = (char*)this;
+  for (i = 0; i < int(sizeof(SID)); i++) {
+    dst[i] = src[i];
+  }
+
+  for (i = 0; i < 3; i++) {
+    WaveformGenerator& wave = voice[i].wave;
+    wave.sync_source = sync_source[i];
+    wave.sync_dest = sync_dest[i];
+    wave.set_wave_table();
+  }
+  sample = sample_buf;
+  fir = fir_buf;
+  select_clock_kernel();
+
+  if (sample) {
+    const short* ring = (const short*)(src + sizeof(SID));
+    for (i = 0; i < RINGSIZE*2; i++) {
+      sample[i] = ring[i];
+    }
+  }
 }
 
 
@@ -430,6 +523,7 @@ void SID::write_state(const State& state)
 void SID::set_voice_mask(reg4 mask)
 {
   filter.set_voice_mask(mask);
+  select_clock_kernel();
 }
 
 
@@ -439,6 +533,7 @@ void SID::set_voice_mask(reg4 mask)
 void SID::enable_filter(bool enable)
 {
   filter.enable_filter(enable);
+  select_clock_kernel();
 }
 
 
@@ -668,8 +763,6 @@ void SID::adjust_sampling_frequency(double sample_freq)
 // ----------------------------------------------------------------------------
 void SID::clock(cycle_count delta_t)
 {
-  int i;
-
   // Pipelined writes on the MOS8580.
   if (unlikely(write_pipeline) && likely(delta_t > 0)) {
     // Step one cycle by a recursive call to ourselves.
@@ -683,19 +776,18 @@ void SID::clock(cycle_count delta_t)
     return;
   }
 
-  // Age bus value.
-  bus_value_ttl -= delta_t;
-  if (unlikely(bus_value_ttl <= 0)) {
-    bus_value = 0;
-    bus_value_ttl = 0;
-  }
+  (this->*clock_kernel)(delta_t);
+}
 
-  // Clock amplitude modulators.
-  for (i = 0; i < 3; i++) {
-    voice[i].envelope.clock(delta_t);
-  }
 
-  // Clock and synchronize oscillators.
+// ----------------------------------------------------------------------------
+// Clock and synchronize oscillators.
+// ----------------------------------------------------------------------------
+RESID_INLINE
+void SID::clock_oscillators_sync(cycle_count delta_t)
+{
+  int i;
+
   // Loop until we reach the current cycle.
   cycle_count delta_t_osc = delta_t;
   while (delta_t_osc) {
@@ -742,6 +834,30 @@ void SID::clock(cycle_count delta_t)
 
     delta_t_osc -= delta_t_min;
   }
+}
+
+
+// ----------------------------------------------------------------------------
+// Generic clock kernel, any configuration.
+// ----------------------------------------------------------------------------
+void SID::clock_generic(cycle_count delta_t)
+{
+  int i;
+
+  // Age bus value.
+  bus_value_ttl -= delta_t;
+  if (unlikely(bus_value_ttl <= 0)) {
+    bus_value = 0;
+    bus_value_ttl = 0;
+  }
+
+  // Clock amplitude modulators.
+  for (i = 0; i < 3; i++) {
+    voice[i].envelope.clock(delta_t);
+  }
+
+  // Clock and synchronize oscillators.
+  clock_oscillators_sync(delta_t);
 
   // Calculate waveform output.
   for (i = 0; i < 3; i++) {
@@ -756,6 +872,90 @@ void SID::clock(cycle_count delta_t)
 }
 
 
+// ----------------------------------------------------------------------------
+// Specialized clock kernels.
+// Without hard sync the oscillators are clocked in one step: the sync search
+// loop (a division per voice and iteration) and synchronize() are no-ops.
+// The filter is clocked without the switch on the routing.
+// ----------------------------------------------------------------------------
+template<bool SYNC, int MODEL, int SUM>
+void SID::clock_kernel_impl(cycle_count delta_t)
+{
+  int i;
+
+  // Age bus value.
+  bus_value_ttl -= delta_t;
+  if (unlikely(bus_value_ttl <= 0)) {
+    bus_value = 0;
+    bus_value_ttl = 0;
+  }
+
+  // Clock amplitude modulators.
+  for (i = 0; i < 3; i++) {
+    voice[i].envelope.clock(delta_t);
+  }
+
+  // Clock oscillators.
+  if (SYNC) {
+    clock_oscillators_sync(delta_t);
+  }
+  else {
+    for (i = 0; i < 3; i++) {
+      voice[i].wave.clock(delta_t);
+    }
+  }
+
+  // Calculate waveform output.
+  for (i = 0; i < 3; i++) {
+    voice[i].wave.set_waveform_output(delta_t);
+  }
+
+  // Clock filter.
+  filter.clock_routed<MODEL, SUM>(delta_t, voice[0].output(), voice[1].output(), voice[2].output());
+
+  // Clock external filter.
+  extfilt.clock(delta_t, filter.output());
+}
+
+#define KERNELS_SUM(sync, model) \
+  { &SID::clock_kernel_impl<sync, model, 0x0>, &SID::clock_kernel_impl<sync, model, 0x1>, \
+    &SID::clock_kernel_impl<sync, model, 0x2>, &SID::clock_kernel_impl<sync, model, 0x3>, \
+    &SID::clock_kernel_impl<sync, model, 0x4>, &SID::clock_kernel_impl<sync, model, 0x5>, \
+    &SID::clock_kernel_impl<sync, model, 0x6>, &SID::clock_kernel_impl<sync, model, 0x7>, \
+    &SID::clock_kernel_impl<sync, model, 0x8>, &SID::clock_kernel_impl<sync, model, 0x9>, \
+    &SID::clock_kernel_impl<sync, model, 0xa>, &SID::clock_kernel_impl<sync, model, 0xb>, \
+    &SID::clock_kernel_impl<sync, model, 0xc>, &SID::clock_kernel_impl<sync, model, 0xd>, \
+    &SID::clock_kernel_impl<sync, model, 0xe>, &SID::clock_kernel_impl<sync, model, 0xf> }
+
+const SID::clock_kernel_t SID::clock_kernels[2][2][16] = {
+  { KERNELS_SUM(false, 0), KERNELS_SUM(false, 1) },
+  { KERNELS_SUM(true, 0), KERNELS_SUM(true, 1) }
+};
+
+#undef KERNELS_SUM
+
+
+// ----------------------------------------------------------------------------
+// Select the clock kernel for the current configuration.
+// ----------------------------------------------------------------------------
+void SID::select_clock_kernel()
+{
+  if (!clock_kernels_enabled || !filter.enabled) {
+    clock_kernel = &SID::clock_generic;
+    return;
+  }
+
+  bool sync = voice[0].wave.sync || voice[1].wave.sync || voice[2].wave.sync;
+  clock_kernel = clock_kernels[sync][filter.sid_model][filter.sum & 0xf];
+}
+
+void SID::enable_clock_kernels(bool enable)
+{
+  clock_kernels_enabled = enable;
+  select_clock_kernel();
+}
+
+
 // ----------------------------------------------------------------------------
 // SID clocking with audio sampling.
 // Fixed point arithmetics are used.
@@ -896,6 +1096,82 @@ int SID::clock_interpolate(cycle_count& delta_t, short* buf, int n, int interlea
 // NB! the result of right shifting negative numbers is really
 // implementation dependent in the C++ standard.
 // ----------------------------------------------------------------------------
+// Convolution of the last fir_N cycle outputs with the filter impulse
+// response for the current sample_offset.
+inline short SID::fir_resample()
+{
+  int fir_offset = sample_offset*fir_RES >> FIXP_SHIFT;
+  int fir_offset_rmd = sample_offset*fir_RES & FIXP_MASK;
+  short* fir_start = fir + fir_offset*fir_N;
+  short* sample_start = sample + sample_index - fir_N - 1 + RINGSIZE;
+
+  // Convolution with filter impulse response.
+  int v1 = 0;
+  for (int j = 0; j < fir_N; j++) {
+    v1 += sample_start[j]*fir_start[j];
+  }
+
+  // Use next FIR table, wrap around to first FIR table using
+  // next sample.
+  if (unlikely(++fir_offset == fir_RES)) {
+    fir_offset = 0;
+    ++sample_start;
+  }
+  fir_start = fir + fir_offset*fir_N;
+
+  // Convolution with filter impulse response.
+  int v2 = 0;
+  for (int k = 0; k < fir_N; k++) {
+    v2 += sample_start[k]*fir_start[k];
+  }
+
+  // Linear interpolation.
+  // fir_offset_rmd is equal for all samples, it can thus be factorized out:
+  // sum(v1 + rmd*(v2 - v1)) = sum(v1) + rmd*(sum(v2) - sum(v1))
+  int v = v1 + int((unsigned(fir_offset_rmd)*unsigned(v2 - v1)) >> FIXP_SHIFT);
+
+  v >>= FIR_SHIFT;
+
+  // Saturated arithmetics to guard against 16 bit sample overflow.
+  const int half = 1 << 15;
+  if (v >= half) {
+    v = half - 1;
+  }
+  else if (v < -half) {
+    v = -half;
+  }
+
+  return v;
+}
+
+
+inline short SID::fir_resample_fastmem()
+{
+  int fir_offset = sample_offset*fir_RES >> FIXP_SHIFT;
+  short* fir_start = fir + fir_offset*fir_N;
+  short* sample_start = sample + sample_index - fir_N + RINGSIZE;
+
+  // Convolution with filter impulse response.
+  int v = 0;
+  for (int j = 0; j < fir_N; j++) {
+    v += sample_start[j]*fir_start[j];
+  }
+
+  v >>= FIR_SHIFT;
+
+  // Saturated arithmetics to guard against 16 bit sample overflow.
+  const int half = 1 << 15;
+  if (v >= half) {
+    v = half - 1;
+  }
+  else if (v < -half) {
+    v = -half;
+  }
+
+  return v;
+}
+
+
 int SID::clock_resample(cycle_count& delta_t, short* buf, int n, int interleave)
 {
   int s;
@@ -921,48 +1197,7 @@ int SID::clock_resample(cycle_count& delta_t, short* buf, int n, int interleave)
 
     sample_offset = next_sample_offset & FIXP_MASK;
 
-    int fir_offset = sample_offset*fir_RES >> FIXP_SHIFT;
-    int fir_offset_rmd = sample_offset*fir_RES & FIXP_MASK;
-    short* fir_start = fir + fir_offset*fir_N;
-    short* sample_start = sample + sample_index - fir_N - 1 + RINGSIZE;
-
-    // Convolution with filter impulse response.
-    int v1 = 0;
-    for (int j = 0; j < fir_N; j++) {
-      v1 += sample_start[j]*fir_start[j];
-    }
-
-    // Use next FIR table, wrap around to first FIR table using
-    // next sample.
-    if (unlikely(++fir_offset == fir_RES)) {
-      fir_offset = 0;
-      ++sample_start;
-    }
-    fir_start = fir + fir_offset*fir_N;
-
-    // Convolution with filter impulse response.
-    int v2 = 0;
-    for (int k = 0; k < fir_N; k++) {
-      v2 += sample_start[k]*fir_start[k];
-    }
-
-    // Linear interpolation.
-    // fir_offset_rmd is equal for all samples, it can thus be factorized out:
-    // sum(v1 + rmd*(v2 - v1)) = sum(v1) + rmd*(sum(v2) - sum(v1))
-    int v = v1 + int((unsigned(fir_offset_rmd)*unsigned(v2 - v1)) >> FIXP_SHIFT);
-
-    v >>= FIR_SHIFT;
-
-    // Saturated arithmetics to guard against 16 bit sample overflow.
-    const int half = 1 << 15;
-    if (v >= half) {
-      v = half - 1;
-    }
-    else if (v < -half) {
-      v = -half;
-    }
-
-    buf[s*interleave] = v;
+    buf[s*interleave] = fir_resample();
   }
 
   return s;
@@ -997,28 +1232,60 @@ int SID::clock_resample_fastmem(cycle_count& delta_t, short* buf, int n, int int
 
     sample_offset = next_sample_offset & FIXP_MASK;
 
-    int fir_offset = sample_offset*fir_RES >> FIXP_SHIFT;
-    short* fir_start = fir + fir_offset*fir_N;
-    short* sample_start = sample + sample_index - fir_N + RINGSIZE;
+    buf[s*interleave] = fir_resample_fastmem();
+  }
 
-    // Convolution with filter impulse response.
-    int v = 0;
-    for (int j = 0; j < fir_N; j++) {
-      v += sample_start[j]*fir_start[j];
-    }
+  return s;
+}
 
-    v >>= FIR_SHIFT;
 
-    // Saturated arithmetics to guard against 16 bit sample overflow.
-    const int half = 1 << 15;
-    if (v >= half) {
-      v = half - 1;
+// ----------------------------------------------------------------------------
+// SID clocking with audio resampling in two stages: the cycle outputs of
+// clock_raw() are passed to decimate(), which does what clock_resample()
+// does between the cycles. Apart from the cycle outputs the stages share no
+// data, i.e. they can run in parallel on different chunks of cycles.
+// ----------------------------------------------------------------------------
+int SID::clock_raw(cycle_count& delta_t, short* raw, int n)
+{
+  if (n > delta_t) {
+    n = delta_t;
+  }
+
+  for (int i = 0; i < n; i++) {
+    clock();
+    raw[i] = output();
+  }
+
+  delta_t -= n;
+  return n;
+}
+
+
+int SID::decimate(const short* raw, int n, short* buf, int interleave)
+{
+  int s = 0;
+
+  for (;;) {
+    cycle_count next_sample_offset = sample_offset + cycles_per_sample;
+    cycle_count delta_t_sample = next_sample_offset >> FIXP_SHIFT;
+
+    if (delta_t_sample > n) {
+      delta_t_sample = n;
+    }
+
+    for (int i = 0; i < delta_t_sample; i++) {
+      sample[sample_index] = sample[sample_index + RINGSIZE] = *raw++;
+      ++sample_index &= RINGMASK;
     }
-    else if (v < -half) {
-      v = -half;
+
+    if ((n -= delta_t_sample) == 0) {
+      sample_offset -= delta_t_sample << FIXP_SHIFT;
+      break;
     }
 
-    buf[s*interleave] = v;
+    sample_offset = next_sample_offset & FIXP_MASK;
+
+    buf[s++*interleave] = sampling == SAMPLE_RESAMPLE_FASTMEM ? fir_resample_fastmem() : fir_resample();
   }
 
   return s;
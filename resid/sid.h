@@ -52,6 +52,19 @@ public:
   int clock(cycle_count& delta_t, short* buf, int n, int interleave = 1);
   void reset();
 
+  // SAMPLE_RESAMPLE(_FASTMEM) in two stages, e.g. on two cores:
+  // clock_raw() clocks up to n cycles and stores the output of every cycle,
+  // decimate() resamples these outputs. Both only touch their own part of
+  // the state; together they produce exactly the samples of
+  // clock(delta_t, buf, ...). decimate() writes at most
+  // n*65536/cycles_per_sample + 1 samples.
+  int clock_raw(cycle_count& delta_t, short* raw, int n);
+  int decimate(const short* raw, int n, short* buf, int interleave = 1);
+
+  // Use the specialized clock kernels for clock(delta_t) (default), or the
+  // generic code (for comparisons).
+  void enable_clock_kernels(bool enable);
+
   // Read/write registers.
   reg8 read(reg8 offset);
   void write(reg8 offset, reg8 value);
@@ -96,6 +109,14 @@ public:
   State read_state();
   void write_state(const State& state);
 
+  // Read/write the complete emulation state (including the filters and the
+  // sampling), unlike read_state/write_state this continues sample exact.
+  // The raw state is only valid for the same build, chip model and sampling
+  // parameters.
+  int raw_state_size();
+  void read_raw_state(void* buf);
+  void write_raw_state(const void* buf);
+
   // 16-bit input (EXT IN).
   void input(short sample);
 
@@ -108,8 +129,26 @@ public:
   int clock_interpolate(cycle_count& delta_t, short* buf, int n, int interleave);
   int clock_resample(cycle_count& delta_t, short* buf, int n, int interleave);
   int clock_resample_fastmem(cycle_count& delta_t, short* buf, int n, int interleave);
+  short fir_resample();
+  short fir_resample_fastmem();
   void write();
 
+  // Clock kernels for clock(delta_t), specialized on hard sync being used by
+  // any voice, the chip model and the inputs routed into the filter. The
+  // kernel is selected whenever one of these changes (control register and
+  // filter writes, chip model, voice mask), the generic code is used for a
+  // disabled filter.
+  typedef void (SID::*clock_kernel_t)(cycle_count delta_t);
+  template<bool SYNC, int MODEL, int SUM>
+  void clock_kernel_impl(cycle_count delta_t);
+  void clock_generic(cycle_count delta_t);
+  void clock_oscillators_sync(cycle_count delta_t);
+  void select_clock_kernel();
+
+  static const clock_kernel_t clock_kernels[2][2][16];
+  clock_kernel_t clock_kernel;
+  bool clock_kernels_enabled;
+
   chip_model sid_model;
   Voice voice[3];
   Filter filter;
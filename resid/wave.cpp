@@ -25,24 +25,16 @@
 namespace reSID
 {
 
-// Waveform lookup tables.
-unsigned short WaveformGenerator::model_wave[2][8][1 << 12] = {
+// Combined waveform lookup tables (8-bit OSC3 samples).
+const unsigned char WaveformGenerator::model_wave[2][4][1 << 12] = {
   {
-    {0},
-    {0},
-    {0},
 #include "wave6581__ST.h"
-    {0},
 #include "wave6581_P_T.h"
 #include "wave6581_PS_.h"
 #include "wave6581_PST.h"
   },
   {
-    {0},
-    {0},
-    {0},
 #include "wave8580__ST.h"
-    {0},
 #include "wave8580_P_T.h"
 #include "wave8580_PS_.h"
 #include "wave8580_PST.h"
@@ -51,10 +43,7 @@ unsigned short WaveformGenerator::model_wave[2][8][1 << 12] = {
 
 
 // DAC lookup tables.
-unsigned short WaveformGenerator::model_dac[2][1 << 12] = {
-  {0},
-  {0},
-};
+unsigned int WaveformGenerator::model_dac[2][2][1 << 6];
 
 
 // ----------------------------------------------------------------------------
@@ -65,26 +54,11 @@ WaveformGenerator::WaveformGenerator()
   static bool class_init;
 
   if (!class_init) {
-    // Calculate tables for normal waveforms.
-    accumulator = 0;
-    for (int i = 0; i < (1 << 12); i++) {
-      reg24 msb = accumulator & 0x800000;
-
-      // Noise mask, triangle, sawtooth, pulse mask.
-      // The triangle calculation is made branch-free, just for the hell of it.
-      model_wave[0][0][i] = model_wave[1][0][i] = 0xfff;
-      model_wave[0][1][i] = model_wave[1][1][i] = ((accumulator ^ -!!msb) >> 11) & 0xffe;
-      model_wave[0][2][i] = model_wave[1][2][i] = accumulator >> 12;
-      model_wave[0][4][i] = model_wave[1][4][i] = 0xfff;
-
-      accumulator += 0x1000;
-    }
-
     // Build DAC lookup tables for 12-bit DACs.
     // MOS 6581: 2R/R ~ 2.20, missing termination resistor.
-    build_dac_table(model_dac[0], 12, 2.20, false);
+    build_dac_split(model_dac[0][0], model_dac[0][1], 12, 6, 2.20, false);
     // MOS 8580: 2R/R ~ 2.00, correct termination.
-    build_dac_table(model_dac[1], 12, 2.00, true);
+    build_dac_split(model_dac[1][0], model_dac[1][1], 12, 6, 2.00, true);
 
     class_init = true;
   }
@@ -118,7 +92,24 @@ void WaveformGenerator::set_sync_source(WaveformGenerator* source)
 void WaveformGenerator::set_chip_model(chip_model model)
 {
   sid_model = model;
-  wave = model_wave[model][waveform & 0x7];
+  set_wave_table();
+}
+
+
+// ----------------------------------------------------------------------------
+// Set up the waveform table or the masks for the waveform in the control
+// register (see wave_sample()).
+// ----------------------------------------------------------------------------
+void WaveformGenerator::set_wave_table()
+{
+  // Index of the combined waveforms in model_wave, -1 for the others.
+  static const int combined[8] = { -1, -1, -1, 0, -1, 1, 2, 3 };
+  int i = combined[waveform & 0x7];
+
+  wave = i < 0 ? 0 : model_wave[sid_model][i];
+  wave_triangle = waveform & 0x1 ? 0xffe : 0x000;
+  wave_sawtooth = waveform & 0x2 ? 0xfff : 0x000;
+  wave_ones = waveform & 0x3 ? 0x000 : 0xfff;
 }
 
 
@@ -176,7 +167,7 @@ void WaveformGenerator::writeCONTROL_REG(reg8 control)
   sync = control & 0x02;
 
   // Set up waveform table.
-  wave = model_wave[sid_model][waveform & 0x7];
+  set_wave_table();
 
   // Substitution of accumulator MSB when sawtooth = 0, ring_mod = 1.
   ring_msb_mask = ((~control >> 5) & (control >> 2) & 0x1) << 23;
@@ -266,7 +257,7 @@ void WaveformGenerator::reset()
   ring_mod = 0;
   sync = 0;
 
-  wave = model_wave[sid_model][0];
+  set_wave_table();
 
   ring_msb_mask = 0;
   no_noise = 0xfff;
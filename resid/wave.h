@@ -65,6 +65,8 @@ protected:
   void write_shift_register();
   void reset_shift_register();
   void set_noise_output();
+  void set_wave_table();
+  reg12 wave_sample(int ix);
 
   const WaveformGenerator* sync_source;
   WaveformGenerator* sync_dest;
@@ -115,11 +117,18 @@ protected:
 
   chip_model sid_model;
 
-  // Sample data for waveforms, not including noise.
-  unsigned short* wave;
-  static unsigned short model_wave[2][8][1 << 12];
-  // DAC lookup tables.
-  static unsigned short model_dac[2][1 << 12];
+  // Sample data for the combined waveforms (sawtooth+triangle, pulse with
+  // triangle and/or sawtooth), 0 for all other waveforms. The samples are
+  // 8-bit OSC3 samples, i.e. the lower 4 bits of the waveform are zero.
+  // Triangle and sawtooth are calculated from the accumulator with the masks
+  // below, pulse and noise are applied as masks in set_waveform_output().
+  const unsigned char* wave;
+  reg12 wave_triangle;
+  reg12 wave_sawtooth;
+  reg12 wave_ones;
+  static const unsigned char model_wave[2][4][1 << 12];
+  // DAC lookup tables for the lower and upper 6 bits (see build_dac_split()).
+  static unsigned int model_dac[2][2][1 << 6];
 
 friend class Voice;
 friend class SID;
@@ -449,6 +458,21 @@ RESID_INLINE void WaveformGenerator::set_noise_output()
 // since the waveform bits are and'ed into the shift register via the shift
 // register outputs.
 
+// Waveform sample for the upper 12 bits of the accumulator (with the MSB
+// substituted for ring modulation), before the pulse and noise masks.
+// Triangle: the lower 11 bits EOR'ed with the MSB, shifted up one bit.
+// Sawtooth: the 12 bits as they are.
+// Neither (pulse and/or noise): all ones.
+RESID_INLINE
+reg12 WaveformGenerator::wave_sample(int ix)
+{
+  if (unlikely(wave != 0)) {
+    return wave[ix] << 4;
+  }
+  return (((ix ^ -(ix >> 11)) << 1) & wave_triangle)
+    | (ix & wave_sawtooth) | wave_ones;
+}
+
 RESID_INLINE
 void WaveformGenerator::set_waveform_output()
 {
@@ -457,8 +481,9 @@ void WaveformGenerator::set_waveform_output()
     // The bit masks no_pulse and no_noise are used to achieve branch-free
     // calculation of the output value.
     int ix = (accumulator ^ (~sync_source->accumulator & ring_msb_mask)) >> 12;
+    reg12 sample = wave_sample(ix);
 
-    waveform_output = wave[ix] & (no_pulse | pulse_output) & no_noise_or_noise_output;
+    waveform_output = sample & (no_pulse | pulse_output) & no_noise_or_noise_output;
 
     // Triangle/Sawtooth output is delayed half cycle on 8580.
     // This will appear as a one cycle delay on OSC3 as it is
@@ -466,7 +491,7 @@ void WaveformGenerator::set_waveform_output()
     if ((waveform & 3) && (sid_model == MOS8580))
     {
         osc3 = tri_saw_pipeline & (no_pulse | pulse_output) & no_noise_or_noise_output;
-        tri_saw_pipeline = wave[ix];
+        tri_saw_pipeline = sample;
     }
     else
     {
@@ -515,7 +540,7 @@ void WaveformGenerator::set_waveform_output(cycle_count delta_t)
     // calculation of the output value.
     int ix = (accumulator ^ (~sync_source->accumulator & ring_msb_mask)) >> 12;
     waveform_output =
-      wave[ix] & (no_pulse | pulse_output) & no_noise_or_noise_output;
+      wave_sample(ix) & (no_pulse | pulse_output) & no_noise_or_noise_output;
     // Triangle/Sawtooth output delay for the 8580 is not modeled
     osc3 = waveform_output;
 
@@ -576,8 +601,9 @@ RESID_INLINE
 short WaveformGenerator::output()
 {
   // DAC imperfections are emulated by using waveform_output as an index
-  // into a DAC lookup table. readOSC() uses waveform_output directly.
-  return model_dac[sid_model][waveform_output];
+  // into DAC lookup tables. readOSC() uses waveform_output directly.
+  const unsigned int (*dac)[1 << 6] = model_dac[sid_model];
+  return (dac[0][waveform_output & 0x3f] + dac[1][waveform_output >> 6]) >> 16;
 }
 
 #endif // RESID_INLINING || defined(RESID_WAVE_CC)
@@ -0,0 +1,270 @@
+//
+// sidcapture.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "sidcapture.h"
+#include <circle/util.h>
+#include <fatfs/ff.h>
+#include "lowlevel_arm.h"
+
+static const char DRIVE[] = "SD:";
+static const char FILENAME[] = "SD:sidw000.rsw";
+#define CAPTURE_MAX_FILES	1000
+
+// completed blocks waiting to be written: 64 blocks buffer at least 64k writes, i.e. several seconds of heavy digi playback
+#define CAPTURE_SLOTS		64
+
+// bytes written to SD per call of captureUpdate: one sector, i.e. (when appending) at most one sector write per iteration of
+// the emulation loop -- a whole block of up to 7k (plus allocating a cluster) could stall the emulation for milliseconds
+#define CAPTURE_WRITE_CHUNK	512
+
+typedef struct
+{
+	u32	full;
+	u32	bytes;
+	u32	writes;
+	u32	newFile;			// the block is the first after a reset of the C64
+	u32	dropped;			// writes dropped before this block (because the ring was full)
+	u64	firstCycle;
+} CAPTURE_SLOT;
+
+static u8 captureRing[ CAPTURE_SLOTS * CAPTURE_BLOCK_BYTES ] AA;
+static CAPTURE_SLOT captureSlot[ CAPTURE_SLOTS ];
+static u32 curSlot = 0, writeSlot = 0;
+
+// current block
+u8 *captureBlockPtr = 0;
+u64 captureLastCycle = 0;
+u8 captureShadow[ CAPTURE_TARGETS ];
+u32 captureBlockWrites = 0;
+static u64 blockFirstCycle = 0;
+
+static u8 compressed[ sizeof( CAPTURE_BLOCK ) + TRACE_COMPRESSED_BYTES( CAPTURE_BLOCK_BYTES ) + 8 ] AA;
+
+static FATFS fileSystem;
+static FIL file;
+static boolean mounted = FALSE, fileOpen = FALSE;
+static char captureFilename[ sizeof( FILENAME ) ];
+static u32 captureFileNr = 0;
+static CAPTURE_HEADER header;
+static u64 fileFirstCycle = 0;
+
+// the compressed block which is being written in chunks, and whether the file has been synced since the last write to it
+static u32 pendingBytes = 0, pendingPos = 0;
+static boolean synced = TRUE;
+
+void captureEndBlock( u64 cycle )
+{
+	if ( captureBlockWrites )
+	{
+		CAPTURE_SLOT *s = &captureSlot[ curSlot ];
+		u32 next = ( curSlot + 1 ) & ( CAPTURE_SLOTS - 1 );
+
+		if ( !captureSlot[ next ].full )
+		{
+			s->bytes = (u32)( captureBlockPtr - &captureRing[ curSlot * CAPTURE_BLOCK_BYTES ] );
+			s->writes = captureBlockWrites;
+			s->firstCycle = blockFirstCycle;
+			s->full = 1;
+			curSlot = next;
+			captureSlot[ curSlot ].newFile = 0;
+			captureSlot[ curSlot ].dropped = 0;
+		} else
+			// the slot is reused for the next block (which inherits a reset)
+			s->dropped += captureBlockWrites;
+	}
+
+	blockFirstCycle = captureLastCycle = cycle;
+	captureBlockWrites = 0;
+	memset( captureShadow, 0, CAPTURE_TARGETS );
+	captureBlockPtr = &captureRing[ curSlot * CAPTURE_BLOCK_BYTES ];
+}
+
+static boolean openCapture( CLogger *logger )
+{
+	FILINFO info;
+	memcpy( captureFilename, FILENAME, sizeof( FILENAME ) );
+	char *digits = captureFilename + 7;
+	for ( ; captureFileNr < CAPTURE_MAX_FILES; captureFileNr ++ )
+	{
+		digits[ 0 ] = '0' + captureFileNr / 100;
+		digits[ 1 ] = '0' + ( captureFileNr / 10 ) % 10;
+		digits[ 2 ] = '0' + captureFileNr % 10;
+		if ( f_stat( captureFilename, &info ) != FR_OK )
+			break;
+	}
+
+	if ( captureFileNr == CAPTURE_MAX_FILES || f_open( &file, captureFilename, FA_WRITE | FA_CREATE_ALWAYS ) != FR_OK )
+	{
+		logger->Write( "RaspiSID", LogError, "Cannot create capture file" );
+		return FALSE;
+	}
+
+	header.nBlocks = 0;
+	header.writes = 0;
+	header.droppedWrites = 0;
+
+	u32 nBytesWritten;
+	if ( f_write( &file, &header, sizeof( CAPTURE_HEADER ), &nBytesWritten ) != FR_OK || nBytesWritten != sizeof( CAPTURE_HEADER ) )
+	{
+		logger->Write( "RaspiSID", LogError, "Cannot write file: %s", captureFilename );
+		f_close( &file );
+		return FALSE;
+	}
+
+	fileOpen = TRUE;
+	logger->Write( "RaspiSID", LogNotice, "capturing register writes to %s", captureFilename );
+	return TRUE;
+}
+
+// completes the header, a capture which is not closed can still be decoded
+static void closeCapture( CLogger *logger )
+{
+	if ( !fileOpen )
+		return;
+	fileOpen = FALSE;
+
+	u32 nBytesWritten;
+	if ( f_lseek( &file, 0 ) != FR_OK ||
+		 f_write( &file, &header, sizeof( CAPTURE_HEADER ), &nBytesWritten ) != FR_OK || nBytesWritten != sizeof( CAPTURE_HEADER ) )
+		logger->Write( "RaspiSID", LogError, "Cannot write file: %s", captureFilename );
+
+	if ( f_close( &file ) != FR_OK )
+		logger->Write( "RaspiSID", LogError, "Cannot close file: %s", captureFilename );
+
+	logger->Write( "RaspiSID", LogNotice, "%s: %u writes (%u dropped)", captureFilename, (u32)header.writes, (u32)header.droppedWrites );
+}
+
+boolean captureStart( CLogger *logger, u32 c64Clock, const u32 *sidModel, u32 flags )
+{
+	if ( f_mount( &fileSystem, DRIVE, 1 ) != FR_OK )
+	{
+		logger->Write( "RaspiSID", LogError, "Cannot mount drive: %s", DRIVE );
+		return FALSE;
+	}
+	mounted = TRUE;
+
+	memset( &header, 0, sizeof( CAPTURE_HEADER ) );
+	header.magic = CAPTURE_MAGIC;
+	header.version = CAPTURE_VERSION;
+	header.headerSize = sizeof( CAPTURE_HEADER );
+	header.c64Clock = c64Clock;
+	header.sidModel[ 0 ] = sidModel[ 0 ];
+	header.sidModel[ 1 ] = sidModel[ 1 ];
+	header.flags = flags;
+
+	// the first file is created with the first block
+	captureEndBlock( 0 );
+	captureSlot[ curSlot ].newFile = 1;
+	return TRUE;
+}
+
+void captureReset( CLogger *logger )
+{
+	if ( !mounted )
+		return;
+	captureEndBlock( captureLastCycle );
+	captureSlot[ curSlot ].newFile = 1;
+}
+
+static void writeChunk( CLogger *logger )
+{
+	u32 bytes = pendingBytes - pendingPos;
+	if ( bytes > CAPTURE_WRITE_CHUNK )
+		bytes = CAPTURE_WRITE_CHUNK;
+
+	u32 nBytesWritten;
+	if ( f_write( &file, &compressed[ pendingPos ], bytes, &nBytesWritten ) != FR_OK || nBytesWritten != bytes )
+	{
+		logger->Write( "RaspiSID", LogError, "Cannot write file: %s, capture stopped", captureFilename );
+		f_close( &file );
+		fileOpen = FALSE;
+		mounted = FALSE;
+		pendingBytes = 0;
+		return;
+	}
+
+	pendingPos += bytes;
+	if ( pendingPos == pendingBytes )
+		pendingBytes = 0;
+}
+
+void captureUpdate( CLogger *logger, u64 cycle )
+{
+	if ( !mounted )
+		return;
+
+	// the last writes should not wait for more writes forever
+	if ( captureBlockWrites && cycle - blockFirstCycle > header.c64Clock )
+		captureEndBlock( cycle );
+
+	// the block being written comes first
+	if ( pendingBytes )
+	{
+		writeChunk( logger );
+		return;
+	}
+
+	CAPTURE_SLOT *s = &captureSlot[ writeSlot ];
+	if ( !s->full )
+	{
+		// f_sync writes the directory entry and the FAT, which can take milliseconds: not while the C64 writes to the SID,
+		// but once there have been no writes for 2 seconds (the file stays decodable without it, see closeCapture)
+		if ( fileOpen && !synced && cycle - captureLastCycle > 2 * (u64)header.c64Clock )
+		{
+			f_sync( &file );
+			synced = TRUE;
+		}
+		return;
+	}
+
+	if ( s->newFile )
+	{
+		closeCapture( logger );
+		if ( openCapture( logger ) )
+			fileFirstCycle = s->firstCycle;
+	}
+
+	if ( fileOpen )
+	{
+		CAPTURE_BLOCK *b = (CAPTURE_BLOCK*)compressed;
+		b->magic = CAPTURE_BLOCK_MAGIC;
+		b->rawSize = s->bytes;
+		b->writes = s->writes;
+		b->firstCycle = s->firstCycle - fileFirstCycle;
+		b->size = traceCompress( &captureRing[ writeSlot * CAPTURE_BLOCK_BYTES ], s->bytes, &compressed[ sizeof( CAPTURE_BLOCK ) ] );
+
+		u32 bytes = sizeof( CAPTURE_BLOCK ) + b->size;
+		u32 padding = TRACE_PADDING( bytes );
+		memset( &compressed[ bytes ], 0, padding );
+		bytes += padding;
+
+		header.nBlocks ++;
+		header.writes += s->writes;
+		header.droppedWrites += s->dropped;
+
+		// the slot is free again, the block is written from 'compressed' in the next iterations
+		pendingBytes = bytes;
+		pendingPos = 0;
+		synced = FALSE;
+	}
+
+	s->full = 0;
+	s->newFile = 0;
+	writeSlot = ( writeSlot + 1 ) & ( CAPTURE_SLOTS - 1 );
+}
@@ -0,0 +1,165 @@
+//
+// sidcapture.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _sidcapture_h
+#define _sidcapture_h
+
+#include <circle/types.h>
+#include <circle/logger.h>
+#include "trace.h"
+
+//
+// capture of the SID/OPL register writes of kernel=sid (define CAPTURE_SID_WRITES in kernel_sid.h), decoded on the host
+// with host/sidcapdec (which also exports SIDdump-style tables)
+//
+// the main loop (not the FIQ handler) records every write when it applies it to the emulation, with the C64 cycle at which
+// the FIQ handler saw it; the records are collected in blocks and compressed and written to SD in the main loop as well, 
+// one block per iteration. If the blocks are not written in time, new ones are dropped (and counted), the emulation never waits.
+//
+// file layout (little endian, structures naturally aligned, blocks padded to 8 bytes as in trace.h):
+//
+//	CAPTURE_HEADER
+//	CAPTURE_BLOCK, compressed records, padding				(repeated)
+//
+// a record is the cycle delta to the previous write (the first: to firstCycle of the block) as unsigned LEB128, the target
+// (CAPTURE_TARGET), and the data XOR the previous value written to the same target in this block, then runs of zero bytes are
+// compressed as in trace.h (0x00 n = n+1 zero bytes). Blocks are independent of each other. A reset of the C64 starts a new file.
+//
+#define CAPTURE_MAGIC			0x57534352			// "RCSW"
+#define CAPTURE_VERSION			1
+#define CAPTURE_BLOCK_MAGIC		0x4b4c4257			// "WBLK"
+
+// bits 0-4 register, bits 5-6 chip
+#define CAPTURE_SID1			0
+#define CAPTURE_SID2			1
+#define CAPTURE_OPL				2					// register: A0-A4 of the access (A4 = 0 address, A4 = 1 data port)
+#define CAPTURE_TARGET( chip, reg )	( ( (chip) << 5 ) | ( (reg) & 31 ) )
+#define CAPTURE_TARGETS			96
+
+// header flags
+#define CAPTURE_FLAG_SID2		1
+#define CAPTURE_FLAG_OPL		2
+
+// writes per block, and the maximum size of their records (5 bytes cycle delta, target, data)
+#define CAPTURE_BLOCK_WRITES	1024
+#define CAPTURE_BLOCK_BYTES		( CAPTURE_BLOCK_WRITES * 7 )
+
+typedef struct
+{
+	u32	magic;
+	u32	version;
+	u32	headerSize;				// offset of the first block
+	u32	c64Clock;				// measured clock of the C64 in Hz
+	u32	sidModel[ 2 ];			// 6581 or 8580
+	u32	flags;
+	u32	nBlocks;				// 0 if the capture has not been closed (the decoder scans the blocks anyway)
+	u64	writes;
+	u64	droppedWrites;			// writes which could not be written to SD in time
+} CAPTURE_HEADER;
+
+typedef struct
+{
+	u32	magic;
+	u32	size;					// compressed bytes following this header (without padding)
+	u32	rawSize;				// bytes of the records
+	u32	writes;
+	u64	firstCycle;				// C64 cycle since the start of the capture
+} CAPTURE_BLOCK;
+
+typedef struct
+{
+	u64	cycle;
+	u8	target;
+	u8	data;
+} CAPTURE_WRITE;
+
+// decodes the records of a block, returns the number of writes (less than 'writes' if the data is corrupt)
+static inline u32 captureDecodeRecords( const u8 *raw, u32 n, u64 firstCycle, u32 writes, CAPTURE_WRITE *w )
+{
+	u8 shadow[ CAPTURE_TARGETS ] = { 0 };
+	u64 cycle = firstCycle;
+	u32 c = 0;
+	for ( u32 i = 0; i < n && c < writes; )
+	{
+		u32 v = 0, shift = 0;
+		while ( i < n && ( raw[ i ] & 0x80 ) && shift < 32 )
+		{
+			v |= ( raw[ i++ ] & 0x7f ) << shift;
+			shift += 7;
+		}
+		if ( i + 3 > n ) break;
+		v |= raw[ i++ ] << shift;
+		u8 t = raw[ i++ ];
+		if ( t >= CAPTURE_TARGETS ) break;
+		cycle += v;
+		shadow[ t ] ^= raw[ i++ ];
+		w[ c ].cycle = cycle;
+		w[ c ].target = t;
+		w[ c ].data = shadow[ t ];
+		c ++;
+	}
+	return c;
+}
+
+// state of the current block (filled by captureWrite), exposed for inlining
+extern u8 *captureBlockPtr;
+extern u64 captureLastCycle;
+extern u8 captureShadow[ CAPTURE_TARGETS ];
+extern u32 captureBlockWrites;
+
+extern void captureEndBlock( u64 cycle );
+
+// starts a capture file (mounts SD, which stays mounted), c64Clock is only stored in the header
+extern boolean captureStart( CLogger *logger, u32 c64Clock, const u32 *sidModel, u32 flags );
+// compresses a completed block and writes it to SD in chunks of 512 bytes (one chunk per call), f_sync only after 2s without
+// register writes, completes blocks which are older than ~1s, call in every iteration of the main loop
+extern void captureUpdate( CLogger *logger, u64 cycle );
+// writes all blocks and closes the file, a new one is started with the next write
+extern void captureReset( CLogger *logger );
+
+static __attribute__( ( always_inline ) ) inline void captureWrite( u64 cycle, u32 target, u8 data )
+{
+	// cycle deltas fit into 5 bytes
+	if ( captureBlockPtr == 0 || cycle - captureLastCycle > 0xffffffffULL )
+		captureEndBlock( cycle );
+
+	u8 *p = traceEncodeRecord( captureBlockPtr, (u32)( cycle - captureLastCycle ) );
+	*p++ = (u8)target;
+	*p++ = data ^ captureShadow[ target ];
+	captureShadow[ target ] = data;
+	captureBlockPtr = p;
+	captureLastCycle = cycle;
+
+	if ( ++ captureBlockWrites == CAPTURE_BLOCK_WRITES )
+		captureEndBlock( cycle );
+}
+
+#ifdef CAPTURE_SID_WRITES
+#define SID_CAPTURE( cycle, chip, reg, data )	captureWrite( cycle, CAPTURE_TARGET( chip, reg ), data );
+#define SID_CAPTURE_START( logger, clock, models, flags )	captureStart( logger, clock, models, flags );
+#define SID_CAPTURE_UPDATE( logger, cycle )	captureUpdate( logger, cycle );
+#define SID_CAPTURE_RESET( logger )			captureReset( logger );
+#else
+#define SID_CAPTURE( cycle, chip, reg, data )
+#define SID_CAPTURE_START( logger, clock, models, flags )
+#define SID_CAPTURE_UPDATE( logger, cycle )
+#define SID_CAPTURE_RESET( logger )
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+//
+// sidchip.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _sidchip_h
+#define _sidchip_h
+
+#include <circle/types.h>
+#include "resid/sid.h"
+
+//
+// the interface of a SID emulation as used by the sound engine (sidengine.h), with the functions of reSID::SID: every 
+// chip of the engine can be emulated by reSID (cycle exact) or by CLiteSID (litesid.h: sample-rate oscillators, 
+// table-driven envelopes and filter, a fraction of the cost), selected at runtime per chip (engineSetChip)
+//
+class CSIDChip
+{
+public:
+	virtual ~CSIDChip() {}
+
+	virtual void set_chip_model( reSID::chip_model model ) = 0;
+	virtual void set_voice_mask( reSID::reg4 mask ) = 0;
+	virtual void input( short sample ) = 0;
+	// the engine reads output() once per sample (at sampleFreq)
+	virtual void set_sampling_parameters( double clockFreq, double sampleFreq ) = 0;
+	virtual void reset() = 0;
+
+	virtual reSID::reg8 read( reSID::reg8 offset ) = 0;
+	virtual void write( reSID::reg8 offset, reSID::reg8 value ) = 0;
+	virtual void clock( reSID::cycle_count delta_t ) = 0;
+	virtual short output() = 0;
+
+	// the complete state, continues sample exact (for the same build, model and sampling parameters)
+	virtual int raw_state_size() = 0;
+	virtual void read_raw_state( void *buf ) = 0;
+	virtual void write_raw_state( const void *buf ) = 0;
+};
+
+// reSID behind the interface, sampling as the engine always did (clock( delta_t ) and output() once per sample)
+class CReSIDChip : public CSIDChip
+{
+public:
+	void set_chip_model( reSID::chip_model model ) { sid.set_chip_model( model ); }
+	void set_voice_mask( reSID::reg4 mask ) { sid.set_voice_mask( mask ); }
+	void input( short sample ) { sid.input( sample ); }
+	void set_sampling_parameters( double clockFreq, double sampleFreq ) { sid.set_sampling_parameters( clockFreq, reSID::SAMPLE_INTERPOLATE, sampleFreq ); }
+	void reset() { sid.reset(); }
+
+	reSID::reg8 read( reSID::reg8 offset ) { return sid.read( offset ); }
+	void write( reSID::reg8 offset, reSID::reg8 value ) { sid.write( offset, value ); }
+	void clock( reSID::cycle_count delta_t ) { sid.clock( delta_t ); }
+	short output() { return sid.output(); }
+
+	int raw_state_size() { return sid.raw_state_size(); }
+	void read_raw_state( void *buf ) { sid.read_raw_state( buf ); }
+	void write_raw_state( const void *buf ) { sid.write_raw_state( buf ); }
+
+	reSID::SID	sid;
+};
+
+#endif
@@ -0,0 +1,228 @@
+//
+// sidengine.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/util.h>
+#include "sidengine.h"
+#include "litesid.h"
+
+using namespace reSID;
+
+// a new chip of the given type, configured as SID i of the engine
+static CSIDChip *createChip( SID_ENGINE *e, u32 i, u32 type )
+{
+	CSIDChip *sid = type == ENGINE_CHIP_LITE ? (CSIDChip *)new CLiteSID : (CSIDChip *)new CReSIDChip;
+
+	for ( int j = 0; j < 24; j++ )
+		sid->write( j, 0 );
+
+	if ( e->sidModel[ i ] == 6581 )
+	{
+		sid->set_chip_model( MOS6581 );
+	} else
+	{
+		sid->set_chip_model( MOS8580 );
+		if ( e->digiBoost[ i ] == 0 )
+		{
+			sid->set_voice_mask( 0x07 );
+			sid->input( 0 );
+		} else
+		{
+			sid->set_voice_mask( 0x0f );
+			sid->input( -32768 );
+		}
+	}
+	return sid;
+}
+
+void engineInit( SID_ENGINE *e, u32 flags, const u32 *sidModel, const u32 *digiBoost, u32 sampleRate )
+{
+	memset( e->sidRegs, 0, sizeof( e->sidRegs ) );
+	for ( int i = 0; i < ENGINE_NUM_SIDS; i++ )
+	{
+		e->chipType[ i ] = ENGINE_CHIP_RESID;
+		e->sidModel[ i ] = sidModel[ i ];
+		e->digiBoost[ i ] = digiBoost[ i ];
+		e->sid[ i ] = createChip( e, i, ENGINE_CHIP_RESID );
+	}
+
+	e->opl = 0;
+	if ( flags & ENGINE_FLAG_OPL )
+	{
+		e->opl = ym3812_init( ENGINE_OPL_CLOCK, sampleRate );
+		ym3812_reset_chip( e->opl );
+	}
+
+	e->sampleRate = sampleRate;
+	engineSetClock( e, 985248 );
+
+	e->quality = ENGINE_QUALITY_EXACT;
+	e->exactStep = e->cyclesPerStep = ( flags & ENGINE_FLAG_PWM ) ? 8 : 2;
+	e->oplHalfRate = FALSE;
+	e->oplLast = 0;
+}
+
+void engineFree( SID_ENGINE *e )
+{
+	for ( int i = 0; i < ENGINE_NUM_SIDS; i++ )
+		delete e->sid[ i ];
+	if ( e->opl )
+		ym3812_shutdown( e->opl );
+}
+
+void engineSetClock( SID_ENGINE *e, u32 clockFreq )
+{
+	e->clockFreq = clockFreq;
+	for ( int i = 0; i < ENGINE_NUM_SIDS; i++ )
+		e->sid[ i ]->set_sampling_parameters( clockFreq, e->sampleRate );
+	e->nCyclesEmulated = 0;
+	e->samplesElapsed = 0;
+}
+
+void engineReset( SID_ENGINE *e )
+{
+	for ( int i = 0; i < ENGINE_NUM_SIDS; i++ )
+		for ( int j = 0; j < 24; j++ )
+		{
+			e->sid[ i ]->write( j, 0 );
+			e->sidRegs[ i ][ j ] = 0;
+		}
+
+	if ( e->opl )
+		ym3812_reset_chip( e->opl );
+}
+
+void engineSetChip( SID_ENGINE *e, u32 i, u32 type )
+{
+	if ( i >= ENGINE_NUM_SIDS || type >= ENGINE_CHIP_TYPES || type == e->chipType[ i ] )
+		return;
+
+	delete e->sid[ i ];
+	e->sid[ i ] = createChip( e, i, type );
+	e->sid[ i ]->set_sampling_parameters( e->clockFreq, e->sampleRate );
+	e->chipType[ i ] = type;
+
+	// the oscillators and envelopes start over, the sound continues with the next notes
+	for ( int j = 0; j < 25; j++ )
+		e->sid[ i ]->write( j, e->sidRegs[ i ][ j ] );
+}
+
+const char *engineChipName( u32 type )
+{
+	static const char *names[ ENGINE_CHIP_TYPES ] = { "reSID", "lite" };
+	return type < ENGINE_CHIP_TYPES ? names[ type ] : "?";
+}
+
+void engineSetQuality( SID_ENGINE *e, u32 quality )
+{
+	if ( quality >= ENGINE_QUALITY_LEVELS )
+		quality = ENGINE_QUALITY_LEVELS - 1;
+
+	e->quality = quality;
+
+	e->cyclesPerStep = e->exactStep;
+	if ( quality >= ENGINE_QUALITY_STEP4 && e->cyclesPerStep < 4 )
+		e->cyclesPerStep = 4;
+	if ( quality >= ENGINE_QUALITY_STEP8 )
+		e->cyclesPerStep = 8;
+
+	boolean oplHalfRate = e->opl && quality >= ENGINE_QUALITY_OPL_HALF;
+	if ( oplHalfRate != e->oplHalfRate )
+	{
+		ym3812_set_rate( e->opl, oplHalfRate ? e->sampleRate / 2 : e->sampleRate );
+		e->oplHalfRate = oplHalfRate;
+	}
+}
+
+const char *engineQualityName( u32 quality )
+{
+	static const char *names[ ENGINE_QUALITY_LEVELS ] = { "exact", "4-cycle steps", "8-cycle steps", "half-rate OPL" };
+	return quality < ENGINE_QUALITY_LEVELS ? names[ quality ] : "?";
+}
+
+// the state of every chip starts 16-byte aligned (reSID copies the SID object)
+#define STATE_ALIGN( n )	( ( (n) + 15 ) & ~15 )
+
+typedef struct
+{
+	u64			nCyclesEmulated;
+	u64			samplesElapsed;
+	u32			quality;
+	s16			oplLast;
+	u32			chipType[ ENGINE_NUM_SIDS ];
+	u8			sidRegs[ ENGINE_NUM_SIDS ][ 32 ];
+} ENGINE_STATE;
+
+u32 engineStateSize( SID_ENGINE *e )
+{
+	u32 size = STATE_ALIGN( sizeof( ENGINE_STATE ) );
+	for ( int i = 0; i < ENGINE_NUM_SIDS; i++ )
+		size += STATE_ALIGN( e->sid[ i ]->raw_state_size() );
+	if ( e->opl )
+		size += STATE_ALIGN( ym3812_state_size() );
+	return size;
+}
+
+void engineSaveState( SID_ENGINE *e, void *state )
+{
+	ENGINE_STATE *s = (ENGINE_STATE *)state;
+	u8 *p = (u8 *)state + STATE_ALIGN( sizeof( ENGINE_STATE ) );
+
+	// also clears the padding, i.e. states can be compared with memcmp
+	memset( state, 0, engineStateSize( e ) );
+	s->nCyclesEmulated = e->nCyclesEmulated;
+	s->samplesElapsed = e->samplesElapsed;
+	s->quality = e->quality;
+	s->oplLast = e->oplLast;
+	memcpy( s->chipType, e->chipType, sizeof( s->chipType ) );
+	memcpy( s->sidRegs, e->sidRegs, sizeof( s->sidRegs ) );
+
+	for ( int i = 0; i < ENGINE_NUM_SIDS; i++ )
+	{
+		e->sid[ i ]->read_raw_state( p );
+		p += STATE_ALIGN( e->sid[ i ]->raw_state_size() );
+	}
+	if ( e->opl )
+		ym3812_save_state( e->opl, p );
+}
+
+void engineLoadState( SID_ENGINE *e, const void *state )
+{
+	const ENGINE_STATE *s = (const ENGINE_STATE *)state;
+	const u8 *p = (const u8 *)state + STATE_ALIGN( sizeof( ENGINE_STATE ) );
+
+	e->nCyclesEmulated = s->nCyclesEmulated;
+	e->samplesElapsed = s->samplesElapsed;
+
+	// before loading the chips, which are then in the state of this quality
+	engineSetQuality( e, s->quality );
+	e->oplLast = s->oplLast;
+
+	// the chips as they were saved, the size of their states depends on it
+	for ( int i = 0; i < ENGINE_NUM_SIDS; i++ )
+		engineSetChip( e, i, s->chipType[ i ] );
+	memcpy( e->sidRegs, s->sidRegs, sizeof( e->sidRegs ) );
+
+	for ( int i = 0; i < ENGINE_NUM_SIDS; i++ )
+	{
+		e->sid[ i ]->write_raw_state( p );
+		p += STATE_ALIGN( e->sid[ i ]->raw_state_size() );
+	}
+	if ( e->opl )
+		ym3812_load_state( e->opl, p );
+}
@@ -0,0 +1,227 @@
+//
+// sidengine.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _sidengine_h
+#define _sidengine_h
+
+#include <circle/types.h>
+#include "lowlevel_arm.h"
+#include "resid/sid.h"
+#include "sidchip.h"
+#include "fmopl.h"
+#include "sidcapture.h"
+
+//
+// the sound emulation of kernel=sid: 2 reSIDs, the OPL2 and the mixer, producing one sample at a time while applying 
+// the register writes when the emulation reaches their C64 cycle. The kernel's main loop and the offline renderer 
+// (host/sidrender) use the same code, i.e. a capture of the register writes (see sidcapture.h) renders to the same samples.
+//
+// the configuration (the defines in kernel_sid.h) is a template parameter, there are no runtime checks in the kernel
+//
+#define ENGINE_FLAG_SID2		1		// the second SID is emulated (at $D420 or, with ENGINE_FLAG_SID2_SAME, as a copy of the first)
+#define ENGINE_FLAG_SID2_SAME	2
+#define ENGINE_FLAG_OPL			4
+#define ENGINE_FLAG_MONO		8		// MIXER_MONO, otherwise MIXER_SID_STEREO
+#define ENGINE_FLAG_PWM			16		// USE_PWM_DIRECT: 8 instead of 2 cycles per emulation step
+#define ENGINE_CONFIGS			32
+
+// code regions for PMU profiling (make kernel=sid PMU_PROFILING=1, see lowlevel_arm.h)
+enum { PMU_RESID_CLOCK = 0, PMU_OPL_UPDATE };
+
+#define ENGINE_NUM_SIDS			2
+#define ENGINE_OPL_CLOCK		3579545
+
+// how a SID is emulated (engineSetChip)
+#define ENGINE_CHIP_RESID		0		// reSID, cycle exact
+#define ENGINE_CHIP_LITE		1		// CLiteSID (litesid.h), sample-rate stepping and table-driven
+#define ENGINE_CHIP_TYPES		2
+
+// emulation quality, every level includes the reductions of the previous ones (see engineSetQuality and governor.h)
+#define ENGINE_QUALITY_EXACT	0		// as configured: 2 cycles per emulation step (8 with ENGINE_FLAG_PWM)
+#define ENGINE_QUALITY_STEP4	1		// at least 4 cycles per step: coarser timing of samples and register writes
+#define ENGINE_QUALITY_STEP8	2		// 8 cycles per step (as with ENGINE_FLAG_PWM)
+#define ENGINE_QUALITY_OPL_HALF	3		// the OPL at half the sample rate (every other sample is repeated)
+#define ENGINE_QUALITY_LEVELS	4
+
+typedef struct
+{
+	CSIDChip	*sid[ ENGINE_NUM_SIDS ];
+	FM_OPL		*opl;
+
+	// ENGINE_CHIP_xxx, the configuration of the chips, and their registers (to switch the emulation at runtime)
+	u32			chipType[ ENGINE_NUM_SIDS ];
+	u32			sidModel[ ENGINE_NUM_SIDS ], digiBoost[ ENGINE_NUM_SIDS ];
+	u8			sidRegs[ ENGINE_NUM_SIDS ][ 32 ];
+
+	u32			clockFreq;				// of the C64
+	u32			sampleRate;
+
+	u64			nCyclesEmulated;
+	u64			samplesElapsed;
+
+	// set by engineSetQuality
+	u32			quality;
+	u32			exactStep, cyclesPerStep;	// cycles per emulation step as configured and at the current quality
+	boolean		oplHalfRate;
+	s16			oplLast;
+} SID_ENGINE;
+
+typedef struct
+{
+	s16			sid1, sid2, opl;		// outputs of the chips (0 if not emulated)
+	s32			left, right;			// mixer output
+} SID_ENGINE_SAMPLE;
+
+// creates the chips (reSID, the OPL only with ENGINE_FLAG_OPL), all registers are 0
+extern void engineInit( SID_ENGINE *e, u32 flags, const u32 *sidModel, const u32 *digiBoost, u32 sampleRate );
+extern void engineFree( SID_ENGINE *e );
+// sets the C64 clock and restarts counting cycles and samples
+extern void engineSetClock( SID_ENGINE *e, u32 clockFreq );
+// a reset of the C64: all registers to 0, the OPL is reset
+extern void engineReset( SID_ENGINE *e );
+// ENGINE_QUALITY_xxx, can be changed at any time (the chips keep their state)
+extern void engineSetQuality( SID_ENGINE *e, u32 quality );
+extern const char *engineQualityName( u32 quality );
+// switches SID i to another emulation (ENGINE_CHIP_xxx) at any time: the new chip gets the current registers
+extern void engineSetChip( SID_ENGINE *e, u32 i, u32 type );
+extern const char *engineChipName( u32 type );
+
+// checkpoints: the complete state of the emulation (the chips including filters and resampling, and the counters of 
+// cycles and samples -- the mixer has no state). Rendering continues with exactly the same samples after engineLoadState, 
+// provided that the engine has been created with the same configuration (engineInit, engineSetClock) by the same build.
+// The state contains the emulation of each chip (engineSetChip), engineStateSize depends on it
+extern u32 engineStateSize( SID_ENGINE *e );
+extern void engineSaveState( SID_ENGINE *e, void *state );
+extern void engineLoadState( SID_ENGINE *e, const void *state );
+
+// does the write go to the first SID (which provides the registers the C64 reads back)?
+template <u32 FLAGS>
+static __attribute__( ( always_inline ) ) inline boolean engineWritesSID1( u32 chip )
+{
+	if ( ( FLAGS & ENGINE_FLAG_OPL ) && chip == CAPTURE_OPL )
+		return FALSE;
+	if ( ( FLAGS & ENGINE_FLAG_SID2 ) && !( FLAGS & ENGINE_FLAG_SID2_SAME ) && chip == CAPTURE_SID2 )
+		return FALSE;
+	return TRUE;
+}
+
+// chip as decoded from the bus (CAPTURE_SID1/SID2/OPL), A = A0-A4
+template <u32 FLAGS>
+static __attribute__( ( always_inline ) ) inline void engineWrite( SID_ENGINE *e, u32 chip, u32 A, u8 D )
+{
+	if ( ( FLAGS & ENGINE_FLAG_OPL ) && chip == CAPTURE_OPL )
+	{
+		ym3812_write( e->opl, ( A & ( 1 << 4 ) ) ? 1 : 0, D );
+	} else
+	if ( engineWritesSID1<FLAGS>( chip ) )
+	{
+		e->sid[ 0 ]->write( A & 31, D );
+		e->sidRegs[ 0 ][ A & 31 ] = D;
+		if ( ( FLAGS & ENGINE_FLAG_SID2 ) && ( FLAGS & ENGINE_FLAG_SID2_SAME ) )
+		{
+			e->sid[ 1 ]->write( A & 31, D );
+			e->sidRegs[ 1 ][ A & 31 ] = D;
+		}
+	} else
+	{
+		e->sid[ 1 ]->write( A & 31, D );
+		e->sidRegs[ 1 ][ A & 31 ] = D;
+	}
+}
+
+// the mixer: left and right from the outputs of the chips
+template <u32 FLAGS>
+static __attribute__( ( always_inline ) ) inline void engineMix( SID_ENGINE_SAMPLE *s )
+{
+	if ( FLAGS & ENGINE_FLAG_MONO )
+	{
+		s->left = s->right = ( (s32)s->sid1 + (s32)s->sid2 + (s32)s->opl ) / 3;
+	} else
+	if ( FLAGS & ENGINE_FLAG_OPL )
+	{
+		s->left  = ( (s32)s->sid1 + (s32)s->opl / 2 ) * 2 / 3;
+		s->right = ( (s32)s->sid2 + (s32)s->opl / 2 ) * 2 / 3;
+	} else
+	{
+		s->left  = (s32)s->sid1;
+		s->right = (s32)s->sid2;
+	}
+}
+
+//
+// emulates until the next sample is due and mixes it, SOURCE provides the register writes and gets notified:
+//
+//	boolean next( u64 nCyclesEmulated, u32 &chip, u32 &A, u8 &D )	the next write if it is due (at most one per step)
+//	void clocked( SID_ENGINE *e )									after every emulation step
+//	void sampled( SID_ENGINE *e )									after the OPL produced a sample
+//
+template <u32 FLAGS, class SOURCE>
+static __attribute__( ( always_inline ) ) inline void engineRenderSample( SID_ENGINE *e, SOURCE &src, SID_ENGINE_SAMPLE *s )
+{
+	const u32 cyclesToEmulate = e->cyclesPerStep;
+	u64 samplesElapsedBefore = e->samplesElapsed;
+
+	do { // do SID emulation until time passed to create an additional sample (i.e. there may be several cycles until a sample value is created)
+		{
+			PMU_SCOPE( PMU_RESID_CLOCK, "reSID clock" )
+			e->sid[ 0 ]->clock( cyclesToEmulate );
+			if ( FLAGS & ENGINE_FLAG_SID2 )
+				e->sid[ 1 ]->clock( cyclesToEmulate );
+		}
+
+		src.clocked( e );
+
+		e->nCyclesEmulated += cyclesToEmulate;
+
+		// apply register updates (we do one-cycle emulation steps, but in case we need to catch up...)
+		u32 chip, A;
+		u8 D;
+		if ( src.next( e->nCyclesEmulated, chip, A, D ) )
+			engineWrite<FLAGS>( e, chip, A, D );
+
+		e->samplesElapsed = ( e->nCyclesEmulated * (u64)e->sampleRate ) / (u64)e->clockFreq;
+
+	} while ( e->samplesElapsed == samplesElapsedBefore );
+
+	s->sid1 = e->sid[ 0 ]->output();
+	s->sid2 = 0;
+	s->opl = 0;
+
+	if ( FLAGS & ENGINE_FLAG_SID2 )
+		s->sid2 = e->sid[ 1 ]->output();
+
+	if ( FLAGS & ENGINE_FLAG_OPL )
+	{
+		if ( e->oplHalfRate && ( e->samplesElapsed & 1 ) )
+		{
+			s->opl = e->oplLast;
+		} else
+		{
+			PMU_SCOPE( PMU_OPL_UPDATE, "OPL2 update" )
+			ym3812_update_one( e->opl, &s->opl, 1 );
+			e->oplLast = s->opl;
+		}
+	}
+
+	src.sampled( e );
+
+	engineMix<FLAGS>( s );
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,119 @@
+//
+// sidpipe.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _sidpipe_h
+#define _sidpipe_h
+
+#include <circle/types.h>
+#include <circle/synchronize.h>
+#include "resid/sid.h"
+
+//
+// reSID with audio resampling (SAMPLE_RESAMPLE) in two pipeline stages, e.g. on two cores: the producer clocks the SID
+// and stores the output of every cycle in blocks (SID::clock_raw), the consumer resamples complete blocks (SID::decimate,
+// which is dominated by the convolution). The blocks are passed through a lock-free single-producer/single-consumer queue;
+// both counters are free running and each is only written by one side. The output is the same as of SID::clock( delta_t, 
+// buf, n ), delayed by up to one block when the producer flushes only full blocks.
+//
+#define SIDPIPE_BLOCK_CYCLES	1024
+#define SIDPIPE_BLOCKS			16		// power of 2
+
+// samples written by sidPipeDecimate (for sample rates up to 1/16 of the C64 clock)
+#define SIDPIPE_MAX_SAMPLES		( SIDPIPE_BLOCK_CYCLES / 16 + 1 )
+
+#define SIDPIPE_CACHE_LINE		64
+
+typedef struct
+{
+	s16		raw[ SIDPIPE_BLOCK_CYCLES ];
+	u32		n;
+} __attribute__( ( aligned( SIDPIPE_CACHE_LINE ) ) ) SIDPIPE_BLOCK;
+
+typedef struct
+{
+	reSID::SID		*sid;
+	SIDPIPE_BLOCK	block[ SIDPIPE_BLOCKS ];
+
+	// blocks handed over by the producer (which also owns 'fill' of the current block) and taken by the consumer
+	volatile u32	produced __attribute__( ( aligned( SIDPIPE_CACHE_LINE ) ) );
+	u32				fill;
+	volatile u32	consumed __attribute__( ( aligned( SIDPIPE_CACHE_LINE ) ) );
+} SID_PIPE;
+
+// the SID must use SAMPLE_RESAMPLE or SAMPLE_RESAMPLE_FASTMEM, it is only clocked through the pipe afterwards
+static inline void sidPipeInit( SID_PIPE *p, reSID::SID *sid )
+{
+	p->sid = sid;
+	p->produced = p->consumed = 0;
+	p->fill = 0;
+}
+
+// producer: hands the current block over (also if it is not full), FALSE if the queue is full
+static inline boolean sidPipeFlush( SID_PIPE *p )
+{
+	if ( p->fill == 0 )
+		return TRUE;
+	if ( p->produced - p->consumed == SIDPIPE_BLOCKS )
+		return FALSE;
+
+	p->block[ p->produced & ( SIDPIPE_BLOCKS - 1 ) ].n = p->fill;
+	// the outputs must be visible before the block is
+	DataMemBarrier();
+	p->produced ++;
+	p->fill = 0;
+	return TRUE;
+}
+
+// producer: clocks the SID for up to delta_t cycles (less if the queue is full), full blocks are handed over
+static inline void sidPipeClock( SID_PIPE *p, reSID::cycle_count &delta_t )
+{
+	while ( delta_t > 0 )
+	{
+		if ( p->fill == SIDPIPE_BLOCK_CYCLES && !sidPipeFlush( p ) )
+			return;
+
+		// the slot of the block being filled is free: produced - consumed < SIDPIPE_BLOCKS
+		if ( p->fill == 0 && p->produced - p->consumed == SIDPIPE_BLOCKS )
+			return;
+
+		SIDPIPE_BLOCK *b = &p->block[ p->produced & ( SIDPIPE_BLOCKS - 1 ) ];
+		p->fill += p->sid->clock_raw( delta_t, &b->raw[ p->fill ], SIDPIPE_BLOCK_CYCLES - p->fill );
+	}
+
+	if ( p->fill == SIDPIPE_BLOCK_CYCLES )
+		sidPipeFlush( p );
+}
+
+// consumer: resamples the next block into buf (at most SIDPIPE_MAX_SAMPLES), FALSE if there is none
+static inline boolean sidPipeDecimate( SID_PIPE *p, s16 *buf, u32 *nSamples, int interleave = 1 )
+{
+	if ( p->consumed == p->produced )
+		return FALSE;
+	DataMemBarrier();
+
+	SIDPIPE_BLOCK *b = &p->block[ p->consumed & ( SIDPIPE_BLOCKS - 1 ) ];
+	*nSamples = p->sid->decimate( b->raw, b->n, buf, interleave );
+
+	// done reading the block before it is handed back
+	DataMemBarrier();
+	p->consumed ++;
+	return TRUE;
+}
+
+#endif
@@ -0,0 +1,82 @@
+//
+// slotwork.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _slotwork_h
+#define _slotwork_h
+
+#include <circle/types.h>
+#include "bus.h"
+
+//
+// slot work: the FIQ handlers spend hundreds of cycles per bus cycle waiting for deadlines (e.g. until the bus is released),
+// WAIT_UP_TO_CYCLE_WORK uses these waits to run small work items
+//
+// a work item is a class with a static function run(), which does one step and returns FALSE if there's nothing to do, and 
+// MAX_CYCLES, the guaranteed upper bound for one step (including reading the cycle counter once). Work items must never 
+// block and must not touch the GPIOs: D0-D7 may be driven or sampled while they run. 
+//
+
+// no slot work: WAIT_UP_TO_CYCLE_WORK behaves like WAIT_UP_TO_CYCLE
+struct SlotWorkNone
+{
+	enum { MAX_CYCLES = 0 };
+
+	// called at the beginning of the FIQ handler: preload the state of the work item (MAX_CYCLES assumes hot caches)
+	static void prepare() {}
+
+	static boolean run() { return FALSE; }
+};
+
+// preloads a memory range into the caches, one cache line per step (e.g. a ROM bank which has just been selected)
+// the range can be set by the FIQ handler and the main loop (a torn update only results in preloading the wrong lines)
+typedef struct
+{
+	const u8 *cur, *end;
+} SLOT_PREFETCH;
+
+extern SLOT_PREFETCH slotPrefetchRange;
+
+static __attribute__( ( always_inline ) ) inline void slotPrefetch( const void *ptr, u32 bytes )
+{
+	slotPrefetchRange.cur = (const u8 *)( (uintptr)ptr & ~63 );
+	slotPrefetchRange.end = (const u8 *)ptr + bytes;
+}
+
+struct SlotWorkPrefetch
+{
+	enum { MAX_CYCLES = 24 };
+
+	static __attribute__( ( always_inline ) ) inline void prepare() 
+	{ 
+		CACHE_PRELOADW( &slotPrefetchRange ); 
+	}
+
+	static __attribute__( ( always_inline ) ) inline boolean run()
+	{
+		const u8 *p = slotPrefetchRange.cur;
+		if ( p >= slotPrefetchRange.end )
+			return FALSE;
+
+		CACHE_PRELOAD( p );
+		slotPrefetchRange.cur = p + 64;
+		return TRUE;
+	}
+};
+
+#endif
@@ -0,0 +1,221 @@
+//
+// timings.cpp part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "timings.h"
+#include "bus.h"
+
+BUS_TIMINGS busTimings;
+BUS_TIMINGS_NS busTimingsNS;
+
+u32 latchPulseCycles = 60;
+u32 busClockChanges = 0;
+
+// measured ARM clock (nominal clock of a RPi 3B until initBusClock), and the time of the last measurement
+static u32 busArmClock = 1200000000;
+static u32 lastTicks = 0;
+
+// ARM clock (in Hz, with a resolution of 100kHz) from the cycles counted during 'us' microseconds
+static u32 clockFromSample( u32 cycles, u32 us )
+{
+	return ( cycles / us ) * 1000000 + ( ( cycles % us ) * 10 / us ) * 100000;
+}
+
+// counts ARM cycles while busy waiting for 'us' microseconds: the cycle counter stops while the core sleeps in WFI,
+// hence an interval of the main loop (which waits for interrupts) must never be used
+static u32 measureBusClock( CTimer *timer, u32 us )
+{
+	u32 t0 = timer->GetClockTicks();
+	u32 c0 = BUS::readCycleCounter();
+	u32 t, c;
+
+	do {
+		t = timer->GetClockTicks();
+		c = BUS::readCycleCounter();
+	} while ( t - t0 < us );
+
+	return clockFromSample( c - c0, t - t0 );
+}
+
+// ns after PHI2 rising to ARM cycles after the FIQ started, and back
+static u32 ns2cycles( u32 ns, u32 clock )
+{
+	if ( ns < BUS_FIQ_LATENCY_NS )
+		return 0;
+	return ( ( ns - BUS_FIQ_LATENCY_NS ) * ( clock / 100000 ) + 5000 ) / 10000;
+}
+
+static u32 cycles2ns( u32 cycles, u32 clock )
+{
+	u32 c = clock / 100000;
+	return ( cycles * 10000 + c / 2 ) / c + BUS_FIQ_LATENCY_NS;
+}
+
+// the FIQ handlers may see a mix of old and new values during one bus cycle (the update is not atomic), but after
+// a change of the clock the old values are wrong anyway
+static void deriveBusTimings()
+{
+	busTimings.armClock = busArmClock;
+	busTimings.addrSample = ns2cycles( busTimingsNS.addrSample, busArmClock );
+	busTimings.muxSample = ns2cycles( busTimingsNS.muxSample, busArmClock );
+	busTimings.readRelease = ns2cycles( busTimingsNS.readRelease, busArmClock );
+	busTimings.writeSample = ns2cycles( busTimingsNS.writeSample, busArmClock );
+	latchPulseCycles = BUS_NS2CYCLES( LATCH_PULSE_NS );
+}
+
+void initBusClock( CTimer *timer )
+{
+	busArmClock = measureBusClock( timer, 10000 );
+	lastTicks = timer->GetClockTicks();
+
+	deriveBusTimings();
+}
+
+boolean updateBusClock( CTimer *timer )
+{
+	u32 t = timer->GetClockTicks();
+	if ( t - lastTicks < BUS_CLOCK_INTERVAL )
+		return FALSE;
+
+	u32 clock = measureBusClock( timer, BUS_CLOCK_WINDOW );
+	lastTicks = timer->GetClockTicks();
+
+	u32 tolerance = busArmClock / BUS_CLOCK_TOLERANCE;
+
+	if ( clock + tolerance >= busArmClock && clock <= busArmClock + tolerance )
+		return FALSE;
+
+	busArmClock = clock;
+	deriveBusTimings();
+	busClockChanges ++;
+
+	return TRUE;
+}
+
+static u32 checksumBusTimings( BUS_TIMINGS *t )
+{
+	u32 *p = (u32*)t;
+	u32 sum = 0x1541;
+	for ( u32 i = 0; i < sizeof( BUS_TIMINGS ) / 4 - 1; i++ )
+		sum = ( ( sum << 5 ) | ( sum >> 27 ) ) ^ p[ i ];
+	return sum;
+}
+
+// sets the (kernel specific) default timings in ns, the profile only overrides these if it exists and is valid
+void setBusTimings( u32 addrSampleNS, u32 muxSampleNS, u32 readReleaseNS, u32 writeSampleNS )
+{
+	memset( &busTimings, 0, sizeof( BUS_TIMINGS ) );
+	busTimings.magic = BUS_TIMINGS_MAGIC;
+	busTimings.version = BUS_TIMINGS_VERSION;
+	busTimingsNS.addrSample = addrSampleNS;
+	busTimingsNS.muxSample = muxSampleNS;
+	busTimingsNS.readRelease = readReleaseNS;
+	busTimingsNS.writeSample = writeSampleNS;
+	deriveBusTimings();
+}
+
+boolean loadBusTimings( CLogger *logger, const char *DRIVE, const char *FILENAME )
+{
+	FATFS m_FileSystem;
+
+	if ( f_mount( &m_FileSystem, DRIVE, 1 ) != FR_OK )
+	{
+		logger->Write( "RaspiTimings", LogWarning, "Cannot mount drive: %s", DRIVE );
+		return FALSE;
+	}
+
+	BUS_TIMINGS t;
+	boolean valid = FALSE;
+
+	FIL file;
+	if ( f_open( &file, FILENAME, FA_READ | FA_OPEN_EXISTING ) == FR_OK )
+	{
+		u32 nBytesRead;
+		if ( f_read( &file, &t, sizeof( BUS_TIMINGS ), &nBytesRead ) == FR_OK && nBytesRead == sizeof( BUS_TIMINGS ) )
+		{
+			if ( t.magic == BUS_TIMINGS_MAGIC && t.version == BUS_TIMINGS_VERSION && t.checksum == checksumBusTimings( &t ) )
+				valid = TRUE;
+		}
+		f_close( &file );
+
+		if ( !valid )
+			logger->Write( "RaspiTimings", LogWarning, "ignoring invalid timing profile %s", FILENAME );
+	}
+
+	if ( f_mount( 0, DRIVE, 0 ) != FR_OK )
+		logger->Write( "RaspiTimings", LogWarning, "Cannot unmount drive: %s", DRIVE );
+
+	if ( !valid )
+	{
+		logger->Write( "RaspiTimings", LogNotice, "using default timings" );
+		return FALSE;
+	}
+
+	// the profile stores cycles at the clock of the calibration, convert them to ns and derive them for the current clock
+	u32 clock = t.armClock >= 100000 ? t.armClock : busArmClock;
+	busTimingsNS.addrSample = cycles2ns( t.addrSample, clock );
+	busTimingsNS.muxSample = cycles2ns( t.muxSample, clock );
+	busTimingsNS.readRelease = cycles2ns( t.readRelease, clock );
+	busTimingsNS.writeSample = cycles2ns( t.writeSample, clock );
+	busTimings.phi2High = t.phi2High;
+	busTimings.phi2Cycle = t.phi2Cycle;
+	deriveBusTimings();
+
+	logger->Write( "RaspiTimings", LogNotice, "timing profile (measured at %u MHz): addr=%u mux=%u release=%u write=%u",
+		t.armClock / 1000000, t.addrSample, t.muxSample, t.readRelease, t.writeSample );
+	logger->Write( "RaspiTimings", LogNotice, "at %u MHz: addr=%u mux=%u release=%u write=%u",
+		busTimings.armClock / 1000000, busTimings.addrSample, busTimings.muxSample, busTimings.readRelease, busTimings.writeSample );
+
+	return TRUE;
+}
+
+boolean saveBusTimings( CLogger *logger, const char *DRIVE, const char *FILENAME, BUS_TIMINGS *t )
+{
+	FATFS m_FileSystem;
+
+	t->magic = BUS_TIMINGS_MAGIC;
+	t->version = BUS_TIMINGS_VERSION;
+	t->checksum = checksumBusTimings( t );
+
+	if ( f_mount( &m_FileSystem, DRIVE, 1 ) != FR_OK )
+	{
+		logger->Write( "RaspiTimings", LogError, "Cannot mount drive: %s", DRIVE );
+		return FALSE;
+	}
+
+	boolean ok = FALSE;
+
+	FIL file;
+	if ( f_open( &file, FILENAME, FA_WRITE | FA_CREATE_ALWAYS ) == FR_OK )
+	{
+		u32 nBytesWritten;
+		if ( f_write( &file, t, sizeof( BUS_TIMINGS ), &nBytesWritten ) == FR_OK && nBytesWritten == sizeof( BUS_TIMINGS ) )
+			ok = TRUE;
+
+		if ( f_close( &file ) != FR_OK )
+			ok = FALSE;
+	}
+
+	if ( !ok )
+		logger->Write( "RaspiTimings", LogError, "Cannot write file: %s", FILENAME );
+
+	if ( f_mount( 0, DRIVE, 0 ) != FR_OK )
+		logger->Write( "RaspiTimings", LogWarning, "Cannot unmount drive: %s", DRIVE );
+
+	return ok;
+}
@@ -0,0 +1,110 @@
+//
+// timings.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _timings_h
+#define _timings_h
+
+#include <circle/types.h>
+#include <circle/util.h>
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <fatfs/ff.h>
+
+// the bus timings used in the FIQ handlers, all values are ARM cycles after the FIQ started (BEGIN_CYCLE_COUNTER)
+// every kernel sets its own defaults, a profile created by the calibration kernel (kernel=calib) overrides them
+//
+// the cycles are derived from the timings in ns (BUS_TIMINGS_NS) for the current ARM clock, which is measured 
+// with the system timer: when the clock changes (e.g. the firmware throttles the ARM because of temperature 
+// or undervoltage) updateBusClock() derives them again
+typedef struct {
+	u32 magic;
+	u32 version;
+
+	// ARM clock (in Hz) when the profile has been measured (busTimings: for which the cycles have been derived)
+	u32 armClock;
+
+	// read A0-A7, IO1, IO2, CS, RW (when there's no multiplexer switching), i.e. waiting for the PLA delay
+	u32 addrSample;
+	// read A8-A12, ROML, ROMH after switching the multiplexers
+	u32 muxSample;
+	// disable the 74LVC245 after we put data onto the bus (read-from-periphery cycles)
+	u32 readRelease;
+	// read D0-D7 in write-to-periphery cycles
+	u32 writeSample;
+
+	// measured length of PHI2 high and a full cycle (only informative)
+	u32 phi2High;
+	u32 phi2Cycle;
+
+	u32 checksum;
+} BUS_TIMINGS;
+
+#define BUS_TIMINGS_MAGIC	0x4d545052	// "RPTM"
+#define BUS_TIMINGS_VERSION	1
+
+// all kernels look for a profile with this name
+static const char BUS_TIMINGS_FILENAME[] = "SD:raspic64.tim";
+
+// the same timings in ns after PHI2 rising (FIQ latency included), independent of the ARM clock
+typedef struct {
+	u32 addrSample;
+	u32 muxSample;
+	u32 readRelease;
+	u32 writeSample;
+} BUS_TIMINGS_NS;
+
+// assumed time from PHI2 rising until the FIQ handler starts (as in the cost model of device.h)
+#define BUS_FIQ_LATENCY_NS	60
+
+// earliest time (in ns after PHI2 rising) at which A0-A7, IO1 and IO2 may be sampled: IO1/IO2 are decoded by the PLA
+// (max. 50ns) and the 74LS139, sampling earlier sees the previous cycle and might drive the bus in a cycle which is not ours
+#define BUS_ADDR_SAMPLE_MIN_NS	90
+
+// length of the pulse on LATCH_CONTROL (see latch.h)
+#define LATCH_PULSE_NS		43
+
+// re-derive the timings if the measured ARM clock deviates by more than 1/64 (~1.5%), measured every ~100ms
+// by busy waiting for 500us (with a resolution of the system timer of 1us this is accurate to ~0.4%)
+#define BUS_CLOCK_TOLERANCE	64
+#define BUS_CLOCK_INTERVAL	100000
+#define BUS_CLOCK_WINDOW	500
+
+// a duration in ns (up to ~300us) converted to ARM cycles at the current clock (contains a division, not for FIQ handlers)
+#define BUS_NS2CYCLES( ns )	( ( (ns) * ( busTimings.armClock / 100000 ) + 5000 ) / 10000 )
+
+extern BUS_TIMINGS busTimings;
+extern BUS_TIMINGS_NS busTimingsNS;
+
+// derived together with busTimings
+extern u32 latchPulseCycles;
+
+// number of times the timings have been derived again because the ARM clock changed
+extern u32 busClockChanges;
+
+// measures the ARM clock (blocks for 10ms), must be called after initCycleCounter() and before setBusTimings()
+extern void initBusClock( CTimer *timer );
+// call in every iteration of a main loop (blocks for BUS_CLOCK_WINDOW every BUS_CLOCK_INTERVAL, reads the system timer
+// otherwise), returns TRUE if the timings have been derived for a new clock
+extern boolean updateBusClock( CTimer *timer );
+
+extern void setBusTimings( u32 addrSampleNS, u32 muxSampleNS, u32 readReleaseNS, u32 writeSampleNS );
+extern boolean loadBusTimings( CLogger *logger, const char *DRIVE, const char *FILENAME );
+extern boolean saveBusTimings( CLogger *logger, const char *DRIVE, const char *FILENAME, BUS_TIMINGS *t );
+
+#endif
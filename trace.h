@@ -0,0 +1,167 @@
+//
+// trace.h part of...
+//
+// RasPIC64 - A framework for interfacing the C64 and a Raspberry Pi 3B/3B+
+// Copyright (c) 2019 Carsten Dachsbacher <frenetic@dachsbacher.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _trace_h
+#define _trace_h
+
+#include <circle/types.h>
+
+//
+// trace files of the bus logic analyzer (kernel=trace), decoded on the host with host/tracedec
+//
+// one sample per C64 cycle (the CPU half, PHI2 high), the control bits are 1 if the line is active:
+#define TRACE_A_MASK		0x1fff					// A0-A12
+#define TRACE_CTRL_SHIFT	13						// CTRL_xxx of dispatch.h (inverted, i.e. 1 = active/write)
+#define TRACE_IO1			( 1 << 13 )
+#define TRACE_IO2			( 1 << 14 )
+#define TRACE_ROML			( 1 << 15 )
+#define TRACE_ROMH			( 1 << 16 )
+#define TRACE_CS			( 1 << 17 )
+#define TRACE_WRITE			( 1 << 18 )
+#define TRACE_RESET			( 1 << 19 )
+#define TRACE_D_SHIFT		20						// D0-D7, write cycles only (in read cycles the Pi cannot see the data bus)
+#define TRACE_SAMPLE_BITS	28
+
+//
+// file layout (little endian, all structures naturally aligned so that the file can be memory-mapped):
+//
+//	TRACE_HEADER
+//	TRACE_BLOCK, compressed records, padding to 8 bytes		(repeated)
+//	TRACE_INDEX[ nBlocks ]									(at indexOffset, only if the trace has been closed)
+//
+// the records of a block are the XOR of each sample with the previous one (the first with 0), as unsigned LEB128 (i.e. an 
+// idle bus needs one zero byte per cycle), then runs of zero bytes are compressed: 0x00 n stands for n+1 zero bytes.
+// Blocks are independent of each other; if the index is missing (the Pi was turned off) the decoder scans the block headers.
+//
+#define TRACE_MAGIC			0x43525452				// "RTRC"
+#define TRACE_VERSION		1
+#define TRACE_BLOCK_MAGIC	0x4b4c4254				// "TBLK"
+
+// maximum cycles per block, and the size of the records of a full block (at most 4 bytes per sample)
+#define TRACE_BLOCK_CYCLES	4096
+#define TRACE_BLOCK_BYTES	( TRACE_BLOCK_CYCLES * 4 )
+
+// worst case of the compressed size (a single zero between non-zero bytes grows from 2 to 3 bytes)
+#define TRACE_COMPRESSED_BYTES( n )	( ( n ) * 3 / 2 + 2 )
+
+typedef struct
+{
+	u32	magic;
+	u32	version;
+	u32	headerSize;				// offset of the first block
+	u32	blockCycles;
+	u32	indexOffset;			// 0 if the trace has not been closed
+	u32	nBlocks;
+	u32	armClock;				// only informative
+	u32	reserved;
+	u64	cycles;					// cycles since the start of the trace, including dropped ones
+	u64	droppedCycles;			// cycles which could not be written to SD in time
+} TRACE_HEADER;
+
+typedef struct
+{
+	u32	magic;
+	u32	size;					// compressed bytes following this header (without padding)
+	u32	rawSize;				// bytes of the records
+	u32	cycles;
+	u64	firstCycle;				// gaps between blocks are dropped cycles
+} TRACE_BLOCK;
+
+typedef struct
+{
+	u64	firstCycle;
+	u32	offset;					// file offset of the TRACE_BLOCK
+	u32	cycles;
+} TRACE_INDEX;
+
+#define TRACE_PADDING( n )	( ( 8 - ( ( n ) & 7 ) ) & 7 )
+
+static inline u8 *traceEncodeRecord( u8 *p, u32 v )
+{
+	while ( v >= 0x80 )
+	{
+		*p++ = (u8)( v | 0x80 );
+		v >>= 7;
+	}
+	*p++ = (u8)v;
+	return p;
+}
+
+static inline u32 traceCompress( const u8 *src, u32 n, u8 *dst )
+{
+	u8 *d = dst;
+	for ( u32 i = 0; i < n; )
+	{
+		if ( src[ i ] )
+		{
+			*d++ = src[ i++ ];
+			continue;
+		}
+		u32 run = 1;
+		while ( run < 256 && i + run < n && src[ i + run ] == 0 )
+			run ++;
+		*d++ = 0;
+		*d++ = (u8)( run - 1 );
+		i += run;
+	}
+	return (u32)( d - dst );
+}
+
+// returns the number of bytes, or ~0 if the data is corrupt or does not fit into dst
+static inline u32 traceDecompress( const u8 *src, u32 n, u8 *dst, u32 max )
+{
+	u32 o = 0;
+	for ( u32 i = 0; i < n; i++ )
+	{
+		if ( src[ i ] )
+		{
+			if ( o == max ) return ~0u;
+			dst[ o++ ] = src[ i ];
+			continue;
+		}
+		if ( ++ i == n ) return ~0u;
+		u32 run = (u32)src[ i ] + 1;
+		if ( o + run > max ) return ~0u;
+		for ( u32 j = 0; j < run; j++ )
+			dst[ o++ ] = 0;
+	}
+	return o;
+}
+
+// decodes the records of a block into samples, returns the number of samples (less than 'cycles' if the data is corrupt)
+static inline u32 traceDecodeRecords( const u8 *raw, u32 n, u32 cycles, u32 *samples )
+{
+	u32 s = 0, c = 0;
+	for ( u32 i = 0; i < n && c < cycles; )
+	{
+		u32 v = 0, shift = 0;
+		while ( i < n && ( raw[ i ] & 0x80 ) && shift < TRACE_SAMPLE_BITS )
+		{
+			v |= ( raw[ i++ ] & 0x7f ) << shift;
+			shift += 7;
+		}
+		if ( i == n ) break;
+		v |= raw[ i++ ] << shift;
+		s ^= v;
+		samples[ c++ ] = s;
+	}
+	return c;
+}
+
+#endif